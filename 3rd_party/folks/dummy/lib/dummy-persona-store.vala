@@ -789,6 +789,47 @@ public class FolksDummy.PersonaStore : Folks.PersonaStore
       get; set; default = null;
     }
 
+  /**
+   * Type of a mock function for the ``change_*`` methods of the store's
+   * personas.
+   *
+   * See {@link FolksDummy.PersonaStore.change_property_mock}.
+   *
+   * @param persona the persona whose property is being changed
+   * @param property_name name of the property being changed
+   * @throws PropertyError to be thrown from the ``change_*`` method
+   * @return delay to apply to the property change (negative delays complete
+   * synchronously; zero delays complete in an idle callback; positive delays
+   * complete after that many milliseconds)
+   *
+   * @since UNRELEASED
+   */
+  public delegate int ChangePropertyMock (Persona persona,
+      string property_name) throws PropertyError;
+
+  /**
+   * Mock function for property changes on the store's personas.
+   *
+   * This function is called whenever a ``change_*`` method (for example
+   * {@link Folks.NameDetails.change_nickname}) is called on one of this
+   * store's personas. It allows the caller to determine whether the change
+   * should fail, by throwing an error from this mock function, and how long
+   * the simulated backing store takes to apply it. If this is ``null``, the
+   * persona's {@link FolksDummy.Persona.property_change_delay} is used and
+   * all changes succeed.
+   *
+   * See {@link FolksDummy.PersonaStore.add_persona_from_details_mock}.
+   *
+   * This mock function may be changed at any time; changes will take effect for
+   * the next property change.
+   *
+   * @since UNRELEASED
+   */
+  public unowned ChangePropertyMock? change_property_mock
+    {
+      get; set; default = null;
+    }
+
   private Type _persona_type = typeof (FolksDummy.Persona);
 
   /**
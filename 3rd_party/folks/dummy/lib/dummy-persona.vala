@@ -302,19 +302,35 @@ public class FolksDummy.Persona : Folks.Persona
    * the current {@link FolksDummy.Persona.property_change_delay} before calling
    * the given ``callback`` which should actually effect the property change.
    *
+   * If the persona's store has a
+   * {@link FolksDummy.PersonaStore.change_property_mock} set, it is called
+   * first; it may fail the change by throwing an error, and the delay it
+   * returns replaces {@link FolksDummy.Persona.property_change_delay}.
+   *
    * @param property_name name of the property being changed
    * @param callback callback to call once the change delay has passed
+   * @throws PropertyError if the store's mock function failed the change
    * @since UNRELEASED
    */
   protected async void change_property (string property_name,
-      ChangePropertyCallback callback)
+      ChangePropertyCallback callback) throws PropertyError
     {
-      if (this.property_change_delay < 0)
+      var delay = this.property_change_delay;
+
+      /* Allow the caller to inject failures and delays. */
+      var dummy_store = this.store as FolksDummy.PersonaStore;
+      if (dummy_store != null &&
+          ((!) dummy_store).change_property_mock != null)
+        {
+          delay = ((!) dummy_store).change_property_mock (this, property_name);
+        }
+
+      if (delay < 0)
         {
           /* No delay. */
           callback ();
         }
-      else if (this.property_change_delay == 0)
+      else if (delay == 0)
         {
           /* Idle delay. */
           Idle.add (() =>
@@ -329,7 +345,7 @@ public class FolksDummy.Persona : Folks.Persona
       else
         {
           /* Timed delay. */
-          Timeout.add (this.property_change_delay, () =>
+          Timeout.add (delay, () =>
             {
               callback ();
               this.change_property.callback ();
@@ -25,6 +25,7 @@
 #define CPIM_ADDRESSBOOK_IFACE_NAME         "com.canonical.pim.AddressBook"
 #define CPIM_ADDRESSBOOK_VIEW_OBJECT_PATH   "/com/canonical/pim/AddressBookView"
 #define CPIM_ADDRESSBOOK_VIEW_IFACE_NAME    "com.canonical.pim.AddressBookView"
+#define CPIM_ADDRESSBOOK_METRICS_IFACE_NAME "com.canonical.pim.AddressBook.Metrics"
 
 //Updater
 #define CPIM_UPDATE_SERVICE_NAME              "com.canonical.pim.updater"
@@ -26,6 +26,7 @@
 
 #include <QtContacts/QContactGuid>
 #include <QtContacts/QContactExtendedDetail>
+#include <QtContacts/QContactFavorite>
 #include <QtContacts/QContactIdFilter>
 #include <QtContacts/QContactDetailFilter>
 #include <QtContacts/QContactUnionFilter>
@@ -43,6 +44,27 @@ using namespace QtContacts;
 namespace galera
 {
 
+FilterPlan::FilterPlan(Type type, const QList<FilterPlan> &children)
+    : m_type(type),
+      m_children(children)
+{
+}
+
+FilterPlan::Type FilterPlan::type() const
+{
+    return m_type;
+}
+
+QList<FilterPlan> FilterPlan::children() const
+{
+    return m_children;
+}
+
+bool FilterPlan::isAll() const
+{
+    return (m_type == All);
+}
+
 Filter::Filter(const QString &filter)
 {
     m_filter = buildFilter(filter);
@@ -306,6 +328,42 @@ QStringList Filter::idsToFilter() const
     return idsToFilter(m_filter);
 }
 
+bool Filter::removedSinceToFilter(QDateTime *since) const
+{
+    return removedSinceToFilter(m_filter, since);
+}
+
+bool Filter::changedSinceToFilter(QDateTime *since, QContactChangeLogFilter::EventType *eventType) const
+{
+    return changedSinceToFilter(m_filter, since, eventType);
+}
+
+/*
+ * Build the bitmap plan for the filter, "residual" receives the part of the filter that
+ * must be tested on each contact and "exact" is set if the plan alone answers the filter
+ */
+FilterPlan Filter::plan(QContactFilter *residual, bool *exact) const
+{
+    FilterPlan result = planFilter(m_filter, exact);
+    if (*exact) {
+        *residual = QContactFilter();
+    } else if (m_filter.type() == QContactFilter::IntersectionFilter) {
+        // keep only the terms not answered by the plan
+        QContactIntersectionFilter residualFilter;
+        Q_FOREACH(const QContactFilter &f, QContactIntersectionFilter(m_filter).filters()) {
+            bool termExact = false;
+            planFilter(f, &termExact);
+            if (!termExact) {
+                residualFilter << f;
+            }
+        }
+        *residual = residualFilter;
+    } else {
+        *residual = m_filter;
+    }
+    return result;
+}
+
 QString Filter::phoneNumberToFilter(const QtContacts::QContactFilter &filter)
 {
     switch (filter.type()) {
@@ -389,6 +447,161 @@ QStringList Filter::idsToFilter(const QtContacts::QContactFilter &filter)
     return result;
 }
 
+bool Filter::removedSinceToFilter(const QtContacts::QContactFilter &filter, QDateTime *since)
+{
+    switch (filter.type()) {
+    case QContactFilter::ChangeLogFilter:
+    {
+        const QContactChangeLogFilter clf(filter);
+        if (clf.eventType() == QContactChangeLogFilter::EventRemoved) {
+            *since = clf.since();
+            return true;
+        }
+        break;
+    }
+    case QContactFilter::UnionFilter:
+    {
+        // if the union contains only the removed filter we'are still able to optimize
+        const QContactUnionFilter uf(filter);
+        if (uf.filters().size() == 1) {
+            return removedSinceToFilter(uf.filters().first(), since);
+        }
+        break;
+    }
+    case QContactFilter::IntersectionFilter:
+    {
+        const QContactIntersectionFilter cif(filter);
+        Q_FOREACH(const QContactFilter &f, cif.filters()) {
+            if (removedSinceToFilter(f, since)) {
+                return true;
+            }
+        }
+        break;
+    }
+    default:
+        break;
+    }
+    return false;
+}
+
+bool Filter::changedSinceToFilter(const QtContacts::QContactFilter &filter, QDateTime *since,
+                                  QContactChangeLogFilter::EventType *eventType)
+{
+    switch (filter.type()) {
+    case QContactFilter::ChangeLogFilter:
+    {
+        const QContactChangeLogFilter clf(filter);
+        if ((clf.eventType() == QContactChangeLogFilter::EventAdded) ||
+            (clf.eventType() == QContactChangeLogFilter::EventChanged)) {
+            *since = clf.since();
+            *eventType = clf.eventType();
+            return true;
+        }
+        break;
+    }
+    case QContactFilter::UnionFilter:
+    {
+        // if the union contains only the change log filter we'are still able to optimize
+        const QContactUnionFilter uf(filter);
+        if (uf.filters().size() == 1) {
+            return changedSinceToFilter(uf.filters().first(), since, eventType);
+        }
+        break;
+    }
+    case QContactFilter::IntersectionFilter:
+    {
+        const QContactIntersectionFilter cif(filter);
+        Q_FOREACH(const QContactFilter &f, cif.filters()) {
+            if (changedSinceToFilter(f, since, eventType)) {
+                return true;
+            }
+        }
+        break;
+    }
+    default:
+        break;
+    }
+    return false;
+}
+
+FilterPlan Filter::planFilter(const QtContacts::QContactFilter &filter, bool *exact)
+{
+    *exact = false;
+    switch (filter.type()) {
+    case QContactFilter::DefaultFilter:
+        *exact = true;
+        return FilterPlan(FilterPlan::All);
+    case QContactFilter::ContactDetailFilter:
+    {
+        const QContactDetailFilter cdf(filter);
+        if ((cdf.detailType() == QContactDetail::TypeFavorite) &&
+            (cdf.detailField() == QContactFavorite::FieldFavorite) &&
+            (cdf.matchFlags() == QContactFilter::MatchExactly) &&
+            (cdf.value().type() == QVariant::Bool) && cdf.value().toBool()) {
+            *exact = true;
+            return FilterPlan(FilterPlan::Favorite);
+        } else if ((cdf.detailType() == QContactDetail::TypePhoneNumber) && (cdf.detailField() == -1)) {
+            *exact = true;
+            return FilterPlan(FilterPlan::HasPhoneNumber);
+        } else if ((cdf.detailType() == QContactDetail::TypeEmailAddress) && (cdf.detailField() == -1)) {
+            *exact = true;
+            return FilterPlan(FilterPlan::HasEmailAddress);
+        }
+        break;
+    }
+    case QContactFilter::UnionFilter:
+    {
+        // the union can only be answered if all terms are answered
+        const QContactUnionFilter uf(filter);
+        if (uf.filters().isEmpty()) {
+            break;
+        }
+
+        QList<FilterPlan> children;
+        Q_FOREACH(const QContactFilter &f, uf.filters()) {
+            bool termExact = false;
+            FilterPlan child = planFilter(f, &termExact);
+            if (!termExact) {
+                return FilterPlan(FilterPlan::All);
+            }
+            children << child;
+        }
+        *exact = true;
+        return FilterPlan(FilterPlan::Or, children);
+    }
+    case QContactFilter::IntersectionFilter:
+    {
+        // any answered term restricts the intersection
+        const QContactIntersectionFilter cif(filter);
+        if (cif.filters().isEmpty()) {
+            break;
+        }
+
+        QList<FilterPlan> children;
+        bool allExact = true;
+        Q_FOREACH(const QContactFilter &f, cif.filters()) {
+            bool termExact = false;
+            FilterPlan child = planFilter(f, &termExact);
+            if (termExact) {
+                if (!child.isAll()) {
+                    children << child;
+                }
+            } else {
+                allExact = false;
+            }
+        }
+        *exact = allExact;
+        if (children.isEmpty()) {
+            return FilterPlan(FilterPlan::All);
+        }
+        return FilterPlan(FilterPlan::And, children);
+    }
+    default:
+        break;
+    }
+    return FilterPlan(FilterPlan::All);
+}
+
 QString Filter::toString(const QtContacts::QContactFilter &filter)
 {
     QByteArray filterArray;
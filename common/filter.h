@@ -21,11 +21,36 @@
 
 #include <QtCore/QDateTime>
 #include <QtContacts/QContactFilter>
+#include <QtContacts/QContactChangeLogFilter>
 #include <QtContacts/QContact>
 
 
 namespace galera
 {
+// Tree of predicates that can be answered by the contact attribute bitmaps
+class FilterPlan
+{
+public:
+    enum Type {
+        All = 0,
+        Favorite,
+        HasPhoneNumber,
+        HasEmailAddress,
+        And,
+        Or
+    };
+
+    FilterPlan(Type type = All, const QList<FilterPlan> &children = QList<FilterPlan>());
+
+    Type type() const;
+    QList<FilterPlan> children() const;
+    bool isAll() const;
+
+private:
+    Type m_type;
+    QList<FilterPlan> m_children;
+};
+
 class Filter
 {
 public:
@@ -43,6 +68,9 @@ public:
     // optimization by index
     QString phoneNumberToFilter() const;
     QStringList idsToFilter() const;
+    bool removedSinceToFilter(QDateTime *since) const;
+    bool changedSinceToFilter(QDateTime *since, QtContacts::QContactChangeLogFilter::EventType *eventType) const;
+    FilterPlan plan(QtContacts::QContactFilter *residual, bool *exact) const;
 
 private:
     QtContacts::QContactFilter m_filter;
@@ -55,6 +83,10 @@ private:
 
     static QString phoneNumberToFilter(const QtContacts::QContactFilter &filter);
     static QStringList idsToFilter(const QtContacts::QContactFilter &filter);
+    static bool removedSinceToFilter(const QtContacts::QContactFilter &filter, QDateTime *since);
+    static bool changedSinceToFilter(const QtContacts::QContactFilter &filter, QDateTime *since,
+                                     QtContacts::QContactChangeLogFilter::EventType *eventType);
+    static FilterPlan planFilter(const QtContacts::QContactFilter &filter, bool *exact);
     static QString toString(const QtContacts::QContactFilter &filter);
     static QtContacts::QContactFilter buildFilter(const QString &filter);
 
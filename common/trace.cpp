@@ -0,0 +1,235 @@
+/*
+ * Copyright 2013 Canonical Ltd.
+ *
+ * This file is part of contact-service-app.
+ *
+ * contact-service-app is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * contact-service-app is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "trace.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDebug>
+#include <QtCore/QFile>
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QVector>
+
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TRACE_BUFFER_SIZE   65536
+#define TRACE_CATEGORY      "address-book"
+
+namespace
+{
+
+struct TraceEvent
+{
+    const char *name;
+    char phase;
+    qint64 start;
+    qint64 duration;
+    qint64 thread;
+    QString id;
+};
+
+class TraceBuffer
+{
+public:
+    TraceBuffer()
+        : m_next(0),
+          m_wrapped(false)
+    {
+    }
+
+    void resize(int size)
+    {
+        QMutexLocker locker(&m_lock);
+        m_events.resize(size);
+        m_next = 0;
+        m_wrapped = false;
+    }
+
+    void append(const TraceEvent &event)
+    {
+        QMutexLocker locker(&m_lock);
+        if (m_events.isEmpty()) {
+            return;
+        }
+        m_events[m_next] = event;
+        m_next = (m_next + 1) % m_events.size();
+        m_wrapped = m_wrapped || (m_next == 0);
+    }
+
+    QVector<TraceEvent> events()
+    {
+        QMutexLocker locker(&m_lock);
+        if (!m_wrapped) {
+            return m_events.mid(0, m_next);
+        }
+        return m_events.mid(m_next) + m_events.mid(0, m_next);
+    }
+
+private:
+    QMutex m_lock;
+    QVector<TraceEvent> m_events;
+    int m_next;
+    bool m_wrapped;
+};
+
+TraceBuffer *traceBuffer()
+{
+    static TraceBuffer buffer;
+    return &buffer;
+}
+
+void saveTraceAtExit()
+{
+    QString fileName = QString("%1.%2.json")
+            .arg(QString::fromLocal8Bit(qgetenv(ADDRESS_BOOK_TRACE)))
+            .arg(getpid());
+    galera::Trace::save(fileName);
+}
+
+bool initTrace()
+{
+    if (!qEnvironmentVariableIsSet(ADDRESS_BOOK_TRACE)) {
+        return false;
+    }
+
+    int size = TRACE_BUFFER_SIZE;
+    if (qEnvironmentVariableIsSet(ADDRESS_BOOK_TRACE_BUFFER)) {
+        size = qMax(1, qgetenv(ADDRESS_BOOK_TRACE_BUFFER).toInt());
+    }
+    traceBuffer()->resize(size);
+
+    // an empty value only keeps the events in memory
+    if (!qgetenv(ADDRESS_BOOK_TRACE).isEmpty()) {
+        atexit(saveTraceAtExit);
+    }
+    return true;
+}
+
+qint64 currentThread()
+{
+    return syscall(SYS_gettid);
+}
+
+} //namespace
+
+namespace galera
+{
+
+bool Trace::m_enabled = initTrace();
+
+qint64 Trace::now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (qint64(ts.tv_sec) * 1000000) + (ts.tv_nsec / 1000);
+}
+
+void Trace::complete(const char *name, const QString &id, qint64 start, qint64 end)
+{
+    if (!m_enabled) {
+        return;
+    }
+
+    TraceEvent event;
+    event.name = name;
+    event.phase = 'X';
+    event.start = start;
+    event.duration = ((end < 0) ? now() : end) - start;
+    event.thread = currentThread();
+    event.id = id;
+    traceBuffer()->append(event);
+}
+
+void Trace::instant(const char *name, const QString &id)
+{
+    if (!m_enabled) {
+        return;
+    }
+
+    TraceEvent event;
+    event.name = name;
+    event.phase = 'i';
+    event.start = now();
+    event.duration = 0;
+    event.thread = currentThread();
+    event.id = id;
+    traceBuffer()->append(event);
+}
+
+QByteArray Trace::toJson()
+{
+    QString processName = QCoreApplication::instance() ?
+                QCoreApplication::applicationName() : QString::number(getpid());
+    qint64 pid = getpid();
+
+    QJsonArray events;
+
+    QJsonObject processArgs;
+    processArgs.insert("name", processName);
+    QJsonObject processEvent;
+    processEvent.insert("name", QStringLiteral("process_name"));
+    processEvent.insert("ph", QStringLiteral("M"));
+    processEvent.insert("pid", pid);
+    processEvent.insert("args", processArgs);
+    events << processEvent;
+
+    Q_FOREACH(const TraceEvent &event, traceBuffer()->events()) {
+        QJsonObject value;
+        value.insert("name", QString::fromLatin1(event.name));
+        value.insert("cat", QStringLiteral(TRACE_CATEGORY));
+        value.insert("ph", QString(QChar(event.phase)));
+        value.insert("ts", event.start);
+        if (event.phase == 'X') {
+            value.insert("dur", event.duration);
+        } else {
+            value.insert("s", QStringLiteral("t"));
+        }
+        value.insert("pid", pid);
+        value.insert("tid", event.thread);
+        if (!event.id.isEmpty()) {
+            QJsonObject args;
+            args.insert("id", event.id);
+            value.insert("args", args);
+        }
+        events << value;
+    }
+
+    QJsonObject trace;
+    trace.insert("traceEvents", events);
+    trace.insert("displayTimeUnit", QStringLiteral("ms"));
+    return QJsonDocument(trace).toJson(QJsonDocument::Compact);
+}
+
+bool Trace::save(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Fail to write trace file" << fileName;
+        return false;
+    }
+    file.write(toJson());
+    return true;
+}
+
+} //namespace
@@ -0,0 +1,94 @@
+/*
+ * Copyright 2013 Canonical Ltd.
+ *
+ * This file is part of contact-service-app.
+ *
+ * contact-service-app is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * contact-service-app is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GALERA_TRACE_H__
+#define __GALERA_TRACE_H__
+
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+
+// enable the trace points, the value is the prefix of the file written at exit
+#define ADDRESS_BOOK_TRACE          "ADDRESS_BOOK_TRACE"
+// number of events kept in the ring buffer
+#define ADDRESS_BOOK_TRACE_BUFFER   "ADDRESS_BOOK_TRACE_BUFFER"
+
+namespace galera
+{
+
+/*
+ * Trace points shared by the service and the contacts plugin.
+ *
+ * Events are kept in an in-memory ring buffer and exported in the Chrome trace event format
+ * (chrome://tracing, Perfetto). The id of an event is the request it belongs to, for queries
+ * this is the view object path, so events of the server and of the client can be matched after
+ * merging the files. When ADDRESS_BOOK_TRACE is not set the trace points only test a flag.
+ */
+class Trace
+{
+public:
+    static inline bool isEnabled() { return m_enabled; }
+
+    // monotonic clock in microseconds, shared by all processes
+    static qint64 now();
+
+    static void complete(const char *name, const QString &id, qint64 start, qint64 end = -1);
+    static void instant(const char *name, const QString &id);
+
+    static QByteArray toJson();
+    static bool save(const QString &fileName);
+
+private:
+    static bool m_enabled;
+};
+
+// record the scope as a complete event
+class TraceScope
+{
+public:
+    TraceScope(const char *name, const QString &id = QString())
+        : m_name(name),
+          m_start(Trace::isEnabled() ? Trace::now() : 0)
+    {
+        if (m_start) {
+            m_id = id;
+        }
+    }
+
+    ~TraceScope()
+    {
+        if (m_start) {
+            Trace::complete(m_name, m_id, m_start);
+        }
+    }
+
+    void setId(const QString &id)
+    {
+        if (m_start) {
+            m_id = id;
+        }
+    }
+
+private:
+    const char *m_name;
+    qint64 m_start;
+    QString m_id;
+};
+
+} //namespace
+
+#endif
@@ -410,6 +410,31 @@ QStringList VCardParser::splitVcards(const QByteArray &vcardList)
     return result;
 }
 
+/*
+ * Streaming version of 'splitVcards', removes the complete vcards from the buffer and keeps the
+ * data of the last vcard, which is only complete when the next vcard begins or 'atEnd' is true.
+ */
+QStringList VCardParser::takeVcards(QByteArray &buffer, bool atEnd)
+{
+    QStringList result;
+    int start = 0;
+
+    while(start < buffer.size()) {
+        int pos = buffer.indexOf("BEGIN:VCARD", start + 1);
+        if (pos == -1) {
+            if (!atEnd) {
+                break;
+            }
+            pos = buffer.length();
+        }
+        result << buffer.mid(start, (pos - start));
+        start = pos;
+    }
+
+    buffer.remove(0, start);
+    return result;
+}
+
 void VCardParser::onReaderStateChanged(QVersitReader::State state)
 {
     if (m_versitReader && (state == QVersitReader::FinishedState)) {
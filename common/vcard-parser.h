@@ -65,6 +65,7 @@ public:
     static QStringList contactToVcardSync(QList<QtContacts::QContact> contacts);
 
     static QStringList splitVcards(const QByteArray &vcardList);
+    static QStringList takeVcards(QByteArray &buffer, bool atEnd);
 
 Q_SIGNALS:
     void vcardParsed(const QStringList &vcards);
@@ -21,6 +21,7 @@
 #include "qcontactrequest-data.h"
 #include "qcontactfetchrequest-data.h"
 #include "qcontactfetchbyidrequest-data.h"
+#include "qcontactidfetchrequest-data.h"
 #include "qcontactremoverequest-data.h"
 #include "qcontactsaverequest-data.h"
 
@@ -30,6 +31,7 @@
 #include "common/sort-clause.h"
 #include "common/dbus-service-defs.h"
 #include "common/source.h"
+#include "common/trace.h"
 
 #include <QtCore/QSharedPointer>
 
@@ -42,9 +44,13 @@
 #include <QtContacts/QContact>
 #include <QtContacts/QContactChangeSet>
 #include <QtContacts/QContactCollectionFetchRequest>
+#include <QtContacts/QContactIdFetchRequest>
 #include <QtContacts/QContactName>
 #include <QtContacts/QContactPhoneNumber>
 #include <QtContacts/QContactFilter>
+#include <QtContacts/QContactCollectionFilter>
+#include <QtContacts/QContactIntersectionFilter>
+#include <QtContacts/QContactInvalidFilter>
 
 #include <QtVersit/QVersitReader>
 #include <QtVersit/QVersitContactImporter>
@@ -265,51 +271,130 @@ void GaleraContactsService::fetchContactsById(QtContacts::QContactFetchByIdReque
     fetchContactsPage(data);
 }
 
-void GaleraContactsService::fetchContacts(QtContacts::QContactFetchRequest *request)
+/* Only the ids are requested, the server will reply with the ids matched by the filter
+ * without serialize the contacts.
+ */
+void GaleraContactsService::fetchContactIds(QtContacts::QContactIdFetchRequest *request)
 {
     if (!isOnline()) {
         qWarning() << "Server is not online";
-        QContactFetchRequestData::notifyError(request);
+        QContactIdFetchRequestData::notifyError(request);
         return;
     }
 
-    // Only return the sources names if the filter is set as contact group type
-    if (request->filter().type() == QContactFilter::ContactDetailFilter) {
-        QContactDetailFilter dFilter = static_cast<QContactDetailFilter>(request->filter());
-
-        if ((dFilter.detailType() == QContactDetail::TypeType) &&
-            (dFilter.detailField() == QContactType::FieldType) &&
-            (dFilter.value() == QContactType::TypeGroup)) {
-
-            QDBusPendingCall pcall = m_iface->asyncCall("availableSources");
-            if (pcall.isError()) {
-                qWarning() << pcall.error().name() << pcall.error().message();
-                QContactFetchRequestData::notifyError(request);
-                return;
+    // contact groups are the sources ids
+    bool groupsOnly = isGroupFilter(request->filter());
+    QContactFilter filter = request->filter();
+    QStringList sources = collectionSources(&filter);
+    QString sortStr = SortClause(request->sorting()).toString();
+    QString filterStr = Filter(filter).toString();
+    QDBusPendingCall pcall = groupsOnly ?
+                             m_iface->asyncCall("availableSources") :
+                             m_iface->asyncCall("queryIds",
+                                                filterStr,
+                                                sortStr,
+                                                -1,
+                                                m_showInvisibleContacts,
+                                                sources);
+
+    if (pcall.isError()) {
+        qWarning() << pcall.error().name() << pcall.error().message();
+        QContactIdFetchRequestData::notifyError(request);
+        return;
+    }
+
+    QContactIdFetchRequestData *data = new QContactIdFetchRequestData(request);
+    m_runningRequests << data;
+
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(pcall, 0);
+    data->updateWatcher(watcher);
+    QObject::connect(watcher, &QDBusPendingCallWatcher::finished,
+                     [=](QDBusPendingCallWatcher *call) {
+                        this->fetchContactIdsDone(data, call, groupsOnly);
+                     });
+}
+
+void GaleraContactsService::fetchContactIdsDone(QContactIdFetchRequestData *data,
+                                                QDBusPendingCallWatcher *call,
+                                                bool groupsOnly)
+{
+    if (!data->isLive()) {
+        destroyRequest(data);
+        return;
+    }
+
+    QList<QContactId> ids;
+    QContactManager::Error opError = QContactManager::NoError;
+
+    if (groupsOnly) {
+        QDBusPendingReply<SourceList> reply = *call;
+        if (reply.isError()) {
+            qWarning() << reply.error().name() << reply.error().message();
+            opError = QContactManager::UnspecifiedError;
+        } else {
+            Q_FOREACH(const Source &source, reply.value()) {
+                QContactId id(m_managerUri, QByteArray("source@") + source.id().toUtf8());
+                if (source.isPrimary()) {
+                    ids.prepend(id);
+                } else {
+                    ids << id;
+                }
             }
+        }
+    } else {
+        QDBusPendingReply<QStringList> reply = *call;
+        if (reply.isError()) {
+            qWarning() << reply.error().name() << reply.error().message();
+            opError = QContactManager::UnspecifiedError;
+        } else {
+            ids = parseIds(reply.value());
+        }
+    }
 
-            QContactFetchRequestData *data = new QContactFetchRequestData(request, 0);
-            m_runningRequests << data;
+    data->update(ids, QContactAbstractRequest::FinishedState, opError);
+    destroyRequest(data);
+}
 
-            QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(pcall, 0);
-            data->updateWatcher(watcher);
-            QObject::connect(watcher, &QDBusPendingCallWatcher::finished,
-                             [=](QDBusPendingCallWatcher *call) {
-                                this->fetchContactsGroupsContinue(data, call);
-                             });
+void GaleraContactsService::fetchContacts(QtContacts::QContactFetchRequest *request)
+{
+    if (!isOnline()) {
+        qWarning() << "Server is not online";
+        QContactFetchRequestData::notifyError(request);
+        return;
+    }
+
+    // Only return the sources names if the filter is set as contact group type
+    if (isGroupFilter(request->filter())) {
+        QDBusPendingCall pcall = m_iface->asyncCall("availableSources");
+        if (pcall.isError()) {
+            qWarning() << pcall.error().name() << pcall.error().message();
+            QContactFetchRequestData::notifyError(request);
             return;
         }
+
+        QContactFetchRequestData *data = new QContactFetchRequestData(request, 0);
+        m_runningRequests << data;
+
+        QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(pcall, 0);
+        data->updateWatcher(watcher);
+        QObject::connect(watcher, &QDBusPendingCallWatcher::finished,
+                         [=](QDBusPendingCallWatcher *call) {
+                            this->fetchContactsGroupsContinue(data, call);
+                         });
+        return;
     }
 
+    QContactFilter filter = request->filter();
+    QStringList sources = collectionSources(&filter);
     QString sortStr = SortClause(request->sorting()).toString();
-    QString filterStr = Filter(request->filter()).toString();
+    QString filterStr = Filter(filter).toString();
     FetchHint fetchHint = FetchHint(request->fetchHint()).toString();
     QDBusPendingCall pcall = m_iface->asyncCall("query",
                                                 filterStr,
                                                 sortStr,
                                                 request->fetchHint().maxCountHint(),
                                                 m_showInvisibleContacts,
-                                                QStringList());
+                                                sources);
     if (pcall.isError()) {
         qWarning() << pcall.error().name() << pcall.error().message();
         QContactFetchRequestData::notifyError(request);
@@ -320,6 +405,9 @@ void GaleraContactsService::fetchContacts(QtContacts::QContactFetchRequest *requ
     m_runningRequests << data;
 
     QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(pcall, 0);
+    if (Trace::isEnabled()) {
+        watcher->setProperty("TRACE_STARTED", Trace::now());
+    }
     data->updateWatcher(watcher);
     QObject::connect(watcher, &QDBusPendingCallWatcher::finished,
                      [=](QDBusPendingCallWatcher *call) {
@@ -343,6 +431,9 @@ void GaleraContactsService::fetchContactsContinue(QContactFetchRequestData *data
         destroyRequest(data);
     } else {
         QDBusObjectPath viewObjectPath = reply.value();
+        if (Trace::isEnabled()) {
+            Trace::complete("client.query", viewObjectPath.path(), call->property("TRACE_STARTED").toLongLong());
+        }
         QDBusInterface *view = new QDBusInterface(m_serviceName,
                                                   viewObjectPath.path(),
                                                   CPIM_ADDRESSBOOK_VIEW_IFACE_NAME);
@@ -371,6 +462,9 @@ void GaleraContactsService::fetchContactsPage(QContactFetchRequestData *data)
     }
 
     QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(pcall, 0);
+    if (Trace::isEnabled()) {
+        watcher->setProperty("TRACE_STARTED", Trace::now());
+    }
     data->updateWatcher(watcher);
     QObject::connect(watcher, &QDBusPendingCallWatcher::finished,
                      [=](QDBusPendingCallWatcher *call) {
@@ -387,6 +481,9 @@ void GaleraContactsService::fetchContactsDone(QContactFetchRequestData *data,
     }
 
     QDBusPendingReply<QStringList> reply = *call;
+    if (Trace::isEnabled()) {
+        Trace::complete("client.contactsDetails", data->view()->path(), call->property("TRACE_STARTED").toLongLong());
+    }
     if (reply.isError()) {
         qWarning() << reply.error().name() << reply.error().message();
         data->update(QList<QContact>(),
@@ -398,6 +495,9 @@ void GaleraContactsService::fetchContactsDone(QContactFetchRequestData *data,
         if (vcards.size()) {
             VCardParser *parser = new VCardParser;
             parser->setProperty("DATA", QVariant::fromValue<void*>(data));
+            if (Trace::isEnabled()) {
+                parser->setProperty("TRACE_STARTED", Trace::now());
+            }
             data->setVCardParser(parser);
             connect(parser,
                     SIGNAL(contactsParsed(QList<QtContacts::QContact>)),
@@ -437,6 +537,9 @@ void GaleraContactsService::onVCardsParsed(QList<QContact> contacts)
 
     QContactFetchRequestData *data = static_cast<QContactFetchRequestData*>(sender->property("DATA").value<void*>());
     data->clearVCardParser();
+    if (Trace::isEnabled() && data->view()) {
+        Trace::complete("client.vcardParse", data->view()->path(), sender->property("TRACE_STARTED").toLongLong());
+    }
 
     if (!data->isLive()) {
         sender->deleteLater();
@@ -937,7 +1040,7 @@ void GaleraContactsService::addRequest(QtContacts::QContactAbstractRequest *requ
             fetchContactsById(static_cast<QContactFetchByIdRequest*>(request));
             break;
         case QContactAbstractRequest::ContactIdFetchRequest:
-            qDebug() << "Not implemented: ContactIdFetchRequest";
+            fetchContactIds(static_cast<QContactIdFetchRequest*>(request));
             break;
         case QContactAbstractRequest::ContactSaveRequest:
             saveContact(static_cast<QContactSaveRequest*>(request));
@@ -969,6 +1072,78 @@ void GaleraContactsService::destroyRequest(QContactRequestData *request)
     }
 }
 
+bool GaleraContactsService::isGroupFilter(const QContactFilter &filter)
+{
+    if (filter.type() == QContactFilter::ContactDetailFilter) {
+        QContactDetailFilter dFilter = static_cast<QContactDetailFilter>(filter);
+
+        return ((dFilter.detailType() == QContactDetail::TypeType) &&
+                (dFilter.detailField() == QContactType::FieldType) &&
+                (dFilter.value() == QContactType::TypeGroup));
+    }
+    return false;
+}
+
+/* Collections are the server sources, collection filters are removed from the
+ * filter and sent as the query sources to be pruned by the server index. If the
+ * collection terms can not match any contact the filter is replaced by an invalid
+ * filter, which the server answers with an empty result
+ */
+QStringList GaleraContactsService::collectionSources(QContactFilter *filter)
+{
+    QList<QContactFilter> collectionFilters;
+    QList<QContactFilter> filters;
+    if (filter->type() == QContactFilter::CollectionFilter) {
+        collectionFilters << *filter;
+    } else if (filter->type() == QContactFilter::IntersectionFilter) {
+        Q_FOREACH(const QContactFilter &f, QContactIntersectionFilter(*filter).filters()) {
+            if (f.type() == QContactFilter::CollectionFilter) {
+                collectionFilters << f;
+            } else {
+                filters << f;
+            }
+        }
+    }
+
+    if (collectionFilters.isEmpty()) {
+        return QStringList();
+    }
+
+    // the contact must be in all collections filters
+    QStringList sources;
+    bool first = true;
+    Q_FOREACH(const QContactFilter &f, collectionFilters) {
+        QStringList collectionIds;
+        Q_FOREACH(const QContactCollectionId &id, QContactCollectionFilter(f).collectionIds()) {
+            collectionIds << QString::fromUtf8(id.localId());
+        }
+
+        if (first) {
+            sources = collectionIds;
+            first = false;
+        } else {
+            QStringList common;
+            Q_FOREACH(const QString &sourceId, sources) {
+                if (collectionIds.contains(sourceId)) {
+                    common << sourceId;
+                }
+            }
+            sources = common;
+        }
+    }
+
+    if (sources.isEmpty()) {
+        *filter = QContactInvalidFilter();
+    } else if (filters.isEmpty()) {
+        *filter = QContactFilter();
+    } else {
+        QContactIntersectionFilter iFilter;
+        iFilter.setFilters(filters);
+        *filter = iFilter;
+    }
+    return sources;
+}
+
 QList<QContactId> GaleraContactsService::parseIds(const QStringList &ids) const
 {
     QList<QContactId> contactIds;
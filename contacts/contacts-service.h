@@ -47,6 +47,7 @@ class QContactCollectionFetchRequestData;
 class QContactRequestData;
 class QContactSaveRequestData;
 class QContactFetchRequestData;
+class QContactIdFetchRequestData;
 class QContactRemoveRequestData;
 
 class GaleraContactsService : public QObject
@@ -111,6 +112,8 @@ private:
     void fetchContactsById(QtContacts::QContactFetchByIdRequest *request);
     void fetchContactsPage(QContactFetchRequestData *data);
     void fetchContactsDone(QContactFetchRequestData *data, QDBusPendingCallWatcher *call);
+    void fetchContactIds(QtContacts::QContactIdFetchRequest *request);
+    void fetchContactIdsDone(QContactIdFetchRequestData *data, QDBusPendingCallWatcher *call, bool groupsOnly);
 
     void saveContact(QtContacts::QContactSaveRequest *request);
     void createGroupsStart(QContactSaveRequestData *data);
@@ -129,6 +132,8 @@ private:
     void destroyRequest(QContactRequestData *request);
 
     QList<QContactId> parseIds(const QStringList &ids) const;
+    static bool isGroupFilter(const QtContacts::QContactFilter &filter);
+    static QStringList collectionSources(QtContacts::QContactFilter *filter);
 };
 
 }
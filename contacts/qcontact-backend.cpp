@@ -24,6 +24,7 @@
 #include <QContactChangeSet>
 #include <QContactTimestamp>
 #include <QContactIdFilter>
+#include <QContactIdFetchRequest>
 
 #include <QtCore/qdebug.h>
 #include <QtCore/qstringbuilder.h>
@@ -100,16 +101,18 @@ int GaleraManagerEngine::managerVersion() const
 /* Filtering */
 QList<QContactId> GaleraManagerEngine::contactIds(const QtContacts::QContactFilter &filter, const QList<QtContacts::QContactSortOrder> &sortOrders, QtContacts::QContactManager::Error *error) const
 {
-    QContactFetchHint hint;
-    hint.setDetailTypesHint(QList<QContactDetail::DetailType>() << QContactDetail::TypeGuid);
-    QList<QtContacts::QContact> clist = contacts(filter, sortOrders, hint, error);
+    QContactIdFetchRequest request;
+    request.setFilter(filter);
+    request.setSorting(sortOrders);
+
+    const_cast<GaleraManagerEngine*>(this)->startRequest(&request);
+    const_cast<GaleraManagerEngine*>(this)->waitForRequestFinished(&request, -1);
 
-    /* Extract the ids */
-    QList<QtContacts::QContactId> ids;
-    Q_FOREACH(const QContact &c, clist)
-        ids.append(c.id());
+    if (error) {
+        *error = request.error();
+    }
 
-    return ids;
+    return request.ids();
 }
 
 QList<QtContacts::QContact> GaleraManagerEngine::contacts(const QtContacts::QContactFilter &filter,
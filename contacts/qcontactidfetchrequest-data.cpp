@@ -0,0 +1,62 @@
+/*
+ * Copyright 2013 Canonical Ltd.
+ *
+ * This file is part of contact-service-app.
+ *
+ * contact-service-app is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * contact-service-app is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qcontactidfetchrequest-data.h"
+
+#include <QtCore/QDebug>
+
+#include <QtContacts/QContactManagerEngine>
+
+using namespace QtContacts;
+
+namespace galera
+{
+
+QContactIdFetchRequestData::QContactIdFetchRequestData(QContactIdFetchRequest *request)
+    : QContactRequestData(request)
+{
+}
+
+void QContactIdFetchRequestData::update(const QList<QContactId> &result,
+                                        QContactAbstractRequest::State state,
+                                        QContactManager::Error error)
+{
+    m_result = result;
+    QContactRequestData::update(state, error);
+}
+
+void QContactIdFetchRequestData::notifyError(QContactIdFetchRequest *request, QContactManager::Error error)
+{
+    QContactManagerEngine::updateContactIdFetchRequest(request,
+                                                       QList<QContactId>(),
+                                                       error,
+                                                       QContactAbstractRequest::FinishedState);
+}
+
+void QContactIdFetchRequestData::updateRequest(QContactAbstractRequest::State state,
+                                               QContactManager::Error error,
+                                               QMap<int, QContactManager::Error> errorMap)
+{
+    Q_UNUSED(errorMap);
+    QContactManagerEngine::updateContactIdFetchRequest(static_cast<QContactIdFetchRequest*>(m_request.data()),
+                                                       m_result,
+                                                       error,
+                                                       state);
+}
+
+} //namespace
@@ -62,13 +62,16 @@ class Contacts(object):
     def delete(self, ids):
         return self.addr_iface.removeContacts(ids)
 
+    def export(self, f, fields = [], sources = []):
+        return self.addr_iface.exportVCards(dbus.types.UnixFd(f), fields, sources)
+
 service = Contacts()
 service.connect()
 
 if __name__ == "__main__":
     parser = argparse.ArgumentParser()
     parser.add_argument('command', choices=['query','create','update',
-        'delete','load'])
+        'delete','load','export'])
     parser.add_argument('filename', action='store', nargs='?')
     args = parser.parse_args()
 
@@ -103,3 +106,11 @@ if __name__ == "__main__":
             print ("New UID:", service.create(vcard))
         else:
             print ("You must supply a path to a VCARD")
+
+    if args.command == 'export':
+        if args.filename:
+            f = open(args.filename, 'w')
+            print ("Exported contacts:", service.export(f))
+            f.close()
+        else:
+            print ("You must supply a path to the export file")
@@ -19,19 +19,24 @@
 #include "addressbook-adaptor.h"
 #include "addressbook.h"
 #include "view.h"
+#include "metrics.h"
+
+#include "common/trace.h"
 
 namespace galera
 {
 
-AddressBookAdaptor::AddressBookAdaptor(const QDBusConnection &connection, AddressBook *parent)
+AddressBookAdaptor::AddressBookAdaptor(const QDBusConnection &connection, AddressBook *addressBook,
+                                       QObject *parent)
     : QDBusAbstractAdaptor(parent),
-      m_addressBook(parent),
+      m_addressBook(addressBook),
       m_connection(connection)
 {
-    setAutoRelaySignals(true);
     connect(m_addressBook, SIGNAL(readyChanged()), SIGNAL(readyChanged()));
     connect(m_addressBook, SIGNAL(safeModeChanged()), SIGNAL(safeModeChanged()));
     connect(m_addressBook, SIGNAL(sourcesChanged()), SIGNAL(sourcesChanged()));
+    connect(m_addressBook, SIGNAL(importProgress(QString,int,int)), SIGNAL(importProgress(QString,int,int)));
+    connect(m_addressBook, SIGNAL(importFinished(QString,int,int)), SIGNAL(importFinished(QString,int,int)));
 }
 
 AddressBookAdaptor::~AddressBookAdaptor()
@@ -41,6 +46,12 @@ AddressBookAdaptor::~AddressBookAdaptor()
 
 SourceList AddressBookAdaptor::availableSources(const QDBusMessage &message)
 {
+    SourceList sources;
+    if (m_addressBook->cachedSources(&sources)) {
+        MetricsTimer timer(Metrics::MethodAvailableSources);
+        return sources;
+    }
+
     message.setDelayedReply(true);
     QMetaObject::invokeMethod(m_addressBook, "availableSources",
                               Qt::QueuedConnection,
@@ -116,13 +127,65 @@ QString AddressBookAdaptor::createContact(const QString &contact, const QString
     return QString();
 }
 
-QDBusObjectPath AddressBookAdaptor::query(const QString &clause, const QString &sort, int maxCount, bool showInvisible, const QStringList &sources)
+QStringList AddressBookAdaptor::createContacts(const QStringList &contacts, const QString &source, const QDBusMessage &message)
+{
+    message.setDelayedReply(true);
+    QMetaObject::invokeMethod(m_addressBook, "createContacts",
+                              Qt::QueuedConnection,
+                              Q_ARG(const QStringList&, contacts),
+                              Q_ARG(const QString&, source),
+                              Q_ARG(const QDBusMessage&, message));
+    return QStringList();
+}
+
+QString AddressBookAdaptor::importVCards(const QDBusUnixFileDescriptor &fd, const QString &source,
+                                         const QDBusMessage &message)
 {
-    View *v = m_addressBook->query(clause, sort, maxCount, showInvisible, sources);
-    v->registerObject(m_connection);
+    message.setDelayedReply(true);
+    QMetaObject::invokeMethod(m_addressBook, "importVCards",
+                              Qt::QueuedConnection,
+                              Q_ARG(const QDBusUnixFileDescriptor&, fd),
+                              Q_ARG(const QString&, source),
+                              Q_ARG(const QDBusMessage&, message));
+    return QString();
+}
+
+QDBusObjectPath AddressBookAdaptor::query(const QString &clause, const QString &sort, int maxCount, bool showInvisible,
+                                          const QStringList &sources, const QDBusMessage &message)
+{
+    MetricsTimer timer(Metrics::MethodQuery);
+    TraceScope trace("query");
+    View *v = m_addressBook->query(clause, sort, maxCount, showInvisible, sources, message);
+    bool registered = v->registerObject(m_connection);
+    // the view calls (contactsDetails, count, sort, close) are served by the view thread,
+    // they do not wait for the main loop
+    v->moveToThread(m_addressBook->viewThread());
+    if (!registered) {
+        // nobody can reach the view, close it so the address book deletes it
+        QMetaObject::invokeMethod(v, "close", Qt::QueuedConnection);
+    }
+    if (Trace::isEnabled()) {
+        trace.setId(v->dynamicObjectPath());
+    }
     return QDBusObjectPath(v->dynamicObjectPath());
 }
 
+QStringList AddressBookAdaptor::queryIds(const QString &clause, const QString &sort, int maxCount, bool showInvisible,
+                                         const QStringList &sources, const QDBusMessage &message)
+{
+    message.setDelayedReply(true);
+    m_addressBook->queryIds(clause, sort, maxCount, showInvisible, sources, message);
+    return QStringList();
+}
+
+int AddressBookAdaptor::queryCount(const QString &clause, bool showInvisible,
+                                   const QStringList &sources, const QDBusMessage &message)
+{
+    message.setDelayedReply(true);
+    m_addressBook->queryCount(clause, showInvisible, sources, message);
+    return 0;
+}
+
 int AddressBookAdaptor::removeContacts(const QStringList &contactIds, const QDBusMessage &message)
 {
     message.setDelayedReply(true);
@@ -133,6 +196,11 @@ int AddressBookAdaptor::removeContacts(const QStringList &contactIds, const QDBu
     return 0;
 }
 
+bool AddressBookAdaptor::setQueryPriority(const QString &priority, const QDBusMessage &message)
+{
+    return m_addressBook->setQueryPriority(priority, message);
+}
+
 QStringList AddressBookAdaptor::sortFields()
 {
     return m_addressBook->sortFields();
@@ -158,6 +226,40 @@ QStringList AddressBookAdaptor::updateContacts(const QStringList &contacts, cons
     return QStringList();
 }
 
+QStringList AddressBookAdaptor::updateContactsWithWrittenGroups(const QStringList &contacts, const QDBusMessage &message)
+{
+    message.setDelayedReply(true);
+    QMetaObject::invokeMethod(m_addressBook, "updateContacts",
+                              Qt::QueuedConnection,
+                              Q_ARG(const QStringList&, contacts),
+                              Q_ARG(const QDBusMessage&, message),
+                              Q_ARG(bool, true));
+    return QStringList();
+}
+
+int AddressBookAdaptor::exportVCards(const QDBusUnixFileDescriptor &fd, const QStringList &fields,
+                                     const QStringList &sources, const QDBusMessage &message)
+{
+    message.setDelayedReply(true);
+    QMetaObject::invokeMethod(m_addressBook, "exportVCards",
+                              Qt::QueuedConnection,
+                              Q_ARG(const QDBusUnixFileDescriptor&, fd),
+                              Q_ARG(const QStringList&, fields),
+                              Q_ARG(const QStringList&, sources),
+                              Q_ARG(const QDBusMessage&, message));
+    return 0;
+}
+
+quint64 AddressBookAdaptor::changesSince(quint64 token, const QDBusMessage &message)
+{
+    message.setDelayedReply(true);
+    QMetaObject::invokeMethod(m_addressBook, "changesSince",
+                              Qt::QueuedConnection,
+                              Q_ARG(quint64, token),
+                              Q_ARG(const QDBusMessage&, message));
+    return 0;
+}
+
 bool AddressBookAdaptor::isReady()
 {
     return m_addressBook->isReady();
@@ -176,12 +278,16 @@ void AddressBookAdaptor::purgeContacts(const QString &since, const QString &sour
     } else {
         sinceDate = QDateTime::fromString(since, Qt::ISODate);
     }
-    m_addressBook->purgeContacts(sinceDate, sourceId, message);
+    QMetaObject::invokeMethod(m_addressBook, "purgeContacts",
+                              Qt::QueuedConnection,
+                              Q_ARG(const QDateTime&, sinceDate),
+                              Q_ARG(const QString&, sourceId),
+                              Q_ARG(const QDBusMessage&, message));
 }
 
 void AddressBookAdaptor::shutDown() const
 {
-    m_addressBook->shutdown();
+    QMetaObject::invokeMethod(m_addressBook, "shutdown", Qt::QueuedConnection);
 }
 
 bool AddressBookAdaptor::safeMode() const
@@ -191,7 +297,9 @@ bool AddressBookAdaptor::safeMode() const
 
 void AddressBookAdaptor::setSafeMode(bool flag)
 {
-    m_addressBook->setSafeMode(flag);
+    QMetaObject::invokeMethod(m_addressBook, "setSafeMode",
+                              Qt::QueuedConnection,
+                              Q_ARG(bool, flag));
 }
 
 } //namespace
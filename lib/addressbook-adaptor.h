@@ -31,6 +31,14 @@
 namespace galera
 {
 class AddressBook;
+/*
+ * QtDBus delivers the calls of an object path in the thread of its object, the adaptor
+ * lives in the D-Bus thread of the address book. The read-only calls (query, queryIds,
+ * queryCount, sortFields, isReady and availableSources once cached) are answered there,
+ * against a snapshot of the contacts map, and do not wait for the folks and EDS callbacks.
+ * The other calls are queued to the main thread. The views returned by 'query' are moved
+ * to the view thread and answer their own calls there.
+ */
 class AddressBookAdaptor: public QDBusAbstractAdaptor
 {
     Q_OBJECT
@@ -54,6 +62,16 @@ class AddressBookAdaptor: public QDBusAbstractAdaptor
 "    <signal name=\"readyChanged\"/>\n"
 "    <signal name=\"safeModeChanged\"/>\n"
 "    <signal name=\"sourcesChanged\"/>\n"
+"    <signal name=\"importProgress\">\n"
+"      <arg direction=\"out\" type=\"s\" name=\"importId\"/>\n"
+"      <arg direction=\"out\" type=\"i\" name=\"created\"/>\n"
+"      <arg direction=\"out\" type=\"i\" name=\"failed\"/>\n"
+"    </signal>\n"
+"    <signal name=\"importFinished\">\n"
+"      <arg direction=\"out\" type=\"s\" name=\"importId\"/>\n"
+"      <arg direction=\"out\" type=\"i\" name=\"created\"/>\n"
+"      <arg direction=\"out\" type=\"i\" name=\"failed\"/>\n"
+"    </signal>\n"
 "    <method name=\"ping\">\n"
 "      <arg direction=\"out\" type=\"b\"/>\n"
 "    </method>\n"
@@ -99,6 +117,24 @@ class AddressBookAdaptor: public QDBusAbstractAdaptor
 "      <arg direction=\"in\" type=\"as\" name=\"sources\"/>\n"
 "      <arg direction=\"out\" type=\"o\"/>\n"
 "    </method>\n"
+"    <method name=\"queryIds\">\n"
+"      <arg direction=\"in\" type=\"s\" name=\"clause\"/>\n"
+"      <arg direction=\"in\" type=\"s\" name=\"sort\"/>\n"
+"      <arg direction=\"in\" type=\"i\" name=\"maxCount\"/>\n"
+"      <arg direction=\"in\" type=\"b\" name=\"showDiabledContacts\"/>\n"
+"      <arg direction=\"in\" type=\"as\" name=\"sources\"/>\n"
+"      <arg direction=\"out\" type=\"as\"/>\n"
+"    </method>\n"
+"    <method name=\"queryCount\">\n"
+"      <arg direction=\"in\" type=\"s\" name=\"clause\"/>\n"
+"      <arg direction=\"in\" type=\"b\" name=\"showDiabledContacts\"/>\n"
+"      <arg direction=\"in\" type=\"as\" name=\"sources\"/>\n"
+"      <arg direction=\"out\" type=\"i\"/>\n"
+"    </method>\n"
+"    <method name=\"setQueryPriority\">\n"
+"      <arg direction=\"in\" type=\"s\" name=\"priority\"/>\n"
+"      <arg direction=\"out\" type=\"b\"/>\n"
+"    </method>\n"
 "    <method name=\"removeContacts\">\n"
 "      <arg direction=\"out\" type=\"i\"/>\n"
 "      <arg direction=\"in\" type=\"as\" name=\"contactIds\"/>\n"
@@ -108,10 +144,40 @@ class AddressBookAdaptor: public QDBusAbstractAdaptor
 "      <arg direction=\"in\" type=\"s\" name=\"source\"/>\n"
 "      <arg direction=\"out\" type=\"s\"/>\n"
 "    </method>\n"
+"    <method name=\"createContacts\">\n"
+"      <arg direction=\"in\" type=\"as\" name=\"contacts\"/>\n"
+"      <arg direction=\"in\" type=\"s\" name=\"source\"/>\n"
+"      <arg direction=\"out\" type=\"as\"/>\n"
+"      <arg direction=\"out\" type=\"as\" name=\"errors\"/>\n"
+"    </method>\n"
+"    <method name=\"importVCards\">\n"
+"      <arg direction=\"in\" type=\"h\" name=\"fd\"/>\n"
+"      <arg direction=\"in\" type=\"s\" name=\"source\"/>\n"
+"      <arg direction=\"out\" type=\"s\" name=\"importId\"/>\n"
+"    </method>\n"
+"    <method name=\"exportVCards\">\n"
+"      <arg direction=\"in\" type=\"h\" name=\"fd\"/>\n"
+"      <arg direction=\"in\" type=\"as\" name=\"fields\"/>\n"
+"      <arg direction=\"in\" type=\"as\" name=\"sources\"/>\n"
+"      <arg direction=\"out\" type=\"i\"/>\n"
+"    </method>\n"
+"    <method name=\"changesSince\">\n"
+"      <arg direction=\"in\" type=\"t\" name=\"token\"/>\n"
+"      <arg direction=\"out\" type=\"t\" name=\"token\"/>\n"
+"      <arg direction=\"out\" type=\"b\" name=\"complete\"/>\n"
+"      <arg direction=\"out\" type=\"as\" name=\"added\"/>\n"
+"      <arg direction=\"out\" type=\"as\" name=\"changed\"/>\n"
+"      <arg direction=\"out\" type=\"as\" name=\"removed\"/>\n"
+"    </method>\n"
 "    <method name=\"updateContacts\">\n"
 "      <arg direction=\"out\" type=\"as\"/>\n"
 "      <arg direction=\"in\" type=\"as\" name=\"contacts\"/>\n"
 "    </method>\n"
+"    <method name=\"updateContactsWithWrittenGroups\">\n"
+"      <arg direction=\"out\" type=\"as\"/>\n"
+"      <arg direction=\"out\" type=\"ai\" name=\"writtenGroups\"/>\n"
+"      <arg direction=\"in\" type=\"as\" name=\"contacts\"/>\n"
+"    </method>\n"
 "    <method name=\"linkContacts\">\n"
 "      <arg direction=\"out\" type=\"s\"/>\n"
 "      <arg direction=\"in\" type=\"as\" name=\"contacts\"/>\n"
@@ -132,7 +198,7 @@ class AddressBookAdaptor: public QDBusAbstractAdaptor
     Q_PROPERTY(bool safeMode READ safeMode WRITE setSafeMode NOTIFY safeModeChanged)
 
 public:
-    AddressBookAdaptor(const QDBusConnection &connection, AddressBook *parent);
+    AddressBookAdaptor(const QDBusConnection &connection, AddressBook *addressBook, QObject *parent);
     virtual ~AddressBookAdaptor();
 
     void setSafeMode(bool flag);
@@ -148,10 +214,21 @@ public Q_SLOTS:
     SourceList updateSources(const SourceList &sources, const QDBusMessage &message);
     bool removeSource(const QString &sourceId, const QDBusMessage &message);
     QStringList sortFields();
-    QDBusObjectPath query(const QString &clause, const QString &sort, int maxCount, bool showInvisible, const QStringList &sources);
+    QDBusObjectPath query(const QString &clause, const QString &sort, int maxCount, bool showInvisible,
+                          const QStringList &sources, const QDBusMessage &message);
+    QStringList queryIds(const QString &clause, const QString &sort, int maxCount, bool showInvisible,
+                         const QStringList &sources, const QDBusMessage &message);
+    int queryCount(const QString &clause, bool showInvisible, const QStringList &sources, const QDBusMessage &message);
+    bool setQueryPriority(const QString &priority, const QDBusMessage &message);
     int removeContacts(const QStringList &contactIds, const QDBusMessage &message);
     QString createContact(const QString &contact, const QString &source, const QDBusMessage &message);
+    QStringList createContacts(const QStringList &contacts, const QString &source, const QDBusMessage &message);
+    QString importVCards(const QDBusUnixFileDescriptor &fd, const QString &source, const QDBusMessage &message);
     QStringList updateContacts(const QStringList &contacts, const QDBusMessage &message);
+    QStringList updateContactsWithWrittenGroups(const QStringList &contacts, const QDBusMessage &message);
+    quint64 changesSince(quint64 token, const QDBusMessage &message);
+    int exportVCards(const QDBusUnixFileDescriptor &fd, const QStringList &fields,
+                     const QStringList &sources, const QDBusMessage &message);
     QString linkContacts(const QStringList &contacts);
     bool unlinkContacts(const QString &parentId, const QStringList &contactsIds);
     bool isReady();
@@ -170,6 +247,8 @@ Q_SIGNALS:
     void reloaded();
     void safeModeChanged();
     void sourcesChanged();
+    void importProgress(const QString &importId, int created, int failed);
+    void importFinished(const QString &importId, int created, int failed);
 
 private:
     AddressBook *m_addressBook;
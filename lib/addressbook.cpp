@@ -19,18 +19,33 @@
 #include "config.h"
 #include "addressbook.h"
 #include "addressbook-adaptor.h"
+#include "change-journal.h"
 #include "view.h"
 #include "contacts-map.h"
 #include "qindividual.h"
 #include "dirtycontact-notify.h"
+#include "eds-client-pool.h"
+#include "export-vcards-request.h"
+#include "metrics.h"
+#include "metrics-adaptor.h"
+#include "main-loop-watchdog.h"
+#include "import-vcards-request.h"
 #include "e-source-ubuntu.h"
 
+#include "common/trace.h"
 #include "common/vcard-parser.h"
 
+#include <QtCore/QAtomicInt>
+#include <QtCore/QMetaMethod>
+#include <QtCore/QMutexLocker>
 #include <QtCore/QPair>
+#include <QtCore/QRunnable>
+#include <QtCore/QThread>
 #include <QtCore/QUuid>
+#include <QtCore/QVector>
 
 #include <QtContacts/QContactExtendedDetail>
+#include <QtContacts/QContactTimestamp>
 
 #include <signal.h>
 #include <sys/socket.h>
@@ -47,6 +62,14 @@ namespace C {
 }
 
 #define MESSAGING_MENU_SOURCE_ID "address-book-service"
+#define MAX_RUNNING_UPDATES      10
+#define MAX_RUNNING_CREATES      10
+#define CREATE_PARSE_CHUNK_SIZE  25
+#define JOURNAL_SIZE             10000
+#define MAIN_LOOP_PROBE_INTERVAL 250
+#define MAIN_LOOP_STALL_THRESHOLD 1000
+#define VIEW_IDLE_TIMEOUT        600
+#define VIEW_REAP_INTERVAL       60000
 
 using namespace QtContacts;
 
@@ -61,25 +84,35 @@ public:
     galera::AddressBook *m_addressbook;
 };
 
-class UpdateContactsData
+class RemoveContactsData
 {
 public:
-    QList<QContact> m_contacts;
+    // contacts that can not be removed by the EDS batches, these are removed one by one by folks
     QStringList m_request;
-    int m_currentIndex;
-    QStringList m_result;
     galera::AddressBook *m_addressbook;
     QDBusMessage m_message;
+    int m_sucessCount;
+    bool m_softRemoval;
+    // number of EDS batches running plus the folks removal
+    int m_pendingCount;
+    QSet<QString> m_removedIds;
 };
 
-class RemoveContactsData
+// Contacts from the same EDS source removed (or marked as deleted) by a single EDS call
+class RemoveContactsSourceData
+{
+public:
+    RemoveContactsData *m_parent;
+    ESource *m_source;
+    GSList *m_contacts;
+    QSet<QString> m_ids;
+};
+
+class GetSourceData
 {
 public:
-    QStringList m_request;
     galera::AddressBook *m_addressbook;
     QDBusMessage m_message;
-    int m_sucessCount;
-    bool m_softRemoval;
 };
 
 class CreateSourceData
@@ -114,6 +147,167 @@ public:
     QDBusMessage m_message;
 };
 
+} //namespace
+
+namespace galera
+{
+
+// One 'updateContacts' call, replied when all its contacts are done
+class UpdateContactsBatch
+{
+public:
+    QDBusMessage m_message;
+    QStringList m_result;
+    QList<int> m_writtenGroups;
+    bool m_replyWrittenGroups;
+    QSet<QString> m_updatedIds;
+    int m_pendingCount;
+};
+
+// A single contact update waiting or running inside of a batch
+class UpdateContactsTask
+{
+public:
+    UpdateContactsBatch *m_batch;
+    int m_index;
+    // identifies the running update, the contact id can change while it runs (Eg. linking)
+    int m_token;
+    QString m_contactId;
+    QContact m_contact;
+};
+
+// One 'createContacts' call, replied when all its contacts are created
+class CreateContactsBatch
+{
+public:
+    QDBusMessage m_message;
+    // replied by calling the listener slot when the batch was not requested through D-Bus
+    QObject *m_listener;
+    QMetaMethod m_listenerSlot;
+    QString m_source;
+    QStringList m_vcards;
+    // filled by the parser jobs, each job writes on its own range
+    QVector<QContact> m_contacts;
+    QStringList m_result;
+    QStringList m_errors;
+    // index and individual id of the created contacts, the vcard and the parsed contact of
+    // each item are released once its persona is created
+    QList<QPair<int, QString> > m_created;
+    // EDS contacts with the extended details to be written when all items are done
+    QList<QPair<ESource*, EContact*> > m_edsContacts;
+    FolksPersonaStore *m_store;
+    QAtomicInt m_pendingParsers;
+    int m_nextIndex;
+    int m_pendingCount;
+    int m_pendingWrites;
+};
+
+// A single persona creation running inside of a batch
+class CreateContactsTask
+{
+public:
+    AddressBook *m_addressbook;
+    CreateContactsBatch *m_batch;
+    int m_index;
+};
+
+} //namespace
+
+namespace
+{
+
+// Contacts created by the same batch and source with the extended details written by a single EDS call
+class CreateContactsSourceData
+{
+public:
+    galera::AddressBook *m_addressbook;
+    galera::CreateContactsBatch *m_batch;
+    ESource *m_source;
+    GSList *m_contacts;
+};
+
+// Release the data of a batch item that is not needed after its persona creation starts
+void releaseCreateItem(galera::CreateContactsBatch *batch, int index)
+{
+    batch->m_vcards[index].clear();
+    batch->m_contacts[index] = QContact();
+}
+
+// Parse a range of the batch vcards in a thread of the pool
+class ParseVCardsJob : public QRunnable
+{
+public:
+    ParseVCardsJob(QObject *listener, galera::CreateContactsBatch *batch, int begin, int end)
+        : m_listener(listener),
+          m_batch(batch),
+          m_begin(begin),
+          m_end(end)
+    {
+    }
+
+    void run()
+    {
+        QContact *contacts = m_batch->m_contacts.data();
+        for(int i = m_begin; i < m_end; i++) {
+            contacts[i] = galera::VCardParser::vcardToContact(m_batch->m_vcards.at(i));
+        }
+
+        // the last job notifies the listener that the batch is ready to be created
+        if (!m_batch->m_pendingParsers.deref()) {
+            QMetaObject::invokeMethod(m_listener, "processCreates", Qt::QueuedConnection);
+        }
+    }
+
+private:
+    QObject *m_listener;
+    galera::CreateContactsBatch *m_batch;
+    int m_begin;
+    int m_end;
+};
+
+// Return the personas of the individual stored on EDS, if 'all' is true the list will be
+// empty if the individual has any persona that is not stored on EDS
+QList<FolksPersona*> eds_personas_from_individual(FolksIndividual *individual, bool all)
+{
+    QList<FolksPersona*> result;
+    GeeSet *personas = folks_individual_get_personas(individual);
+    if (!personas) {
+        return result;
+    }
+
+    GeeIterator *iter = gee_iterable_iterator(GEE_ITERABLE(personas));
+    while(gee_iterator_next(iter)) {
+        FolksPersona *persona = FOLKS_PERSONA(gee_iterator_get(iter));
+        if (EDSF_IS_PERSONA(persona) &&
+            EDSF_IS_PERSONA_STORE(folks_persona_get_store(persona))) {
+            result << persona;
+            continue;
+        }
+
+        g_object_unref(persona);
+        if (all) {
+            Q_FOREACH(FolksPersona *p, result) {
+                g_object_unref(p);
+            }
+            result.clear();
+            break;
+        }
+    }
+    g_object_unref(iter);
+    return result;
+}
+
+void remove_contacts_step_done(RemoveContactsData *data)
+{
+    data->m_pendingCount--;
+    if (data->m_pendingCount == 0) {
+        int count = data->m_sucessCount + data->m_removedIds.size();
+        QDBusMessage reply = data->m_message.createReply(count);
+        QDBusConnection::sessionBus().send(reply);
+        delete data;
+    }
+}
+
 ESource* create_esource_from_data(CreateSourceData &data, ESourceRegistry **registry)
 {
     GError *error = NULL;
@@ -138,10 +332,9 @@ ESource* create_esource_from_data(CreateSourceData &data, ESourceRegistry **regi
     ESourceAddressBook *ext = E_SOURCE_ADDRESS_BOOK(e_source_get_extension(source, E_SOURCE_EXTENSION_ADDRESS_BOOK));
     e_source_backend_set_backend_name(E_SOURCE_BACKEND(ext), "local");
 
-    *registry = e_source_registry_new_sync(NULL, &error);
-    if (error) {
-        qWarning() << "Fail to change default contact address book" << error->message;
-        g_error_free(error);
+    *registry = galera::EdsClientPool::instance()->registry();
+    if (!*registry) {
+        qWarning() << "Fail to change default contact address book";
         g_object_unref(source);
         return 0;
     }
@@ -160,8 +353,19 @@ AddressBook::AddressBook(QObject *parent)
     : QObject(parent),
       m_individualAggregator(0),
       m_contacts(0),
+      m_viewThread(new QThread(this)),
+      m_dbusThread(new QThread(this)),
+      m_dbusObject(0),
+      m_sourcesCacheValid(false),
+      m_clientWatcher(0),
+      m_viewReaper(0),
+      m_viewIdleTimeout(VIEW_IDLE_TIMEOUT * 1000),
+      m_maxRowsHeld(0),
       m_adaptor(0),
       m_notifyContactUpdate(0),
+      m_journal(0),
+      m_mainLoopProbe(0),
+      m_mainLoopWatchdog(0),
       m_edsIsLive(false),
       m_ready(false),
       m_isAboutToQuit(false),
@@ -169,9 +373,15 @@ AddressBook::AddressBook(QObject *parent)
       m_individualsChangedDetailedId(0),
       m_notifyIsQuiescentHandlerId(0),
       m_connection(QDBusConnection::sessionBus()),
+      m_backendStore(0),
+      m_backendAvailableId(0),
+      m_personaStoresLoaded(false),
       m_messagingMenu(0),
       m_messagingMenuMessage(0),
-      m_sourceRegistryListener(0)
+      m_maxRunningUpdates(MAX_RUNNING_UPDATES),
+      m_nextUpdateToken(0),
+      m_runningCreates(0),
+      m_maxRunningCreates(MAX_RUNNING_CREATES)
 {
     if (qEnvironmentVariableIsSet(ALTERNATIVE_CPIM_SERVICE_NAME)) {
         m_serviceName = qgetenv(ALTERNATIVE_CPIM_SERVICE_NAME);
@@ -179,18 +389,82 @@ AddressBook::AddressBook(QObject *parent)
     } else {
         m_serviceName = CPIM_SERVICE_NAME;
     }
+
+    if (qEnvironmentVariableIsSet(ADDRESS_BOOK_MAX_RUNNING_UPDATES)) {
+        m_maxRunningUpdates = qMax(1, qgetenv(ADDRESS_BOOK_MAX_RUNNING_UPDATES).toInt());
+    }
+
+    if (qEnvironmentVariableIsSet(ADDRESS_BOOK_MAX_RUNNING_CREATES)) {
+        m_maxRunningCreates = qMax(1, qgetenv(ADDRESS_BOOK_MAX_RUNNING_CREATES).toInt());
+    }
+
+    int journalSize = JOURNAL_SIZE;
+    if (qEnvironmentVariableIsSet(ADDRESS_BOOK_JOURNAL_SIZE)) {
+        journalSize = qMax(1, qgetenv(ADDRESS_BOOK_JOURNAL_SIZE).toInt());
+    }
+    m_journal = new ChangeJournal(journalSize);
+
+    // the journal file is removed after load, if the service does not quit properly
+    // the changes will be lost and the clients will need to do a full sync. A loaded journal
+    // is used once the contacts are loaded and compared with the ones of the previous run
+    if (qEnvironmentVariableIsSet(ADDRESS_BOOK_JOURNAL_FILE)) {
+        m_journalFile = QString::fromUtf8(qgetenv(ADDRESS_BOOK_JOURNAL_FILE));
+        if (m_journal->load(m_journalFile)) {
+            qDebug() << "Change journal loaded from" << m_journalFile << "changes:" << m_journal->size();
+        }
+        QFile::remove(m_journalFile);
+    }
+
+    m_viewThread->setObjectName("address-book-views");
+    m_viewThread->start();
+    // the sort field table is filled on first use, fill it before the D-Bus thread parses
+    // the sort clauses of the queries
+    SortClause::supportedFields();
+    m_dbusThread->setObjectName("address-book-dbus");
+    m_dbusThread->start();
+
+    m_clientWatcher = new QDBusServiceWatcher(this);
+    m_clientWatcher->setConnection(m_connection);
+    m_clientWatcher->setWatchMode(QDBusServiceWatcher::WatchForUnregistration);
+    connect(m_clientWatcher, SIGNAL(serviceUnregistered(QString)), SLOT(onClientUnregistered(QString)));
+
+    // 0 disables the idle timeout and the rows limit
+    if (qEnvironmentVariableIsSet(ADDRESS_BOOK_VIEW_IDLE_TIMEOUT)) {
+        m_viewIdleTimeout = qMax(0, qgetenv(ADDRESS_BOOK_VIEW_IDLE_TIMEOUT).toInt()) * 1000;
+    }
+    if (qEnvironmentVariableIsSet(ADDRESS_BOOK_MAX_ROWS_HELD)) {
+        m_maxRowsHeld = qMax(0, qgetenv(ADDRESS_BOOK_MAX_ROWS_HELD).toInt());
+    }
+    m_viewReaper = new QTimer(this);
+    m_viewReaper->setInterval(m_viewIdleTimeout > 0 ?
+                                  qMin<qint64>(VIEW_REAP_INTERVAL, qMax<qint64>(1000, m_viewIdleTimeout / 2)) :
+                                  VIEW_REAP_INTERVAL);
+    connect(m_viewReaper, SIGNAL(timeout()), SLOT(reapViews()));
+    if ((m_viewIdleTimeout > 0) || (m_maxRowsHeld > 0)) {
+        m_viewReaper->start();
+    }
+
     prepareUnixSignals();
     connectWithEDS();
     connect(this, SIGNAL(readyChanged()), SLOT(checkCompatibility()));
     connect(this, SIGNAL(safeModeChanged()), SLOT(onSafeModeChanged()));
+    // the persona stores will be reloaded in the next lookup
+    connect(this, SIGNAL(sourcesChanged()), SLOT(clearPersonaStores()));
 }
 
 AddressBook::~AddressBook()
 {
-    if (m_sourceRegistryListener) {
-        g_object_unref(m_sourceRegistryListener);
-        m_sourceRegistryListener = 0;
+    for(int i = 0; i < m_backendHandlers.size(); i++) {
+        g_signal_handler_disconnect(m_backendHandlers[i].first, m_backendHandlers[i].second);
+        g_object_unref(m_backendHandlers[i].first);
+    }
+    m_backendHandlers.clear();
+    if (m_backendStore) {
+        g_signal_handler_disconnect(m_backendStore, m_backendAvailableId);
+        g_object_unref(m_backendStore);
+        m_backendStore = 0;
     }
+    clearPersonaStores();
 
     if (m_messagingMenuMessage) {
         g_object_unref(m_messagingMenuMessage);
@@ -214,6 +488,15 @@ AddressBook::~AddressBook()
         delete m_notifyContactUpdate;
         m_notifyContactUpdate = 0;
     }
+
+    delete m_journal;
+    m_journal = 0;
+
+    // the queries still running in the D-Bus thread use the address book
+    m_dbusThread->quit();
+    m_dbusThread->wait();
+    m_viewThread->quit();
+    m_viewThread->wait();
 }
 
 QString AddressBook::objectPath()
@@ -232,20 +515,43 @@ bool AddressBook::registerObject(QDBusConnection &connection)
     }
 
     if (!m_adaptor) {
-        m_adaptor = new AddressBookAdaptor(connection, this);
-        if (!connection.registerObject(galera::AddressBook::objectPath(), this))
+        // the exported object lives in the D-Bus thread, the adaptors forward the calls
+        // that change the address book to the main thread
+        m_dbusObject = new QObject;
+        m_adaptor = new AddressBookAdaptor(connection, this, m_dbusObject);
+        new MetricsAdaptor(this, m_dbusObject);
+        if (!m_mainLoopProbe) {
+            m_mainLoopProbe = new MainLoopProbe(MAIN_LOOP_PROBE_INTERVAL, this);
+        }
+        if (!m_mainLoopWatchdog) {
+            int threshold = MAIN_LOOP_STALL_THRESHOLD;
+            if (qEnvironmentVariableIsSet(ADDRESS_BOOK_STALL_THRESHOLD)) {
+                threshold = qgetenv(ADDRESS_BOOK_STALL_THRESHOLD).toInt();
+            }
+            // a threshold of 0 disables the watchdog
+            if (threshold > 0) {
+                m_mainLoopWatchdog = new MainLoopWatchdog(threshold,
+                                                          qEnvironmentVariableIsSet(ADDRESS_BOOK_STALL_STACK),
+                                                          this);
+            }
+        }
+        // the calls received before the move are moved with the object
+        if (!connection.registerObject(galera::AddressBook::objectPath(), m_dbusObject))
         {
             qWarning() << "Could not register object!" << objectPath();
-            delete m_adaptor;
+            delete m_dbusObject;
+            m_dbusObject = 0;
             m_adaptor = 0;
             if (m_notifyContactUpdate) {
                 delete m_notifyContactUpdate;
                 m_notifyContactUpdate = 0;
             }
+        } else {
+            m_dbusObject->moveToThread(m_dbusThread);
         }
     }
     if (m_adaptor) {
-        m_notifyContactUpdate = new DirtyContactsNotify(m_adaptor);
+        m_notifyContactUpdate = new DirtyContactsNotify(m_adaptor, m_journal);
     }
     return (m_adaptor != 0);
 }
@@ -274,17 +580,55 @@ void AddressBook::unprepareFolks()
     // flusing any pending notification
     m_notifyContactUpdate->flush();
 
+    // the contacts saved with the journal are compared with the ones loaded in the next run
+    if (m_isAboutToQuit && m_ready && !m_journalFile.isEmpty()) {
+        m_journal->setSnapshot(journalSnapshot());
+    }
+
+    // the contacts will be reloaded and the changes during the reload are unknown
+    if (!m_isAboutToQuit) {
+        m_journal->reset();
+    }
+
     setIsReady(false);
+    cancelUpdates("Contacts are being reloaded");
 
     Q_FOREACH(View* view, m_views) {
-        view->close();
+        // the view lives in the view thread, wait for it to be closed
+        QMetaObject::invokeMethod(view, "close",
+                                  view->thread() == QThread::currentThread() ?
+                                      Qt::DirectConnection : Qt::BlockingQueuedConnection);
     }
     m_views.clear();
 
+    // the id and count queries still running are answered with an error, their views
+    // live in the D-Bus thread
+    m_sharedLock.lock();
+    QHash<View*, QDBusMessage> queries = m_queries;
+    m_queries.clear();
+    m_sharedLock.unlock();
+    QHash<View*, QDBusMessage>::const_iterator i = queries.constBegin();
+    for(; i != queries.constEnd(); i++) {
+        QDBusConnection::sessionBus().send(i.value().createErrorReply(QDBusError::Failed,
+                                                                      "Contacts are being reloaded"));
+        i.key()->deleteLater();
+    }
+
+    // the exports stop starting chunks, the running ones keep their snapshot
+    Q_FOREACH(ExportVCardsRequest *request, m_exports) {
+        request->cancel("Contacts are being reloaded");
+    }
+    m_exports.clear();
+
     if (m_contacts) {
-        delete m_contacts;
+        // the filters still running keep the data of their snapshots
+        ContactsMap *contacts = m_contacts;
+        m_sharedLock.lock();
         m_contacts = 0;
+        m_sharedLock.unlock();
+        delete contacts;
     }
+    clearPersonaStores();
 
     qDebug() << "Will destroy aggregator" << (void*) m_individualAggregator;
     if (m_individualAggregator) {
@@ -315,11 +659,9 @@ void AddressBook::checkCompatibility()
         return;
     }
 
-    GError *gError = NULL;
-    ESourceRegistry *r = e_source_registry_new_sync(NULL, &gError);
-    if (gError) {
-        qWarning() << "Fail to check compatibility" << gError->message;
-        g_error_free(gError);
+    ESourceRegistry *r = EdsClientPool::instance()->registry();
+    if (!r) {
+        qWarning() << "Fail to check compatibility";
         return;
     }
 
@@ -336,7 +678,6 @@ void AddressBook::checkCompatibility()
     }
 
     g_list_free_full(sources, g_object_unref);
-    g_object_unref(r);
 
     if (enableSafeMode) {
         qWarning() << "Enabling safe mode";
@@ -356,6 +697,14 @@ void AddressBook::shutdown()
 void AddressBook::continueShutdown()
 {
     qDebug() << "Folks is not running anymore";
+    EdsClientPool *pool = EdsClientPool::instance();
+    qDebug() << "EDS handshakes, registry:" << pool->registryHandshakes()
+             << "avoided:" << pool->registryHandshakesAvoided()
+             << "clients:" << pool->clientHandshakes()
+             << "avoided:" << pool->clientHandshakesAvoided();
+    if (!m_journalFile.isEmpty()) {
+        m_journal->save(m_journalFile);
+    }
     if (m_adaptor) {
         if (m_connection.interface() &&
             m_connection.interface()->isValid()) {
@@ -366,7 +715,9 @@ void AddressBook::continueShutdown()
             }
         }
 
-        delete m_adaptor;
+        // the adaptors are deleted with their object in the D-Bus thread
+        m_dbusObject->deleteLater();
+        m_dbusObject = 0;
         m_adaptor = 0;
         Q_EMIT stopped();
     }
@@ -375,17 +726,45 @@ void AddressBook::continueShutdown()
 void AddressBook::setIsReady(bool isReady)
 {
     if (isReady != m_ready) {
+        m_sharedLock.lock();
         m_ready = isReady;
+        m_sharedLock.unlock();
+        // record the changes made while the service was not running, the changes made
+        // during the initial load are not notified either
+        if (m_ready && m_journal->needsReconcile()) {
+            m_journal->reconcile(journalSnapshot());
+            qDebug() << "Change journal reconciled, changes:" << m_journal->size();
+        }
         if (m_adaptor) {
             Q_EMIT readyChanged();
         }
     }
 }
 
+QHash<QString, qint64> AddressBook::journalSnapshot() const
+{
+    QHash<QString, qint64> snapshot;
+    if (!m_contacts) {
+        return snapshot;
+    }
+
+    Q_FOREACH(ContactEntry *entry, m_contacts->values()) {
+        if (entry->individual()->deletedAt().isValid()) {
+            continue;
+        }
+        QDateTime modified = QContactTimestamp(entry->individual()->timestamp()).lastModified();
+        snapshot.insert(entry->individual()->id(), modified.isValid() ? modified.toMSecsSinceEpoch() : 0);
+    }
+    return snapshot;
+}
+
 void AddressBook::prepareFolks()
 {
     qDebug() << "Initialize folks";
-    m_contacts = new ContactsMap;
+    ContactsMap *contacts = new ContactsMap;
+    m_sharedLock.lock();
+    m_contacts = contacts;
+    m_sharedLock.unlock();
     m_individualAggregator = folks_individual_aggregator_dup();
     gboolean ready;
     g_object_get(G_OBJECT(m_individualAggregator), "is-quiescent", &ready, NULL);
@@ -439,38 +818,9 @@ void AddressBook::connectWithEDS()
     }
 
     // connect with source registry to get notifications about source change
-    GError *gError = NULL;
-    if (m_sourceRegistryListener) {
-        g_object_unref(m_sourceRegistryListener);
-        m_sourceRegistryListener = 0;
-    }
-    m_sourceRegistryListener = e_source_registry_new_sync(NULL, &gError);
-    if (gError) {
-        qWarning() << "Fail to connect with source registry" << gError->message;
-        g_error_free(gError);
-        m_sourceRegistryListener = 0;
-    } else {
-        g_signal_connect(m_sourceRegistryListener,
-                         "source-added",
-                         G_CALLBACK(AddressBook::sourceEDSChanged),
-                         this);
-        g_signal_connect(m_sourceRegistryListener,
-                         "source-changed",
-                         G_CALLBACK(AddressBook::sourceEDSChanged),
-                         this);
-        g_signal_connect(m_sourceRegistryListener,
-                         "source-removed",
-                         G_CALLBACK(AddressBook::sourceEDSChanged),
-                         this);
-        g_signal_connect(m_sourceRegistryListener,
-                         "source-enabled",
-                         G_CALLBACK(AddressBook::sourceEDSChanged),
-                         this);
-        g_signal_connect(m_sourceRegistryListener,
-                         "source-disabled",
-                         G_CALLBACK(AddressBook::sourceEDSChanged),
-                         this);
-    }
+    EdsClientPool *pool = EdsClientPool::instance();
+    pool->prepare();
+    connect(pool, SIGNAL(sourcesChanged()), SIGNAL(sourcesChanged()), Qt::UniqueConnection);
 
     // check if service is already registered
     // We will try register a EDS service if its fails this mean that the service is already registered
@@ -494,6 +844,7 @@ void AddressBook::connectWithEDS()
 
 SourceList AddressBook::availableSources(const QDBusMessage &message)
 {
+    MetricsTimer timer(Metrics::MethodAvailableSources);
     getSource(message, false);
     return SourceList();
 }
@@ -603,11 +954,9 @@ void AddressBook::updateSourcesEDS(void *data)
     }
 
     if (uData->m_registry == 0) {
-        GError *gError = 0;
-        uData->m_registry = e_source_registry_new_sync(NULL, &gError);
-        if (gError) {
-            qWarning() << "Fail to create source registry" << gError->message;
-            g_error_free(gError);
+        uData->m_registry = EdsClientPool::instance()->registry();
+        if (uData->m_registry == 0) {
+            qWarning() << "Fail to create source registry";
             goto operation_done;
         }
     }
@@ -644,9 +993,6 @@ operation_done:
     QDBusMessage reply = uData->m_message.createReply(QVariant::fromValue<SourceList>(result));
     QDBusConnection::sessionBus().send(reply);
 
-    if (uData->m_registry) {
-        g_object_unref (uData->m_registry);
-    }
     delete uData;
 }
 
@@ -669,11 +1015,6 @@ void AddressBook::updateSourceEDSDone(GObject *registry,
     uData->m_addressbook->updateSourcesEDS(data);
 }
 
-void AddressBook::sourceEDSChanged(ESourceRegistry *registry, ESource *source, AddressBook *self)
-{
-    Q_EMIT self->sourcesChanged();
-}
-
 void AddressBook::removeSource(const QString &sourceId, const QDBusMessage &message)
 {
     FolksBackendStore *bs = folks_backend_store_dup();
@@ -847,7 +1188,9 @@ bool AddressBook::isSafeMode()
     if (!envSafeMode.isEmpty()) {
         return (envSafeMode.toLower() == "on" ? true : false);
     } else {
-        return m_settings.value(SETTINGS_SAFE_MODE_KEY, false).toBool();
+        // also called in the D-Bus thread, a QSettings object is not shared between threads
+        QSettings settings(SETTINGS_ORG, SETTINGS_APPLICATION);
+        return settings.value(SETTINGS_SAFE_MODE_KEY, false).toBool();
     }
 }
 
@@ -860,12 +1203,15 @@ void AddressBook::setSafeMode(bool flag)
 
     if (m_settings.value(SETTINGS_SAFE_MODE_KEY, false).toBool() != flag) {
         m_settings.setValue(SETTINGS_SAFE_MODE_KEY, flag);
+        // the sources are read-only in safe mode
+        clearSourcesCache();
         if (!flag) {
             // make all contacts visible
             Q_FOREACH(ContactEntry *entry, m_contacts->values()) {
                 QIndividual *i = entry->individual();
                 if (!i->isVisible()) {
                     i->setVisible(true);
+                    m_contacts->updateIndexes(entry);
                 }
             }
             // clear invisible sources list
@@ -911,7 +1257,6 @@ void AddressBook::createSourceDone(GObject *source,
             cData->m_addressbook->m_settings.sync();
         }
     }
-    g_object_unref(source);
     QDBusMessage reply = cData->m_message.createReply(QVariant::fromValue<Source>(src));
     QDBusConnection::sessionBus().send(reply);
     delete cData;
@@ -920,7 +1265,9 @@ void AddressBook::createSourceDone(GObject *source,
 void AddressBook::getSource(const QDBusMessage &message, bool onlyTheDefault)
 {
     FolksBackendStore *backendStore = folks_backend_store_dup();
-    QDBusMessage *msg = new QDBusMessage(message);
+    GetSourceData *msg = new GetSourceData;
+    msg->m_addressbook = this;
+    msg->m_message = message;
 
     if (folks_backend_store_get_is_prepared(backendStore)) {
         if (onlyTheDefault) {
@@ -945,24 +1292,28 @@ void AddressBook::getSource(const QDBusMessage &message, bool onlyTheDefault)
 
 void AddressBook::availableSourcesDoneListAllSources(FolksBackendStore *backendStore,
                                                      GAsyncResult *res,
-                                                     QDBusMessage *msg)
+                                                     void *data)
 {
+    GetSourceData *msg = static_cast<GetSourceData*>(data);
     SourceList list = availableSourcesDoneImpl(backendStore, res);
-    QDBusMessage reply = msg->createReply(QVariant::fromValue<SourceList>(list));
+    msg->m_addressbook->setSourcesCache(list);
+    QDBusMessage reply = msg->m_message.createReply(QVariant::fromValue<SourceList>(list));
     QDBusConnection::sessionBus().send(reply);
     delete msg;
 }
 
 void AddressBook::availableSourcesDoneListDefaultSource(FolksBackendStore *backendStore,
                                                         GAsyncResult *res,
-                                                        QDBusMessage *msg)
+                                                        void *data)
 {
+    GetSourceData *msg = static_cast<GetSourceData*>(data);
     Source defaultSource;
     SourceList list = availableSourcesDoneImpl(backendStore, res);
+    msg->m_addressbook->setSourcesCache(list);
     if (list.count() > 0) {
         defaultSource = list.first();
     }
-    QDBusMessage reply = msg->createReply(QVariant::fromValue<Source>(defaultSource));
+    QDBusMessage reply = msg->m_message.createReply(QVariant::fromValue<Source>(defaultSource));
     QDBusConnection::sessionBus().send(reply);
     delete msg;
 }
@@ -1015,18 +1366,15 @@ SourceList AddressBook::availableSourcesDoneImpl(FolksBackendStore *backendStore
             // FIXME: Due a bug on Folks we can not rely on folks_persona_store_get_is_primary_store
             // see main.cpp:68
             if (strcmp(folks_backend_get_name(backend), "eds") == 0) {
-                GError *error = 0;
-                ESourceRegistry *r = e_source_registry_new_sync(NULL, &error);
-                if (error) {
-                    qWarning() << "Failt to check default source:" << error->message;
-                    g_error_free(error);
+                ESourceRegistry *r = EdsClientPool::instance()->registry();
+                if (!r) {
+                    qWarning() << "Failt to check default source";
                 } else {
                     ESource *defaultSource = e_source_registry_ref_default_address_book(r);
                     ESource *source = edsf_persona_store_get_source(EDSF_PERSONA_STORE(store));
                     displayName = QString::fromUtf8(e_source_get_display_name(source));
                     isPrimary = e_source_equal(defaultSource, source);
                     g_object_unref(defaultSource);
-                    g_object_unref(r);
 
                     if (e_source_has_extension(source, E_SOURCE_EXTENSION_UBUNTU)) {
                         ESourceUbuntu *ubuntu_ex = E_SOURCE_UBUNTU(e_source_get_extension(source, E_SOURCE_EXTENSION_UBUNTU));
@@ -1062,6 +1410,7 @@ SourceList AddressBook::availableSourcesDoneImpl(FolksBackendStore *backendStore
 
 QString AddressBook::createContact(const QString &contact, const QString &source, const QDBusMessage &message)
 {
+    MetricsTimer timer(Metrics::MethodCreateContact);
     ContactEntry *entry = m_contacts->valueFromVCard(contact);
     if (entry) {
         qWarning() << "Contact exists";
@@ -1094,124 +1443,603 @@ QString AddressBook::createContact(const QString &contact, const QString &source
     return "";
 }
 
+/*
+ * Parse all vcards of the batch in the thread pool and create the contacts keeping at most
+ * 'm_maxRunningCreates' persona creations running, the reply contains the new vcard of each
+ * contact, or an empty string and the error message when the contact could not be created.
+ */
+QStringList AddressBook::createContacts(const QStringList &contacts, const QString &source, const QDBusMessage &message)
+{
+    MetricsTimer timer(Metrics::MethodCreateContacts);
+    CreateContactsBatch *batch = new CreateContactsBatch;
+    batch->m_message = message;
+    batch->m_listener = 0;
+    batch->m_source = source;
+    startCreateContacts(batch, contacts);
+    return QStringList();
+}
+
+/*
+ * Same as the D-Bus call, the listener slot receives the results and errors lists
+ */
+void AddressBook::createContacts(const QStringList &contacts, const QString &source,
+                                 QObject *listener, const char *slot)
+{
+    CreateContactsBatch *batch = new CreateContactsBatch;
+    batch->m_listener = listener;
+    int slotIndex = listener->metaObject()->indexOfSlot(++slot);
+    if (slotIndex == -1) {
+        qWarning() << "Invalid slot:" << slot << "for object" << listener;
+    } else {
+        batch->m_listenerSlot = listener->metaObject()->method(slotIndex);
+    }
+    batch->m_source = source;
+    startCreateContacts(batch, contacts);
+}
+
+void AddressBook::startCreateContacts(CreateContactsBatch *batch, const QStringList &contacts)
+{
+    batch->m_vcards = contacts;
+    batch->m_contacts.resize(contacts.size());
+    batch->m_store = 0;
+    batch->m_nextIndex = 0;
+    batch->m_pendingCount = contacts.size();
+    batch->m_pendingWrites = 0;
+    for(int i = 0; i < contacts.size(); i++) {
+        batch->m_result << QString();
+        batch->m_errors << QString();
+    }
+
+    if (contacts.isEmpty()) {
+        createContactsFinish(batch);
+        return;
+    }
+
+    // the personas can not be created while folks is not loaded
+    if (!m_ready || !m_individualAggregator) {
+        qWarning() << "Create contacts requested before the address book is ready";
+        for(int i = 0; i < contacts.size(); i++) {
+            batch->m_errors[i] = "Address book is not ready";
+        }
+        createContactsFinish(batch);
+        return;
+    }
+
+    int jobs = (contacts.size() + CREATE_PARSE_CHUNK_SIZE - 1) / CREATE_PARSE_CHUNK_SIZE;
+    batch->m_pendingParsers.store(jobs);
+    m_pendingCreates << batch;
+
+    for(int i = 0; i < jobs; i++) {
+        int begin = i * CREATE_PARSE_CHUNK_SIZE;
+        int end = qMin(begin + CREATE_PARSE_CHUNK_SIZE, contacts.size());
+        QueryExecutor::instance()->start(new ParseVCardsJob(this, batch, begin, end), QueryExecutor::Bulk);
+    }
+}
+
+QString AddressBook::importVCards(const QDBusUnixFileDescriptor &fd, const QString &source, const QDBusMessage &message)
+{
+    MetricsTimer timer(Metrics::MethodImportVCards);
+    if (!m_ready) {
+        qWarning() << "Import requested before the address book is ready";
+        if (message.type() == QDBusMessage::MethodCallMessage) {
+            message.setDelayedReply(true);
+            QDBusConnection::sessionBus().send(message.createErrorReply(QDBusError::Failed,
+                                                                        "Address book is not ready"));
+        }
+        return QString();
+    }
+
+    QString importId;
+    ImportVCardsRequest *request = new ImportVCardsRequest(this, fd, source, this);
+    if (request->start()) {
+        connect(request, SIGNAL(progress(QString,int,int)), SIGNAL(importProgress(QString,int,int)));
+        connect(request, SIGNAL(finished(QString,int,int)), SIGNAL(importFinished(QString,int,int)));
+        importId = request->id();
+    } else {
+        delete request;
+    }
+
+    // the adaptor queues the call and leaves the reply to us
+    if (message.type() == QDBusMessage::MethodCallMessage) {
+        QDBusConnection::sessionBus().send(message.createReply(importId));
+    }
+    return importId;
+}
+
+void AddressBook::exportVCards(const QDBusUnixFileDescriptor &fd, const QStringList &fields,
+                               const QStringList &sources, const QDBusMessage &message)
+{
+    MetricsTimer timer(Metrics::MethodExportVCards);
+    if (!m_ready) {
+        QDBusConnection::sessionBus().send(message.createErrorReply(QDBusError::Failed,
+                                                                    "Address book is not ready"));
+        return;
+    }
+
+    ExportVCardsRequest *request = new ExportVCardsRequest(m_contacts->snapshot(), fd, fields, sources, message, this);
+    m_exports << request;
+    connect(request, SIGNAL(finished()), SLOT(exportFinished()));
+    request->start();
+}
+
+void AddressBook::exportFinished()
+{
+    m_exports.removeOne(qobject_cast<ExportVCardsRequest*>(QObject::sender()));
+}
+
+/*
+ * Reply with the token of the last change, a flag telling if the changes since the token are
+ * complete and the ids of the contacts added, changed and removed after the token.
+ */
+void AddressBook::changesSince(quint64 token, const QDBusMessage &message)
+{
+    MetricsTimer timer(Metrics::MethodChangesSince);
+    QStringList added;
+    QStringList changed;
+    QStringList removed;
+    bool complete = m_journal->changesSince(token, &added, &changed, &removed);
+
+    QDBusMessage reply = message.createReply(QVariantList() << m_journal->currentToken()
+                                                            << complete
+                                                            << added
+                                                            << changed
+                                                            << removed);
+    QDBusConnection::sessionBus().send(reply);
+}
+
 FolksPersonaStore * AddressBook::getFolksStore(const QString &source)
 {
     QString sourceId(source);
     FolksPersonaStore *result = 0;
 
     // if source is empty we try use EDS default source
-    if (source.isEmpty()) {
-        GError *gError = NULL;
-        ESourceRegistry *registry = e_source_registry_new_sync (NULL, &gError);
-        if (gError) {
+    if (sourceId.isEmpty()) {
+        sourceId = EdsClientPool::instance()->defaultSourceId();
+        if (sourceId.isEmpty()) {
             qWarning() << "Fail to find EDS default source";
-        } else {
-            ESource *defaultAB = e_source_registry_ref_default_address_book(registry);
-            if (defaultAB) {
-                sourceId = QString::fromUtf8(e_source_get_uid(defaultAB));
-            }
-            g_object_unref(registry);
         }
     }
 
     if (!sourceId.isEmpty()) {
-        FolksBackendStore *backendStore = folks_backend_store_dup();
-        GeeCollection *backends = folks_backend_store_list_backends(backendStore);
-
-        GeeIterator *iter = gee_iterable_iterator(GEE_ITERABLE(backends));
-        while((result == 0) && gee_iterator_next(iter)) {
-            FolksBackend *backend = FOLKS_BACKEND(gee_iterator_get(iter));
-            GeeMap *stores = folks_backend_get_persona_stores(backend);
-            GeeCollection *values =  gee_map_get_values(stores);
-            GeeIterator *storeIter = gee_iterable_iterator(GEE_ITERABLE(values));
-
-            while(gee_iterator_next(storeIter)) {
-                FolksPersonaStore *store = FOLKS_PERSONA_STORE(gee_iterator_get(storeIter));
-
-                QString id = QString::fromUtf8(folks_persona_store_get_id(store));
-                if (id == sourceId) {
-                    result = store;
-                    break;
-                }
-                g_object_unref(store);
-            }
-
-            g_object_unref(storeIter);
-            g_object_unref(backend);
-            g_object_unref(values);
+        if (!m_personaStoresLoaded) {
+            updatePersonaStores();
         }
-        g_object_unref(iter);
-        g_object_unref(backendStore);
+        result = m_personaStores.value(sourceId, 0);
     }
 
     if (!result) {
         result = folks_individual_aggregator_get_primary_store(m_individualAggregator);
         Q_ASSERT(result);
-        g_object_ref(result);
     }
 
+    g_object_ref(result);
     return result;
 }
 
-QString AddressBook::linkContacts(const QStringList &contacts)
+/*
+ * Load the persona stores of all backends and keep the table updated with the
+ * backend signals, the table is cleared when the sources change.
+ */
+void AddressBook::updatePersonaStores()
 {
-    //TODO
-    return "";
+    if (!m_backendStore) {
+        // backends loaded later are connected as soon as they are available
+        m_backendStore = folks_backend_store_dup();
+        m_backendAvailableId = g_signal_connect(m_backendStore,
+                                                "backend-available",
+                                                (GCallback) AddressBook::backendAvailable,
+                                                this);
+    }
+
+    m_personaStoresLoaded = true;
+    GeeCollection *backends = folks_backend_store_list_backends(m_backendStore);
+
+    GeeIterator *iter = gee_iterable_iterator(GEE_ITERABLE(backends));
+    while(gee_iterator_next(iter)) {
+        FolksBackend *backend = FOLKS_BACKEND(gee_iterator_get(iter));
+        connectBackend(backend);
+        g_object_unref(backend);
+    }
+    g_object_unref(iter);
+    g_object_unref(backends);
 }
 
-View *AddressBook::query(const QString &clause, const QString &sort, int maxCount, bool showInvisible, const QStringList &sources)
+void AddressBook::connectBackend(FolksBackend *backend)
 {
-    View *view = new View(clause, sort, maxCount, showInvisible, sources, m_ready ? m_contacts : 0, this);
-    m_views << view;
-    connect(view, SIGNAL(closed()), this, SLOT(viewClosed()));
-    return view;
+    bool connected = false;
+    for(int i = 0; i < m_backendHandlers.size(); i++) {
+        if (m_backendHandlers[i].first == backend) {
+            connected = true;
+            break;
+        }
+    }
+
+    if (!connected) {
+        g_object_ref(backend);
+        m_backendHandlers << qMakePair(backend,
+                                       g_signal_connect(backend,
+                                                        "persona-store-added",
+                                                        (GCallback) AddressBook::personaStoreAdded,
+                                                        this));
+        g_object_ref(backend);
+        m_backendHandlers << qMakePair(backend,
+                                       g_signal_connect(backend,
+                                                        "persona-store-removed",
+                                                        (GCallback) AddressBook::personaStoreRemoved,
+                                                        this));
+    }
+
+    GeeMap *stores = folks_backend_get_persona_stores(backend);
+    GeeCollection *values =  gee_map_get_values(stores);
+    GeeIterator *storeIter = gee_iterable_iterator(GEE_ITERABLE(values));
+    while(gee_iterator_next(storeIter)) {
+        FolksPersonaStore *store = FOLKS_PERSONA_STORE(gee_iterator_get(storeIter));
+        personaStoreAdded(backend, store, this);
+        g_object_unref(store);
+    }
+
+    g_object_unref(storeIter);
+    g_object_unref(values);
 }
 
-void AddressBook::viewClosed()
+void AddressBook::clearPersonaStores()
 {
-    m_views.remove(qobject_cast<View*>(QObject::sender()));
+    Q_FOREACH(FolksPersonaStore *store, m_personaStores.values()) {
+        g_object_unref(store);
+    }
+    m_personaStores.clear();
+    m_personaStoresLoaded = false;
+    clearSourcesCache();
 }
 
-void AddressBook::individualChanged(QIndividual *individual)
+void AddressBook::setSourcesCache(const SourceList &sources)
 {
-    if (individual->isVisible()) {
-        m_notifyContactUpdate->insertChangedContacts(QSet<QString>() << individual->id());
+    // the persona store signals clear the cache
+    if (!m_personaStoresLoaded) {
+        updatePersonaStores();
     }
+
+    QMutexLocker locker(&m_sharedLock);
+    m_sourcesCache = sources;
+    m_sourcesCacheValid = true;
 }
 
-void AddressBook::onEdsServiceOwnerChanged(const QString &name, const QString &oldOwner, const QString &newOwner)
+void AddressBook::clearSourcesCache()
 {
-    if (newOwner.isEmpty()) {
-        m_edsIsLive = false;
-        m_isAboutToReload = true;
-        qWarning() << "EDS died: restarting service" << m_individualsChangedDetailedId;
-        unprepareFolks();
-    } else {
-        m_edsIsLive = true;
+    QMutexLocker locker(&m_sharedLock);
+    m_sourcesCache.clear();
+    m_sourcesCacheValid = false;
+}
+
+bool AddressBook::cachedSources(SourceList *sources) const
+{
+    QMutexLocker locker(&m_sharedLock);
+    if (m_sourcesCacheValid) {
+        *sources = m_sourcesCache;
     }
+    return m_sourcesCacheValid;
 }
 
-void AddressBook::onSafeModeChanged()
+void AddressBook::backendAvailable(FolksBackendStore *backendStore,
+                                   FolksBackend *backend,
+                                   AddressBook *self)
 {
-    GIcon *icon = g_themed_icon_new("address-book-app");
+    Q_UNUSED(backendStore);
+    self->clearSourcesCache();
+    // the table is filled in the next lookup if it was not loaded yet
+    if (self->m_personaStoresLoaded) {
+        self->connectBackend(backend);
+    }
+}
 
-    if (m_messagingMenu == 0) {
-//        m_messagingMenu = messaging_menu_app_new("address-book-app.desktop");
-//        messaging_menu_app_register(m_messagingMenu);
-//        messaging_menu_app_append_source(m_messagingMenu, MESSAGING_MENU_SOURCE_ID, icon, C::gettext("Address book service"));
+void AddressBook::personaStoreAdded(FolksBackend *backend,
+                                    FolksPersonaStore *store,
+                                    AddressBook *self)
+{
+    MetricsActivity activity("folks.personaStoreAdded");
+    Q_UNUSED(backend);
+    self->clearSourcesCache();
+    if (!self->m_personaStoresLoaded) {
+        return;
+    }
+    QString id = QString::fromUtf8(folks_persona_store_get_id(store));
+    FolksPersonaStore *old = self->m_personaStores.value(id, 0);
+    if (old == store) {
+        return;
     }
 
-    if (m_messagingMenuMessage) {
-//        messaging_menu_app_remove_message(m_messagingMenu, m_messagingMenuMessage);
-        g_object_unref (m_messagingMenuMessage);
-        m_messagingMenuMessage = 0;
+    self->m_personaStores.insert(id, FOLKS_PERSONA_STORE(g_object_ref(store)));
+    if (old) {
+        g_object_unref(old);
     }
+}
 
-//    if (isSafeMode()) {
-//        m_messagingMenuMessage = messaging_menu_message_new("address-book-service-safe-mode",
-//                                                            icon,
-//                                                            C::gettext("Update required"),
-//                                                            NULL,
+void AddressBook::personaStoreRemoved(FolksBackend *backend,
+                                      FolksPersonaStore *store,
+                                      AddressBook *self)
+{
+    Q_UNUSED(backend);
+    self->clearSourcesCache();
+    QString id = QString::fromUtf8(folks_persona_store_get_id(store));
+    if (self->m_personaStores.value(id, 0) == store) {
+        self->m_personaStores.remove(id);
+        g_object_unref(store);
+    }
+}
+
+QString AddressBook::linkContacts(const QStringList &contacts)
+{
+    //TODO
+    return "";
+}
+
+View *AddressBook::query(const QString &clause, const QString &sort, int maxCount, bool showInvisible, const QStringList &sources,
+                         const QDBusMessage &message)
+{
+    // the view has no parent, it is moved to the view thread once registered
+    View *view = new View(clause, sort, maxCount, showInvisible, sources, contactsSnapshot(), 0,
+                          View::ContactsResult, clientPriority(message));
+    connect(view, SIGNAL(closed()), this, SLOT(viewClosed()));
+    if (!message.service().isEmpty()) {
+        view->setOwner(message.service());
+    }
+    if (m_maxRowsHeld > 0) {
+        connect(view, SIGNAL(filterDone()), this, SLOT(reapViews()));
+    }
+
+    // queued before the view can be closed, the close is queued to the main thread too
+    QMetaObject::invokeMethod(this, "trackView", Qt::QueuedConnection, Q_ARG(QObject*, view));
+    return view;
+}
+
+void AddressBook::trackView(QObject *object)
+{
+    View *view = static_cast<View*>(object);
+    m_views << view;
+
+    // the view is closed if the client leaves the bus without closing it
+    if (!view->owner().isEmpty()) {
+        m_clientWatcher->addWatchedService(view->owner());
+    }
+}
+
+void AddressBook::watchClient(const QString &client)
+{
+    m_clientWatcher->addWatchedService(client);
+}
+
+ContactsSnapshot AddressBook::contactsSnapshot() const
+{
+    QMutexLocker locker(&m_sharedLock);
+    if (!m_ready || !m_contacts) {
+        return ContactsSnapshot();
+    }
+    return m_contacts->snapshot();
+}
+
+bool AddressBook::takeQuery(View *view)
+{
+    QMutexLocker locker(&m_sharedLock);
+    return (m_queries.remove(view) > 0);
+}
+
+QThread *AddressBook::viewThread() const
+{
+    return m_viewThread;
+}
+
+QueryExecutor::Priority AddressBook::clientPriority(const QDBusMessage &message) const
+{
+    QMutexLocker locker(&m_sharedLock);
+    return m_clientPriorities.value(message.service(), QueryExecutor::Auto);
+}
+
+bool AddressBook::setQueryPriority(const QString &priority, const QDBusMessage &message)
+{
+    bool ok = false;
+    QueryExecutor::Priority value = QueryExecutor::fromString(priority, &ok);
+    QString client = message.service();
+    if (!ok || client.isEmpty()) {
+        qWarning() << "Invalid query priority" << priority << "requested by" << client;
+        return false;
+    }
+
+    m_sharedLock.lock();
+    if (value == QueryExecutor::Auto) {
+        m_clientPriorities.remove(client);
+    } else {
+        m_clientPriorities.insert(client, value);
+    }
+    m_sharedLock.unlock();
+    if (value != QueryExecutor::Auto) {
+        // the watcher lives in the main thread
+        QMetaObject::invokeMethod(this, "watchClient", Qt::QueuedConnection, Q_ARG(QString, client));
+    }
+    qDebug() << "Query priority of" << client << "set to" << QueryExecutor::toString(value);
+    return true;
+}
+
+void AddressBook::queryIds(const QString &clause, const QString &sort, int maxCount, bool showInvisible,
+                           const QStringList &sources, const QDBusMessage &message)
+{
+    ContactsSnapshot contacts = contactsSnapshot();
+    if (contacts.isNull()) {
+        QDBusConnection::sessionBus().send(message.createReply(QStringList()));
+        return;
+    }
+
+    // the view is not registered on the bus, it only lives until the filter finishes
+    qint64 started = Metrics::now();
+    qint64 traceStarted = Trace::now();
+    View *view = new View(clause, sort, maxCount, showInvisible, sources, contacts, 0, View::IdsResult,
+                          clientPriority(message));
+    m_sharedLock.lock();
+    m_queries.insert(view, message);
+    m_sharedLock.unlock();
+    // runs in the D-Bus thread, with the view
+    connect(view, &View::filterDone, view, [this, view, message, started, traceStarted]() {
+        if (!takeQuery(view)) {
+            // already answered by the reload, that deletes the view
+            return;
+        }
+        Metrics::instance()->recordCall(Metrics::MethodQueryIds, (Metrics::now() - started) / 1000);
+        if (Trace::isEnabled()) {
+            Trace::complete("queryIds", view->dynamicObjectPath(), traceStarted);
+        }
+        QDBusConnection::sessionBus().send(message.createReply(view->ids()));
+        view->deleteLater();
+    });
+}
+
+void AddressBook::queryCount(const QString &clause, bool showInvisible,
+                             const QStringList &sources, const QDBusMessage &message)
+{
+    ContactsSnapshot contacts = contactsSnapshot();
+    if (contacts.isNull()) {
+        QDBusConnection::sessionBus().send(message.createReply(0));
+        return;
+    }
+
+    qint64 started = Metrics::now();
+    qint64 traceStarted = Trace::now();
+    View *view = new View(clause, QString(), -1, showInvisible, sources, contacts, 0, View::CountResult,
+                          clientPriority(message));
+    m_sharedLock.lock();
+    m_queries.insert(view, message);
+    m_sharedLock.unlock();
+    // runs in the D-Bus thread, with the view
+    connect(view, &View::filterDone, view, [this, view, message, started, traceStarted]() {
+        if (!takeQuery(view)) {
+            // already answered by the reload, that deletes the view
+            return;
+        }
+        Metrics::instance()->recordCall(Metrics::MethodQueryCount, (Metrics::now() - started) / 1000);
+        if (Trace::isEnabled()) {
+            Trace::complete("queryCount", view->dynamicObjectPath(), traceStarted);
+        }
+        QDBusConnection::sessionBus().send(message.createReply(view->resultCount()));
+        view->deleteLater();
+    });
+}
+
+void AddressBook::viewClosed()
+{
+    View *view = qobject_cast<View*>(QObject::sender());
+    m_views.remove(view);
+    // deleted in its own thread
+    view->deleteLater();
+}
+
+void AddressBook::onClientUnregistered(const QString &client)
+{
+    m_sharedLock.lock();
+    m_clientPriorities.remove(client);
+    m_sharedLock.unlock();
+    m_clientWatcher->removeWatchedService(client);
+
+    Q_FOREACH(View *view, m_views) {
+        if (view->owner() == client) {
+            reapView(view, Metrics::ViewsReapedOwnerGone);
+        }
+    }
+}
+
+void AddressBook::reapViews()
+{
+    QList<View*> views;
+    Q_FOREACH(View *view, m_views) {
+        if ((m_viewIdleTimeout > 0) && (view->idleTime() > m_viewIdleTimeout)) {
+            reapView(view, Metrics::ViewsReapedIdle);
+        } else {
+            views << view;
+        }
+    }
+
+    if (m_maxRowsHeld <= 0) {
+        return;
+    }
+
+    qint64 rows = 0;
+    Q_FOREACH(View *view, views) {
+        rows += view->rowsHeld();
+    }
+
+    // close the least recently used views first, the most recent one is always kept
+    while ((rows > m_maxRowsHeld) && (views.size() > 1)) {
+        View *oldest = views.first();
+        Q_FOREACH(View *view, views) {
+            if (view->idleTime() > oldest->idleTime()) {
+                oldest = view;
+            }
+        }
+        views.removeOne(oldest);
+        rows -= oldest->rowsHeld();
+        reapView(oldest, Metrics::ViewsReapedRowsLimit);
+    }
+}
+
+void AddressBook::reapView(View *view, Metrics::Counter reason)
+{
+    qDebug() << "Closing view" << view->dynamicObjectPath() << "of" << view->owner()
+             << "idle for" << view->idleTime() << "ms";
+    Metrics::instance()->add(reason);
+    // 'viewClosed' deletes the view once it is closed in its own thread
+    m_views.remove(view);
+    QMetaObject::invokeMethod(view, "close", Qt::QueuedConnection);
+}
+
+void AddressBook::individualChanged(QIndividual *individual)
+{
+    // the deletion mark, timestamps and personas can be changed by another client
+    ContactEntry *entry = m_contacts ? m_contacts->value(individual->id()) : 0;
+    if (entry) {
+        m_contacts->updateIndexes(entry);
+    }
+
+    if (individual->isVisible()) {
+        m_notifyContactUpdate->insertChangedContacts(QSet<QString>() << individual->id());
+    }
+}
+
+void AddressBook::onEdsServiceOwnerChanged(const QString &name, const QString &oldOwner, const QString &newOwner)
+{
+    if (newOwner.isEmpty()) {
+        m_sharedLock.lock();
+        m_edsIsLive = false;
+        m_sharedLock.unlock();
+        m_isAboutToReload = true;
+        qWarning() << "EDS died: restarting service" << m_individualsChangedDetailedId;
+        // the connections with the old EDS are not valid anymore
+        EdsClientPool::instance()->clear();
+        unprepareFolks();
+    } else {
+        m_sharedLock.lock();
+        m_edsIsLive = true;
+        m_sharedLock.unlock();
+    }
+}
+
+void AddressBook::onSafeModeChanged()
+{
+    GIcon *icon = g_themed_icon_new("address-book-app");
+
+    if (m_messagingMenu == 0) {
+//        m_messagingMenu = messaging_menu_app_new("address-book-app.desktop");
+//        messaging_menu_app_register(m_messagingMenu);
+//        messaging_menu_app_append_source(m_messagingMenu, MESSAGING_MENU_SOURCE_ID, icon, C::gettext("Address book service"));
+    }
+
+    if (m_messagingMenuMessage) {
+//        messaging_menu_app_remove_message(m_messagingMenu, m_messagingMenuMessage);
+        g_object_unref (m_messagingMenuMessage);
+        m_messagingMenuMessage = 0;
+    }
+
+//    if (isSafeMode()) {
+//        m_messagingMenuMessage = messaging_menu_message_new("address-book-service-safe-mode",
+//                                                            icon,
+//                                                            C::gettext("Update required"),
+//                                                            NULL,
 //                                                            C::gettext("Only local contacts will be editable until the contact sync upgrade is complete."),
 //                                                            QDateTime::currentMSecsSinceEpoch() * 1000); // the value is expected to be in microseconds
 //    } else {
@@ -1229,21 +2057,160 @@ void AddressBook::onSafeModeChanged()
 }
 
 int AddressBook::removeContacts(const QStringList &contactIds, const QDBusMessage &message)
+{
+    MetricsTimer timer(Metrics::MethodRemoveContacts);
+    removeContacts(contactIds, true, message);
+    return 0;
+}
+
+/*
+ * Group the contacts by EDS source and remove (or mark as deleted) each group with
+ * a single EDS call. Contacts with personas that are not stored on EDS are removed
+ * one by one by folks.
+ */
+void AddressBook::removeContacts(const QStringList &contactIds, bool softRemoval, const QDBusMessage &message)
 {
     RemoveContactsData *data = new RemoveContactsData;
     data->m_addressbook = this;
     data->m_message = message;
-    data->m_request = contactIds;
     data->m_sucessCount = 0;
-    data->m_softRemoval = true;
-    removeContactDone(0, 0, data);
-    return 0;
+    data->m_softRemoval = softRemoval;
+    // the folks removal counts as one
+    data->m_pendingCount = 1;
+
+    QDateTime currentDate = QDateTime::currentDateTime();
+    QMap<QString, RemoveContactsSourceData*> sources;
+    Q_FOREACH(const QString &contactId, contactIds) {
+        ContactEntry *entry = m_contacts->value(contactId);
+        if (!entry) {
+            continue;
+        }
+
+        // soft removal only changes the EDS personas, the removal needs to remove all of them
+        QList<FolksPersona*> personas = eds_personas_from_individual(entry->individual()->individual(),
+                                                                     !softRemoval);
+        if (personas.isEmpty()) {
+            data->m_request << contactId;
+            continue;
+        }
+
+        Q_FOREACH(FolksPersona *persona, personas) {
+            FolksPersonaStore *store = folks_persona_get_store(persona);
+            ESource *source = edsf_persona_store_get_source(EDSF_PERSONA_STORE(store));
+            QString sourceId = QString::fromUtf8(e_source_get_uid(source));
+
+            RemoveContactsSourceData *sourceData = sources.value(sourceId, 0);
+            if (!sourceData) {
+                sourceData = new RemoveContactsSourceData;
+                sourceData->m_parent = data;
+                sourceData->m_source = E_SOURCE(g_object_ref(source));
+                sourceData->m_contacts = 0;
+                sources.insert(sourceId, sourceData);
+            }
+
+            EContact *contact = edsf_persona_get_contact(EDSF_PERSONA(persona));
+            if (softRemoval) {
+                QIndividual::setContactDeletedAt(contact, currentDate);
+            }
+            sourceData->m_contacts = g_slist_prepend(sourceData->m_contacts, g_object_ref(contact));
+            sourceData->m_ids << contactId;
+            g_object_unref(persona);
+        }
+    }
+
+    data->m_pendingCount += sources.size();
+    Q_FOREACH(RemoveContactsSourceData *sourceData, sources.values()) {
+        EdsClientPool::instance()->client(sourceData->m_source,
+                                          AddressBook::removeContactsSourceConnected,
+                                          sourceData);
+    }
+
+    removeContactDone(m_individualAggregator, 0, data);
+}
+
+void AddressBook::removeContactsSourceConnected(EBookClient *client,
+                                                const QString &errorMessage,
+                                                void *data)
+{
+    RemoveContactsSourceData *sourceData = static_cast<RemoveContactsSourceData*>(data);
+    if (!client) {
+        qWarning() << "Fail to remove contacts:" << errorMessage;
+        removeContactsSourceDone(0, 0, data);
+        return;
+    }
+
+    if (sourceData->m_parent->m_softRemoval) {
+        e_book_client_modify_contacts(client,
+                                      sourceData->m_contacts,
+                                      NULL,
+                                      (GAsyncReadyCallback) removeContactsSourceDone,
+                                      data);
+    } else {
+        GSList *uids = 0;
+        for(GSList *l = sourceData->m_contacts; l != 0; l = l->next) {
+            uids = g_slist_prepend(uids, (gpointer) e_contact_get_const(E_CONTACT(l->data), E_CONTACT_UID));
+        }
+        e_book_client_remove_contacts(client,
+                                      uids,
+                                      NULL,
+                                      (GAsyncReadyCallback) removeContactsSourceDone,
+                                      data);
+        g_slist_free(uids);
+    }
+}
+
+void AddressBook::removeContactsSourceDone(GObject *source,
+                                           GAsyncResult *res,
+                                           void *data)
+{
+    MetricsActivity activity("eds.removeContactsDone");
+    RemoveContactsSourceData *sourceData = static_cast<RemoveContactsSourceData*>(data);
+    RemoveContactsData *removeData = sourceData->m_parent;
+    AddressBook *self = removeData->m_addressbook;
+
+    if (res) {
+        GError *error = 0;
+        if (removeData->m_softRemoval) {
+            e_book_client_modify_contacts_finish(E_BOOK_CLIENT(source), res, &error);
+        } else {
+            e_book_client_remove_contacts_finish(E_BOOK_CLIENT(source), res, &error);
+        }
+
+        if (error) {
+            qWarning() << "Fail to remove contacts from EDS:" << error->message;
+            g_error_free(error);
+        } else {
+            QSet<QString> removedIds = sourceData->m_ids - removeData->m_removedIds;
+            removeData->m_removedIds += removedIds;
+            // the contacts map is gone if the contacts were reloaded in the meantime
+            if (removeData->m_softRemoval && !removedIds.isEmpty() && self->m_contacts) {
+                QDateTime currentDate = QDateTime::currentDateTime();
+                QString sourceId = QString::fromUtf8(e_source_get_uid(sourceData->m_source));
+                Q_FOREACH(const QString &contactId, removedIds) {
+                    ContactEntry *entry = self->m_contacts->value(contactId);
+                    if (entry) {
+                        entry->individual()->setDeletedAt(currentDate, sourceId);
+                        self->m_contacts->updateTombstone(entry);
+                    }
+                }
+                // since these will not be removed we need to send a removal singal
+                self->m_notifyContactUpdate->insertRemovedContacts(removedIds);
+            }
+        }
+    }
+
+    g_slist_free_full(sourceData->m_contacts, g_object_unref);
+    g_object_unref(sourceData->m_source);
+    delete sourceData;
+
+    remove_contacts_step_done(removeData);
 }
 
 void AddressBook::removeContactDone(FolksIndividualAggregator *individualAggregator,
                                     GAsyncResult *result,
                                     void *data)
 {
+    MetricsActivity activity("folks.removeContactDone");
     GError *error = 0;
     RemoveContactsData *removeData = static_cast<RemoveContactsData*>(data);
 
@@ -1260,25 +2227,18 @@ void AddressBook::removeContactDone(FolksIndividualAggregator *individualAggrega
 
     if (!removeData->m_request.isEmpty()) {
         QString contactId = removeData->m_request.takeFirst();
-        ContactEntry *entry = removeData->m_addressbook->m_contacts->value(contactId);
+        ContactsMap *contacts = removeData->m_addressbook->m_contacts;
+        ContactEntry *entry = contacts ? contacts->value(contactId) : 0;
         if (entry) {
-            if (removeData->m_softRemoval && entry->individual()->markAsDeleted()) {
-                removeContactDone(individualAggregator, 0, data);
-                // since this will not be removed we need to send a removal singal
-                removeData->m_addressbook->m_notifyContactUpdate->insertRemovedContacts(QSet<QString>() << entry->individual()->id());
-            } else {
-                folks_individual_aggregator_remove_individual(individualAggregator,
-                                                              entry->individual()->individual(),
-                                                              (GAsyncReadyCallback) removeContactDone,
-                                                              data);
-            }
+            folks_individual_aggregator_remove_individual(individualAggregator,
+                                                          entry->individual()->individual(),
+                                                          (GAsyncReadyCallback) removeContactDone,
+                                                          data);
         } else {
             removeContactDone(individualAggregator, 0, data);
         }
     } else {
-        QDBusMessage reply = removeData->m_message.createReply(removeData->m_sucessCount);
-        QDBusConnection::sessionBus().send(reply);
-        delete removeData;
+        remove_contacts_step_done(removeData);
     }
 }
 
@@ -1295,102 +2255,112 @@ bool AddressBook::unlinkContacts(const QString &parent, const QStringList &conta
 
 bool AddressBook::isReady() const
 {
+    QMutexLocker locker(&m_sharedLock);
     return m_ready && m_edsIsLive;
 }
 
-QStringList AddressBook::updateContacts(const QStringList &contacts, const QDBusMessage &message)
+QStringList AddressBook::updateContacts(const QStringList &contacts, const QDBusMessage &message,
+                                        bool writtenGroups)
 {
-    //TODO: support multiple update contacts calls
-    Q_ASSERT(m_updateCommandPendingContacts.isEmpty());
-    if (!processUpdates()) {
-        qWarning() << "Fail to process pending updates";
-        QDBusMessage reply = m_updateCommandReplyMessage.createReply(QStringList());
-        QDBusConnection::sessionBus().send(reply);
+    MetricsTimer timer(Metrics::MethodUpdateContacts);
+    if (contacts.isEmpty()) {
+        QVariantList reply;
+        reply << QStringList();
+        if (writtenGroups) {
+            reply << QVariant::fromValue(QList<int>());
+        }
+        QDBusConnection::sessionBus().send(message.createReply(reply));
         return QStringList();
     }
 
-    m_updatedIds.clear();
-    m_updateCommandReplyMessage = message;
-    m_updateCommandResult = contacts;
-    m_updateCommandPendingContacts = contacts;
+    UpdateContactsBatch *batch = new UpdateContactsBatch;
+    batch->m_message = message;
+    batch->m_replyWrittenGroups = writtenGroups;
+    batch->m_result = contacts;
+    batch->m_pendingCount = contacts.size();
+
+    for(int i = 0; i < contacts.size(); i++) {
+        UpdateContactsTask *task = new UpdateContactsTask;
+        task->m_batch = batch;
+        task->m_index = i;
+        batch->m_writtenGroups << 0;
+        task->m_contact = VCardParser::vcardToContact(contacts[i]);
+        task->m_contactId = task->m_contact.detail<QContactGuid>().guid();
+        m_pendingUpdates << task;
+    }
 
-    updateContactsDone("", "");
+    processUpdates();
     return QStringList();
 }
 
 void AddressBook::purgeContacts(const QDateTime &since, const QString &sourceId, const QDBusMessage &message)
 {
-    RemoveContactsData *data = new RemoveContactsData;
-    data->m_addressbook = this;
-    data->m_message = message;
-    data->m_sucessCount = 0;
-    data->m_softRemoval = false;
-
-    Q_FOREACH(const ContactEntry *entry, m_contacts->values()) {
+    MetricsTimer timer(Metrics::MethodPurgeContacts);
+    QStringList contactIds;
+    // tombstones are indexed by source and deletion time
+    Q_FOREACH(const ContactEntry *entry, m_contacts->removedSince(since, sourceId)) {
         if (entry->individual()->deletedAt() > since) {
-            QContactSyncTarget syncTarget = entry->individual()->contact().detail<QContactSyncTarget>();
-            if (syncTarget.value(QContactSyncTarget::FieldSyncTarget + 1).toString() == sourceId) {
-                data->m_request << entry->individual()->id();
-            }
+            contactIds << entry->individual()->id();
         }
     }
 
-    removeContactDone(0, 0, data);
+    removeContacts(contactIds, false, message);
 }
 
-void AddressBook::updateContactsDone(const QString &contactId,
+void AddressBook::updateContactsDone(const QString &token,
                                      const QString &error)
 {
-    int currentContactIndex = m_updateCommandResult.size() - m_updateCommandPendingContacts.size() - 1;
+    MetricsActivity activity("updateContactsDone");
+    UpdateContactsTask *task = m_runningUpdates.take(token.toInt());
+    if (!task) {
+        // the tasks are failed when the contacts are reloaded
+        qWarning() << "Update done for an unknown task" << token;
+        return;
+    }
+
+    updateContactsTaskDone(task, error, true);
+    // the callback can be called during the 'processUpdates' loop
+    QMetaObject::invokeMethod(this, "processUpdates", Qt::QueuedConnection);
+}
+
+void AddressBook::updateContactsTaskDone(UpdateContactsTask *task, const QString &error, bool changed)
+{
+    UpdateContactsBatch *batch = task->m_batch;
 
     if (!error.isEmpty()) {
         // update the result with the error
-        if (currentContactIndex >= 0 &&
-            currentContactIndex < m_updateCommandResult.size()) {
-            m_updateCommandResult[currentContactIndex] = error;
-        } else {
-            qWarning() << "Invalid contact changed index" << currentContactIndex <<
-                          "Contact list size" << m_updateCommandResult.size();
-        }
-    } else if (!contactId.isEmpty()){
+        batch->m_result[task->m_index] = error;
+    } else {
         // update the result with the new contact info
-        ContactEntry *entry = m_contacts->value(contactId);
-        Q_ASSERT(entry);
-        m_updatedIds << contactId;
-        QContact contact = entry->individual()->contact();
-        QString vcard = VCardParser::contactToVcard(contact);
-        if (!vcard.isEmpty()) {
-            m_updateCommandResult[currentContactIndex] = vcard;
+        ContactEntry *entry = m_contacts ? m_contacts->value(task->m_contactId) : 0;
+        if (entry) {
+            QContact contact = entry->individual()->contact();
+            batch->m_result[task->m_index] = VCardParser::contactToVcard(contact);
+            if (changed) {
+                batch->m_writtenGroups[task->m_index] = entry->individual()->lastWrittenGroups();
+                batch->m_updatedIds << task->m_contactId;
+                // update contact position on map
+                m_contacts->updatePosition(entry);
+            }
         } else {
-            m_updateCommandResult[currentContactIndex] = "";
+            batch->m_result[task->m_index] = "";
         }
-        // update contact position on map
-        m_contacts->updatePosition(entry);
     }
+    delete task;
 
-    if (!m_updateCommandPendingContacts.isEmpty()) {
-        QString vCard = m_updateCommandPendingContacts.takeFirst();
-        QContact newContact = VCardParser::vcardToContact(vCard);
-        ContactEntry *entry = m_contacts->value(newContact.detail<QContactGuid>().guid());
-        if (entry) {
-            entry->individual()->update(newContact, this,
-                                        SLOT(updateContactsDone(QString,QString)));
-        } else {
-            qWarning() << "Contact not found for update:" << vCard;
-            updateContactsDone("", "Contact not found!");
+    batch->m_pendingCount--;
+    if (batch->m_pendingCount == 0) {
+        QVariantList arguments;
+        arguments << batch->m_result;
+        if (batch->m_replyWrittenGroups) {
+            // the number of detail groups written for each contact
+            arguments << QVariant::fromValue(batch->m_writtenGroups);
         }
-    } else {
-        QDBusMessage reply = m_updateCommandReplyMessage.createReply(m_updateCommandResult);
-        QDBusConnection::sessionBus().send(reply);
+        QDBusConnection::sessionBus().send(batch->m_message.createReply(arguments));
 
         // notify about the changes
-        m_notifyContactUpdate->insertChangedContacts(m_updatedIds.toSet());
-
-        // clear command data
-        m_updatedIds.clear();
-        m_updateCommandResult.clear();
-        m_updateCommandReplyMessage = QDBusMessage();
-        m_updateLock.unlock();
+        m_notifyContactUpdate->insertChangedContacts(batch->m_updatedIds);
+        delete batch;
     }
 }
 
@@ -1431,6 +2401,7 @@ void AddressBook::individualsChangedCb(FolksIndividualAggregator *individualAggr
                                        GeeMultiMap *changes,
                                        AddressBook *self)
 {
+    MetricsActivity activity("folks.individualsChanged");
     Q_UNUSED(individualAggregator);
 
     QSet<QString> removedIds;
@@ -1528,6 +2499,7 @@ void AddressBook::createContactDone(FolksIndividualAggregator *individualAggrega
                                     GAsyncResult *res,
                                     void *data)
 {
+    MetricsActivity activity("folks.createContactDone");
     CreateContactData *createData = static_cast<CreateContactData*>(data);
 
     FolksPersona *persona;
@@ -1581,23 +2553,312 @@ void AddressBook::quitSignalHandler(int)
      ::write(m_sigQuitFd[0], &a, sizeof(a));
 }
 
-bool AddressBook::processUpdates()
+/*
+ * Start the pending updates in the order that they were requested, keeping at most
+ * 'm_maxRunningUpdates' running at the same time. Updates to a contact that is
+ * already being updated wait for the running update to finish.
+ */
+void AddressBook::processUpdates()
+{
+    MetricsActivity activity("processUpdates");
+    int i = 0;
+    while ((i < m_pendingUpdates.size()) &&
+           (m_runningUpdates.size() < m_maxRunningUpdates)) {
+        UpdateContactsTask *task = m_pendingUpdates[i];
+        if (isUpdating(task->m_contactId)) {
+            // wait for the running update of the same contact
+            i++;
+            continue;
+        }
+        m_pendingUpdates.removeAt(i);
+
+        ContactEntry *entry = m_contacts ? m_contacts->value(task->m_contactId) : 0;
+        if (!entry) {
+            qWarning() << "Contact not found for update:" << task->m_contactId;
+            updateContactsTaskDone(task, "Contact not found!", false);
+            continue;
+        }
+
+        task->m_token = m_nextUpdateToken++;
+        m_runningUpdates.insert(task->m_token, task);
+        if (!entry->individual()->update(task->m_contact, this,
+                                         SLOT(updateContactsDone(QString,QString)),
+                                         QString::number(task->m_token))) {
+            // if the contact is equal the update is not started and no callback will be called
+            task = m_runningUpdates.take(task->m_token);
+            if (task) {
+                updateContactsTaskDone(task, QString(), false);
+            }
+        }
+    }
+}
+
+bool AddressBook::isUpdating(const QString &contactId) const
 {
-    int timeout = 10;
-    while(!m_updateLock.tryLock(1000)) {
-        if (timeout <= 0) {
-            return false;
+    Q_FOREACH(const UpdateContactsTask *task, m_runningUpdates) {
+        if (task->m_contactId == contactId) {
+            return true;
         }
-        QCoreApplication::processEvents();
-        timeout--;
     }
-    return true;
+    return false;
+}
+
+/*
+ * Fail the waiting and running updates, their contacts are being reloaded. A running update
+ * that finishes later is ignored.
+ */
+void AddressBook::cancelUpdates(const QString &error)
+{
+    QList<UpdateContactsTask*> tasks = m_pendingUpdates + m_runningUpdates.values();
+    m_pendingUpdates.clear();
+    m_runningUpdates.clear();
+    Q_FOREACH(UpdateContactsTask *task, tasks) {
+        updateContactsTaskDone(task, error, false);
+    }
+}
+
+/*
+ * Start the persona creations of the parsed batches in the order that they were requested,
+ * keeping at most 'm_maxRunningCreates' running at the same time.
+ */
+void AddressBook::processCreates()
+{
+    MetricsActivity activity("processCreates");
+    int i = 0;
+    while ((i < m_pendingCreates.size()) &&
+           (m_runningCreates < m_maxRunningCreates)) {
+        CreateContactsBatch *batch = m_pendingCreates[i];
+        if (batch->m_pendingParsers.loadAcquire() > 0) {
+            // wait for the parser jobs
+            i++;
+            continue;
+        }
+
+        int index = batch->m_nextIndex++;
+        if (batch->m_nextIndex >= batch->m_vcards.size()) {
+            m_pendingCreates.removeAt(i);
+        }
+
+        // folks can be reloaded while the batch waits
+        if (!m_ready || !m_individualAggregator) {
+            batch->m_errors[index] = "Address book is not ready";
+            releaseCreateItem(batch, index);
+            createContactsItemDone(batch);
+            continue;
+        }
+
+        const QContact &contact = batch->m_contacts[index];
+        if (contact.isEmpty()) {
+            qWarning() << "Fail to parse contact" << index;
+            batch->m_errors[index] = "Invalid contact";
+            releaseCreateItem(batch, index);
+            createContactsItemDone(batch);
+            continue;
+        }
+
+        if (m_contacts && m_contacts->valueFromVCard(batch->m_vcards[index])) {
+            qWarning() << "Contact exists";
+            batch->m_errors[index] = "Contact already exists";
+            releaseCreateItem(batch, index);
+            createContactsItemDone(batch);
+            continue;
+        }
+        batch->m_vcards[index].clear();
+
+        if (!batch->m_store) {
+            batch->m_store = getFolksStore(batch->m_source);
+        }
+
+        CreateContactsTask *task = new CreateContactsTask;
+        task->m_addressbook = this;
+        task->m_batch = batch;
+        task->m_index = index;
+        m_runningCreates++;
+
+        GHashTable *details = QIndividual::parseDetails(contact);
+        Q_ASSERT(details);
+        folks_individual_aggregator_add_persona_from_details(m_individualAggregator,
+                                                             NULL, //parent
+                                                             batch->m_store,
+                                                             details,
+                                                             (GAsyncReadyCallback) createContactsTaskDone,
+                                                             (void*) task);
+        g_hash_table_destroy(details);
+    }
+}
+
+void AddressBook::createContactsTaskDone(FolksIndividualAggregator *individualAggregator,
+                                         GAsyncResult *res,
+                                         void *data)
+{
+    MetricsActivity activity("folks.createContactsTaskDone");
+    CreateContactsTask *task = static_cast<CreateContactsTask*>(data);
+    CreateContactsBatch *batch = task->m_batch;
+    AddressBook *self = task->m_addressbook;
+
+    GError *error = NULL;
+    FolksPersona *persona = folks_individual_aggregator_add_persona_from_details_finish(individualAggregator, res, &error);
+    if (error != NULL) {
+        qWarning() << "Failed to create individual from contact:" << error->message;
+        batch->m_errors[task->m_index] = QString::fromUtf8(error->message);
+        g_clear_error(&error);
+    } else if (persona == NULL) {
+        qWarning() << "Failed to create individual from contact: Persona already exists";
+        batch->m_errors[task->m_index] = "Contact already exists";
+    } else {
+        FolksIndividual *individual = folks_persona_get_individual(persona);
+        batch->m_created << qMakePair(task->m_index,
+                                      individual ? QString::fromUtf8(folks_individual_get_id(individual)) : QString());
+
+        // the extended details are written for all contacts of the batch at the end
+        FolksPersonaStore *store = folks_persona_get_store(persona);
+        if (EDSF_IS_PERSONA(persona) && EDSF_IS_PERSONA_STORE(store)) {
+            EContact *contact = edsf_persona_get_contact(EDSF_PERSONA(persona));
+            QIndividual::setContactExtendedDetails(contact,
+                                                   batch->m_contacts[task->m_index].details(QContactExtendedDetail::Type),
+                                                   QDateTime::currentDateTime());
+            ESource *source = edsf_persona_store_get_source(EDSF_PERSONA_STORE(store));
+            batch->m_edsContacts << qMakePair(E_SOURCE(g_object_ref(source)),
+                                              E_CONTACT(g_object_ref(contact)));
+        }
+        g_object_unref(persona);
+    }
+    releaseCreateItem(batch, task->m_index);
+
+    self->m_runningCreates--;
+    delete task;
+
+    self->createContactsItemDone(batch);
+    QMetaObject::invokeMethod(self, "processCreates", Qt::QueuedConnection);
+}
+
+/*
+ * When all personas of the batch are created, write the extended details of the EDS
+ * contacts with a single EDS call for each source.
+ */
+void AddressBook::createContactsItemDone(CreateContactsBatch *batch)
+{
+    batch->m_pendingCount--;
+    if (batch->m_pendingCount > 0) {
+        return;
+    }
+
+    QMap<QString, CreateContactsSourceData*> sources;
+    for(int i = 0; i < batch->m_edsContacts.size(); i++) {
+        // the references of the source and the contact are moved to the source data
+        ESource *source = batch->m_edsContacts[i].first;
+        QString sourceId = QString::fromUtf8(e_source_get_uid(source));
+        CreateContactsSourceData *sourceData = sources.value(sourceId, 0);
+        if (!sourceData) {
+            sourceData = new CreateContactsSourceData;
+            sourceData->m_addressbook = this;
+            sourceData->m_batch = batch;
+            sourceData->m_source = source;
+            sourceData->m_contacts = 0;
+            sources.insert(sourceId, sourceData);
+        } else {
+            g_object_unref(source);
+        }
+        sourceData->m_contacts = g_slist_prepend(sourceData->m_contacts, batch->m_edsContacts[i].second);
+    }
+    batch->m_edsContacts.clear();
+
+    batch->m_pendingWrites = sources.size();
+    if (sources.isEmpty()) {
+        createContactsFinish(batch);
+        return;
+    }
+
+    Q_FOREACH(CreateContactsSourceData *sourceData, sources.values()) {
+        EdsClientPool::instance()->client(sourceData->m_source,
+                                          AddressBook::createContactsSourceConnected,
+                                          sourceData);
+    }
+}
+
+void AddressBook::createContactsSourceConnected(EBookClient *client,
+                                                const QString &errorMessage,
+                                                void *data)
+{
+    if (!client) {
+        qWarning() << "Fail to write contacts extended details:" << errorMessage;
+        createContactsSourceDone(0, 0, data);
+        return;
+    }
+
+    CreateContactsSourceData *sourceData = static_cast<CreateContactsSourceData*>(data);
+    e_book_client_modify_contacts(client,
+                                  sourceData->m_contacts,
+                                  NULL,
+                                  (GAsyncReadyCallback) createContactsSourceDone,
+                                  data);
+}
+
+void AddressBook::createContactsSourceDone(GObject *source,
+                                           GAsyncResult *res,
+                                           void *data)
+{
+    MetricsActivity activity("eds.createContactsDone");
+    CreateContactsSourceData *sourceData = static_cast<CreateContactsSourceData*>(data);
+    CreateContactsBatch *batch = sourceData->m_batch;
+    AddressBook *self = sourceData->m_addressbook;
+
+    if (res) {
+        GError *error = 0;
+        e_book_client_modify_contacts_finish(E_BOOK_CLIENT(source), res, &error);
+        if (error) {
+            qWarning() << "Fail to write contacts extended details:" << error->message;
+            g_error_free(error);
+        }
+    }
+
+    g_slist_free_full(sourceData->m_contacts, g_object_unref);
+    g_object_unref(sourceData->m_source);
+    delete sourceData;
+
+    batch->m_pendingWrites--;
+    if (batch->m_pendingWrites == 0) {
+        self->createContactsFinish(batch);
+    }
+}
+
+void AddressBook::createContactsFinish(CreateContactsBatch *batch)
+{
+    for(int i = 0; i < batch->m_created.size(); i++) {
+        int index = batch->m_created[i].first;
+        const QString &individualId = batch->m_created[i].second;
+        ContactEntry *entry = (m_contacts && !individualId.isEmpty()) ? m_contacts->value(individualId) : 0;
+        if (entry) {
+            // We will need to reload contact due the extended details
+            entry->individual()->flush();
+            batch->m_result[index] = VCardParser::contactToVcard(entry->individual()->contact());
+        } else {
+            batch->m_errors[index] = "Failed to retrieve the new contact";
+        }
+    }
+
+    if (batch->m_listener) {
+        batch->m_listenerSlot.invoke(batch->m_listener,
+                                     Q_ARG(QStringList, batch->m_result),
+                                     Q_ARG(QStringList, batch->m_errors));
+    } else if (batch->m_message.type() != QDBusMessage::InvalidMessage) {
+        // the second argument contains the error message of each contact that was not created
+        QDBusMessage reply = batch->m_message.createReply(QVariantList() << batch->m_result
+                                                                         << batch->m_errors);
+        QDBusConnection::sessionBus().send(reply);
+    }
+
+    if (batch->m_store) {
+        g_object_unref(batch->m_store);
+    }
+    delete batch;
 }
 
 int AddressBook::init()
 {
     struct sigaction quit = { { 0 } };
     Source::registerMetaType();
+    qRegisterMetaType<QDBusUnixFileDescriptor>("QDBusUnixFileDescriptor");
 
     quit.sa_handler = AddressBook::quitSignalHandler;
     sigemptyset(&quit.sa_mask);
@@ -1606,6 +2867,9 @@ int AddressBook::init()
     if (sigaction(SIGQUIT, &quit, 0) > 0)
         return 1;
 
+    // a client closing the export file descriptor should not kill the service
+    signal(SIGPIPE, SIG_IGN);
+
     return 0;
 }
 
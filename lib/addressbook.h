@@ -20,12 +20,17 @@
 #define __GALERA_ADDRESSBOOK_H__
 
 #include "common/source.h"
+#include "metrics.h"
+#include "query-executor.h"
 
+#include <QtCore/QMutex>
 #include <QtCore/QObject>
+#include <QtCore/QPair>
 #include <QtCore/QSet>
 #include <QtCore/QString>
 #include <QtCore/QStringList>
 #include <QtCore/QSettings>
+#include <QtCore/QThread>
 
 #include <QtDBus/QtDBus>
 
@@ -38,15 +43,23 @@
 typedef struct _MessagingMenuMessage MessagingMenuMessage;
 typedef struct _MessagingMenuApp MessagingMenuApp;
 typedef struct _ESource ESource;
+typedef struct _EBookClient EBookClient;
 typedef struct _ESourceRegistry ESourceRegistry;
 
 namespace galera
 {
 class View;
 class ContactsMap;
+class ContactsSnapshot;
+class ExportVCardsRequest;
 class AddressBookAdaptor;
 class QIndividual;
 class DirtyContactsNotify;
+class UpdateContactsTask;
+class CreateContactsBatch;
+class ChangeJournal;
+class MainLoopProbe;
+class MainLoopWatchdog;
 
 class AddressBook: public QObject
 {
@@ -60,11 +73,21 @@ public:
 
     // Adaptor
     QString linkContacts(const QStringList &contacts);
-    View *query(const QString &clause, const QString &sort, int maxCount, bool showInvisible, const QStringList &sources);
+    // called in the D-Bus thread
+    View *query(const QString &clause, const QString &sort, int maxCount, bool showInvisible, const QStringList &sources,
+                const QDBusMessage &message);
+    // priority class requested by the caller for its queries
+    QueryExecutor::Priority clientPriority(const QDBusMessage &message) const;
+    QThread *viewThread() const;
     QStringList sortFields();
     bool unlinkContacts(const QString &parent, const QStringList &contacts);
     bool isReady() const;
-    void setSafeMode(bool flag);
+    // sources listed by the last 'availableSources' call, false if they changed since then
+    bool cachedSources(SourceList *sources) const;
+    Q_INVOKABLE void setSafeMode(bool flag);
+    void createContacts(const QStringList &contacts, const QString &source, QObject *listener, const char *slot);
+    Q_INVOKABLE QString importVCards(const QDBusUnixFileDescriptor &fd, const QString &source,
+                                     const QDBusMessage &message = QDBusMessage());
 
     static bool isSafeMode();
     static int init();
@@ -74,6 +97,8 @@ Q_SIGNALS:
     void readyChanged();
     void safeModeChanged();
     void sourcesChanged();
+    void importProgress(const QString &importId, int created, int failed);
+    void importFinished(const QString &importId, int created, int failed);
 
 public Q_SLOTS:
     bool start();
@@ -84,16 +109,35 @@ public Q_SLOTS:
     SourceList updateSources(const SourceList &sources, const QDBusMessage &message);
     void removeSource(const QString &sourceId, const QDBusMessage &message);
     QString createContact(const QString &contact, const QString &source, const QDBusMessage &message = QDBusMessage());
+    QStringList createContacts(const QStringList &contacts, const QString &source, const QDBusMessage &message = QDBusMessage());
     int removeContacts(const QStringList &contactIds, const QDBusMessage &message);
-    QStringList updateContacts(const QStringList &contacts, const QDBusMessage &message);
+    // 'writtenGroups' adds a second reply argument with the detail groups written for each contact
+    QStringList updateContacts(const QStringList &contacts, const QDBusMessage &message,
+                               bool writtenGroups = false);
+    void exportVCards(const QDBusUnixFileDescriptor &fd, const QStringList &fields,
+                      const QStringList &sources, const QDBusMessage &message);
+    void changesSince(quint64 token, const QDBusMessage &message);
     void purgeContacts(const QDateTime &since, const QString &sourceId, const QDBusMessage &message);
-    void updateContactsDone(const QString &contactId, const QString &error);
+    // queryIds, setQueryPriority and queryCount are called in the D-Bus thread
+    void queryIds(const QString &clause, const QString &sort, int maxCount, bool showInvisible,
+                  const QStringList &sources, const QDBusMessage &message);
+    bool setQueryPriority(const QString &priority, const QDBusMessage &message);
+    void queryCount(const QString &clause, bool showInvisible,
+                    const QStringList &sources, const QDBusMessage &message);
+    void updateContactsDone(const QString &token, const QString &error);
 
 private Q_SLOTS:
+    void trackView(QObject *view);
+    void watchClient(const QString &client);
     void viewClosed();
+    void exportFinished();
+    void processUpdates();
+    void processCreates();
     void individualChanged(QIndividual *individual);
     void onEdsServiceOwnerChanged(const QString &name, const QString &oldOwner, const QString &newOwner);
     void onSafeModeChanged();
+    void onClientUnregistered(const QString &client);
+    void reapViews();
 
     // Unix signal handlers.
     void handleSigQuit();
@@ -104,18 +148,47 @@ private Q_SLOTS:
 
     // check compatibility and if the safe mode should be enabled
     void checkCompatibility();
+    void clearPersonaStores();
 
 private:
     FolksIndividualAggregator *m_individualAggregator;
     ContactsMap *m_contacts;
     QSet<View*> m_views;
+    // views of the queryIds and queryCount calls waiting for their filter
+    QHash<View*, QDBusMessage> m_queries;
+    // exports reading the contacts map
+    QList<ExportVCardsRequest*> m_exports;
+    // serves the D-Bus calls of the views, away from the folks and EDS callbacks
+    QThread *m_viewThread;
+    // serves the read-only calls of the address book against snapshots of the contacts map,
+    // the other calls are queued to the main thread
+    QThread *m_dbusThread;
+    QObject *m_dbusObject;
+    // guards what the D-Bus thread reads: m_contacts, m_ready, m_edsIsLive, m_queries,
+    // m_clientPriorities and the sources cache. Only the main thread changes them, except
+    // m_queries and m_clientPriorities
+    mutable QMutex m_sharedLock;
+    SourceList m_sourcesCache;
+    bool m_sourcesCacheValid;
+    // query priority set by the clients, until they leave the bus
+    QHash<QString, QueryExecutor::Priority> m_clientPriorities;
+    QDBusServiceWatcher *m_clientWatcher;
+    // views left open by their clients are closed after this idle time (ms), or when
+    // all views together hold more than m_maxRowsHeld contacts
+    QTimer *m_viewReaper;
+    qint64 m_viewIdleTimeout;
+    qint64 m_maxRowsHeld;
     AddressBookAdaptor *m_adaptor;
     // timer to avoid send several updates at the same time
     DirtyContactsNotify *m_notifyContactUpdate;
+    // contact changes since the service started, used by the incremental sync
+    ChangeJournal *m_journal;
+    QString m_journalFile;
+    MainLoopProbe *m_mainLoopProbe;
+    MainLoopWatchdog *m_mainLoopWatchdog;
     QDBusServiceWatcher *m_edsWatcher;
     MessagingMenuApp *m_messagingMenu;
     MessagingMenuMessage *m_messagingMenuMessage;
-    ESourceRegistry *m_sourceRegistryListener;
     static QSettings m_settings;
 
     bool m_edsIsLive;
@@ -126,12 +199,23 @@ private:
     gulong m_notifyIsQuiescentHandlerId;
     QDBusConnection m_connection;
 
+    // persona stores by source id, updated by the backend signals
+    QHash<QString, FolksPersonaStore*> m_personaStores;
+    QList<QPair<FolksBackend*, gulong> > m_backendHandlers;
+    FolksBackendStore *m_backendStore;
+    gulong m_backendAvailableId;
+    bool m_personaStoresLoaded;
+
     // Update command
-    QMutex m_updateLock;
-    QDBusMessage m_updateCommandReplyMessage;
-    QStringList m_updateCommandResult;
-    QStringList m_updatedIds;
-    QStringList m_updateCommandPendingContacts;
+    QList<UpdateContactsTask*> m_pendingUpdates;
+    QHash<int, UpdateContactsTask*> m_runningUpdates;
+    int m_maxRunningUpdates;
+    int m_nextUpdateToken;
+
+    // Create command
+    QList<CreateContactsBatch*> m_pendingCreates;
+    int m_runningCreates;
+    int m_maxRunningCreates;
 
     // Unix signals
     static int m_sigQuitFd[2];
@@ -144,6 +228,12 @@ private:
     AddressBook(const AddressBook&);
 
     void getSource(const QDBusMessage &message, bool onlyTheDefault);
+    void setSourcesCache(const SourceList &sources);
+    void clearSourcesCache();
+    // empty if the address book is not ready, thread safe
+    ContactsSnapshot contactsSnapshot() const;
+    // false if the query was already answered
+    bool takeQuery(View *view);
 
     void setupUnixSignals();
 
@@ -151,23 +241,33 @@ private:
     void prepareUnixSignals();
     static void quitSignalHandler(int unused);
 
-    bool processUpdates();
+    void reapView(View *view, Metrics::Counter reason);
+    void updateContactsTaskDone(UpdateContactsTask *task, const QString &error, bool changed);
+    bool isUpdating(const QString &contactId) const;
+    void cancelUpdates(const QString &error);
+    void startCreateContacts(CreateContactsBatch *batch, const QStringList &contacts);
+    void createContactsItemDone(CreateContactsBatch *batch);
+    void createContactsFinish(CreateContactsBatch *batch);
     void prepareFolks();
     void unprepareEds();
     void connectWithEDS();
     void continueShutdown();
     void setIsReady(bool isReady);
+    QHash<QString, qint64> journalSnapshot() const;
     bool registerObject(QDBusConnection &connection);
     QString removeContact(FolksIndividual *individual, bool *visible);
+    void removeContacts(const QStringList &contactIds, bool softRemoval, const QDBusMessage &message);
     QString addContact(FolksIndividual *individual, bool visible);
     FolksPersonaStore *getFolksStore(const QString &source);
+    void updatePersonaStores();
+    void connectBackend(FolksBackend *backend);
 
     static void availableSourcesDoneListAllSources(FolksBackendStore *backendStore,
                                                    GAsyncResult *res,
-                                                   QDBusMessage *msg);
+                                                   void *data);
     static void availableSourcesDoneListDefaultSource(FolksBackendStore *backendStore,
                                                       GAsyncResult *res,
-                                                      QDBusMessage *msg);
+                                                      void *data);
     static SourceList availableSourcesDoneImpl(FolksBackendStore *backendStore,
                                                GAsyncResult *res);
     static void individualsChangedCb(FolksIndividualAggregator *individualAggregator,
@@ -182,15 +282,39 @@ private:
     static void createContactDone(FolksIndividualAggregator *individualAggregator,
                                   GAsyncResult *res,
                                   void *data);
+    static void createContactsTaskDone(FolksIndividualAggregator *individualAggregator,
+                                       GAsyncResult *res,
+                                       void *data);
+    static void createContactsSourceConnected(EBookClient *client,
+                                              const QString &errorMessage,
+                                              void *data);
+    static void createContactsSourceDone(GObject *source,
+                                         GAsyncResult *res,
+                                         void *data);
     static void removeContactDone(FolksIndividualAggregator *individualAggregator,
                                   GAsyncResult *result,
                                   void *data);
+    static void removeContactsSourceConnected(EBookClient *client,
+                                              const QString &errorMessage,
+                                              void *data);
+    static void removeContactsSourceDone(GObject *source,
+                                         GAsyncResult *res,
+                                         void *data);
     static void createSourceDone(GObject *source,
                                  GAsyncResult *res,
                                  void *data);
     static void removeSourceDone(GObject *source,
                                  GAsyncResult *res,
                                  void *data);
+    static void backendAvailable(FolksBackendStore *backendStore,
+                                 FolksBackend *backend,
+                                 AddressBook *self);
+    static void personaStoreAdded(FolksBackend *backend,
+                                  FolksPersonaStore *store,
+                                  AddressBook *self);
+    static void personaStoreRemoved(FolksBackend *backend,
+                                    FolksPersonaStore *store,
+                                    AddressBook *self);
     static void folksUnprepared(GObject *source,
                                GAsyncResult *res,
                                void *data);
@@ -212,9 +336,6 @@ private:
     static void updateSourceEDSDone(GObject *source,
                                     GAsyncResult *res,
                                     void *data);
-    static void sourceEDSChanged(ESourceRegistry *registry,
-                                 ESource *source,
-                                 AddressBook *self);
 
     friend class DirtyContactsNotify;
 };
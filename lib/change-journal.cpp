@@ -0,0 +1,278 @@
+/*
+ * Copyright 2013 Canonical Ltd.
+ *
+ * This file is part of contact-service-app.
+ *
+ * contact-service-app is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * contact-service-app is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "change-journal.h"
+
+#include <QtCore/QDataStream>
+#include <QtCore/QDateTime>
+#include <QtCore/QDebug>
+#include <QtCore/QFile>
+#include <QtCore/QHash>
+
+#define JOURNAL_FILE_MAGIC      0x4a524e4c
+#define JOURNAL_FILE_VERSION    2
+
+namespace galera
+{
+
+ChangeJournal::ChangeJournal(int capacity)
+    : m_entries(qMax(1, capacity)),
+      m_start(0),
+      m_size(0),
+      m_hasSnapshot(false),
+      m_needsReconcile(false)
+{
+    // the sequence starts from the current time to avoid reuse the tokens of a previous run
+    m_sequence = quint64(QDateTime::currentMSecsSinceEpoch()) * 1000;
+    m_validSince = m_sequence;
+}
+
+int ChangeJournal::capacity() const
+{
+    return m_entries.size();
+}
+
+int ChangeJournal::size() const
+{
+    return m_size;
+}
+
+quint64 ChangeJournal::currentToken() const
+{
+    return m_sequence;
+}
+
+quint64 ChangeJournal::oldestValidToken() const
+{
+    // all changes after the oldest valid token are in the buffer
+    return qMax(m_validSince, m_sequence - m_size);
+}
+
+void ChangeJournal::append(ChangeType type, const QSet<QString> &ids)
+{
+    Q_FOREACH(const QString &id, ids) {
+        int index = (m_start + m_size) % m_entries.size();
+        if (m_size == m_entries.size()) {
+            // overwrite the oldest change
+            m_start = (m_start + 1) % m_entries.size();
+        } else {
+            m_size++;
+        }
+        m_entries[index].m_type = type;
+        m_entries[index].m_contactId = id;
+        m_sequence++;
+    }
+}
+
+bool ChangeJournal::changesSince(quint64 token,
+                                 QStringList *added,
+                                 QStringList *changed,
+                                 QStringList *removed) const
+{
+    // the changes made while the service was not running are not known yet
+    if (m_needsReconcile ||
+        (token < oldestValidToken()) || (token > m_sequence)) {
+        return false;
+    }
+
+    // the changes are contiguous, the first change after the token is found by its offset
+    int first = m_size - int(m_sequence - token);
+    QHash<QString, ChangeType> result;
+    QStringList order;
+    QSet<QString> listed;
+    for(int i = first; i < m_size; i++) {
+        const Entry &entry = m_entries[(m_start + i) % m_entries.size()];
+        if (!result.contains(entry.m_contactId)) {
+            result.insert(entry.m_contactId, entry.m_type);
+            // a contact added, removed and added again is listed once
+            if (!listed.contains(entry.m_contactId)) {
+                listed.insert(entry.m_contactId);
+                order << entry.m_contactId;
+            }
+            continue;
+        }
+
+        ChangeType previous = result.value(entry.m_contactId);
+        switch (entry.m_type) {
+        case ContactAdded:
+            // the client knew the contact before it was removed
+            result.insert(entry.m_contactId, previous == ContactRemoved ? ContactChanged : ContactAdded);
+            break;
+        case ContactChanged:
+            if (previous != ContactAdded) {
+                result.insert(entry.m_contactId, ContactChanged);
+            }
+            break;
+        case ContactRemoved:
+            if (previous == ContactAdded) {
+                // the client never saw this contact
+                result.remove(entry.m_contactId);
+            } else {
+                result.insert(entry.m_contactId, ContactRemoved);
+            }
+            break;
+        }
+    }
+
+    Q_FOREACH(const QString &id, order) {
+        if (!result.contains(id)) {
+            continue;
+        }
+        switch (result.value(id)) {
+        case ContactAdded:
+            *added << id;
+            break;
+        case ContactChanged:
+            *changed << id;
+            break;
+        case ContactRemoved:
+            *removed << id;
+            break;
+        }
+    }
+    return true;
+}
+
+void ChangeJournal::reset()
+{
+    m_start = 0;
+    m_size = 0;
+    m_validSince = m_sequence;
+    m_snapshot.clear();
+    m_hasSnapshot = false;
+    m_needsReconcile = false;
+}
+
+void ChangeJournal::setSnapshot(const QHash<QString, qint64> &contacts)
+{
+    m_snapshot = contacts;
+    m_hasSnapshot = true;
+}
+
+bool ChangeJournal::needsReconcile() const
+{
+    return m_needsReconcile;
+}
+
+void ChangeJournal::reconcile(const QHash<QString, qint64> &contacts)
+{
+    if (!m_needsReconcile) {
+        return;
+    }
+
+    QSet<QString> added;
+    QSet<QString> changed;
+    QSet<QString> removed;
+    QHash<QString, qint64>::const_iterator i;
+    for(i = contacts.constBegin(); i != contacts.constEnd(); ++i) {
+        QHash<QString, qint64>::const_iterator previous = m_snapshot.constFind(i.key());
+        if (previous == m_snapshot.constEnd()) {
+            added << i.key();
+        } else if (previous.value() != i.value()) {
+            changed << i.key();
+        }
+    }
+    for(i = m_snapshot.constBegin(); i != m_snapshot.constEnd(); ++i) {
+        if (!contacts.contains(i.key())) {
+            removed << i.key();
+        }
+    }
+
+    append(ContactRemoved, removed);
+    append(ContactChanged, changed);
+    append(ContactAdded, added);
+    m_snapshot.clear();
+    m_hasSnapshot = false;
+    m_needsReconcile = false;
+}
+
+bool ChangeJournal::load(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QFile::ReadOnly)) {
+        return false;
+    }
+
+    QDataStream stream(&file);
+    quint32 magic;
+    qint32 version;
+    quint64 sequence;
+    quint64 validSince;
+    qint32 size;
+    stream >> magic >> version >> sequence >> validSince >> size;
+    if ((magic != JOURNAL_FILE_MAGIC) || (version != JOURNAL_FILE_VERSION) || (size < 0)) {
+        qWarning() << "Invalid change journal file" << fileName;
+        return false;
+    }
+
+    reset();
+    // keep only the newest changes if the journal is smaller than the saved one
+    int skip = qMax(0, size - m_entries.size());
+    for(int i = 0; i < size; i++) {
+        qint32 type;
+        QString contactId;
+        stream >> type >> contactId;
+        if (i >= skip) {
+            m_entries[m_size].m_type = ChangeType(type);
+            m_entries[m_size].m_contactId = contactId;
+            m_size++;
+        }
+    }
+
+    bool hasSnapshot;
+    QHash<QString, qint64> snapshot;
+    stream >> hasSnapshot >> snapshot;
+    if (stream.status() != QDataStream::Ok) {
+        qWarning() << "Fail to read the change journal file" << fileName;
+        reset();
+        return false;
+    }
+
+    m_sequence = sequence;
+    if (hasSnapshot) {
+        m_validSince = validSince;
+        m_snapshot = snapshot;
+        m_hasSnapshot = true;
+        m_needsReconcile = true;
+    } else {
+        // without the contacts of the previous run the changes made since then are unknown
+        m_validSince = m_sequence;
+    }
+    return true;
+}
+
+bool ChangeJournal::save(const QString &fileName) const
+{
+    QFile file(fileName);
+    if (!file.open(QFile::WriteOnly | QFile::Truncate)) {
+        qWarning() << "Fail to save the change journal" << fileName << file.errorString();
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream << quint32(JOURNAL_FILE_MAGIC) << qint32(JOURNAL_FILE_VERSION)
+           << m_sequence << m_validSince << qint32(m_size);
+    for(int i = 0; i < m_size; i++) {
+        const Entry &entry = m_entries[(m_start + i) % m_entries.size()];
+        stream << qint32(entry.m_type) << entry.m_contactId;
+    }
+    stream << m_hasSnapshot << m_snapshot;
+    return (stream.status() == QDataStream::Ok);
+}
+
+} //namespace
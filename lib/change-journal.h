@@ -0,0 +1,94 @@
+/*
+ * Copyright 2013 Canonical Ltd.
+ *
+ * This file is part of contact-service-app.
+ *
+ * contact-service-app is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * contact-service-app is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GALERA_CHANGE_JOURNAL_H__
+#define __GALERA_CHANGE_JOURNAL_H__
+
+#include <QtCore/QHash>
+#include <QtCore/QSet>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtCore/QVector>
+
+namespace galera
+{
+
+/*
+ * In-memory ring buffer of contact changes, each change receives a sequence number that
+ * can be used by the clients as a token to retrieve the changes that happened after it.
+ * When the token is older than the oldest change in the buffer (or older than the last reset)
+ * the changes are not complete and the client needs to do a full sync.
+ *
+ * The journal saved at shutdown keeps a snapshot of the contacts (id and last modification
+ * time). A loaded journal is only used after 'reconcile' appends the differences between that
+ * snapshot and the contacts loaded, which were changed while the service was not running.
+ */
+class ChangeJournal
+{
+public:
+    enum ChangeType {
+        ContactAdded = 0,
+        ContactChanged,
+        ContactRemoved
+    };
+
+    ChangeJournal(int capacity);
+
+    int capacity() const;
+    int size() const;
+    quint64 currentToken() const;
+    quint64 oldestValidToken() const;
+
+    void append(ChangeType type, const QSet<QString> &ids);
+    bool changesSince(quint64 token,
+                      QStringList *added,
+                      QStringList *changed,
+                      QStringList *removed) const;
+    void reset();
+
+    void setSnapshot(const QHash<QString, qint64> &contacts);
+    bool needsReconcile() const;
+    void reconcile(const QHash<QString, qint64> &contacts);
+
+    bool load(const QString &fileName);
+    bool save(const QString &fileName) const;
+
+private:
+    class Entry
+    {
+    public:
+        ChangeType m_type;
+        QString m_contactId;
+    };
+
+    QVector<Entry> m_entries;
+    // position of the oldest change and number of changes in the buffer
+    int m_start;
+    int m_size;
+    // sequence of the last change
+    quint64 m_sequence;
+    // changes before this sequence are unknown
+    quint64 m_validSince;
+    QHash<QString, qint64> m_snapshot;
+    bool m_hasSnapshot;
+    bool m_needsReconcile;
+};
+
+} //namespace
+
+#endif
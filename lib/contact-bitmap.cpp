@@ -0,0 +1,362 @@
+/*
+ * Copyright 2013 Canonical Ltd.
+ *
+ * This file is part of contact-service-app.
+ *
+ * contact-service-app is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * contact-service-app is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "contact-bitmap.h"
+
+#include <QtCore/QtAlgorithms>
+
+#include <algorithm>
+#include <iterator>
+
+// containers with more values than this are stored as bitsets
+#define BITMAP_ARRAY_MAX_SIZE   4096
+#define BITMAP_CONTAINER_WORDS  1024
+
+namespace galera
+{
+
+ContactBitmap::Container::Container()
+    : m_count(0)
+{
+}
+
+bool ContactBitmap::Container::isBitset() const
+{
+    return !m_words.isEmpty();
+}
+
+void ContactBitmap::Container::insert(quint16 value)
+{
+    if (isBitset()) {
+        quint64 mask = Q_UINT64_C(1) << (value & 63);
+        quint64 &word = m_words[value >> 6];
+        if (!(word & mask)) {
+            word |= mask;
+            m_count++;
+        }
+        return;
+    }
+
+    QVector<quint16>::iterator it = std::lower_bound(m_values.begin(), m_values.end(), value);
+    if ((it == m_values.end()) || (*it != value)) {
+        m_values.insert(it, value);
+        m_count++;
+        if (m_count > BITMAP_ARRAY_MAX_SIZE) {
+            setWords(words());
+        }
+    }
+}
+
+void ContactBitmap::Container::remove(quint16 value)
+{
+    if (isBitset()) {
+        quint64 mask = Q_UINT64_C(1) << (value & 63);
+        quint64 &word = m_words[value >> 6];
+        if (word & mask) {
+            word &= ~mask;
+            m_count--;
+            if (m_count <= BITMAP_ARRAY_MAX_SIZE) {
+                setWords(m_words);
+            }
+        }
+        return;
+    }
+
+    QVector<quint16>::iterator it = std::lower_bound(m_values.begin(), m_values.end(), value);
+    if ((it != m_values.end()) && (*it == value)) {
+        m_values.erase(it);
+        m_count--;
+    }
+}
+
+bool ContactBitmap::Container::contains(quint16 value) const
+{
+    if (isBitset()) {
+        return (m_words[value >> 6] & (Q_UINT64_C(1) << (value & 63)));
+    }
+    return std::binary_search(m_values.constBegin(), m_values.constEnd(), value);
+}
+
+QVector<quint64> ContactBitmap::Container::words() const
+{
+    if (isBitset()) {
+        return m_words;
+    }
+
+    QVector<quint64> result(BITMAP_CONTAINER_WORDS, 0);
+    Q_FOREACH(quint16 value, m_values) {
+        result[value >> 6] |= (Q_UINT64_C(1) << (value & 63));
+    }
+    return result;
+}
+
+// store the words choosing the smallest representation
+void ContactBitmap::Container::setWords(const QVector<quint64> &words)
+{
+    int count = 0;
+    Q_FOREACH(quint64 word, words) {
+        count += qPopulationCount(word);
+    }
+
+    m_count = count;
+    if (count > BITMAP_ARRAY_MAX_SIZE) {
+        m_words = words;
+        m_values.clear();
+        return;
+    }
+
+    QVector<quint16> values;
+    values.reserve(count);
+    for(int i = 0; i < words.size(); i++) {
+        quint64 word = words[i];
+        while (word) {
+            values << quint16((i << 6) + qCountTrailingZeroBits(word));
+            word &= (word - 1);
+        }
+    }
+    m_values = values;
+    m_words.clear();
+}
+
+ContactBitmap::ContactBitmap()
+{
+}
+
+void ContactBitmap::insert(int slot)
+{
+    Q_ASSERT(slot >= 0);
+    m_containers[quint16(slot >> 16)].insert(quint16(slot & 0xFFFF));
+}
+
+void ContactBitmap::remove(int slot)
+{
+    QMap<quint16, Container>::iterator it = m_containers.find(quint16(slot >> 16));
+    if (it != m_containers.end()) {
+        it.value().remove(quint16(slot & 0xFFFF));
+        if (it.value().m_count == 0) {
+            m_containers.erase(it);
+        }
+    }
+}
+
+void ContactBitmap::setValue(int slot, bool value)
+{
+    if (value) {
+        insert(slot);
+    } else {
+        remove(slot);
+    }
+}
+
+bool ContactBitmap::contains(int slot) const
+{
+    QMap<quint16, Container>::const_iterator it = m_containers.constFind(quint16(slot >> 16));
+    if (it != m_containers.constEnd()) {
+        return it.value().contains(quint16(slot & 0xFFFF));
+    }
+    return false;
+}
+
+int ContactBitmap::count() const
+{
+    int result = 0;
+    Q_FOREACH(const Container &c, m_containers) {
+        result += c.m_count;
+    }
+    return result;
+}
+
+bool ContactBitmap::isEmpty() const
+{
+    return m_containers.isEmpty();
+}
+
+void ContactBitmap::clear()
+{
+    m_containers.clear();
+}
+
+QList<int> ContactBitmap::toList() const
+{
+    QList<int> result;
+    result.reserve(count());
+
+    QMap<quint16, Container>::const_iterator it = m_containers.constBegin();
+    for(; it != m_containers.constEnd(); it++) {
+        int base = int(it.key()) << 16;
+        const Container &c = it.value();
+        if (c.isBitset()) {
+            for(int i = 0; i < c.m_words.size(); i++) {
+                quint64 word = c.m_words[i];
+                while (word) {
+                    result << (base + (i << 6) + int(qCountTrailingZeroBits(word)));
+                    word &= (word - 1);
+                }
+            }
+        } else {
+            Q_FOREACH(quint16 value, c.m_values) {
+                result << (base + value);
+            }
+        }
+    }
+    return result;
+}
+
+ContactBitmap ContactBitmap::operator&(const ContactBitmap &other) const
+{
+    ContactBitmap result;
+    QMap<quint16, Container>::const_iterator it = m_containers.constBegin();
+    for(; it != m_containers.constEnd(); it++) {
+        QMap<quint16, Container>::const_iterator otherIt = other.m_containers.constFind(it.key());
+        if (otherIt != other.m_containers.constEnd()) {
+            Container c = combine(it.value(), otherIt.value(), And);
+            if (c.m_count > 0) {
+                result.m_containers.insert(it.key(), c);
+            }
+        }
+    }
+    return result;
+}
+
+ContactBitmap ContactBitmap::operator|(const ContactBitmap &other) const
+{
+    ContactBitmap result(*this);
+    QMap<quint16, Container>::const_iterator it = other.m_containers.constBegin();
+    for(; it != other.m_containers.constEnd(); it++) {
+        QMap<quint16, Container>::iterator resultIt = result.m_containers.find(it.key());
+        if (resultIt != result.m_containers.end()) {
+            resultIt.value() = combine(resultIt.value(), it.value(), Or);
+        } else {
+            result.m_containers.insert(it.key(), it.value());
+        }
+    }
+    return result;
+}
+
+ContactBitmap ContactBitmap::operator-(const ContactBitmap &other) const
+{
+    ContactBitmap result;
+    QMap<quint16, Container>::const_iterator it = m_containers.constBegin();
+    for(; it != m_containers.constEnd(); it++) {
+        QMap<quint16, Container>::const_iterator otherIt = other.m_containers.constFind(it.key());
+        if (otherIt == other.m_containers.constEnd()) {
+            result.m_containers.insert(it.key(), it.value());
+        } else {
+            Container c = combine(it.value(), otherIt.value(), AndNot);
+            if (c.m_count > 0) {
+                result.m_containers.insert(it.key(), c);
+            }
+        }
+    }
+    return result;
+}
+
+ContactBitmap &ContactBitmap::operator&=(const ContactBitmap &other)
+{
+    *this = *this & other;
+    return *this;
+}
+
+ContactBitmap &ContactBitmap::operator|=(const ContactBitmap &other)
+{
+    *this = *this | other;
+    return *this;
+}
+
+ContactBitmap &ContactBitmap::operator-=(const ContactBitmap &other)
+{
+    *this = *this - other;
+    return *this;
+}
+
+ContactBitmap ContactBitmap::range(int size)
+{
+    ContactBitmap result;
+    for(int base = 0; base < size; base += 0x10000) {
+        int chunkSize = qMin(size - base, 0x10000);
+        QVector<quint64> words(BITMAP_CONTAINER_WORDS, 0);
+        int fullWords = chunkSize >> 6;
+        for(int i = 0; i < fullWords; i++) {
+            words[i] = ~Q_UINT64_C(0);
+        }
+        if (chunkSize & 63) {
+            words[fullWords] = (Q_UINT64_C(1) << (chunkSize & 63)) - 1;
+        }
+
+        Container c;
+        c.setWords(words);
+        result.m_containers.insert(quint16(base >> 16), c);
+    }
+    return result;
+}
+
+ContactBitmap::Container ContactBitmap::combine(const Container &a, const Container &b, Operation op)
+{
+    Container result;
+    if (!a.isBitset() && !b.isBitset()) {
+        QVector<quint16> values;
+        switch (op) {
+        case And:
+            std::set_intersection(a.m_values.constBegin(), a.m_values.constEnd(),
+                                  b.m_values.constBegin(), b.m_values.constEnd(),
+                                  std::back_inserter(values));
+            break;
+        case Or:
+            std::set_union(a.m_values.constBegin(), a.m_values.constEnd(),
+                           b.m_values.constBegin(), b.m_values.constEnd(),
+                           std::back_inserter(values));
+            break;
+        case AndNot:
+            std::set_difference(a.m_values.constBegin(), a.m_values.constEnd(),
+                                b.m_values.constBegin(), b.m_values.constEnd(),
+                                std::back_inserter(values));
+            break;
+        }
+
+        if (values.size() > BITMAP_ARRAY_MAX_SIZE) {
+            Container tmp;
+            tmp.m_values = values;
+            tmp.m_count = values.size();
+            result.setWords(tmp.words());
+        } else {
+            result.m_values = values;
+            result.m_count = values.size();
+        }
+        return result;
+    }
+
+    QVector<quint64> wordsA = a.words();
+    QVector<quint64> wordsB = b.words();
+    for(int i = 0; i < BITMAP_CONTAINER_WORDS; i++) {
+        switch (op) {
+        case And:
+            wordsA[i] &= wordsB[i];
+            break;
+        case Or:
+            wordsA[i] |= wordsB[i];
+            break;
+        case AndNot:
+            wordsA[i] &= ~wordsB[i];
+            break;
+        }
+    }
+    result.setWords(wordsA);
+    return result;
+}
+
+} //namespace
@@ -0,0 +1,88 @@
+/*
+ * Copyright 2013 Canonical Ltd.
+ *
+ * This file is part of contact-service-app.
+ *
+ * contact-service-app is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * contact-service-app is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GALERA_CONTACT_BITMAP_H__
+#define __GALERA_CONTACT_BITMAP_H__
+
+#include <QtCore/QList>
+#include <QtCore/QMap>
+#include <QtCore/QVector>
+
+namespace galera
+{
+
+/*
+ * Compressed set of contact slots. Slots are split in chunks of 65536 values, a chunk
+ * is stored as a sorted array while it is sparse and as a plain bitset when it is dense.
+ */
+class ContactBitmap
+{
+public:
+    ContactBitmap();
+
+    void insert(int slot);
+    void remove(int slot);
+    void setValue(int slot, bool value);
+    bool contains(int slot) const;
+    int count() const;
+    bool isEmpty() const;
+    void clear();
+    QList<int> toList() const;
+
+    ContactBitmap operator&(const ContactBitmap &other) const;
+    ContactBitmap operator|(const ContactBitmap &other) const;
+    ContactBitmap operator-(const ContactBitmap &other) const;
+    ContactBitmap &operator&=(const ContactBitmap &other);
+    ContactBitmap &operator|=(const ContactBitmap &other);
+    ContactBitmap &operator-=(const ContactBitmap &other);
+
+    // all slots from 0 to size - 1
+    static ContactBitmap range(int size);
+
+private:
+    class Container
+    {
+    public:
+        // used while the container is sparse
+        QVector<quint16> m_values;
+        // used when the container is dense
+        QVector<quint64> m_words;
+        int m_count;
+
+        Container();
+        bool isBitset() const;
+        void insert(quint16 value);
+        void remove(quint16 value);
+        bool contains(quint16 value) const;
+        QVector<quint64> words() const;
+        void setWords(const QVector<quint64> &words);
+    };
+
+    enum Operation {
+        And = 0,
+        Or,
+        AndNot
+    };
+
+    QMap<quint16, Container> m_containers;
+
+    static Container combine(const Container &a, const Container &b, Operation op);
+};
+
+} //namespace
+#endif
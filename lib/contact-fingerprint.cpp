@@ -0,0 +1,218 @@
+/*
+ * Copyright 2013 Canonical Ltd.
+ *
+ * This file is part of contact-service-app.
+ *
+ * contact-service-app is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * contact-service-app is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "contact-fingerprint.h"
+
+#include <QtCore/QDateTime>
+#include <QtCore/QSequentialIterable>
+#include <QtCore/QUrl>
+
+#include <QtContacts/QContactFavorite>
+
+using namespace QtContacts;
+
+namespace
+{
+
+// 64 bits FNV-1a, makes collisions between two versions of the same contact very unlikely
+const quint64 FNV_OFFSET_BASIS = Q_UINT64_C(14695981039346656037);
+const quint64 FNV_PRIME = Q_UINT64_C(1099511628211);
+
+void hashBytes(quint64 *hash, const char *data, int size)
+{
+    for(int i = 0; i < size; i++) {
+        *hash ^= static_cast<uchar>(data[i]);
+        *hash *= FNV_PRIME;
+    }
+}
+
+void hashInt(quint64 *hash, qint64 value)
+{
+    hashBytes(hash, reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void hashString(quint64 *hash, const QString &value)
+{
+    hashInt(hash, value.size());
+    hashBytes(hash, reinterpret_cast<const char*>(value.constData()), value.size() * sizeof(QChar));
+}
+
+void hashVariant(quint64 *hash, const QVariant &value)
+{
+    hashInt(hash, value.userType());
+    switch(value.userType()) {
+    case QMetaType::UnknownType:
+        break;
+    case QMetaType::Bool:
+    case QMetaType::Int:
+    case QMetaType::UInt:
+    case QMetaType::LongLong:
+    case QMetaType::ULongLong:
+        hashInt(hash, value.toLongLong());
+        break;
+    case QMetaType::QString:
+        hashString(hash, value.toString());
+        break;
+    case QMetaType::QByteArray:
+    {
+        QByteArray data = value.toByteArray();
+        hashInt(hash, data.size());
+        hashBytes(hash, data.constData(), data.size());
+        break;
+    }
+    case QMetaType::QDate:
+        hashInt(hash, value.toDate().toJulianDay());
+        break;
+    case QMetaType::QDateTime:
+        hashInt(hash, value.toDateTime().toMSecsSinceEpoch());
+        break;
+    case QMetaType::QUrl:
+        hashString(hash, value.toUrl().toString());
+        break;
+    default:
+        if (value.canConvert<QVariantList>()) {
+            // QStringList, QVariantList and the list of contexts/subtypes
+            QSequentialIterable list = value.value<QSequentialIterable>();
+            hashInt(hash, list.size());
+            Q_FOREACH(const QVariant &item, list) {
+                hashVariant(hash, item);
+            }
+        } else {
+            hashString(hash, value.toString());
+        }
+        break;
+    }
+}
+
+// final avalanche of the 64 bits hash (MurmurHash3 fmix64)
+quint64 mix(quint64 hash)
+{
+    hash ^= hash >> 33;
+    hash *= Q_UINT64_C(0xff51afd7ed558ccd);
+    hash ^= hash >> 33;
+    hash *= Q_UINT64_C(0xc4ceb9fe1a85ec53);
+    hash ^= hash >> 33;
+    return hash;
+}
+
+int personaFromDetailUri(const QString &detailUri)
+{
+    // detail uri format: <persona index>.<detail index>
+    if (detailUri.isEmpty()) {
+        return 0;
+    }
+    return detailUri.left(detailUri.indexOf('.')).toInt();
+}
+
+} //namespace
+
+namespace galera
+{
+
+ContactFingerprint::ContactFingerprint()
+    : m_isNull(true),
+      m_contactHash(0)
+{
+}
+
+ContactFingerprint::ContactFingerprint(const QContact &contact)
+    : m_isNull(false),
+      m_contactHash(FNV_OFFSET_BASIS)
+{
+    hashString(&m_contactHash, contact.id().toString());
+
+    // the position of each detail is part of the hash, moving a value from a detail to
+    // another one of the same type changes the result
+    QHash<QPair<int, int>, int> groupSizes;
+    QList<QContactDetail> details = contact.details();
+    for(int i = 0; i < details.size(); i++) {
+        const QContactDetail &detail = details[i];
+        hashInt(&m_contactHash, i);
+        hashInt(&m_contactHash, detailHash(detail, false));
+
+        if (!detail.isEmpty()) {
+            QPair<int, int> key(detail.type(), personaFromDetailUri(detail.detailUri()));
+            int index = groupSizes.value(key, 0);
+            groupSizes.insert(key, index + 1);
+
+            QHash<QPair<int, int>, quint64>::iterator group = m_groupHashes.find(key);
+            if (group == m_groupHashes.end()) {
+                group = m_groupHashes.insert(key, FNV_OFFSET_BASIS);
+            }
+            hashInt(&group.value(), index);
+            hashInt(&group.value(), detailHash(detail, true));
+        }
+    }
+
+    m_contactHash = mix(m_contactHash);
+    QHash<QPair<int, int>, quint64>::iterator group = m_groupHashes.begin();
+    for(; group != m_groupHashes.end(); group++) {
+        group.value() = mix(group.value());
+    }
+}
+
+bool ContactFingerprint::isNull() const
+{
+    return m_isNull;
+}
+
+quint64 ContactFingerprint::contactHash() const
+{
+    return m_contactHash;
+}
+
+quint64 ContactFingerprint::groupHash(QContactDetail::DetailType type,
+                                      int persona,
+                                      bool includeEmptyPersona) const
+{
+    quint64 hash = m_groupHashes.value(qMakePair(static_cast<int>(type), persona), 0);
+    if (includeEmptyPersona && (persona != 0)) {
+        quint64 emptyPersona = m_groupHashes.value(qMakePair(static_cast<int>(type), 0), 0);
+        if (emptyPersona != 0) {
+            // the details without persona follow the ones of the persona
+            hashInt(&hash, emptyPersona);
+            hash = mix(hash);
+        }
+    }
+    return hash;
+}
+
+quint64 ContactFingerprint::detailHash(const QContactDetail &detail, bool contentOnly)
+{
+    quint64 hash = FNV_OFFSET_BASIS;
+    hashInt(&hash, detail.type());
+
+    // favorite is compared by the flag only (see UpdateContactRequest::isEqual)
+    if (contentOnly && (detail.type() == QContactDetail::TypeFavorite)) {
+        hashInt(&hash, detail.value(QContactFavorite::FieldFavorite).toBool());
+        return hash;
+    }
+
+    QMap<int, QVariant> values = detail.values();
+    QMap<int, QVariant>::const_iterator i = values.constBegin();
+    for(; i != values.constEnd(); i++) {
+        if (contentOnly && (i.key() == QContactDetail::FieldDetailUri)) {
+            continue;
+        }
+        hashInt(&hash, i.key());
+        hashVariant(&hash, i.value());
+    }
+    return hash;
+}
+
+} //namespace
@@ -0,0 +1,63 @@
+/*
+ * Copyright 2013 Canonical Ltd.
+ *
+ * This file is part of contact-service-app.
+ *
+ * contact-service-app is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * contact-service-app is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GALERA_CONTACT_FINGERPRINT_H__
+#define __GALERA_CONTACT_FINGERPRINT_H__
+
+#include <QtCore/QHash>
+#include <QtCore/QPair>
+
+#include <QtContacts/QContact>
+#include <QtContacts/QContactDetail>
+
+namespace galera
+{
+
+/*
+ * Content hashes of a contact and of its detail groups (all details of the same type
+ * that belong to the same persona). The hashes are computed once and used to check
+ * if a contact or a detail group changed without compare the details one by one.
+ *
+ * The detail uris are part of the contact hash, the group hashes only take into account
+ * the detail values. Both depend on the detail order, a different order is only a false
+ * change and the details are compared one by one.
+ */
+class ContactFingerprint
+{
+public:
+    ContactFingerprint();
+    explicit ContactFingerprint(const QtContacts::QContact &contact);
+
+    bool isNull() const;
+    quint64 contactHash() const;
+    // details without persona are part of the group if 'includeEmptyPersona' is true
+    quint64 groupHash(QtContacts::QContactDetail::DetailType type,
+                      int persona,
+                      bool includeEmptyPersona = false) const;
+
+    static quint64 detailHash(const QtContacts::QContactDetail &detail, bool contentOnly);
+
+private:
+    bool m_isNull;
+    quint64 m_contactHash;
+    QHash<QPair<int, int>, quint64> m_groupHashes;
+};
+
+} //namespace
+
+#endif
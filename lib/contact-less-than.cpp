@@ -21,7 +21,6 @@
 
 #include "contact-less-than.h"
 #include "contacts-map.h"
-#include "qindividual.h"
 
 #include <QtCore/QTime>
 #include <QtCore/QDebug>
@@ -45,16 +44,16 @@ bool ContactLessThan::operator()(const QtContacts::QContact &contactA, const QtC
     return (r <= 0);
 }
 
-ContactEntryLessThan::ContactEntryLessThan(const SortClause &sortClause)
+ContactRecordLessThan::ContactRecordLessThan(const SortClause &sortClause)
     : m_sortClause(sortClause)
 {
 
 }
 
-bool ContactEntryLessThan::operator()(ContactEntry *entryA, ContactEntry *entryB)
+bool ContactRecordLessThan::operator()(const ContactRecord *recordA, const ContactRecord *recordB)
 {
-    int r = QContactManagerEngine::compareContact(entryA->individual()->contact(),
-                                                  entryB->individual()->contact(),
+    int r = QContactManagerEngine::compareContact(recordA->m_contact,
+                                                  recordB->m_contact,
                                                   m_sortClause.toContactSortOrder());
     return (r <= 0);
 }
@@ -28,7 +28,7 @@
 
 namespace galera {
 
-class ContactEntry;
+class ContactRecord;
 
 class ContactLessThan
 {
@@ -41,12 +41,12 @@ private:
     SortClause m_sortClause;
 };
 
-class ContactEntryLessThan
+class ContactRecordLessThan
 {
 public:
-    ContactEntryLessThan(const SortClause &sortClause);
+    ContactRecordLessThan(const SortClause &sortClause);
 
-    bool operator()(ContactEntry *entryA, ContactEntry *entryB);
+    bool operator()(const ContactRecord *recordA, const ContactRecord *recordB);
 
 private:
     SortClause m_sortClause;
@@ -26,6 +26,8 @@
 #include <QtContacts/QContactDisplayLabel>
 #include <QtContacts/QContactTag>
 #include <QtContacts/QContactPhoneNumber>
+#include <QtContacts/QContactTimestamp>
+#include <QtContacts/QContactFavorite>
 
 #include <phonenumbers/phonenumberutil.h>
 #include <phonenumbers/region_code.h>
@@ -35,9 +37,268 @@ using namespace QtContacts;
 namespace galera
 {
 
+class ContactsMapData : public QSharedData
+{
+public:
+    // records by slot, a free slot has an empty record
+    QVector<ContactRecord> m_records;
+    QHash<QString, int> m_idToSlot;
+    QMultiMap<QString, int> m_phoneToSlot;
+    // deleted contacts ordered by deletion time for each source
+    QHash<QString, QMultiMap<QDateTime, int> > m_tombstones;
+    // contacts ordered by created and last modified time
+    QMultiMap<QDateTime, int> m_createdToSlot;
+    QMultiMap<QDateTime, int> m_modifiedToSlot;
+    // attribute bitmaps
+    ContactBitmap m_allSlots;
+    ContactBitmap m_favorites;
+    ContactBitmap m_withPhoneNumber;
+    ContactBitmap m_withEmailAddress;
+    ContactBitmap m_visible;
+    ContactBitmap m_deleted;
+    // contacts that have a persona on each source
+    QHash<QString, ContactBitmap> m_sourceToSlots;
+    // sorted contacts
+    QList<int> m_sorted;
+    SortClause m_sortClause;
+
+    QList<int> slotsByPhone(const QString &minimalPhone) const;
+    QList<int> removedSince(const QDateTime &since, const QString &sourceId) const;
+    QList<int> changedSince(const QDateTime &since, QContactChangeLogFilter::EventType eventType) const;
+    ContactBitmap evaluate(const FilterPlan &plan) const;
+    ContactBitmap sourcesBitmap(const QStringList &sources) const;
+
+    void insertIndexes(const ContactRecord &record);
+    void removeIndexes(const ContactRecord &record);
+    void insertSorted(int slot);
+    void updateSorted(int slot);
+    void sort();
+};
+
+namespace
+{
+
+class SlotLessThan
+{
+public:
+    SlotLessThan(const ContactsMapData *data)
+        : m_data(data),
+          m_lessThan(data->m_sortClause)
+    {
+    }
+
+    bool operator()(int slotA, int slotB)
+    {
+        return m_lessThan(&m_data->m_records.at(slotA), &m_data->m_records.at(slotB));
+    }
+
+private:
+    const ContactsMapData *m_data;
+    ContactRecordLessThan m_lessThan;
+};
+
+} //namespace
+
+QList<int> ContactsMapData::slotsByPhone(const QString &minimalPhone) const
+{
+    return m_phoneToSlot.values(minimalPhone);
+}
+
+// Return the deleted contacts with deletion time equal or newer than "since",
+// ordered by deletion time; if "sourceId" is empty all sources are used
+QList<int> ContactsMapData::removedSince(const QDateTime &since, const QString &sourceId) const
+{
+    QList<int> result;
+    QHash<QString, QMultiMap<QDateTime, int> >::const_iterator i = m_tombstones.constBegin();
+    for(; i != m_tombstones.constEnd(); i++) {
+        if (!sourceId.isEmpty() && (i.key() != sourceId)) {
+            continue;
+        }
+        QMultiMap<QDateTime, int>::const_iterator t = since.isValid() ?
+                    i.value().lowerBound(since) : i.value().constBegin();
+        for(; t != i.value().constEnd(); t++) {
+            result << t.value();
+        }
+    }
+    return result;
+}
+
+// Return the contacts created (EventAdded) or modified (EventChanged) at
+// "since" or later, ordered by time
+QList<int> ContactsMapData::changedSince(const QDateTime &since, QContactChangeLogFilter::EventType eventType) const
+{
+    QList<int> result;
+    const QMultiMap<QDateTime, int> &index = (eventType == QContactChangeLogFilter::EventAdded) ?
+                m_createdToSlot : m_modifiedToSlot;
+    QMultiMap<QDateTime, int>::const_iterator i = since.isValid() ?
+                index.lowerBound(since) : index.constBegin();
+    for(; i != index.constEnd(); i++) {
+        result << i.value();
+    }
+    return result;
+}
+
+ContactBitmap ContactsMapData::evaluate(const FilterPlan &plan) const
+{
+    switch (plan.type()) {
+    case FilterPlan::Favorite:
+        return m_favorites;
+    case FilterPlan::HasPhoneNumber:
+        return m_withPhoneNumber;
+    case FilterPlan::HasEmailAddress:
+        return m_withEmailAddress;
+    case FilterPlan::And:
+    {
+        QList<FilterPlan> children = plan.children();
+        ContactBitmap result = evaluate(children.first());
+        for(int i = 1; (i < children.size()) && !result.isEmpty(); i++) {
+            result &= evaluate(children.at(i));
+        }
+        return result;
+    }
+    case FilterPlan::Or:
+    {
+        ContactBitmap result;
+        Q_FOREACH(const FilterPlan &child, plan.children()) {
+            result |= evaluate(child);
+        }
+        return result;
+    }
+    default:
+        return m_allSlots;
+    }
+}
+
+// Return the contacts with a persona on any of the sources
+ContactBitmap ContactsMapData::sourcesBitmap(const QStringList &sources) const
+{
+    ContactBitmap result;
+    Q_FOREACH(const QString &sourceId, sources) {
+        result |= m_sourceToSlots.value(sourceId);
+    }
+    return result;
+}
+
+void ContactsMapData::insertIndexes(const ContactRecord &record)
+{
+    int slot = record.m_slot;
+
+    // phone map
+    Q_FOREACH(const QString &phone, record.m_phones) {
+        m_phoneToSlot.insert(phone, slot);
+    }
+
+    // tombstone map
+    if (record.m_deletedAt.isValid()) {
+        m_tombstones[record.m_deletedAtSource].insert(record.m_deletedAt, slot);
+        m_deleted.insert(slot);
+    }
+
+    // timestamp maps
+    if (record.m_created.isValid()) {
+        m_createdToSlot.insert(record.m_created, slot);
+    }
+    if (record.m_modified.isValid()) {
+        m_modifiedToSlot.insert(record.m_modified, slot);
+    }
+
+    // attribute bitmaps
+    const QContact &contact = record.m_contact;
+    bool favorite = false;
+    Q_FOREACH(const QContactFavorite &fav, contact.details<QContactFavorite>()) {
+        if (fav.isFavorite()) {
+            favorite = true;
+            break;
+        }
+    }
+    m_favorites.setValue(slot, favorite);
+    m_withPhoneNumber.setValue(slot, !contact.details(QContactDetail::TypePhoneNumber).isEmpty());
+    m_withEmailAddress.setValue(slot, !contact.details(QContactDetail::TypeEmailAddress).isEmpty());
+    m_visible.setValue(slot, record.m_visible);
+    Q_FOREACH(const QString &sourceId, record.m_sources) {
+        m_sourceToSlots[sourceId].insert(slot);
+    }
+}
+
+void ContactsMapData::removeIndexes(const ContactRecord &record)
+{
+    int slot = record.m_slot;
+    Q_FOREACH(const QString &phone, record.m_phones) {
+        m_phoneToSlot.remove(phone, slot);
+    }
+
+    if (record.m_deletedAt.isValid()) {
+        m_deleted.remove(slot);
+        QHash<QString, QMultiMap<QDateTime, int> >::iterator s = m_tombstones.find(record.m_deletedAtSource);
+        if (s != m_tombstones.end()) {
+            s.value().remove(record.m_deletedAt, slot);
+            if (s.value().isEmpty()) {
+                m_tombstones.erase(s);
+            }
+        }
+    }
+
+    m_createdToSlot.remove(record.m_created, slot);
+    m_modifiedToSlot.remove(record.m_modified, slot);
+
+    m_favorites.remove(slot);
+    m_withPhoneNumber.remove(slot);
+    m_withEmailAddress.remove(slot);
+    m_visible.remove(slot);
+    Q_FOREACH(const QString &sourceId, record.m_sources) {
+        QHash<QString, ContactBitmap>::iterator i = m_sourceToSlots.find(sourceId);
+        if (i != m_sourceToSlots.end()) {
+            i.value().remove(slot);
+            if (i.value().isEmpty()) {
+                m_sourceToSlots.erase(i);
+            }
+        }
+    }
+}
+
+void ContactsMapData::insertSorted(int slot)
+{
+    if (!m_sortClause.isEmpty()) {
+        SlotLessThan lessThan(this);
+        QList<int>::iterator it(std::upper_bound(m_sorted.begin(), m_sorted.end(), slot, lessThan));
+        m_sorted.insert(it, slot);
+    } else {
+        m_sorted.append(slot);
+    }
+}
+
+void ContactsMapData::updateSorted(int slot)
+{
+    if (m_sortClause.isEmpty()) {
+        return;
+    }
+
+    int oldPos = m_sorted.indexOf(slot);
+    SlotLessThan lessThan(this);
+    QList<int>::iterator it(std::upper_bound(m_sorted.begin(), m_sorted.end(), slot, lessThan));
+
+    if (it != m_sorted.end()) {
+        int newPos = std::distance(m_sorted.begin(), it);
+        if (oldPos != newPos) {
+            m_sorted.move(oldPos, newPos);
+        }
+    } else if (oldPos != (m_sorted.size() - 1)) {
+        m_sorted.move(oldPos, m_sorted.size() -1);
+    }
+}
+
+void ContactsMapData::sort()
+{
+    if (!m_sortClause.isEmpty()) {
+        SlotLessThan lessThan(this);
+        qSort(m_sorted.begin(), m_sorted.end(), lessThan);
+    }
+}
+
 //ContactInfo
 ContactEntry::ContactEntry(QIndividual *individual)
-    : m_individual(individual)
+    : m_individual(individual),
+      m_slot(-1)
 {
     Q_ASSERT(individual);
 }
@@ -52,14 +313,178 @@ QIndividual *ContactEntry::individual() const
     return m_individual;
 }
 
+int ContactEntry::slot() const
+{
+    return m_slot;
+}
+
+//ContactRecord
+ContactRecord::ContactRecord()
+    : m_visible(false),
+      m_slot(-1)
+{
+}
+
+bool ContactRecord::inSources(const QStringList &sources) const
+{
+    Q_FOREACH(const QString &sourceId, m_sources) {
+        if (sources.contains(sourceId)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+//ContactsSnapshot
+ContactsSnapshot::ContactsSnapshot()
+{
+}
+
+ContactsSnapshot::ContactsSnapshot(const QSharedDataPointer<ContactsMapData> &data)
+    : d(data)
+{
+}
+
+ContactsSnapshot::ContactsSnapshot(const ContactsSnapshot &other)
+    : d(other.d)
+{
+}
+
+ContactsSnapshot::~ContactsSnapshot()
+{
+}
+
+ContactsSnapshot &ContactsSnapshot::operator=(const ContactsSnapshot &other)
+{
+    d = other.d;
+    return *this;
+}
+
+bool ContactsSnapshot::isNull() const
+{
+    return (d.constData() == 0);
+}
+
+int ContactsSnapshot::size() const
+{
+    return d->m_idToSlot.size();
+}
+
+SortClause ContactsSnapshot::sort() const
+{
+    return d->m_sortClause;
+}
+
+const ContactRecord *ContactsSnapshot::value(const QString &id) const
+{
+    int slot = d->m_idToSlot.value(id, -1);
+    return (slot >= 0) ? &d->m_records.at(slot) : 0;
+}
+
+QList<const ContactRecord *> ContactsSnapshot::values() const
+{
+    QList<const ContactRecord *> result;
+    Q_FOREACH(int slot, d->m_sorted) {
+        result << &d->m_records.at(slot);
+    }
+    return result;
+}
+
+QList<const ContactRecord *> ContactsSnapshot::values(const QStringList &ids) const
+{
+    QList<const ContactRecord *> result;
+    Q_FOREACH(const QString &id, ids) {
+        const ContactRecord *record = value(id);
+        if (record) {
+            result << record;
+        }
+    }
+    return result;
+}
+
+// Return the contacts on the bitmap ordered by slot
+QList<const ContactRecord *> ContactsSnapshot::values(const ContactBitmap &bitmap) const
+{
+    QList<const ContactRecord *> result;
+    Q_FOREACH(int slot, bitmap.toList()) {
+        if ((slot < d->m_records.size()) && (d->m_records.at(slot).m_slot >= 0)) {
+            result << &d->m_records.at(slot);
+        }
+    }
+    return result;
+}
+
+QList<const ContactRecord *> ContactsSnapshot::valueByPhone(const QString &phone) const
+{
+    if (phone.isEmpty()) {
+        return values();
+    }
+
+    QList<const ContactRecord *> result;
+    Q_FOREACH(int slot, d->slotsByPhone(ContactsMap::minimalNumber(phone))) {
+        result << &d->m_records.at(slot);
+    }
+    return result;
+}
+
+QList<const ContactRecord *> ContactsSnapshot::removedSince(const QDateTime &since, const QString &sourceId) const
+{
+    QList<const ContactRecord *> result;
+    Q_FOREACH(int slot, d->removedSince(since, sourceId)) {
+        result << &d->m_records.at(slot);
+    }
+    return result;
+}
+
+QList<const ContactRecord *> ContactsSnapshot::changedSince(const QDateTime &since,
+                                                            QContactChangeLogFilter::EventType eventType) const
+{
+    QList<const ContactRecord *> result;
+    Q_FOREACH(int slot, d->changedSince(since, eventType)) {
+        result << &d->m_records.at(slot);
+    }
+    return result;
+}
+
+ContactBitmap ContactsSnapshot::evaluate(const FilterPlan &plan) const
+{
+    return d->evaluate(plan);
+}
+
+ContactBitmap ContactsSnapshot::sourcesBitmap(const QStringList &sources) const
+{
+    return d->sourcesBitmap(sources);
+}
+
+ContactBitmap ContactsSnapshot::deletedBitmap() const
+{
+    return d->m_deleted;
+}
+
+ContactBitmap ContactsSnapshot::visibleBitmap() const
+{
+    return d->m_visible;
+}
+
+// Sort records returned by the indexes in the same order used by "values()"
+void ContactsSnapshot::sortRecords(QList<const ContactRecord *> *records) const
+{
+    if (!d->m_sortClause.isEmpty()) {
+        ContactRecordLessThan lessThan(d->m_sortClause);
+        qSort(records->begin(), records->end(), lessThan);
+    }
+}
+
 //ContactMap
 ContactsMap::ContactsMap()
-    : m_sortClause(defaultSort())
+    : d(new ContactsMapData)
 {
+    d->m_sortClause = defaultSort();
 }
 
 ContactsMap::~ContactsMap()
 {
+    // the snapshots keep their own data
     clear();
 }
 
@@ -74,17 +499,18 @@ QList<ContactEntry *> ContactsMap::valueByPhone(const QString &phone) const
         return values();
     }
 
-    return m_phoneToEntry.values(minimalNumber(phone));
+    QList<ContactEntry *> result;
+    Q_FOREACH(int slot, d->slotsByPhone(minimalNumber(phone))) {
+        result << m_slotToEntry.at(slot);
+    }
+    return result;
 }
 
-QList<ContactEntry *> ContactsMap::values(const QStringList &ids) const
+QList<ContactEntry *> ContactsMap::removedSince(const QDateTime &since, const QString &sourceId) const
 {
     QList<ContactEntry *> result;
-    Q_FOREACH(const QString &id, ids) {
-        ContactEntry *entry = m_idToEntry.value(id, 0);
-        if (entry) {
-            result << entry;
-        }
+    Q_FOREACH(int slot, d->removedSince(since, sourceId)) {
+        result << m_slotToEntry.at(slot);
     }
     return result;
 }
@@ -97,7 +523,6 @@ ContactEntry *ContactsMap::take(FolksIndividual *individual)
 
 ContactEntry *ContactsMap::take(const QString &id)
 {
-    QWriteLocker locker(&m_mutex);
     ContactEntry *entry = m_idToEntry.take(id);
     removeData(entry, false);
     return entry;
@@ -105,41 +530,48 @@ ContactEntry *ContactsMap::take(const QString &id)
 
 void ContactsMap::remove(const QString &id)
 {
-    QWriteLocker locker(&m_mutex);
     ContactEntry *entry = m_idToEntry.take(id);
     removeData(entry, true);
 }
 
 void ContactsMap::insert(ContactEntry *entry)
 {
-    QWriteLocker locker(&m_mutex);
     insertData(entry);
 }
 
 void ContactsMap::updatePosition(ContactEntry *entry)
 {
-    QWriteLocker locker(&m_mutex);
-    if (!m_sortClause.isEmpty()) {
-        int oldPos = m_contacts.indexOf(entry);
+    if (entry->m_slot < 0) {
+        return;
+    }
 
-        ContactEntryLessThan lessThan(m_sortClause);
-        QList<ContactEntry*>::iterator it(std::upper_bound(m_contacts.begin(), m_contacts.end(), entry, lessThan));
+    ContactRecord newRecord = record(entry);
+    QMutexLocker locker(&m_snapshotLock);
+    ContactsMapData *data = d.data();
+    data->removeIndexes(data->m_records.at(entry->m_slot));
+    data->m_records[entry->m_slot] = newRecord;
+    data->insertIndexes(newRecord);
+    data->updateSorted(entry->m_slot);
+}
 
-        if (it != m_contacts.end()) {
-            int newPos = std::distance(m_contacts.begin(), it);
-            if (oldPos != newPos) {
-                m_contacts.move(oldPos, newPos);
-            }
-        } else if (oldPos != (m_contacts.size() - 1)) {
-            m_contacts.move(oldPos, m_contacts.size() -1);
-        }
-    }
+void ContactsMap::updateTombstone(ContactEntry *entry)
+{
+    updateIndexes(entry);
+}
 
-    // update phone number map
-    Q_FOREACH(const QString &key, m_phoneToEntry.keys(entry)) {
-        m_phoneToEntry.remove(key, entry);
+// Refresh the indexes that do not depend on the sort order
+void ContactsMap::updateIndexes(ContactEntry *entry)
+{
+    if ((entry->m_slot < 0) || (m_idToEntry.value(entry->individual()->id(), 0) != entry)) {
+        return;
     }
-    insertData(entry->individual()->contact().details<QContactPhoneNumber>(), entry);
+
+    ContactRecord newRecord = record(entry);
+    QMutexLocker locker(&m_snapshotLock);
+    ContactsMapData *data = d.data();
+    data->removeIndexes(data->m_records.at(entry->m_slot));
+    data->m_records[entry->m_slot] = newRecord;
+    data->insertIndexes(newRecord);
 }
 
 int ContactsMap::size() const
@@ -149,34 +581,40 @@ int ContactsMap::size() const
 
 void ContactsMap::clear()
 {
-    QWriteLocker locker(&m_mutex);
     QList<ContactEntry*> entries = m_idToEntry.values();
     m_idToEntry.clear();
-    m_phoneToEntry.clear();
-    m_contacts.clear();
-    qDeleteAll(entries);
-}
+    m_slotToEntry.clear();
+    m_freeSlots.clear();
 
-void ContactsMap::lockForRead()
-{
-    m_mutex.lockForRead();
+    ContactsMapData *data = new ContactsMapData;
+    data->m_sortClause = d.constData()->m_sortClause;
+    QMutexLocker locker(&m_snapshotLock);
+    d = data;
+    locker.unlock();
+
+    qDeleteAll(entries);
 }
 
-void ContactsMap::unlock()
+ContactsSnapshot ContactsMap::snapshot()
 {
-    m_mutex.unlock();
+    QMutexLocker locker(&m_snapshotLock);
+    return ContactsSnapshot(d);
 }
 
 QList<ContactEntry*> ContactsMap::values() const
 {
-    return m_contacts;
+    QList<ContactEntry*> result;
+    Q_FOREACH(int slot, d->m_sorted) {
+        result << m_slotToEntry.at(slot);
+    }
+    return result;
 }
 
 QList<QContact> ContactsMap::contacts() const
 {
     QList<QContact> result;
-    Q_FOREACH(ContactEntry *e, m_contacts) {
-        result << e->individual()->contact();
+    Q_FOREACH(int slot, d->m_sorted) {
+        result << d->m_records.at(slot).m_contact;
     }
     return result;
 }
@@ -188,18 +626,17 @@ QStringList ContactsMap::keys() const
 
 void ContactsMap::sertSort(const SortClause &clause)
 {
-    if (clause.toContactSortOrder() != m_sortClause.toContactSortOrder()) {
-        m_sortClause = clause;
-        if (!m_sortClause.isEmpty()) {
-            ContactEntryLessThan lessThan(m_sortClause);
-            qSort(m_contacts.begin(), m_contacts.end(), lessThan);
-        }
+    if (clause.toContactSortOrder() != d.constData()->m_sortClause.toContactSortOrder()) {
+        QMutexLocker locker(&m_snapshotLock);
+        ContactsMapData *data = d.data();
+        data->m_sortClause = clause;
+        data->sort();
     }
 }
 
 SortClause ContactsMap::sort() const
 {
-    return m_sortClause;
+    return d->m_sortClause;
 }
 
 SortClause ContactsMap::defaultSort()
@@ -259,13 +696,56 @@ ContactEntry *ContactsMap::value(FolksIndividual *individual) const
     return m_idToEntry.value(contactId, 0);
 }
 
+// Copy the contact data used by the indexes and by the snapshot readers, it must run on
+// the main thread since it can load the contact from folks
+ContactRecord ContactsMap::record(ContactEntry *entry) const
+{
+    QIndividual *individual = entry->individual();
+    ContactRecord record;
+    record.m_id = individual->id();
+    record.m_contact = individual->contact();
+    record.m_deletedAt = individual->deletedAt();
+    if (record.m_deletedAt.isValid()) {
+        record.m_deletedAtSource = individual->deletedAtSource();
+    }
+    QContactTimestamp timestamp(individual->timestamp());
+    record.m_created = timestamp.created();
+    record.m_modified = timestamp.lastModified();
+    record.m_sources = individual->sourceIds();
+    record.m_visible = individual->isVisible();
+    record.m_slot = entry->m_slot;
+    Q_FOREACH(const QContactPhoneNumber &phone, record.m_contact.details<QContactPhoneNumber>()) {
+        QString mNumber = minimalNumber(phone.number());
+        if (!mNumber.isEmpty()) {
+            record.m_phones << mNumber;
+        }
+    }
+    return record;
+}
+
 void ContactsMap::removeData(ContactEntry *entry, bool del)
 {
     if (entry) {
-        Q_FOREACH(const QString &key,  m_phoneToEntry.keys(entry)) {
-            m_phoneToEntry.remove(key, entry);
+        if (entry->m_slot >= 0) {
+            QMutexLocker locker(&m_snapshotLock);
+            ContactsMapData *data = d.data();
+            const ContactRecord &old = data->m_records.at(entry->m_slot);
+            if (data->m_idToSlot.value(old.m_id, -1) == entry->m_slot) {
+                data->m_idToSlot.remove(old.m_id);
+            }
+            data->removeIndexes(old);
+            data->m_sorted.removeOne(entry->m_slot);
+
+            // release the bitmap slot
+            data->m_allSlots.remove(entry->m_slot);
+            data->m_records[entry->m_slot] = ContactRecord();
+            locker.unlock();
+
+            m_slotToEntry[entry->m_slot] = 0;
+            m_freeSlots << entry->m_slot;
+            entry->m_slot = -1;
         }
-        m_contacts.removeOne(entry);
+
         if (del) {
             delete entry;
         }
@@ -282,31 +762,31 @@ void ContactsMap::insertData(ContactEntry *entry)
         // fill id map
         m_idToEntry.insert(folks_individual_get_id(fIndividual), entry);
 
-        // fill contact list
-        if (!m_sortClause.isEmpty()) {
-            ContactEntryLessThan lessThan(m_sortClause);
-            QList<ContactEntry*>::iterator it(std::upper_bound(m_contacts.begin(), m_contacts.end(), entry, lessThan));
-            m_contacts.insert(it, entry);
+        // reserve a bitmap slot
+        if (m_freeSlots.isEmpty()) {
+            entry->m_slot = m_slotToEntry.size();
+            m_slotToEntry << entry;
         } else {
-            m_contacts.append(entry);
+            entry->m_slot = m_freeSlots.takeLast();
+            m_slotToEntry[entry->m_slot] = entry;
         }
 
-        // fill phone map
-        insertData(entry->individual()->contact().details<QContactPhoneNumber>(), entry);
-    }
-}
-
-void ContactsMap::insertData(const QList<QContactPhoneNumber> &numbers, ContactEntry *entry)
-{
-    Q_FOREACH(const QContactPhoneNumber &phone, numbers) {
-        QString mNumber = minimalNumber(phone.number());
-        if (!mNumber.isEmpty()) {
-            m_phoneToEntry.insert(mNumber, entry);
+        ContactRecord newRecord = record(entry);
+        QMutexLocker locker(&m_snapshotLock);
+        ContactsMapData *data = d.data();
+        if (entry->m_slot < data->m_records.size()) {
+            data->m_records[entry->m_slot] = newRecord;
+        } else {
+            data->m_records << newRecord;
         }
+        data->m_idToSlot.insert(newRecord.m_id, entry->m_slot);
+        data->m_allSlots.insert(entry->m_slot);
+        data->insertIndexes(newRecord);
+        data->insertSorted(entry->m_slot);
     }
 }
 
-QString ContactsMap::minimalNumber(const QString &phone) const
+QString ContactsMap::minimalNumber(const QString &phone)
 {
     static i18n::phonenumbers::PhoneNumberUtil *phonenumberUtil = i18n::phonenumbers::PhoneNumberUtil::GetInstance();
 
@@ -19,13 +19,23 @@
 #ifndef __GALERA_CONTACTS_MAP_PRIV_H__
 #define __GALERA_CONTACTS_MAP_PRIV_H__
 
+#include "contact-bitmap.h"
+
 #include "common/sort-clause.h"
+#include "common/filter.h"
 
 #include <QtCore/QString>
+#include <QtCore/QStringList>
 #include <QtCore/QHash>
-#include <QtCore/QReadWriteLock>
+#include <QtCore/QVector>
+#include <QtCore/QMap>
+#include <QtCore/QDateTime>
+#include <QtCore/QMutex>
+#include <QtCore/QSharedDataPointer>
 
+#include <QtContacts/QContact>
 #include <QtContacts/QContactPhoneNumber>
+#include <QtContacts/QContactChangeLogFilter>
 
 #include <folks/folks.h>
 #include <glib.h>
@@ -35,6 +45,7 @@ namespace galera
 {
 
 class QIndividual;
+class ContactsMapData;
 
 class ContactEntry
 {
@@ -43,15 +54,83 @@ public:
     ~ContactEntry();
 
     QIndividual *individual() const;
+    int slot() const;
 
 private:
     ContactEntry();
     ContactEntry(const ContactEntry &other);
 
     QIndividual *m_individual;
+    // position of the contact on the attribute bitmaps
+    int m_slot;
+
+    friend class ContactsMap;
 };
 
+// Copy of a contact and of its indexed data, taken on the main thread when the contact
+// is inserted or updated on the map
+class ContactRecord
+{
+public:
+    ContactRecord();
+
+    QString m_id;
+    QtContacts::QContact m_contact;
+    QDateTime m_deletedAt;
+    QString m_deletedAtSource;
+    QDateTime m_created;
+    QDateTime m_modified;
+    QStringList m_sources;
+    // minimal phone numbers on the phone index
+    QStringList m_phones;
+    bool m_visible;
+    int m_slot;
+
+    bool inSources(const QStringList &sources) const;
+};
 
+/*
+ * Read only view of the contacts map at the time it was taken. It can be used from any
+ * thread without locks: the map copies its data before the next change while a snapshot
+ * shares it, the records returned are valid while the snapshot exists.
+ */
+class ContactsSnapshot
+{
+public:
+    ContactsSnapshot();
+    ContactsSnapshot(const ContactsSnapshot &other);
+    ~ContactsSnapshot();
+    ContactsSnapshot &operator=(const ContactsSnapshot &other);
+
+    bool isNull() const;
+    int size() const;
+    SortClause sort() const;
+
+    const ContactRecord *value(const QString &id) const;
+    QList<const ContactRecord*> values() const;
+    QList<const ContactRecord*> values(const QStringList &ids) const;
+    QList<const ContactRecord*> values(const ContactBitmap &bitmap) const;
+    QList<const ContactRecord*> valueByPhone(const QString &phone) const;
+    QList<const ContactRecord*> removedSince(const QDateTime &since, const QString &sourceId = QString()) const;
+    QList<const ContactRecord*> changedSince(const QDateTime &since, QtContacts::QContactChangeLogFilter::EventType eventType) const;
+    ContactBitmap evaluate(const FilterPlan &plan) const;
+    ContactBitmap sourcesBitmap(const QStringList &sources) const;
+    ContactBitmap deletedBitmap() const;
+    ContactBitmap visibleBitmap() const;
+    void sortRecords(QList<const ContactRecord*> *records) const;
+
+private:
+    QSharedDataPointer<ContactsMapData> d;
+
+    ContactsSnapshot(const QSharedDataPointer<ContactsMapData> &data);
+
+    friend class ContactsMap;
+};
+
+/*
+ * Contacts loaded from folks. The map is changed by the main thread only, the other
+ * threads read it through snapshots.
+ */
 class ContactsMap
 {
 public:
@@ -66,7 +145,7 @@ public:
     ContactEntry *value(FolksIndividual *individual) const;
     ContactEntry *value(const QString &id) const;
     QList<ContactEntry*> valueByPhone(const QString &phone) const;
-    QList<ContactEntry*> values(const QStringList &ids) const;
+    QList<ContactEntry*> removedSince(const QDateTime &since, const QString &sourceId = QString()) const;
 
     ContactEntry *take(FolksIndividual *individual);
     ContactEntry *take(const QString &id);
@@ -74,10 +153,12 @@ public:
     void remove(const QString &id);
     void insert(ContactEntry *entry);
     void updatePosition(ContactEntry *entry);
+    void updateTombstone(ContactEntry *entry);
+    void updateIndexes(ContactEntry *entry);
     int size() const;
     void clear();
-    void lockForRead();
-    void unlock();
+    // thread safe
+    ContactsSnapshot snapshot();
     QList<ContactEntry*> values() const;
     QList<QtContacts::QContact> contacts() const;
     QStringList keys() const;
@@ -86,19 +167,20 @@ public:
     SortClause sort() const;
 
     static SortClause defaultSort();
+    // last digits of the number used by the phone index
+    static QString minimalNumber(const QString &phone);
 
 private:
+    // shared with the snapshots, changed only after taking m_snapshotLock
+    QSharedDataPointer<ContactsMapData> d;
+    QMutex m_snapshotLock;
     QHash<QString, ContactEntry*> m_idToEntry;
-    QMultiMap<QString, ContactEntry*> m_phoneToEntry;
-    // sorted contacts
-    QList<ContactEntry*> m_contacts;
-    SortClause m_sortClause;
-    QReadWriteLock m_mutex;
+    QVector<ContactEntry*> m_slotToEntry;
+    QList<int> m_freeSlots;
 
+    ContactRecord record(ContactEntry *entry) const;
     void removeData(ContactEntry *entry, bool del);
     void insertData(ContactEntry *entry);
-    void insertData(const QList<QtContacts::QContactPhoneNumber> &numbers, ContactEntry *entry);
-    QString minimalNumber(const QString &phone) const;
 };
 
 } //namespace
@@ -22,12 +22,15 @@
 
 #include "dirtycontact-notify.h"
 #include "addressbook-adaptor.h"
+#include "change-journal.h"
+#include "metrics.h"
 
 namespace galera {
 
-DirtyContactsNotify::DirtyContactsNotify(AddressBookAdaptor *adaptor, QObject *parent)
+DirtyContactsNotify::DirtyContactsNotify(AddressBookAdaptor *adaptor, ChangeJournal *journal, QObject *parent)
     : QObject(parent),
-      m_adaptor(adaptor)
+      m_adaptor(adaptor),
+      m_journal(journal)
 {
     m_timer.setInterval(NOTIFY_CONTACTS_TIMEOUT);
     m_timer.setSingleShot(true);
@@ -40,6 +43,11 @@ void DirtyContactsNotify::insertAddedContacts(QSet<QString> ids)
         return;
     }
 
+    // the journal keeps every change, the signals are compressed
+    if (m_journal) {
+        m_journal->append(ChangeJournal::ContactAdded, ids);
+    }
+
     // if the contact was removed before ignore the removal signal, and send a update signal
     QSet<QString> addedIds = ids;
     Q_FOREACH(QString added, ids) {
@@ -75,6 +83,10 @@ void DirtyContactsNotify::insertRemovedContacts(QSet<QString> ids)
         return;
     }
 
+    if (m_journal) {
+        m_journal->append(ChangeJournal::ContactRemoved, ids);
+    }
+
     // if the contact was added before ignore the added and removed signal
     QSet<QString> removedIds = ids;
     Q_FOREACH(QString removed, ids) {
@@ -94,12 +106,18 @@ void DirtyContactsNotify::insertChangedContacts(QSet<QString> ids)
         return;
     }
 
+    if (m_journal) {
+        m_journal->append(ChangeJournal::ContactChanged, ids);
+    }
+
     m_contactsChanged += ids;
     m_timer.start();
 }
 
 void DirtyContactsNotify::emitSignals()
 {
+    MetricsActivity activity("emitSignals");
+    Metrics *metrics = Metrics::instance();
     qWarning() << "Emit singals:"
                << "\n\tChanged:" << m_contactsChanged.size()
                << "\n\tRemoved:" << m_contactsRemoved.size()
@@ -111,17 +129,23 @@ void DirtyContactsNotify::emitSignals()
         m_contactsChanged.subtract(m_contactsRemoved);
 
         if (!m_contactsChanged.isEmpty()) {
+            metrics->add(Metrics::SignalsEmitted);
+            metrics->add(Metrics::SignalIdsEmitted, m_contactsChanged.size());
             Q_EMIT m_adaptor->contactsUpdated(m_contactsChanged.toList());
             m_contactsChanged.clear();
         }
     }
 
     if (!m_contactsRemoved.isEmpty()) {
+        metrics->add(Metrics::SignalsEmitted);
+        metrics->add(Metrics::SignalIdsEmitted, m_contactsRemoved.size());
         Q_EMIT m_adaptor->contactsRemoved(m_contactsRemoved.toList());
         m_contactsRemoved.clear();
     }
 
     if (!m_contactsAdded.isEmpty()) {
+        metrics->add(Metrics::SignalsEmitted);
+        metrics->add(Metrics::SignalIdsEmitted, m_contactsAdded.size());
         Q_EMIT m_adaptor->contactsAdded(m_contactsAdded.toList());
         m_contactsAdded.clear();
     }
@@ -28,6 +28,7 @@
 namespace galera {
 
 class AddressBookAdaptor;
+class ChangeJournal;
 
 // this is a helper class uses a timer with a small timeout to notify the client about
 // any contact change notification. This class should be used instead of emit the signal directly
@@ -38,7 +39,7 @@ class DirtyContactsNotify : public QObject
     Q_OBJECT
 
 public:
-    DirtyContactsNotify(AddressBookAdaptor *adaptor, QObject *parent=0);
+    DirtyContactsNotify(AddressBookAdaptor *adaptor, ChangeJournal *journal=0, QObject *parent=0);
     void insertChangedContacts(QSet<QString> ids);
     void insertRemovedContacts(QSet<QString> ids);
     void insertAddedContacts(QSet<QString> ids);
@@ -50,6 +51,7 @@ private Q_SLOTS:
 
 private:
     QPointer<AddressBookAdaptor> m_adaptor;
+    ChangeJournal *m_journal;
     QTimer m_timer;
     QSet<QString> m_contactsChanged;
     QSet<QString> m_contactsAdded;
@@ -0,0 +1,312 @@
+/*
+ * Copyright 2013 Canonical Ltd.
+ *
+ * This file is part of contact-service-app.
+ *
+ * contact-service-app is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * contact-service-app is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include "eds-client-pool.h"
+
+#include <QtCore/QDebug>
+
+namespace
+{
+
+class ClientRequestData
+{
+public:
+    galera::EdsClientPool *m_pool;
+    QString m_sourceId;
+};
+
+} //namespace
+
+namespace galera
+{
+
+EdsClientPool::EdsClientPool()
+    : QObject(),
+      m_registry(0),
+      m_registryPending(false),
+      m_registryHandshakes(0),
+      m_registryHandshakesAvoided(0),
+      m_clientHandshakes(0),
+      m_clientHandshakesAvoided(0)
+{
+}
+
+EdsClientPool *EdsClientPool::instance()
+{
+    static EdsClientPool *pool = 0;
+    if (!pool) {
+        pool = new EdsClientPool;
+    }
+    return pool;
+}
+
+void EdsClientPool::prepare()
+{
+    if (m_registry || m_registryPending) {
+        return;
+    }
+
+    m_registryPending = true;
+    m_registryHandshakes.ref();
+    e_source_registry_new(NULL, (GAsyncReadyCallback) EdsClientPool::registryReady, this);
+}
+
+ESourceRegistry *EdsClientPool::registry()
+{
+    if (m_registry) {
+        m_registryHandshakesAvoided.ref();
+        return m_registry;
+    }
+
+    // the async creation did not finish yet
+    GError *error = 0;
+    m_registryHandshakes.ref();
+    ESourceRegistry *registry = e_source_registry_new_sync(NULL, &error);
+    if (error) {
+        qWarning() << "Fail to connect with source registry" << error->message;
+        g_error_free(error);
+        return 0;
+    }
+
+    setRegistry(registry);
+    return m_registry;
+}
+
+QString EdsClientPool::defaultSourceId()
+{
+    if (m_defaultSourceId.isEmpty()) {
+        ESourceRegistry *r = registry();
+        ESource *defaultSource = r ? e_source_registry_ref_default_address_book(r) : 0;
+        if (defaultSource) {
+            m_defaultSourceId = QString::fromUtf8(e_source_get_uid(defaultSource));
+            g_object_unref(defaultSource);
+        }
+    }
+    return m_defaultSourceId;
+}
+
+EBookClient *EdsClientPool::client(ESource *source)
+{
+    QString sourceId = QString::fromUtf8(e_source_get_uid(source));
+    EBookClient *client = m_clients.value(sourceId, 0);
+    if (client) {
+        m_clientHandshakesAvoided.ref();
+        return E_BOOK_CLIENT(g_object_ref(client));
+    }
+
+    GError *error = 0;
+    m_clientHandshakes.ref();
+    EClient *newClient = E_BOOK_CLIENT_CONNECT_SYNC(source, NULL, &error);
+    if (error) {
+        qWarning() << "Fail to connect with EDS" << error->message;
+        g_error_free(error);
+        return 0;
+    }
+
+    m_clients.insert(sourceId, E_BOOK_CLIENT(g_object_ref(newClient)));
+    return E_BOOK_CLIENT(newClient);
+}
+
+void EdsClientPool::client(ESource *source, EdsClientReadyFunc func, void *data)
+{
+    QString sourceId = QString::fromUtf8(e_source_get_uid(source));
+    EBookClient *client = m_clients.value(sourceId, 0);
+    if (client) {
+        m_clientHandshakesAvoided.ref();
+        func(client, QString(), data);
+        return;
+    }
+
+    // wait for the connection already running for this source
+    bool connecting = m_pendingClients.contains(sourceId);
+    m_pendingClients[sourceId] << qMakePair(func, data);
+    if (connecting) {
+        m_clientHandshakesAvoided.ref();
+        return;
+    }
+
+    ClientRequestData *request = new ClientRequestData;
+    request->m_pool = this;
+    request->m_sourceId = sourceId;
+    m_clientHandshakes.ref();
+    E_BOOK_CLIENT_CONNECT(source, NULL, (GAsyncReadyCallback) EdsClientPool::clientReady, request);
+}
+
+void EdsClientPool::invalidate(const QString &sourceId)
+{
+    EBookClient *client = m_clients.take(sourceId);
+    if (client) {
+        g_object_unref(client);
+    }
+
+    if (m_pendingClients.contains(sourceId)) {
+        m_staleClients << sourceId;
+    }
+}
+
+void EdsClientPool::clear()
+{
+    Q_FOREACH(EBookClient *client, m_clients.values()) {
+        g_object_unref(client);
+    }
+    m_clients.clear();
+    m_staleClients += m_pendingClients.keys().toSet();
+}
+
+int EdsClientPool::registryHandshakes() const
+{
+    return m_registryHandshakes.load();
+}
+
+int EdsClientPool::registryHandshakesAvoided() const
+{
+    return m_registryHandshakesAvoided.load();
+}
+
+int EdsClientPool::clientHandshakes() const
+{
+    return m_clientHandshakes.load();
+}
+
+int EdsClientPool::clientHandshakesAvoided() const
+{
+    return m_clientHandshakesAvoided.load();
+}
+
+void EdsClientPool::setRegistry(ESourceRegistry *registry)
+{
+    Q_ASSERT(m_registry == 0);
+    m_registry = registry;
+
+    g_signal_connect(m_registry,
+                     "source-added",
+                     G_CALLBACK(EdsClientPool::sourceAdded),
+                     this);
+    g_signal_connect(m_registry,
+                     "source-enabled",
+                     G_CALLBACK(EdsClientPool::sourceAdded),
+                     this);
+    g_signal_connect(m_registry,
+                     "source-changed",
+                     G_CALLBACK(EdsClientPool::sourceChanged),
+                     this);
+    g_signal_connect(m_registry,
+                     "source-removed",
+                     G_CALLBACK(EdsClientPool::sourceChanged),
+                     this);
+    g_signal_connect(m_registry,
+                     "source-disabled",
+                     G_CALLBACK(EdsClientPool::sourceChanged),
+                     this);
+    g_signal_connect(m_registry,
+                     "notify::default-address-book",
+                     G_CALLBACK(EdsClientPool::defaultSourceChanged),
+                     this);
+}
+
+void EdsClientPool::registryReady(GObject *source, GAsyncResult *res, EdsClientPool *self)
+{
+    Q_UNUSED(source);
+    GError *error = 0;
+    ESourceRegistry *registry = e_source_registry_new_finish(res, &error);
+    self->m_registryPending = false;
+    if (error) {
+        qWarning() << "Fail to connect with source registry" << error->message;
+        g_error_free(error);
+        return;
+    }
+
+    if (self->m_registry) {
+        // a sync registry was created while this one was loading
+        g_object_unref(registry);
+    } else {
+        self->setRegistry(registry);
+    }
+}
+
+void EdsClientPool::clientReady(GObject *source, GAsyncResult *res, void *data)
+{
+    Q_UNUSED(source);
+    ClientRequestData *request = static_cast<ClientRequestData*>(data);
+    EdsClientPool *self = request->m_pool;
+    QString sourceId = request->m_sourceId;
+    delete request;
+
+    QString errorMessage;
+    GError *error = 0;
+    EClient *client = e_book_client_connect_finish(res, &error);
+    if (error) {
+        errorMessage = QString::fromUtf8(error->message);
+        qWarning() << "Fail to connect with EDS" << errorMessage;
+        g_error_free(error);
+    }
+
+    // the source changed during the connection, the client can not be reused
+    bool stale = self->m_staleClients.remove(sourceId);
+    bool releaseClient = false;
+    EBookClient *bookClient = client ? E_BOOK_CLIENT(client) : 0;
+    if (bookClient) {
+        EBookClient *pooled = self->m_clients.value(sourceId, 0);
+        if (pooled) {
+            // a sync connection was created while this one was running
+            g_object_unref(bookClient);
+            bookClient = pooled;
+        } else if (stale) {
+            releaseClient = true;
+        } else {
+            self->m_clients.insert(sourceId, bookClient);
+        }
+    }
+
+    QList<QPair<EdsClientReadyFunc, void*> > waiting = self->m_pendingClients.take(sourceId);
+    for(int i = 0; i < waiting.size(); i++) {
+        waiting[i].first(bookClient, errorMessage, waiting[i].second);
+    }
+
+    if (releaseClient) {
+        g_object_unref(bookClient);
+    }
+}
+
+void EdsClientPool::sourceAdded(ESourceRegistry *registry, ESource *source, EdsClientPool *self)
+{
+    Q_UNUSED(registry);
+    Q_UNUSED(source);
+    Q_EMIT self->sourcesChanged();
+}
+
+void EdsClientPool::sourceChanged(ESourceRegistry *registry, ESource *source, EdsClientPool *self)
+{
+    Q_UNUSED(registry);
+    QString sourceId = QString::fromUtf8(e_source_get_uid(source));
+    if (sourceId == self->m_defaultSourceId) {
+        self->m_defaultSourceId.clear();
+    }
+    self->invalidate(sourceId);
+    Q_EMIT self->sourcesChanged();
+}
+
+void EdsClientPool::defaultSourceChanged(ESourceRegistry *registry, GParamSpec *pspec, EdsClientPool *self)
+{
+    Q_UNUSED(registry);
+    Q_UNUSED(pspec);
+    self->m_defaultSourceId.clear();
+}
+
+} //namespace
@@ -0,0 +1,96 @@
+/*
+ * Copyright 2013 Canonical Ltd.
+ *
+ * This file is part of contact-service-app.
+ *
+ * contact-service-app is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * contact-service-app is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GALERA_EDS_CLIENT_POOL_H__
+#define __GALERA_EDS_CLIENT_POOL_H__
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QObject>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QPair>
+#include <QtCore/QSet>
+#include <QtCore/QString>
+
+#include <libebook/libebook.h>
+
+namespace galera
+{
+
+// 'client' is only valid during the callback, use g_object_ref to keep it
+typedef void (*EdsClientReadyFunc)(EBookClient *client, const QString &errorMessage, void *data);
+
+// Process wide source registry and EBookClient connections. Each connection is a blocking
+// handshake with EDS, the registry and the clients are created once and shared by all
+// operations. The clients are dropped when the source changes or is removed.
+class EdsClientPool : public QObject
+{
+    Q_OBJECT
+
+public:
+    static EdsClientPool *instance();
+
+    // start the async creation of the source registry
+    void prepare();
+    // the returned registry is owned by the pool
+    ESourceRegistry *registry();
+    // cached uid of the default address book
+    QString defaultSourceId();
+    // return a new reference for the source client or 0 in case of error
+    EBookClient *client(ESource *source);
+    void client(ESource *source, EdsClientReadyFunc func, void *data);
+    void invalidate(const QString &sourceId);
+    void clear();
+
+    int registryHandshakes() const;
+    int registryHandshakesAvoided() const;
+    int clientHandshakes() const;
+    int clientHandshakesAvoided() const;
+
+Q_SIGNALS:
+    void sourcesChanged();
+
+private:
+    ESourceRegistry *m_registry;
+    bool m_registryPending;
+    QString m_defaultSourceId;
+    QHash<QString, EBookClient*> m_clients;
+    QHash<QString, QList<QPair<EdsClientReadyFunc, void*> > > m_pendingClients;
+    // sources invalidated while the client was connecting
+    QSet<QString> m_staleClients;
+    // read by the metrics in the D-Bus thread
+    QAtomicInt m_registryHandshakes;
+    QAtomicInt m_registryHandshakesAvoided;
+    QAtomicInt m_clientHandshakes;
+    QAtomicInt m_clientHandshakesAvoided;
+
+    EdsClientPool();
+    EdsClientPool(const EdsClientPool &);
+
+    void setRegistry(ESourceRegistry *registry);
+
+    static void registryReady(GObject *source, GAsyncResult *res, EdsClientPool *self);
+    static void clientReady(GObject *source, GAsyncResult *res, void *data);
+    static void sourceAdded(ESourceRegistry *registry, ESource *source, EdsClientPool *self);
+    static void sourceChanged(ESourceRegistry *registry, ESource *source, EdsClientPool *self);
+    static void defaultSourceChanged(ESourceRegistry *registry, GParamSpec *pspec, EdsClientPool *self);
+};
+
+} //namespace
+
+#endif
@@ -0,0 +1,273 @@
+/*
+ * Copyright 2013 Canonical Ltd.
+ *
+ * This file is part of contact-service-app.
+ *
+ * contact-service-app is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * contact-service-app is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "export-vcards-request.h"
+#include "contacts-map.h"
+#include "qindividual.h"
+#include "query-executor.h"
+
+#include "common/fetch-hint.h"
+#include "common/vcard-parser.h"
+
+#include <QtCore/QDebug>
+#include <QtCore/QRunnable>
+
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+
+#define EXPORT_CHUNK_SIZE   50
+#define EXPORT_WINDOW_SIZE  4
+// a write of up to PIPE_BUF bytes does not block once the descriptor is writable
+#define EXPORT_WRITE_SIZE   PIPE_BUF
+
+using namespace QtContacts;
+
+namespace
+{
+
+// Serialize a chunk of the contacts snapshot in a thread of the pool
+class SerializeVCardsJob : public QRunnable
+{
+public:
+    SerializeVCardsJob(QObject *listener, const galera::ContactsSnapshot &contacts, int index,
+                       const QStringList &ids, const QStringList &fields, const QStringList &sources)
+        : m_listener(listener),
+          m_allContacts(contacts),
+          m_index(index),
+          m_ids(ids),
+          m_fields(fields),
+          m_sources(sources)
+    {
+    }
+
+    void run()
+    {
+        QList<QContactDetail::DetailType> fields = galera::FetchHint::parseFieldNames(m_fields);
+        QList<QContact> contacts;
+
+        Q_FOREACH(const galera::ContactRecord *record, m_allContacts.values(m_ids)) {
+            if (!m_sources.isEmpty() && !record->inSources(m_sources)) {
+                continue;
+            }
+            contacts << galera::QIndividual::copy(record->m_contact, fields);
+        }
+        m_allContacts = galera::ContactsSnapshot();
+
+        QByteArray data;
+        if (!contacts.isEmpty()) {
+            data = galera::VCardParser::contactToVcardSync(contacts).join("").toUtf8();
+        }
+        QMetaObject::invokeMethod(m_listener, "onChunkSerialized", Qt::QueuedConnection,
+                                  Q_ARG(int, m_index),
+                                  Q_ARG(int, contacts.size()),
+                                  Q_ARG(QByteArray, data));
+    }
+
+private:
+    QObject *m_listener;
+    galera::ContactsSnapshot m_allContacts;
+    int m_index;
+    QStringList m_ids;
+    QStringList m_fields;
+    QStringList m_sources;
+};
+
+} //namespace
+
+namespace galera
+{
+
+ExportVCardsRequest::ExportVCardsRequest(const ContactsSnapshot &contacts,
+                                         const QDBusUnixFileDescriptor &fd,
+                                         const QStringList &fields,
+                                         const QStringList &sources,
+                                         const QDBusMessage &message,
+                                         QObject *parent)
+    : QObject(parent),
+      m_contacts(contacts),
+      m_fd(fd),
+      m_fields(fields),
+      m_sources(sources),
+      m_message(message),
+      m_notifier(0),
+      m_writeOffset(0),
+      m_chunkCount(0),
+      m_nextChunk(0),
+      m_nextWrite(0),
+      m_writtenChunks(0),
+      m_runningChunks(0),
+      m_exported(0)
+{
+}
+
+ExportVCardsRequest::~ExportVCardsRequest()
+{
+    delete m_notifier;
+}
+
+void ExportVCardsRequest::start()
+{
+    if (!m_fd.isValid()) {
+        m_error = "Invalid file descriptor";
+        finish();
+        return;
+    }
+
+    // the chunks serialize the contacts of the same snapshot
+    Q_FOREACH(const ContactRecord *record, m_contacts.values()) {
+        if (record->m_visible && !record->m_deletedAt.isValid()) {
+            m_ids << record->m_id;
+        }
+    }
+    m_chunkCount = (m_ids.size() + EXPORT_CHUNK_SIZE - 1) / EXPORT_CHUNK_SIZE;
+
+    // the descriptor shares its file status flags with the client, so it stays blocking and
+    // is only written when poll reports room for it
+    m_notifier = new QSocketNotifier(m_fd.fileDescriptor(), QSocketNotifier::Write);
+    m_notifier->setEnabled(false);
+    connect(m_notifier, SIGNAL(activated(int)), SLOT(writeData()));
+
+    startChunks();
+    if (m_chunkCount == 0) {
+        finish();
+    }
+}
+
+void ExportVCardsRequest::cancel(const QString &error)
+{
+    if (m_error.isEmpty()) {
+        m_error = error;
+    }
+    // no chunk is started after this, the running ones hold their own snapshot
+    m_contacts = ContactsSnapshot();
+    finish();
+}
+
+void ExportVCardsRequest::startChunks()
+{
+    while (m_error.isEmpty() &&
+           (m_nextChunk < m_chunkCount) &&
+           ((m_nextChunk - m_writtenChunks) < EXPORT_WINDOW_SIZE)) {
+        QStringList ids = m_ids.mid(m_nextChunk * EXPORT_CHUNK_SIZE, EXPORT_CHUNK_SIZE);
+        m_runningChunks++;
+        QueryExecutor::instance()->start(new SerializeVCardsJob(this, m_contacts, m_nextChunk,
+                                                                ids, m_fields, m_sources),
+                                         QueryExecutor::Bulk);
+        m_nextChunk++;
+    }
+}
+
+void ExportVCardsRequest::onChunkSerialized(int index, int count, const QByteArray &data)
+{
+    m_runningChunks--;
+    m_exported += count;
+    m_chunks.insert(index, data);
+    writeData();
+}
+
+void ExportVCardsRequest::writeData()
+{
+    while (m_error.isEmpty()) {
+        if (m_writeOffset >= m_writeBuffer.size()) {
+            if (!m_writeBuffer.isNull()) {
+                // the chunk was completely written, there is room for a new one
+                m_writeBuffer = QByteArray();
+                m_writtenChunks++;
+                startChunks();
+            }
+
+            if (!m_chunks.contains(m_nextWrite)) {
+                break;
+            }
+            m_writeBuffer = m_chunks.take(m_nextWrite++);
+            m_writeOffset = 0;
+            if (m_writeBuffer.isNull()) {
+                m_writeBuffer = QByteArray("");
+            }
+            continue;
+        }
+
+        struct pollfd pfd;
+        pfd.fd = m_fd.fileDescriptor();
+        pfd.events = POLLOUT;
+        pfd.revents = 0;
+        int ready = ::poll(&pfd, 1, 0);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            m_error = QString::fromUtf8(strerror(errno));
+            qWarning() << "Fail to wait for the export file descriptor:" << m_error;
+            continue;
+        } else if (ready == 0) {
+            // wait for the reader
+            m_notifier->setEnabled(true);
+            return;
+        } else if (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) {
+            m_error = "The export file descriptor was closed";
+            qWarning() << "Fail to write vcards:" << m_error;
+            continue;
+        }
+
+        ssize_t size = ::write(m_fd.fileDescriptor(),
+                               m_writeBuffer.constData() + m_writeOffset,
+                               qMin(m_writeBuffer.size() - m_writeOffset, EXPORT_WRITE_SIZE));
+        if (size < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            m_error = QString::fromUtf8(strerror(errno));
+            qWarning() << "Fail to write vcards:" << m_error;
+        } else {
+            m_writeOffset += size;
+        }
+    }
+
+    m_notifier->setEnabled(false);
+    if (!m_error.isEmpty() || (m_writtenChunks == m_chunkCount)) {
+        finish();
+    }
+}
+
+void ExportVCardsRequest::finish()
+{
+    if (m_notifier) {
+        m_notifier->setEnabled(false);
+    }
+
+    // wait for the running chunks before destroy the request
+    if (m_runningChunks > 0) {
+        return;
+    }
+
+    if (m_message.type() != QDBusMessage::InvalidMessage) {
+        if (m_error.isEmpty()) {
+            QDBusConnection::sessionBus().send(m_message.createReply(m_exported));
+        } else {
+            QDBusConnection::sessionBus().send(m_message.createErrorReply("Failed to export contacts", m_error));
+        }
+        m_message = QDBusMessage();
+    }
+    Q_EMIT finished();
+    deleteLater();
+}
+
+} //namespace
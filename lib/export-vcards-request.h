@@ -0,0 +1,89 @@
+/*
+ * Copyright 2013 Canonical Ltd.
+ *
+ * This file is part of contact-service-app.
+ *
+ * contact-service-app is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * contact-service-app is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GALERA_EXPORT_VCARDS_REQUEST_H__
+#define __GALERA_EXPORT_VCARDS_REQUEST_H__
+
+#include <QtCore/QObject>
+#include <QtCore/QByteArray>
+#include <QtCore/QMap>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtCore/QSocketNotifier>
+
+#include <QtDBus/QDBusMessage>
+#include <QtDBus/QDBusUnixFileDescriptor>
+
+#include "contacts-map.h"
+
+namespace galera
+{
+
+/*
+ * Write the vcards of a snapshot of the contacts to a file descriptor. The contacts are
+ * serialized in chunks by the thread pool and written in order, a new chunk is only started
+ * when there is room in the window of chunks not written yet.
+ */
+class ExportVCardsRequest : public QObject
+{
+    Q_OBJECT
+public:
+    ExportVCardsRequest(const ContactsSnapshot &contacts,
+                        const QDBusUnixFileDescriptor &fd,
+                        const QStringList &fields,
+                        const QStringList &sources,
+                        const QDBusMessage &message,
+                        QObject *parent = 0);
+    ~ExportVCardsRequest();
+
+    void start();
+    void cancel(const QString &error);
+
+Q_SIGNALS:
+    void finished();
+
+private Q_SLOTS:
+    void onChunkSerialized(int index, int count, const QByteArray &data);
+    void writeData();
+
+private:
+    ContactsSnapshot m_contacts;
+    QDBusUnixFileDescriptor m_fd;
+    QStringList m_fields;
+    QStringList m_sources;
+    QDBusMessage m_message;
+    QSocketNotifier *m_notifier;
+    QStringList m_ids;
+    QMap<int, QByteArray> m_chunks;
+    QByteArray m_writeBuffer;
+    int m_writeOffset;
+    int m_chunkCount;
+    int m_nextChunk;
+    int m_nextWrite;
+    int m_writtenChunks;
+    int m_runningChunks;
+    int m_exported;
+    QString m_error;
+
+    void startChunks();
+    void finish();
+};
+
+} //namespace
+
+#endif
@@ -0,0 +1,139 @@
+/*
+ * Copyright 2013 Canonical Ltd.
+ *
+ * This file is part of contact-service-app.
+ *
+ * contact-service-app is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * contact-service-app is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "import-vcards-request.h"
+#include "addressbook.h"
+
+#include "common/vcard-parser.h"
+
+#include <QtCore/QDebug>
+#include <QtCore/QUuid>
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#define IMPORT_READ_SIZE            65536
+#define IMPORT_BATCH_SIZE           100
+#define IMPORT_MAX_RUNNING_BATCHES  2
+
+namespace galera
+{
+
+ImportVCardsRequest::ImportVCardsRequest(AddressBook *addressBook,
+                                         const QDBusUnixFileDescriptor &fd,
+                                         const QString &source,
+                                         QObject *parent)
+    : QObject(parent),
+      m_addressBook(addressBook),
+      m_fd(fd),
+      m_notifier(0),
+      m_id(QUuid::createUuid().toString().remove("{").remove("}")),
+      m_source(source),
+      m_runningBatches(0),
+      m_created(0),
+      m_failed(0),
+      m_atEnd(false)
+{
+}
+
+ImportVCardsRequest::~ImportVCardsRequest()
+{
+    delete m_notifier;
+}
+
+QString ImportVCardsRequest::id() const
+{
+    return m_id;
+}
+
+bool ImportVCardsRequest::start()
+{
+    if (!m_fd.isValid()) {
+        qWarning() << "Invalid file descriptor for import";
+        return false;
+    }
+
+    // the descriptor shares its file status flags with the client, so it stays blocking;
+    // it is only read when the notifier reports data
+    m_notifier = new QSocketNotifier(m_fd.fileDescriptor(), QSocketNotifier::Read);
+    connect(m_notifier, SIGNAL(activated(int)), SLOT(readAvailable()));
+    return true;
+}
+
+void ImportVCardsRequest::readAvailable()
+{
+    QByteArray data(IMPORT_READ_SIZE, Qt::Uninitialized);
+    ssize_t size = ::read(m_fd.fileDescriptor(), data.data(), data.size());
+    if (size < 0) {
+        if ((errno == EAGAIN) || (errno == EINTR)) {
+            return;
+        }
+        qWarning() << "Fail to read vcards:" << strerror(errno);
+        m_atEnd = true;
+    } else if (size == 0) {
+        m_atEnd = true;
+    } else {
+        m_buffer.append(data.constData(), size);
+    }
+
+    m_pendingVcards += VCardParser::takeVcards(m_buffer, m_atEnd);
+    processVcards();
+}
+
+void ImportVCardsRequest::onBatchDone(const QStringList &result, const QStringList &errors)
+{
+    Q_UNUSED(errors);
+
+    m_runningBatches--;
+    Q_FOREACH(const QString &vcard, result) {
+        if (vcard.isEmpty()) {
+            m_failed++;
+        } else {
+            m_created++;
+        }
+    }
+
+    Q_EMIT progress(m_id, m_created, m_failed);
+    processVcards();
+}
+
+void ImportVCardsRequest::processVcards()
+{
+    while ((m_runningBatches < IMPORT_MAX_RUNNING_BATCHES) &&
+           ((m_pendingVcards.size() >= IMPORT_BATCH_SIZE) ||
+            (m_atEnd && !m_pendingVcards.isEmpty()))) {
+        QStringList batch = m_pendingVcards.mid(0, IMPORT_BATCH_SIZE);
+        m_pendingVcards.erase(m_pendingVcards.begin(), m_pendingVcards.begin() + batch.size());
+        m_runningBatches++;
+        m_addressBook->createContacts(batch, m_source, this, SLOT(onBatchDone(QStringList,QStringList)));
+    }
+
+    if (!m_atEnd) {
+        // keep reading only while there is room for one more batch
+        m_notifier->setEnabled(m_pendingVcards.size() < IMPORT_BATCH_SIZE);
+    } else {
+        m_notifier->setEnabled(false);
+        if ((m_runningBatches == 0) && m_pendingVcards.isEmpty()) {
+            Q_EMIT finished(m_id, m_created, m_failed);
+            deleteLater();
+        }
+    }
+}
+
+} //namespace
@@ -0,0 +1,77 @@
+/*
+ * Copyright 2013 Canonical Ltd.
+ *
+ * This file is part of contact-service-app.
+ *
+ * contact-service-app is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * contact-service-app is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GALERA_IMPORT_VCARDS_REQUEST_H__
+#define __GALERA_IMPORT_VCARDS_REQUEST_H__
+
+#include <QtCore/QObject>
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtCore/QSocketNotifier>
+
+#include <QtDBus/QDBusUnixFileDescriptor>
+
+namespace galera
+{
+class AddressBook;
+
+/*
+ * Read vcards from a file descriptor and create the contacts in batches, the file is read
+ * only while the number of vcards waiting to be created is smaller than one batch.
+ */
+class ImportVCardsRequest : public QObject
+{
+    Q_OBJECT
+public:
+    ImportVCardsRequest(AddressBook *addressBook,
+                        const QDBusUnixFileDescriptor &fd,
+                        const QString &source,
+                        QObject *parent = 0);
+    ~ImportVCardsRequest();
+
+    QString id() const;
+    bool start();
+
+Q_SIGNALS:
+    void progress(const QString &importId, int created, int failed);
+    void finished(const QString &importId, int created, int failed);
+
+private Q_SLOTS:
+    void readAvailable();
+    void onBatchDone(const QStringList &result, const QStringList &errors);
+
+private:
+    AddressBook *m_addressBook;
+    QDBusUnixFileDescriptor m_fd;
+    QSocketNotifier *m_notifier;
+    QString m_id;
+    QString m_source;
+    QByteArray m_buffer;
+    QStringList m_pendingVcards;
+    int m_runningBatches;
+    int m_created;
+    int m_failed;
+    bool m_atEnd;
+
+    void processVcards();
+};
+
+} //namespace
+
+#endif
@@ -0,0 +1,178 @@
+/*
+ * Copyright 2013 Canonical Ltd.
+ *
+ * This file is part of contact-service-app.
+ *
+ * contact-service-app is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * contact-service-app is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "main-loop-watchdog.h"
+#include "metrics.h"
+
+#include <QtCore/QDebug>
+#include <QtCore/QMutexLocker>
+
+#ifdef __GLIBC__
+#include <execinfo.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#endif
+
+// time allowed for the main thread to answer the stack sample request
+#define STACK_SAMPLE_TIMEOUT    100
+#define STACK_SAMPLE_MAX_FRAMES 64
+#define STACK_SAMPLE_SIGNAL     SIGUSR2
+
+namespace
+{
+
+#ifdef __GLIBC__
+void *s_stackFrames[STACK_SAMPLE_MAX_FRAMES];
+volatile sig_atomic_t s_stackFrameCount = 0;
+QAtomicInt s_stackSampled;
+
+void stackSampleHandler(int)
+{
+    s_stackFrameCount = backtrace(s_stackFrames, STACK_SAMPLE_MAX_FRAMES);
+    s_stackSampled.store(1);
+}
+#endif
+
+} //namespace
+
+namespace galera
+{
+
+MainLoopWatchdog::MainLoopWatchdog(int threshold, bool sampleStack, QObject *parent)
+    : QThread(parent),
+      m_threshold(threshold),
+      m_interval(qMax(10, threshold / 4)),
+      m_sampleStack(sampleStack),
+      m_mainThread(pthread_self()),
+      m_lastBeat(Metrics::now()),
+      m_stopped(0),
+      m_stallDetected(false)
+{
+#ifdef __GLIBC__
+    if (m_sampleStack) {
+        // the first backtrace call loads libgcc, do it outside of the signal handler
+        void *frame;
+        backtrace(&frame, 1);
+
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = stackSampleHandler;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        if (sigaction(STACK_SAMPLE_SIGNAL, &action, 0) != 0) {
+            qWarning() << "Fail to install the stack sample handler";
+            m_sampleStack = false;
+        }
+    }
+#else
+    m_sampleStack = false;
+#endif
+
+    m_heartbeat.setTimerType(Qt::PreciseTimer);
+    m_heartbeat.setInterval(m_interval);
+    connect(&m_heartbeat, SIGNAL(timeout()), SLOT(onHeartbeat()));
+    m_heartbeat.start();
+
+    start(QThread::LowPriority);
+}
+
+MainLoopWatchdog::~MainLoopWatchdog()
+{
+    stop();
+}
+
+void MainLoopWatchdog::stop()
+{
+    m_heartbeat.stop();
+    m_stallLock.lock();
+    m_stopped.store(1);
+    m_wakeUp.wakeAll();
+    m_stallLock.unlock();
+    wait();
+}
+
+void MainLoopWatchdog::run()
+{
+    QMutexLocker locker(&m_stallLock);
+    while (!m_stopped.load()) {
+        m_wakeUp.wait(&m_stallLock, m_interval);
+        if (m_stopped.load() || m_stallDetected) {
+            continue;
+        }
+
+        qint64 blocked = ((Metrics::now() - m_lastBeat.load()) / 1000000) - m_interval;
+        if (blocked > m_threshold) {
+            const char *activity = Metrics::instance()->activity();
+            m_stallDetected = true;
+            m_stallActivity = QString::fromLatin1(activity ? activity : "unknown");
+            if (m_sampleStack) {
+                m_stallStack = sampleMainThreadStack();
+            }
+            qWarning() << "Main loop blocked for" << blocked << "ms in" << m_stallActivity;
+        }
+    }
+}
+
+void MainLoopWatchdog::onHeartbeat()
+{
+    qint64 now = Metrics::now();
+    qint64 blocked = ((now - m_lastBeat.fetchAndStoreRelaxed(now)) / 1000) - (qint64(m_interval) * 1000);
+
+    QMutexLocker locker(&m_stallLock);
+    if (blocked > (qint64(m_threshold) * 1000)) {
+        QString activity = m_stallDetected ? m_stallActivity : QStringLiteral("unknown");
+        qWarning() << "Main loop stalled for" << (blocked / 1000) << "ms in" << activity;
+        Q_FOREACH(const QString &frame, m_stallStack) {
+            qWarning() << "\t" << frame;
+        }
+        Metrics::instance()->recordStall(blocked, activity, m_stallStack);
+    }
+    m_stallDetected = false;
+    m_stallStack.clear();
+}
+
+QStringList MainLoopWatchdog::sampleMainThreadStack()
+{
+    QStringList stack;
+#ifdef __GLIBC__
+    s_stackSampled.store(0);
+    if (pthread_kill(m_mainThread, STACK_SAMPLE_SIGNAL) != 0) {
+        return stack;
+    }
+
+    for(int i = 0; (i < STACK_SAMPLE_TIMEOUT) && !s_stackSampled.load(); i++) {
+        QThread::msleep(1);
+    }
+    if (!s_stackSampled.load()) {
+        return stack;
+    }
+
+    char **symbols = backtrace_symbols(s_stackFrames, s_stackFrameCount);
+    if (symbols) {
+        // skip the signal handler frames
+        for(int i = 2; i < s_stackFrameCount; i++) {
+            stack << QString::fromLocal8Bit(symbols[i]);
+        }
+        free(symbols);
+    }
+#endif
+    return stack;
+}
+
+} //namespace
@@ -0,0 +1,78 @@
+/*
+ * Copyright 2013 Canonical Ltd.
+ *
+ * This file is part of contact-service-app.
+ *
+ * contact-service-app is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * contact-service-app is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GALERA_MAIN_LOOP_WATCHDOG_H__
+#define __GALERA_MAIN_LOOP_WATCHDOG_H__
+
+#include <QtCore/QAtomicInteger>
+#include <QtCore/QMutex>
+#include <QtCore/QStringList>
+#include <QtCore/QThread>
+#include <QtCore/QTimer>
+#include <QtCore/QWaitCondition>
+
+#include <pthread.h>
+
+namespace galera
+{
+
+/*
+ * Detect main loop iterations blocked for longer than the threshold.
+ *
+ * The main loop updates a heartbeat from a timer, the watchdog thread checks it and while the
+ * loop is blocked captures the callback marked as running (see MetricsActivity) and optionally
+ * a stack sample of the main thread. The stall is logged and recorded in the metrics when the
+ * main loop comes back.
+ */
+class MainLoopWatchdog : public QThread
+{
+    Q_OBJECT
+public:
+    MainLoopWatchdog(int threshold, bool sampleStack, QObject *parent = 0);
+    ~MainLoopWatchdog();
+
+    void stop();
+
+protected:
+    void run();
+
+private Q_SLOTS:
+    void onHeartbeat();
+
+private:
+    QTimer m_heartbeat;
+    int m_threshold;
+    int m_interval;
+    bool m_sampleStack;
+    pthread_t m_mainThread;
+    QAtomicInteger<qint64> m_lastBeat;
+    QAtomicInt m_stopped;
+
+    // stall in progress, filled by the watchdog thread
+    QMutex m_stallLock;
+    QWaitCondition m_wakeUp;
+    bool m_stallDetected;
+    QString m_stallActivity;
+    QStringList m_stallStack;
+
+    QStringList sampleMainThreadStack();
+};
+
+} //namespace
+
+#endif
@@ -0,0 +1,75 @@
+/*
+ * Copyright 2013 Canonical Ltd.
+ *
+ * This file is part of contact-service-app.
+ *
+ * contact-service-app is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * contact-service-app is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "metrics-adaptor.h"
+#include "metrics.h"
+#include "addressbook.h"
+#include "eds-client-pool.h"
+#include "query-executor.h"
+
+#include "common/trace.h"
+
+#include <QtCore/QJsonDocument>
+
+namespace galera
+{
+
+MetricsAdaptor::MetricsAdaptor(AddressBook *addressBook, QObject *parent)
+    : QDBusAbstractAdaptor(parent),
+      m_addressBook(addressBook)
+{
+}
+
+MetricsAdaptor::~MetricsAdaptor()
+{
+}
+
+QString MetricsAdaptor::metrics()
+{
+    QJsonObject result = Metrics::instance()->toJson();
+
+    EdsClientPool *pool = EdsClientPool::instance();
+    QJsonObject eds;
+    eds.insert("registryHandshakes", pool->registryHandshakes());
+    eds.insert("registryHandshakesAvoided", pool->registryHandshakesAvoided());
+    eds.insert("clientHandshakes", pool->clientHandshakes());
+    eds.insert("clientHandshakesAvoided", pool->clientHandshakesAvoided());
+    int lookups = pool->clientHandshakes() + pool->clientHandshakesAvoided();
+    eds.insert("clientHitRatio", lookups ? (qreal(pool->clientHandshakesAvoided()) / lookups) : 0.0);
+    result.insert("edsClientPool", eds);
+    result.insert("queryExecutor", QueryExecutor::instance()->toJson());
+    result.insert("isReady", m_addressBook->isReady());
+
+    return QString::fromUtf8(QJsonDocument(result).toJson(QJsonDocument::Compact));
+}
+
+void MetricsAdaptor::reset()
+{
+    Metrics::instance()->reset();
+}
+
+QString MetricsAdaptor::trace()
+{
+    // empty if the service runs without ADDRESS_BOOK_TRACE
+    if (!Trace::isEnabled()) {
+        return QString();
+    }
+    return QString::fromUtf8(Trace::toJson());
+}
+
+} //namespace
@@ -0,0 +1,64 @@
+/*
+ * Copyright 2013 Canonical Ltd.
+ *
+ * This file is part of contact-service-app.
+ *
+ * contact-service-app is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * contact-service-app is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GALERA_METRICS_ADAPTOR_H__
+#define __GALERA_METRICS_ADAPTOR_H__
+
+#include <QtCore/QObject>
+#include <QtCore/QString>
+
+#include <QtDBus/QtDBus>
+
+#include "common/dbus-service-defs.h"
+
+namespace galera
+{
+
+class AddressBook;
+class MetricsAdaptor: public QDBusAbstractAdaptor
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", CPIM_ADDRESSBOOK_METRICS_IFACE_NAME)
+    Q_CLASSINFO("D-Bus Introspection", ""
+"  <interface name=\"com.canonical.pim.AddressBook.Metrics\">\n"
+"    <method name=\"metrics\">\n"
+"      <arg direction=\"out\" type=\"s\" name=\"json\"/>\n"
+"    </method>\n"
+"    <method name=\"reset\"/>\n"
+"    <method name=\"trace\">\n"
+"      <arg direction=\"out\" type=\"s\" name=\"json\"/>\n"
+"    </method>\n"
+"  </interface>\n"
+        "")
+public:
+    // served in the D-Bus thread of the address book
+    MetricsAdaptor(AddressBook *addressBook, QObject *parent);
+    virtual ~MetricsAdaptor();
+
+public Q_SLOTS:
+    QString metrics();
+    void reset();
+    QString trace();
+
+private:
+    AddressBook *m_addressBook;
+};
+
+} //namespace
+
+#endif
@@ -0,0 +1,315 @@
+/*
+ * Copyright 2013 Canonical Ltd.
+ *
+ * This file is part of contact-service-app.
+ *
+ * contact-service-app is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * contact-service-app is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "metrics.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDateTime>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QJsonArray>
+#include <QtCore/QThread>
+#include <QtCore/qmath.h>
+
+// number of stalls kept in the metrics snapshot
+#define METRICS_MAX_STALLS 16
+
+namespace
+{
+
+QElapsedTimer startedClock()
+{
+    QElapsedTimer clock;
+    clock.start();
+    return clock;
+}
+
+} //namespace
+
+namespace galera
+{
+
+LatencyHistogram::LatencyHistogram()
+{
+    reset();
+}
+
+void LatencyHistogram::record(qint64 usecs)
+{
+    usecs = qMax(qint64(0), usecs);
+    m_buckets[bucket(usecs)].fetchAndAddRelaxed(1);
+    m_count.fetchAndAddRelaxed(1);
+    m_total.fetchAndAddRelaxed(usecs);
+
+    qint64 max = m_max.load();
+    while ((usecs > max) && !m_max.testAndSetRelaxed(max, usecs)) {
+        max = m_max.load();
+    }
+}
+
+void LatencyHistogram::reset()
+{
+    for(int i = 0; i < Buckets; i++) {
+        m_buckets[i].store(0);
+    }
+    m_count.store(0);
+    m_total.store(0);
+    m_max.store(0);
+}
+
+qint64 LatencyHistogram::count() const
+{
+    return m_count.load();
+}
+
+qint64 LatencyHistogram::percentile(qreal p) const
+{
+    qint64 rank = qCeil(m_count.load() * p / 100.0);
+    qint64 seen = 0;
+    for(int i = 0; i < Buckets; i++) {
+        seen += m_buckets[i].load();
+        if ((seen > 0) && (seen >= rank)) {
+            return qMin(upperBound(i), m_max.load());
+        }
+    }
+    return m_max.load();
+}
+
+QJsonObject LatencyHistogram::toJson() const
+{
+    qint64 count = m_count.load();
+    QJsonObject result;
+    result.insert("count", count);
+    result.insert("meanUs", count ? (m_total.load() / count) : 0);
+    result.insert("p50Us", percentile(50));
+    result.insert("p90Us", percentile(90));
+    result.insert("p99Us", percentile(99));
+    result.insert("maxUs", m_max.load());
+
+    // only the buckets in use, as [upper bound, count] pairs
+    QJsonArray buckets;
+    for(int i = 0; i < Buckets; i++) {
+        qint64 value = m_buckets[i].load();
+        if (value > 0) {
+            QJsonArray pair;
+            pair << upperBound(i) << value;
+            buckets << pair;
+        }
+    }
+    result.insert("buckets", buckets);
+    return result;
+}
+
+int LatencyHistogram::bucket(qint64 usecs)
+{
+    if (usecs < LinearBuckets) {
+        return usecs;
+    }
+    int msb = 63 - __builtin_clzll(usecs);
+    int sub = (usecs >> (msb - 3)) & (SubBuckets - 1);
+    return qMin(LinearBuckets + ((msb - 4) * SubBuckets) + sub, Buckets - 1);
+}
+
+qint64 LatencyHistogram::upperBound(int bucket)
+{
+    if (bucket < LinearBuckets) {
+        return bucket;
+    }
+    int msb = 4 + ((bucket - LinearBuckets) / SubBuckets);
+    int sub = (bucket - LinearBuckets) % SubBuckets;
+    return (qint64(SubBuckets + sub + 1) << (msb - 3)) - 1;
+}
+
+Metrics::Metrics()
+    : m_activity(0)
+{
+    reset();
+}
+
+Metrics *Metrics::instance()
+{
+    static Metrics metrics;
+    return &metrics;
+}
+
+qint64 Metrics::now()
+{
+    // monotonic clock shared by all threads
+    static const QElapsedTimer clock = startedClock();
+    return clock.nsecsElapsed();
+}
+
+void Metrics::recordCall(Method method, qint64 usecs)
+{
+    m_methods[method].record(usecs);
+}
+
+void Metrics::record(Histogram histogram, qint64 usecs)
+{
+    m_histograms[histogram].record(usecs);
+}
+
+void Metrics::add(Counter counter, qint64 value)
+{
+    m_counters[counter].fetchAndAddRelaxed(value);
+}
+
+qint64 Metrics::counter(Counter counter) const
+{
+    return m_counters[counter].load();
+}
+
+QJsonObject Metrics::toJson() const
+{
+    QJsonObject methods;
+    for(int i = 0; i < MethodCount; i++) {
+        if (m_methods[i].count() > 0) {
+            methods.insert(methodName(Method(i)), m_methods[i].toJson());
+        }
+    }
+
+    QJsonObject histograms;
+    for(int i = 0; i < HistogramCount; i++) {
+        histograms.insert(histogramName(Histogram(i)), m_histograms[i].toJson());
+    }
+
+    QJsonObject counters;
+    for(int i = 0; i < CounterCount; i++) {
+        counters.insert(counterName(Counter(i)), m_counters[i].load());
+    }
+
+    qint64 hits = counter(ContactCacheHits);
+    qint64 lookups = hits + counter(ContactCacheMisses);
+
+    QJsonObject result;
+    result.insert("methods", methods);
+    result.insert("histograms", histograms);
+    result.insert("counters", counters);
+    result.insert("contactCacheHitRatio", lookups ? (qreal(hits) / lookups) : 0.0);
+
+    QJsonArray stalls;
+    {
+        QMutexLocker locker(&m_stallsLock);
+        Q_FOREACH(const QJsonObject &stall, m_stalls) {
+            stalls << stall;
+        }
+    }
+    result.insert("stalls", stalls);
+    return result;
+}
+
+void Metrics::reset()
+{
+    for(int i = 0; i < MethodCount; i++) {
+        m_methods[i].reset();
+    }
+    for(int i = 0; i < HistogramCount; i++) {
+        m_histograms[i].reset();
+    }
+    // gauges are kept, they describe the current state
+    m_counters[ContactCacheHits].store(0);
+    m_counters[ContactCacheMisses].store(0);
+    m_counters[SignalsEmitted].store(0);
+    m_counters[SignalIdsEmitted].store(0);
+    m_counters[MainLoopStalls].store(0);
+
+    QMutexLocker locker(&m_stallsLock);
+    m_stalls.clear();
+}
+
+const char *Metrics::activity() const
+{
+    return m_activity.load();
+}
+
+const char *Metrics::setActivity(const char *name)
+{
+    return m_activity.fetchAndStoreRelaxed(name);
+}
+
+void Metrics::recordStall(qint64 usecs, const QString &activity, const QStringList &stack)
+{
+    record(MainLoopStall, usecs);
+    add(MainLoopStalls);
+
+    QJsonObject stall;
+    stall.insert("at", QDateTime::currentDateTime().toString(Qt::ISODate));
+    stall.insert("durationUs", usecs);
+    stall.insert("activity", activity);
+    if (!stack.isEmpty()) {
+        stall.insert("stack", QJsonArray::fromStringList(stack));
+    }
+
+    QMutexLocker locker(&m_stallsLock);
+    m_stalls << stall;
+    while (m_stalls.size() > METRICS_MAX_STALLS) {
+        m_stalls.removeFirst();
+    }
+}
+
+bool Metrics::isMainThread()
+{
+    QCoreApplication *app = QCoreApplication::instance();
+    return app && (QThread::currentThread() == app->thread());
+}
+
+const char *Metrics::methodName(Method method)
+{
+    static const char *names[] = {
+        "query", "queryIds", "queryCount", "contactsDetails", "count",
+        "createContact", "createContacts", "updateContacts", "removeContacts",
+        "importVCards", "exportVCards", "changesSince", "purgeContacts", "availableSources"
+    };
+    return names[method];
+}
+
+const char *Metrics::histogramName(Histogram histogram)
+{
+    static const char *names[] = {
+        "filterQueueTime", "filterRunTime", "contactRebuildTime", "mainLoopLag", "mainLoopStall"
+    };
+    return names[histogram];
+}
+
+const char *Metrics::counterName(Counter counter)
+{
+    static const char *names[] = {
+        "filtersPending", "filtersRunning", "openViews", "rowsHeld",
+        "contactCacheHits", "contactCacheMisses", "signalsEmitted", "signalIdsEmitted",
+        "mainLoopStalls", "viewsReapedOwnerGone", "viewsReapedIdle", "viewsReapedRowsLimit"
+    };
+    return names[counter];
+}
+
+MainLoopProbe::MainLoopProbe(int interval, QObject *parent)
+    : QObject(parent),
+      m_expected(0)
+{
+    m_timer.setInterval(interval);
+    connect(&m_timer, SIGNAL(timeout()), SLOT(onTimeout()));
+    m_expected = Metrics::now() + (qint64(interval) * 1000000);
+    m_timer.start();
+}
+
+void MainLoopProbe::onTimeout()
+{
+    qint64 now = Metrics::now();
+    Metrics::instance()->record(Metrics::MainLoopLag, qMax(qint64(0), now - m_expected) / 1000);
+    m_expected = now + (qint64(m_timer.interval()) * 1000000);
+}
+
+} //namespace
@@ -0,0 +1,222 @@
+/*
+ * Copyright 2013 Canonical Ltd.
+ *
+ * This file is part of contact-service-app.
+ *
+ * contact-service-app is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * contact-service-app is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GALERA_METRICS_H__
+#define __GALERA_METRICS_H__
+
+#include <QtCore/QAtomicInteger>
+#include <QtCore/QJsonObject>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QObject>
+#include <QtCore/QStringList>
+#include <QtCore/QTimer>
+
+namespace galera
+{
+
+/*
+ * Latency histogram in microseconds. Values below 16us are exact, above that each power of
+ * two is split in 8 buckets (~12% relative error). Recording is a few relaxed atomic
+ * operations, so it can be used from any thread.
+ */
+class LatencyHistogram
+{
+public:
+    enum {
+        LinearBuckets = 16,
+        SubBuckets = 8,
+        Buckets = LinearBuckets + (40 * SubBuckets)
+    };
+
+    LatencyHistogram();
+
+    void record(qint64 usecs);
+    void reset();
+
+    qint64 count() const;
+    qint64 percentile(qreal p) const;
+    QJsonObject toJson() const;
+
+private:
+    QAtomicInteger<qint64> m_buckets[Buckets];
+    QAtomicInteger<qint64> m_count;
+    QAtomicInteger<qint64> m_total;
+    QAtomicInteger<qint64> m_max;
+
+    LatencyHistogram(const LatencyHistogram &);
+
+    static int bucket(qint64 usecs);
+    static qint64 upperBound(int bucket);
+};
+
+/*
+ * Process wide runtime metrics. The counters are atomics and stay enabled in production, the
+ * snapshot is exported by the com.canonical.pim.AddressBook.Metrics interface.
+ */
+class Metrics
+{
+public:
+    // D-Bus methods measured by the service, the time is spent on the main loop
+    enum Method {
+        MethodQuery = 0,
+        MethodQueryIds,
+        MethodQueryCount,
+        MethodContactsDetails,
+        MethodViewCount,
+        MethodCreateContact,
+        MethodCreateContacts,
+        MethodUpdateContacts,
+        MethodRemoveContacts,
+        MethodImportVCards,
+        MethodExportVCards,
+        MethodChangesSince,
+        MethodPurgeContacts,
+        MethodAvailableSources,
+        MethodCount
+    };
+
+    enum Histogram {
+        // time from the query creation until a pool thread runs the filter
+        FilterQueueTime = 0,
+        FilterRunTime,
+        // time to rebuild the QContact of an individual
+        ContactRebuildTime,
+        // delay of the main loop to fire the probe timer
+        MainLoopLag,
+        // main loop iterations blocked over the watchdog threshold
+        MainLoopStall,
+        HistogramCount
+    };
+
+    enum Counter {
+        FiltersPending = 0,
+        FiltersRunning,
+        OpenViews,
+        RowsHeld,
+        ContactCacheHits,
+        ContactCacheMisses,
+        SignalsEmitted,
+        SignalIdsEmitted,
+        MainLoopStalls,
+        // views closed by the service instead of their client
+        ViewsReapedOwnerGone,
+        ViewsReapedIdle,
+        ViewsReapedRowsLimit,
+        CounterCount
+    };
+
+    static Metrics *instance();
+    static qint64 now();
+
+    void recordCall(Method method, qint64 usecs);
+    void record(Histogram histogram, qint64 usecs);
+    void add(Counter counter, qint64 value = 1);
+
+    qint64 counter(Counter counter) const;
+    QJsonObject toJson() const;
+    void reset();
+
+    // name of the main loop callback in progress, only static strings are accepted
+    const char *activity() const;
+    const char *setActivity(const char *name);
+    void recordStall(qint64 usecs, const QString &activity, const QStringList &stack);
+
+    static bool isMainThread();
+    static const char *methodName(Method method);
+
+private:
+    LatencyHistogram m_methods[MethodCount];
+    LatencyHistogram m_histograms[HistogramCount];
+    QAtomicInteger<qint64> m_counters[CounterCount];
+    QAtomicPointer<const char> m_activity;
+    mutable QMutex m_stallsLock;
+    QList<QJsonObject> m_stalls;
+
+    Metrics();
+    Metrics(const Metrics &);
+
+    static const char *histogramName(Histogram histogram);
+    static const char *counterName(Counter counter);
+};
+
+// measure how late the main loop fires a periodic timer
+class MainLoopProbe : public QObject
+{
+    Q_OBJECT
+public:
+    MainLoopProbe(int interval, QObject *parent = 0);
+
+private Q_SLOTS:
+    void onTimeout();
+
+private:
+    QTimer m_timer;
+    qint64 m_expected;
+};
+
+// mark the main loop callback running in the scope, reported by the stall watchdog
+class MetricsActivity
+{
+public:
+    MetricsActivity(const char *name)
+        : m_previous(0),
+          m_active(Metrics::isMainThread())
+    {
+        if (m_active) {
+            m_previous = Metrics::instance()->setActivity(name);
+        }
+    }
+
+    ~MetricsActivity()
+    {
+        if (m_active) {
+            Metrics::instance()->setActivity(m_previous);
+        }
+    }
+
+private:
+    const char *m_previous;
+    bool m_active;
+};
+
+// record the time spent in the scope for a D-Bus method
+class MetricsTimer
+{
+public:
+    MetricsTimer(Metrics::Method method)
+        : m_method(method),
+          m_started(Metrics::now()),
+          m_activity(Metrics::methodName(method))
+    {
+    }
+
+    ~MetricsTimer()
+    {
+        Metrics::instance()->recordCall(m_method, (Metrics::now() - m_started) / 1000);
+    }
+
+private:
+    Metrics::Method m_method;
+    qint64 m_started;
+    MetricsActivity m_activity;
+};
+
+} //namespace
+
+#endif
@@ -20,7 +20,9 @@
 #include "detail-context-parser.h"
 #include "gee-utils.h"
 #include "update-contact-request.h"
+#include "eds-client-pool.h"
 #include "e-source-ubuntu.h"
+#include "metrics.h"
 
 #include "common/vcard-parser.h"
 
@@ -156,6 +158,7 @@ QIndividual::QIndividual(FolksIndividual *individual, FolksIndividualAggregator
     : m_individual(0),
       m_aggregator(aggregator),
       m_contact(0),
+      m_lastWrittenGroups(0),
       m_currentUpdate(0),
       m_visible(true)
 {
@@ -917,16 +920,31 @@ QtContacts::QContact &QIndividual::contact()
 {
     if (!m_contact && m_individual) {
         QMutexLocker locker(&m_contactLock);
+        qint64 started = Metrics::now();
         updatePersonas();
         // avoid change on m_contact pointer until the contact is fully loaded
         QContact contact;
         contact.setId(QContactId("qtcontacts:galera:", m_id.toUtf8()));
         updateContact(&contact);
+        m_fingerprint = ContactFingerprint(contact);
         m_contact = new QContact(contact);
+
+        Metrics *metrics = Metrics::instance();
+        metrics->add(Metrics::ContactCacheMisses);
+        metrics->record(Metrics::ContactRebuildTime, (Metrics::now() - started) / 1000);
+    } else {
+        Metrics::instance()->add(Metrics::ContactCacheHits);
     }
     return *m_contact;
 }
 
+const ContactFingerprint &QIndividual::fingerprint()
+{
+    // the fingerprint is computed when the contact is loaded
+    contact();
+    return m_fingerprint;
+}
+
 void QIndividual::updatePersonas()
 {
     Q_FOREACH(FolksPersona *p, m_personas.values()) {
@@ -1087,11 +1105,14 @@ void QIndividual::updateContact(QContact *contact) const
     contact->saveDetail(&normalizedLabel);
 }
 
-bool QIndividual::update(const QtContacts::QContact &newContact, QObject *object, const char *slot)
+bool QIndividual::update(const QtContacts::QContact &newContact, QObject *object, const char *slot,
+                         const QString &token)
 {
-    QContact &originalContact = contact();
-    if (newContact != originalContact) {
-        m_currentUpdate = new UpdateContactRequest(newContact, this, object, slot);
+    // sync clients mostly send unchanged contacts, compare the hashes instead of the details
+    ContactFingerprint newFingerprint(newContact);
+    m_lastWrittenGroups = 0;
+    if (newFingerprint.contactHash() != fingerprint().contactHash()) {
+        m_currentUpdate = new UpdateContactRequest(newContact, newFingerprint, this, object, slot, token);
         if (!m_contactLock.tryLock(5000)) {
             qWarning() << "Fail to lock contact to update";
             m_currentUpdate->notifyError("Fail to update contact");
@@ -1107,6 +1128,7 @@ bool QIndividual::update(const QtContacts::QContact &newContact, QObject *object
             if (errorMessage.isEmpty()) {
                 markAsDirty();
             }
+            m_lastWrittenGroups = m_currentUpdate->writtenGroups();
             m_currentUpdate->deleteLater();
             m_currentUpdate = 0;
             m_contactLock.unlock();
@@ -1119,6 +1141,11 @@ bool QIndividual::update(const QtContacts::QContact &newContact, QObject *object
     }
 }
 
+int QIndividual::lastWrittenGroups() const
+{
+    return m_lastWrittenGroups;
+}
+
 bool QIndividual::update(const QString &vcard, QObject *object, const char *slot)
 {
     QContact contact = VCardParser::vcardToContact(vcard);
@@ -1159,6 +1186,7 @@ void QIndividual::clear()
     if (m_contact) {
         delete m_contact;
         m_contact = 0;
+        m_fingerprint = ContactFingerprint();
     }
 }
 
@@ -1188,7 +1216,7 @@ void QIndividual::flush()
 
 bool QIndividual::markAsDeleted()
 {
-    QString currentDate = QDateTime::currentDateTime().toString(Qt::ISODate);
+    QDateTime currentDate = QDateTime::currentDateTime();
     GeeSet *personas = folks_individual_get_personas(m_individual);
     if (!personas) {
         return false;
@@ -1205,30 +1233,20 @@ bool QIndividual::markAsDeleted()
 
             GError *error = NULL;
             ESource *source = edsf_persona_store_get_source(EDSF_PERSONA_STORE(store));
-            EClient *client = E_BOOK_CLIENT_CONNECT_SYNC(source, NULL, &error);
-            if (error) {
-                qWarning() << "Fail to connect with EDS" << error->message;
-                g_error_free(error);
+            EBookClient *client = EdsClientPool::instance()->client(source);
+            if (!client) {
                 continue;
             }
 
             EContact *c = edsf_persona_get_contact(EDSF_PERSONA(persona));
-            EVCardAttribute *attr = e_vcard_get_attribute(E_VCARD(c), X_DELETED_AT);
-            if (!attr) {
-                attr = e_vcard_attribute_new("", X_DELETED_AT);
-                e_vcard_add_attribute_with_value(E_VCARD(c), attr,
-                                                 currentDate.toUtf8().constData());
-            } else {
-                e_vcard_attribute_add_value(attr, currentDate.toUtf8().constData());
-            }
+            setContactDeletedAt(c, currentDate);
 
-            e_book_client_modify_contact_sync(E_BOOK_CLIENT(client), c, NULL, &error);
+            e_book_client_modify_contact_sync(client, c, NULL, &error);
             if (error) {
                 qWarning() << "Fail to update EDS contact:" << error->message;
                 g_error_free(error);
             } else {
-                m_deletedAt = QDateTime::currentDateTime();
-                notifyUpdate();
+                setDeletedAt(currentDate);
             }
 
             g_object_unref(client);
@@ -1240,6 +1258,27 @@ bool QIndividual::markAsDeleted()
     return m_deletedAt.isValid();
 }
 
+void QIndividual::setDeletedAt(const QDateTime &deletedAt, const QString &sourceId)
+{
+    m_deletedAt = deletedAt;
+    if (!sourceId.isEmpty()) {
+        m_deletedAtSource = sourceId;
+    }
+    notifyUpdate();
+}
+
+void QIndividual::setContactDeletedAt(EContact *contact, const QDateTime &deletedAt)
+{
+    QByteArray date = deletedAt.toString(Qt::ISODate).toUtf8();
+    EVCardAttribute *attr = e_vcard_get_attribute(E_VCARD(contact), X_DELETED_AT);
+    if (!attr) {
+        attr = e_vcard_attribute_new("", X_DELETED_AT);
+        e_vcard_add_attribute_with_value(E_VCARD(contact), attr, date.constData());
+    } else {
+        e_vcard_attribute_add_value(attr, date.constData());
+    }
+}
+
 QDateTime QIndividual::deletedAt()
 {
     if (!m_deletedAt.isNull()) {
@@ -1249,6 +1288,7 @@ QDateTime QIndividual::deletedAt()
     // make the date invalid to avoid re-check
     // it will be null again if the QIndividual is marked as dirty
     m_deletedAt = QDateTime(QDate(), QTime(0, 0, 0));
+    m_deletedAtSource.clear();
 
     GeeSet *personas = folks_individual_get_personas(m_individual);
     if (!personas) {
@@ -1265,6 +1305,7 @@ QDateTime QIndividual::deletedAt()
                 GString *value = e_vcard_attribute_get_value_decoded(attr);
                 if (value) {
                     m_deletedAt = QDateTime::fromString(value->str, Qt::ISODate);
+                    m_deletedAtSource = QString::fromUtf8(folks_persona_store_get_id(folks_persona_get_store(persona)));
                     g_string_free(value, true);
                     // Addressbook server does not support aggregation we can return
                     // the first person value
@@ -1277,6 +1318,84 @@ QDateTime QIndividual::deletedAt()
     return m_deletedAt;
 }
 
+// Return the contact timestamp without loading the full contact
+QContactDetail QIndividual::timestamp() const
+{
+    if (m_contact) {
+        return m_contact->detail<QContactTimestamp>();
+    }
+
+    if (!m_individual) {
+        return QContactDetail();
+    }
+
+    // the contact uses the timestamp of the persona with the lowest iid
+    QString firstIid;
+    FolksPersona *firstPersona = 0;
+    GeeSet *personas = folks_individual_get_personas(m_individual);
+    if (!personas) {
+        return QContactDetail();
+    }
+
+    GeeIterator *iter = gee_iterable_iterator(GEE_ITERABLE(personas));
+    while(gee_iterator_next(iter)) {
+        FolksPersona *persona = FOLKS_PERSONA(gee_iterator_get(iter));
+        QString iid = qStringFromGChar(folks_persona_get_iid(persona));
+        if (!firstPersona || (iid < firstIid)) {
+            if (firstPersona) {
+                g_object_unref(firstPersona);
+            }
+            firstPersona = persona;
+            firstIid = iid;
+        } else {
+            g_object_unref(persona);
+        }
+    }
+    g_object_unref(iter);
+
+    QContactDetail result;
+    if (firstPersona) {
+        result = getTimeStamp(firstPersona, 1);
+        g_object_unref(firstPersona);
+    }
+    return result;
+}
+
+// The ids of the sources (persona stores) of all personas of this individual
+QStringList QIndividual::sourceIds() const
+{
+    QStringList result;
+    if (!m_individual) {
+        return result;
+    }
+
+    GeeSet *personas = folks_individual_get_personas(m_individual);
+    if (!personas) {
+        return result;
+    }
+
+    GeeIterator *iter = gee_iterable_iterator(GEE_ITERABLE(personas));
+    while(gee_iterator_next(iter)) {
+        FolksPersona *persona = FOLKS_PERSONA(gee_iterator_get(iter));
+        QString storeId = qStringFromGChar(folks_persona_store_get_id(folks_persona_get_store(persona)));
+        if (!result.contains(storeId)) {
+            result << storeId;
+        }
+        g_object_unref(persona);
+    }
+    g_object_unref(iter);
+    return result;
+}
+
+// The id of the source that contains the persona marked as deleted
+QString QIndividual::deletedAtSource()
+{
+    if (m_deletedAt.isNull()) {
+        deletedAt();
+    }
+    return m_deletedAtSource;
+}
+
 void QIndividual::setVisible(bool visible)
 {
     m_visible = visible;
@@ -1801,53 +1920,56 @@ void QIndividual::setExtendedDetails(FolksPersona *persona,
     if (EDSF_IS_PERSONA_STORE(store)) {
         GError *error = NULL;
         ESource *source = edsf_persona_store_get_source(EDSF_PERSONA_STORE(store));
-        EClient *client = E_BOOK_CLIENT_CONNECT_SYNC(source, NULL, &error);
-        if (error) {
-            qWarning() << "Fail to connect with EDS" << error->message;
-            g_error_free(error);
-        } else {
+        EBookClient *client = EdsClientPool::instance()->client(source);
+        if (client) {
             EContact *c = edsf_persona_get_contact(EDSF_PERSONA(persona));
+            setContactExtendedDetails(c, xDetails, createdAtDate);
 
-            // create X-CREATED-AT if it does not exists
-            EVCardAttribute *attr = e_vcard_get_attribute(E_VCARD(c), X_CREATED_AT);
-            if (!attr) {
-                QDateTime createdAt = createdAtDate.isValid() ? createdAtDate : QDateTime::currentDateTime();
-                attr = e_vcard_attribute_new("", X_CREATED_AT);
-                e_vcard_add_attribute_with_value(E_VCARD(c),
-                                                 attr,
-                                                 createdAt.toUTC().toString(Qt::ISODate).toUtf8().constData());
+            e_book_client_modify_contact_sync(client, c, NULL, &error);
+            if (error) {
+                qWarning() << "Fail to update EDS contact:" << error->message;
+                g_error_free(error);
             }
+            g_object_unref(client);
+        }
+    }
+}
 
-            Q_FOREACH(const QContactDetail &d, xDetails) {
-                QContactExtendedDetail xd = static_cast<QContactExtendedDetail>(d);
-                // X_CREATED_AT should not be updated
-                if (xd.name() == X_CREATED_AT) {
-                    continue;
-                }
+void QIndividual::setContactExtendedDetails(EContact *contact,
+                                            const QList<QContactDetail> &xDetails,
+                                            const QDateTime &createdAtDate)
+{
+    // create X-CREATED-AT if it does not exists
+    EVCardAttribute *attr = e_vcard_get_attribute(E_VCARD(contact), X_CREATED_AT);
+    if (!attr) {
+        QDateTime createdAt = createdAtDate.isValid() ? createdAtDate : QDateTime::currentDateTime();
+        attr = e_vcard_attribute_new("", X_CREATED_AT);
+        e_vcard_add_attribute_with_value(E_VCARD(contact),
+                                         attr,
+                                         createdAt.toUTC().toString(Qt::ISODate).toUtf8().constData());
+    }
 
-                if (m_supportedExtendedDetails.contains(xd.name())) {
-                    // Remove old attribute
-                    attr = e_vcard_get_attribute(E_VCARD(c), xd.name().toUtf8().constData());
-                    if (attr) {
-                        e_vcard_remove_attribute(E_VCARD(c), attr);
-                    }
-
-                    attr = e_vcard_attribute_new("", xd.name().toUtf8().constData());
-                    e_vcard_add_attribute_with_value(E_VCARD(c),
-                                                     attr,
-                                                     xd.data().toString().toUtf8().constData());
-                } else {
-                    qWarning() << "Extended detail not supported" << xd.name();
-                }
-            }
+    Q_FOREACH(const QContactDetail &d, xDetails) {
+        QContactExtendedDetail xd = static_cast<QContactExtendedDetail>(d);
+        // X_CREATED_AT should not be updated
+        if (xd.name() == X_CREATED_AT) {
+            continue;
+        }
 
-            e_book_client_modify_contact_sync(E_BOOK_CLIENT(client), c, NULL, &error);
-            if (error) {
-                qWarning() << "Fail to update EDS contact:" << error->message;
-                g_error_free(error);
+        if (m_supportedExtendedDetails.contains(xd.name())) {
+            // Remove old attribute
+            attr = e_vcard_get_attribute(E_VCARD(contact), xd.name().toUtf8().constData());
+            if (attr) {
+                e_vcard_remove_attribute(E_VCARD(contact), attr);
             }
+
+            attr = e_vcard_attribute_new("", xd.name().toUtf8().constData());
+            e_vcard_add_attribute_with_value(E_VCARD(contact),
+                                             attr,
+                                             xd.data().toString().toUtf8().constData());
+        } else {
+            qWarning() << "Extended detail not supported" << xd.name();
         }
-        g_object_unref(client);
     }
 }
 
@@ -1855,6 +1977,7 @@ void QIndividual::markAsDirty()
 {
     delete m_contact;
     m_contact = 0;
+    m_fingerprint = ContactFingerprint();
     m_deletedAt = QDateTime();
 }
 
@@ -31,6 +31,9 @@
 #include <QtContacts/QContactDetail>
 
 #include <folks/folks.h>
+#include <libebook/libebook.h>
+
+#include "contact-fingerprint.h"
 
 namespace galera
 {
@@ -46,9 +49,13 @@ public:
 
     QString id() const;
     QtContacts::QContact &contact();
+    const ContactFingerprint &fingerprint();
     QtContacts::QContact copy(QList<QtContacts::QContactDetail::DetailType> fields);
     bool update(const QString &vcard, QObject *object, const char *slot);
-    bool update(const QtContacts::QContact &contact, QObject *object, const char *slot);
+    // the slot receives the token (the contact id by default) and the error message
+    bool update(const QtContacts::QContact &contact, QObject *object, const char *slot,
+                const QString &token = QString());
+    int lastWrittenGroups() const;
     void setIndividual(FolksIndividual *individual);
     FolksIndividual *individual() const;
     QList<FolksPersona*> personas() const;
@@ -57,15 +64,23 @@ public:
     void flush();
     bool markAsDeleted();
     QDateTime deletedAt();
+    QtContacts::QContactDetail timestamp() const;
+    QStringList sourceIds() const;
+    QString deletedAtSource();
+    void setDeletedAt(const QDateTime &deletedAt, const QString &sourceId = QString());
     void setVisible(bool visible);
     bool isVisible() const;
 
     static QtContacts::QContact copy(const QtContacts::QContact &c, QList<QtContacts::QContactDetail::DetailType> fields);
     static GHashTable *parseDetails(const QtContacts::QContact &contact);
     static QString displayName(const QtContacts::QContact &contact);
+    static void setContactDeletedAt(EContact *contact, const QDateTime &deletedAt);
     static void setExtendedDetails(FolksPersona *persona,
                                    const QList<QtContacts::QContactDetail> &xDetails,
                                    const QDateTime &createdAt = QDateTime());
+    static void setContactExtendedDetails(EContact *contact,
+                                          const QList<QtContacts::QContactDetail> &xDetails,
+                                          const QDateTime &createdAt = QDateTime());
 
     // enable or disable auto-link
     static void enableAutoLink(bool flag);
@@ -75,6 +90,8 @@ private:
     FolksIndividual *m_individual;
     FolksIndividualAggregator *m_aggregator;
     QtContacts::QContact *m_contact;
+    ContactFingerprint m_fingerprint;
+    int m_lastWrittenGroups;
     UpdateContactRequest *m_currentUpdate;
     QList<QPair<QObject*, QMetaMethod> > m_listeners;
     QMap<QString, FolksPersona*> m_personas;
@@ -83,6 +100,7 @@ private:
     QMetaObject::Connection m_updateConnection;
     QMutex m_contactLock;
     QDateTime m_deletedAt;
+    QString m_deletedAtSource;
     bool m_visible;
     static bool m_autoLink;
     static QStringList m_supportedExtendedDetails;
@@ -0,0 +1,126 @@
+/*
+ * Copyright 2013 Canonical Ltd.
+ *
+ * This file is part of contact-service-app.
+ *
+ * contact-service-app is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * contact-service-app is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include "query-executor.h"
+
+#include "common/filter.h"
+
+#include <QtCore/QDateTime>
+#include <QtCore/QThread>
+
+// queries returning up to this number of contacts are interactive
+#define INTERACTIVE_MAX_COUNT 50
+
+namespace galera
+{
+
+QueryExecutor::QueryExecutor()
+{
+    int cores = QThread::idealThreadCount();
+    m_interactive.setMaxThreadCount(cores);
+
+    int bulkThreads = qMax(1, cores / 2);
+    if (qEnvironmentVariableIsSet(ADDRESS_BOOK_BULK_THREADS)) {
+        bulkThreads = qMax(1, qgetenv(ADDRESS_BOOK_BULK_THREADS).toInt());
+    }
+    m_bulk.setMaxThreadCount(bulkThreads);
+}
+
+QueryExecutor *QueryExecutor::instance()
+{
+    static QueryExecutor executor;
+    return &executor;
+}
+
+void QueryExecutor::start(QRunnable *job, Priority priority)
+{
+    if (priority == Bulk) {
+        m_bulk.start(job);
+    } else {
+        m_interactive.start(job);
+    }
+}
+
+QJsonObject QueryExecutor::toJson() const
+{
+    QJsonObject interactive;
+    interactive.insert("maxThreads", m_interactive.maxThreadCount());
+    interactive.insert("activeThreads", m_interactive.activeThreadCount());
+
+    QJsonObject bulk;
+    bulk.insert("maxThreads", m_bulk.maxThreadCount());
+    bulk.insert("activeThreads", m_bulk.activeThreadCount());
+
+    QJsonObject result;
+    result.insert("interactive", interactive);
+    result.insert("bulk", bulk);
+    return result;
+}
+
+QueryExecutor::Priority QueryExecutor::classify(const Filter &filter, int maxCount)
+{
+    // lookups answered by an index
+    if (!filter.idsToFilter().isEmpty() || !filter.phoneNumberToFilter().isEmpty()) {
+        return Interactive;
+    }
+
+    if ((maxCount > 0) && (maxCount <= INTERACTIVE_MAX_COUNT)) {
+        return Interactive;
+    }
+
+    // full listings and sync scans
+    QDateTime since;
+    QtContacts::QContactChangeLogFilter::EventType eventType;
+    if (filter.isEmpty() ||
+        filter.removedSinceToFilter(&since) ||
+        filter.changedSinceToFilter(&since, &eventType)) {
+        return Bulk;
+    }
+
+    return Interactive;
+}
+
+QueryExecutor::Priority QueryExecutor::fromString(const QString &name, bool *ok)
+{
+    if (ok) {
+        *ok = true;
+    }
+    if (name == "interactive") {
+        return Interactive;
+    } else if (name == "bulk") {
+        return Bulk;
+    } else if (name != "auto" && ok) {
+        *ok = false;
+    }
+    return Auto;
+}
+
+QString QueryExecutor::toString(Priority priority)
+{
+    switch (priority) {
+    case Interactive:
+        return "interactive";
+    case Bulk:
+        return "bulk";
+    default:
+        return "auto";
+    }
+}
+
+} //namespace
@@ -0,0 +1,63 @@
+/*
+ * Copyright 2013 Canonical Ltd.
+ *
+ * This file is part of contact-service-app.
+ *
+ * contact-service-app is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * contact-service-app is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GALERA_QUERY_EXECUTOR_H__
+#define __GALERA_QUERY_EXECUTOR_H__
+
+#include <QtCore/QJsonObject>
+#include <QtCore/QRunnable>
+#include <QtCore/QString>
+#include <QtCore/QThreadPool>
+
+namespace galera
+{
+
+class Filter;
+
+// Thread pools used for the queries and the vcard jobs. Interactive work (lookups by id or
+// phone number, small queries) has its own threads and never waits behind the bulk scans
+// (full listings, change log scans, export and batch parsing), which are limited to a few cores.
+class QueryExecutor
+{
+public:
+    enum Priority {
+        Auto = 0,
+        Interactive,
+        Bulk
+    };
+
+    static QueryExecutor *instance();
+
+    void start(QRunnable *job, Priority priority);
+    QJsonObject toJson() const;
+
+    static Priority classify(const Filter &filter, int maxCount);
+    static Priority fromString(const QString &name, bool *ok = 0);
+    static QString toString(Priority priority);
+
+private:
+    QThreadPool m_interactive;
+    QThreadPool m_bulk;
+
+    QueryExecutor();
+    QueryExecutor(const QueryExecutor &);
+};
+
+} //namespace
+
+#endif
@@ -27,6 +27,19 @@
 
 using namespace QtContacts;
 
+namespace
+{
+
+class DetailChangeData
+{
+public:
+    galera::UpdateContactRequest *m_request;
+    QContactDetail::DetailType m_detailType;
+    int m_personaIndex;
+};
+
+}
+
 namespace galera {
 
 template<>
@@ -44,14 +57,21 @@ bool sortDetails<QContactDetail::TypeEmailAddress>(const QContactDetail &d1, con
 }
 
 
-UpdateContactRequest::UpdateContactRequest(QtContacts::QContact newContact, QIndividual *parent, QObject *listener, const char *slot)
+UpdateContactRequest::UpdateContactRequest(QtContacts::QContact newContact,
+                                           const ContactFingerprint &newFingerprint,
+                                           QIndividual *parent,
+                                           QObject *listener,
+                                           const char *slot,
+                                           const QString &token)
     : QObject(),
       m_parent(parent),
       m_object(listener),
-      m_currentPersona(0),
+      m_token(token.isEmpty() ? parent->id() : token),
       m_eventLoop(0),
       m_newContact(newContact),
-      m_currentPersonaIndex(0)
+      m_newFingerprint(newFingerprint),
+      m_pendingChanges(0),
+      m_writtenGroups(0)
 {
     int slotIndex = listener->metaObject()->indexOfSlot(++slot);
     if (slotIndex == -1) {
@@ -64,7 +84,7 @@ UpdateContactRequest::UpdateContactRequest(QtContacts::QContact newContact, QInd
 UpdateContactRequest::~UpdateContactRequest()
 {
     // check if there is a operation running
-    if (m_currentPersona != 0) {
+    if (m_pendingChanges > 0) {
         wait();
     }
 }
@@ -73,10 +93,11 @@ void UpdateContactRequest::invokeSlot(const QString &errorMessage)
 {
     Q_EMIT done(errorMessage);
 
-    if (m_slot.isValid() && m_parent) {
-        m_slot.invoke(m_object, Q_ARG(QString, m_parent->id()),
+    if (m_slot.isValid()) {
+        m_slot.invoke(m_object, Q_ARG(QString, m_token),
                                 Q_ARG(QString, errorMessage));
-    } else if (m_parent == 0) {
+    }
+    if (m_parent == 0) {
         // the object was detached we need to destroy it
         deleteLater();
     }
@@ -88,11 +109,28 @@ void UpdateContactRequest::invokeSlot(const QString &errorMessage)
 
 void UpdateContactRequest::start()
 {
-    m_currentDetailType = QContactDetail::TypeAddress;
     m_originalContact = m_parent->contact();
+    m_originalFingerprint = m_parent->fingerprint();
     m_personas = m_parent->personas();
-    m_currentPersonaIndex = 0;
-    updatePersona();
+    m_errorMessage.clear();
+    m_writtenGroups = 0;
+
+    // the personas can not be destroyed while the changes are running
+    Q_FOREACH(FolksPersona *persona, m_personas) {
+        g_object_ref(persona);
+    }
+
+    // avoid finish the request while starting the changes
+    m_pendingChanges++;
+    for(int i = 0; i < m_personas.size(); i++) {
+        // persona index starts at 1
+        updatePersona(m_personas[i], i + 1);
+    }
+    m_pendingChanges--;
+
+    if (m_pendingChanges == 0) {
+        finish();
+    }
 }
 
 void UpdateContactRequest::wait()
@@ -114,6 +152,11 @@ void UpdateContactRequest::notifyError(const QString &errorMessage)
     invokeSlot(errorMessage);
 }
 
+int UpdateContactRequest::writtenGroups() const
+{
+    return m_writtenGroups;
+}
+
 bool UpdateContactRequest::isEqual(const QtContacts::QContactDetail &detailA,
                                    const QtContacts::QContactDetail &detailB)
 {
@@ -184,6 +227,37 @@ bool UpdateContactRequest::isEqual(QList<QtContacts::QContactDetail> listA,
     return isEqual(listA, listB);
 }
 
+/*
+ * Compare a detail group using the contact fingerprints first, the details are only
+ * compared one by one if the group hashes differ.
+ */
+bool UpdateContactRequest::isEqual(QtContacts::QContactDetail::DetailType type,
+                                   int persona,
+                                   const QList<QtContacts::QContactDetail> &listA,
+                                   const QList<QtContacts::QContactDetail> &listB) const
+{
+    // new details without persona are saved on the first persona (see 'detailsFromPersona')
+    if (m_originalFingerprint.groupHash(type, persona) ==
+        m_newFingerprint.groupHash(type, persona, (persona == 1))) {
+        return true;
+    }
+    return isEqual(listA, listB);
+}
+
+bool UpdateContactRequest::isEqual(QtContacts::QContactDetail::DetailType type,
+                                   int persona,
+                                   const QList<QtContacts::QContactDetail> &listA,
+                                   const QtContacts::QContactDetail &prefA,
+                                   const QList<QtContacts::QContactDetail> &listB,
+                                   const QtContacts::QContactDetail &prefB) const
+{
+    if (prefA != prefB) {
+        return false;
+    }
+
+    return isEqual(type, persona, listA, listB);
+}
+
 bool UpdateContactRequest::checkPersona(QtContacts::QContactDetail &det, int persona)
 {
     if (det.detailUri().isEmpty()) {
@@ -237,20 +311,21 @@ QList<QtContacts::QContactDetail> UpdateContactRequest::detailsFromPersona(QtCon
     return detailsFromPersona(m_newContact, type, persona, (persona==1), pref);
 }
 
-void UpdateContactRequest::updateAddress()
+bool UpdateContactRequest::updateAddress(FolksPersona *persona, int index)
 {
     QContactDetail originalPref;
     QList<QContactDetail> originalDetails = originalDetailsFromPersona(QContactDetail::TypeAddress,
-                                                                       m_currentPersonaIndex,
+                                                                       index,
                                                                        &originalPref);
     QContactDetail prefDetail;
     QList<QContactDetail> newDetails = detailsFromPersona(QContactDetail::TypeAddress,
-                                                          m_currentPersonaIndex,
+                                                          index,
                                                           &prefDetail);
 
-    if (m_currentPersona &&
-        FOLKS_IS_POSTAL_ADDRESS_DETAILS(m_currentPersona) &&
-        !isEqual(originalDetails, originalPref, newDetails, prefDetail)) {
+    if (persona &&
+        FOLKS_IS_POSTAL_ADDRESS_DETAILS(persona) &&
+        !isEqual(QContactDetail::TypeAddress, index,
+                 originalDetails, originalPref, newDetails, prefDetail)) {
         qDebug() << "Adderess diff";
         GeeSet *newSet = SET_AFD_NEW();
 
@@ -282,24 +357,25 @@ void UpdateContactRequest::updateAddress()
             g_object_unref(pa);
         }
 
-        folks_postal_address_details_change_postal_addresses(FOLKS_POSTAL_ADDRESS_DETAILS(m_currentPersona),
+        folks_postal_address_details_change_postal_addresses(FOLKS_POSTAL_ADDRESS_DETAILS(persona),
                                                              newSet,
                                                              (GAsyncReadyCallback) updateDetailsDone,
-                                                             this);
+                                                             detailChangeData(QContactDetail::TypeAddress, index));
         g_object_unref(newSet);
-    } else {
-        updateDetailsDone(0, 0, this);
+        return true;
     }
+    return false;
 }
 
-void UpdateContactRequest::updateAvatar()
+bool UpdateContactRequest::updateAvatar(FolksPersona *persona, int index)
 {
-    QList<QContactDetail> originalDetails = originalDetailsFromPersona(QContactDetail::TypeAvatar, m_currentPersonaIndex, 0);
-    QList<QContactDetail> newDetails = detailsFromPersona(QContactDetail::TypeAvatar, m_currentPersonaIndex, 0);
+    QList<QContactDetail> originalDetails = originalDetailsFromPersona(QContactDetail::TypeAvatar, index, 0);
+    QList<QContactDetail> newDetails = detailsFromPersona(QContactDetail::TypeAvatar, index, 0);
 
-    if (m_currentPersona &&
-        FOLKS_IS_AVATAR_DETAILS(m_currentPersona) &&
-        !isEqual(originalDetails, newDetails)) {
+    if (persona &&
+        FOLKS_IS_AVATAR_DETAILS(persona) &&
+        !isEqual(QContactDetail::TypeAvatar, index,
+                 originalDetails, newDetails)) {
         qDebug() << "avatar diff:"
                  << "\n\t" << originalDetails.size() << (originalDetails.size() > 0 ? originalDetails[0] : QContactDetail()) << "\n"
                  << "\n\t" << newDetails.size() << (newDetails.size() > 0 ? newDetails[0] : QContactDetail());
@@ -308,14 +384,14 @@ void UpdateContactRequest::updateAvatar()
         QContactExtendedDetail originalAvatarRev;
         QContactExtendedDetail newAvatarRev;
         Q_FOREACH(const QContactExtendedDetail &det,
-                  originalDetailsFromPersona(QContactDetail::TypeExtendedDetail, m_currentPersonaIndex, 0)) {
+                  originalDetailsFromPersona(QContactDetail::TypeExtendedDetail, index, 0)) {
             if (det.name() == "X-AVATAR-REV") {
                 originalAvatarRev = det;
                 break;
             }
         }
         Q_FOREACH(const QContactExtendedDetail &det,
-                  detailsFromPersona(QContactDetail::TypeExtendedDetail, m_currentPersonaIndex, 0)) {
+                  detailsFromPersona(QContactDetail::TypeExtendedDetail, index, 0)) {
             if (det.name() == "X-AVATAR-REV") {
                 newAvatarRev = det;
                 break;
@@ -355,27 +431,28 @@ void UpdateContactRequest::updateAvatar()
                 }
             }
 
-            folks_avatar_details_change_avatar(FOLKS_AVATAR_DETAILS(m_currentPersona),
+            folks_avatar_details_change_avatar(FOLKS_AVATAR_DETAILS(persona),
                                                G_LOADABLE_ICON(avatarFileIcon),
                                                (GAsyncReadyCallback) updateDetailsDone,
-                                               this);
+                                               detailChangeData(QContactDetail::TypeAvatar, index));
             if (avatarFileIcon) {
                 g_object_unref(avatarFileIcon);
             }
-            return;
+            return true;
         }
     }
-    updateDetailsDone(0, 0, this);
+    return false;
 }
 
-void UpdateContactRequest::updateBirthday()
+bool UpdateContactRequest::updateBirthday(FolksPersona *persona, int index)
 {
-    QList<QContactDetail> originalDetails = originalDetailsFromPersona(QContactDetail::TypeBirthday, m_currentPersonaIndex, 0);
-    QList<QContactDetail> newDetails = detailsFromPersona(QContactDetail::TypeBirthday, m_currentPersonaIndex, 0);
+    QList<QContactDetail> originalDetails = originalDetailsFromPersona(QContactDetail::TypeBirthday, index, 0);
+    QList<QContactDetail> newDetails = detailsFromPersona(QContactDetail::TypeBirthday, index, 0);
 
-    if (m_currentPersona &&
-        FOLKS_IS_BIRTHDAY_DETAILS(m_currentPersona) &&
-        !isEqual(originalDetails, newDetails)) {
+    if (persona &&
+        FOLKS_IS_BIRTHDAY_DETAILS(persona) &&
+        !isEqual(QContactDetail::TypeBirthday, index,
+                 originalDetails, newDetails)) {
         qDebug() << "birthday diff";
         //Only supports one birthday
         QDateTime dateTimeBirthday;
@@ -390,23 +467,23 @@ void UpdateContactRequest::updateBirthday()
         if (dateTimeBirthday.isValid()) {
             dateTime = g_date_time_new_from_unix_utc(dateTimeBirthday.toMSecsSinceEpoch() / 1000);
         }
-        folks_birthday_details_change_birthday(FOLKS_BIRTHDAY_DETAILS(m_currentPersona),
+        folks_birthday_details_change_birthday(FOLKS_BIRTHDAY_DETAILS(persona),
                                                dateTime,
                                                (GAsyncReadyCallback) updateDetailsDone,
-                                               this);
+                                               detailChangeData(QContactDetail::TypeBirthday, index));
         if (dateTime) {
             g_date_time_unref(dateTime);
         }
-    } else {
-        updateDetailsDone(0, 0, this);
+        return true;
     }
+    return false;
 }
 
-void UpdateContactRequest::updateFullName(const QString &fullName)
+bool UpdateContactRequest::updateFullName(FolksPersona *persona, int index, const QString &fullName)
 {
-    QList<QContactDetail> originalDetails = originalDetailsFromPersona(QContactDetail::TypeDisplayLabel, m_currentPersonaIndex, 0);
-    if (m_currentPersona &&
-        FOLKS_IS_NAME_DETAILS(m_currentPersona) &&
+    QList<QContactDetail> originalDetails = originalDetailsFromPersona(QContactDetail::TypeDisplayLabel, index, 0);
+    if (persona &&
+        FOLKS_IS_NAME_DETAILS(persona) &&
         originalDetails.size() > 0 &&
         (originalDetails[0].value(QContactDisplayLabel::FieldLabel).toString() != fullName)) {
         qDebug() << "Full Name diff:"
@@ -414,30 +491,31 @@ void UpdateContactRequest::updateFullName(const QString &fullName)
                  << "\n\t" << fullName;
         //Only supports one fullName
         QByteArray fullNameUtf8 = fullName.toUtf8();
-        folks_name_details_change_full_name(FOLKS_NAME_DETAILS(m_currentPersona),
+        folks_name_details_change_full_name(FOLKS_NAME_DETAILS(persona),
                                             fullNameUtf8.constData(),
                                             (GAsyncReadyCallback) updateDetailsDone,
-                                            this);
-    } else {
-        updateDetailsDone(0, 0, this);
+                                            detailChangeData(QContactDetail::TypeDisplayLabel, index));
+        return true;
     }
+    return false;
 }
 
-void UpdateContactRequest::updateEmail()
+bool UpdateContactRequest::updateEmail(FolksPersona *persona, int index)
 {
     QContactDetail originalPref;
     QList<QContactDetail> originalDetails = originalDetailsFromPersona(QContactDetail::TypeEmailAddress,
-                                                                       m_currentPersonaIndex,
+                                                                       index,
                                                                        &originalPref);
 
     QContactDetail prefDetail;
     QList<QContactDetail> newDetails = detailsFromPersona(QContactDetail::TypeEmailAddress,
-                                                          m_currentPersonaIndex,
+                                                          index,
                                                           &prefDetail);
 
-    if (m_currentPersona &&
-        FOLKS_IS_EMAIL_DETAILS(m_currentPersona) &&
-        !isEqual(originalDetails, originalPref, newDetails, prefDetail)) {
+    if (persona &&
+        FOLKS_IS_EMAIL_DETAILS(persona) &&
+        !isEqual(QContactDetail::TypeEmailAddress, index,
+                 originalDetails, originalPref, newDetails, prefDetail)) {
         qDebug() << "email diff";
         GeeSet *newSet = SET_AFD_NEW();
 
@@ -452,24 +530,25 @@ void UpdateContactRequest::updateEmail()
             g_object_unref(field);
         }
 
-        folks_email_details_change_email_addresses(FOLKS_EMAIL_DETAILS(m_currentPersona),
+        folks_email_details_change_email_addresses(FOLKS_EMAIL_DETAILS(persona),
                                                    newSet,
                                                    (GAsyncReadyCallback) updateDetailsDone,
-                                                   this);
+                                                   detailChangeData(QContactDetail::TypeEmailAddress, index));
         g_object_unref(newSet);
-    } else {
-        updateDetailsDone(0, 0, this);
+        return true;
     }
+    return false;
 }
 
-void UpdateContactRequest::updateName()
+bool UpdateContactRequest::updateName(FolksPersona *persona, int index)
 {
-    QList<QContactDetail> originalDetails = originalDetailsFromPersona(QContactDetail::TypeName, m_currentPersonaIndex, 0);
-    QList<QContactDetail> newDetails = detailsFromPersona(QContactDetail::TypeName, m_currentPersonaIndex, 0);
+    QList<QContactDetail> originalDetails = originalDetailsFromPersona(QContactDetail::TypeName, index, 0);
+    QList<QContactDetail> newDetails = detailsFromPersona(QContactDetail::TypeName, index, 0);
 
-    if (m_currentPersona &&
-        FOLKS_IS_NAME_DETAILS(m_currentPersona) &&
-        !isEqual(originalDetails, newDetails)) {
+    if (persona &&
+        FOLKS_IS_NAME_DETAILS(persona) &&
+        !isEqual(QContactDetail::TypeName, index,
+                 originalDetails, newDetails)) {
         //Only supports one fullName
         FolksStructuredName *sn = 0;
         if (newDetails.count()) {
@@ -487,26 +566,27 @@ void UpdateContactRequest::updateName()
                                            suffix.constData());
         }
 
-        folks_name_details_change_structured_name(FOLKS_NAME_DETAILS(m_currentPersona),
+        folks_name_details_change_structured_name(FOLKS_NAME_DETAILS(persona),
                                                   sn,
                                                   (GAsyncReadyCallback) updateDetailsDone,
-                                                  this);
+                                                  detailChangeData(QContactDetail::TypeName, index));
         if (sn) {
             g_object_unref(sn);
         }
-    } else {
-        updateDetailsDone(0, 0, this);
+        return true;
     }
+    return false;
 }
 
-void UpdateContactRequest::updateNickname()
+bool UpdateContactRequest::updateNickname(FolksPersona *persona, int index)
 {
-    QList<QContactDetail> originalDetails = originalDetailsFromPersona(QContactDetail::TypeNickname, m_currentPersonaIndex, 0);
-    QList<QContactDetail> newDetails = detailsFromPersona(QContactDetail::TypeNickname, m_currentPersonaIndex, 0);
+    QList<QContactDetail> originalDetails = originalDetailsFromPersona(QContactDetail::TypeNickname, index, 0);
+    QList<QContactDetail> newDetails = detailsFromPersona(QContactDetail::TypeNickname, index, 0);
 
-    if (m_currentPersona &&
-        FOLKS_IS_NAME_DETAILS(m_currentPersona) &&
-        !isEqual(originalDetails, newDetails)) {
+    if (persona &&
+        FOLKS_IS_NAME_DETAILS(persona) &&
+        !isEqual(QContactDetail::TypeNickname, index,
+                 originalDetails, newDetails)) {
         qDebug() << "Nickname diff";
         //Only supports one fullName
         QString nicknameValue;
@@ -516,25 +596,26 @@ void UpdateContactRequest::updateNickname()
         }
 
         QByteArray nicknameValueUtf8 = nicknameValue.toUtf8();
-        folks_name_details_change_nickname(FOLKS_NAME_DETAILS(m_currentPersona),
+        folks_name_details_change_nickname(FOLKS_NAME_DETAILS(persona),
                                            nicknameValueUtf8.constData(),
                                            (GAsyncReadyCallback) updateDetailsDone,
-                                           this);
-    } else {
-        updateDetailsDone(0, 0, this);
+                                           detailChangeData(QContactDetail::TypeNickname, index));
+        return true;
     }
+    return false;
 }
 
-void UpdateContactRequest::updateNote()
+bool UpdateContactRequest::updateNote(FolksPersona *persona, int index)
 {
     QContactDetail originalPref;
-    QList<QContactDetail> originalDetails = originalDetailsFromPersona(QContactDetail::TypeNote, m_currentPersonaIndex, &originalPref);
+    QList<QContactDetail> originalDetails = originalDetailsFromPersona(QContactDetail::TypeNote, index, &originalPref);
     QContactDetail prefDetail;
-    QList<QContactDetail> newDetails = detailsFromPersona(QContactDetail::TypeNote, m_currentPersonaIndex, &prefDetail);
+    QList<QContactDetail> newDetails = detailsFromPersona(QContactDetail::TypeNote, index, &prefDetail);
 
-    if (m_currentPersona &&
-        FOLKS_IS_NOTE_DETAILS(m_currentPersona) &&
-        !isEqual(originalDetails, originalPref, newDetails, prefDetail)) {
+    if (persona &&
+        FOLKS_IS_NOTE_DETAILS(persona) &&
+        !isEqual(QContactDetail::TypeNote, index,
+                 originalDetails, originalPref, newDetails, prefDetail)) {
         qDebug() << "notes diff";
         GeeSet *newSet = SET_AFD_NEW();
 
@@ -549,30 +630,31 @@ void UpdateContactRequest::updateNote()
             g_object_unref(field);
         }
 
-        folks_note_details_change_notes(FOLKS_NOTE_DETAILS(m_currentPersona),
+        folks_note_details_change_notes(FOLKS_NOTE_DETAILS(persona),
                                         newSet,
                                         (GAsyncReadyCallback) updateDetailsDone,
-                                        this);
+                                        detailChangeData(QContactDetail::TypeNote, index));
         g_object_unref(newSet);
-    } else {
-        updateDetailsDone(0, 0, this);
+        return true;
     }
+    return false;
 }
 
-void UpdateContactRequest::updateOnlineAccount()
+bool UpdateContactRequest::updateOnlineAccount(FolksPersona *persona, int index)
 {
     QContactDetail originalPref;
     QList<QContactDetail> originalDetails = originalDetailsFromPersona(QContactDetail::TypeOnlineAccount,
-                                                                       m_currentPersonaIndex,
+                                                                       index,
                                                                        &originalPref);
     QContactDetail prefDetail;
     QList<QContactDetail> newDetails = detailsFromPersona(QContactDetail::TypeOnlineAccount,
-                                                          m_currentPersonaIndex,
+                                                          index,
                                                           &prefDetail);
 
-    if (m_currentPersona &&
-        FOLKS_IS_IM_DETAILS(m_currentPersona) &&
-        !isEqual(originalDetails, originalPref, newDetails, prefDetail)) {
+    if (persona &&
+        FOLKS_IS_IM_DETAILS(persona) &&
+        !isEqual(QContactDetail::TypeOnlineAccount, index,
+                 originalDetails, originalPref, newDetails, prefDetail)) {
         qDebug() << "OnlineAccounts diff";
         GeeMultiMap *imMap = GEE_MULTI_MAP_AFD_NEW(FOLKS_TYPE_IM_FIELD_DETAILS);
 
@@ -593,31 +675,32 @@ void UpdateContactRequest::updateOnlineAccount()
             }
         }
 
-       folks_im_details_change_im_addresses(FOLKS_IM_DETAILS(m_currentPersona),
+       folks_im_details_change_im_addresses(FOLKS_IM_DETAILS(persona),
                                             imMap,
                                             (GAsyncReadyCallback) updateDetailsDone,
-                                            this);
+                                            detailChangeData(QContactDetail::TypeOnlineAccount, index));
 
         g_object_unref(imMap);
-    } else {
-        updateDetailsDone(0, 0, this);
+        return true;
     }
+    return false;
 }
 
-void UpdateContactRequest::updateOrganization()
+bool UpdateContactRequest::updateOrganization(FolksPersona *persona, int index)
 {
     QContactDetail originalPref;
     QList<QContactDetail> originalDetails = originalDetailsFromPersona(QContactDetail::TypeOrganization,
-                                                                       m_currentPersonaIndex,
+                                                                       index,
                                                                        &originalPref);
     QContactDetail prefDetail;
     QList<QContactDetail> newDetails = detailsFromPersona(QContactDetail::TypeOrganization,
-                                                          m_currentPersonaIndex,
+                                                          index,
                                                           &prefDetail);
 
-    if (m_currentPersona &&
-        FOLKS_IS_ROLE_DETAILS(m_currentPersona) &&
-        !isEqual(originalDetails, originalPref, newDetails, prefDetail)) {
+    if (persona &&
+        FOLKS_IS_ROLE_DETAILS(persona) &&
+        !isEqual(QContactDetail::TypeOrganization, index,
+                 originalDetails, originalPref, newDetails, prefDetail)) {
         qDebug() << "Organization diff";
         GeeSet *newSet = SET_AFD_NEW();
 
@@ -640,31 +723,32 @@ void UpdateContactRequest::updateOrganization()
             g_object_unref(roleValue);
         }
 
-        folks_role_details_change_roles(FOLKS_ROLE_DETAILS(m_currentPersona),
+        folks_role_details_change_roles(FOLKS_ROLE_DETAILS(persona),
                                         newSet,
                                         (GAsyncReadyCallback) updateDetailsDone,
-                                        this);
+                                        detailChangeData(QContactDetail::TypeOrganization, index));
 
         g_object_unref(newSet);
-    } else {
-        updateDetailsDone(0, 0, this);
+        return true;
     }
+    return false;
 }
 
-void UpdateContactRequest::updatePhone()
+bool UpdateContactRequest::updatePhone(FolksPersona *persona, int index)
 {
     QContactDetail originalPref;
     QList<QContactDetail> originalDetails = originalDetailsFromPersona(QContactDetail::TypePhoneNumber,
-                                                                       m_currentPersonaIndex,
+                                                                       index,
                                                                        &originalPref);
     QContactDetail prefDetail;
     QList<QContactDetail> newDetails = detailsFromPersona(QContactDetail::TypePhoneNumber,
-                                                          m_currentPersonaIndex,
+                                                          index,
                                                           &prefDetail);
 
-    if (m_currentPersona &&
-        FOLKS_IS_PHONE_DETAILS(m_currentPersona) &&
-        !isEqual(originalDetails, originalPref, newDetails, prefDetail)) {
+    if (persona &&
+        FOLKS_IS_PHONE_DETAILS(persona) &&
+        !isEqual(QContactDetail::TypePhoneNumber, index,
+                 originalDetails, originalPref, newDetails, prefDetail)) {
         qDebug() << "Phone diff:"
                  << "\n\t" << originalDetails.size() << (originalDetails.size() > 0 ? originalDetails[0] : QContactDetail()) << "\n"
                  << "\n\t" << newDetails.size() << (newDetails.size() > 0 ? newDetails[0] : QContactDetail());
@@ -682,31 +766,32 @@ void UpdateContactRequest::updatePhone()
             g_object_unref(field);
         }
 
-        folks_phone_details_change_phone_numbers(FOLKS_PHONE_DETAILS(m_currentPersona),
+        folks_phone_details_change_phone_numbers(FOLKS_PHONE_DETAILS(persona),
                                                  newSet,
                                                  (GAsyncReadyCallback) updateDetailsDone,
-                                                 this);
+                                                 detailChangeData(QContactDetail::TypePhoneNumber, index));
         g_object_unref(newSet);
-    } else {
-        updateDetailsDone(0, 0, this);
+        return true;
     }
+    return false;
 }
 
-void UpdateContactRequest::updateUrl()
+bool UpdateContactRequest::updateUrl(FolksPersona *persona, int index)
 {
     QContactDetail originalPref;
     QList<QContactDetail> originalDetails = originalDetailsFromPersona(QContactDetail::TypeUrl,
-                                                                       m_currentPersonaIndex,
+                                                                       index,
                                                                        &originalPref);
 
     QContactDetail prefDetail;
     QList<QContactDetail> newDetails = detailsFromPersona(QContactDetail::TypeUrl,
-                                                          m_currentPersonaIndex,
+                                                          index,
                                                           &prefDetail);
 
-    if (m_currentPersona &&
-        FOLKS_IS_URL_DETAILS(m_currentPersona) &&
-        !isEqual(originalDetails, originalPref, newDetails, prefDetail)) {
+    if (persona &&
+        FOLKS_IS_URL_DETAILS(persona) &&
+        !isEqual(QContactDetail::TypeUrl, index,
+                 originalDetails, originalPref, newDetails, prefDetail)) {
         qDebug() << "Url diff";
         GeeSet *newSet = SET_AFD_NEW();
 
@@ -721,20 +806,20 @@ void UpdateContactRequest::updateUrl()
             g_object_unref(field);
         }
 
-        folks_url_details_change_urls(FOLKS_URL_DETAILS(m_currentPersona),
+        folks_url_details_change_urls(FOLKS_URL_DETAILS(persona),
                                       newSet,
                                       (GAsyncReadyCallback) updateDetailsDone,
-                                      this);
+                                      detailChangeData(QContactDetail::TypeUrl, index));
         g_object_unref(newSet);
-    } else {
-        updateDetailsDone(0, 0, this);
+        return true;
     }
+    return false;
 }
 
-void UpdateContactRequest::updateFavorite()
+bool UpdateContactRequest::updateFavorite(FolksPersona *persona, int index)
 {
-    QList<QContactDetail> originalDetails = originalDetailsFromPersona(QContactDetail::TypeFavorite, m_currentPersonaIndex, 0);
-    QList<QContactDetail> newDetails = detailsFromPersona(QContactDetail::TypeFavorite, m_currentPersonaIndex, 0);
+    QList<QContactDetail> originalDetails = originalDetailsFromPersona(QContactDetail::TypeFavorite, index, 0);
+    QList<QContactDetail> newDetails = detailsFromPersona(QContactDetail::TypeFavorite, index, 0);
 
     // as default all contacts has favorte set to false
     if (newDetails.isEmpty()) {
@@ -743,9 +828,10 @@ void UpdateContactRequest::updateFavorite()
         newDetails << fav;
     }
 
-    if (m_currentPersona &&
-        FOLKS_IS_FAVOURITE_DETAILS(m_currentPersona) &&
-        !isEqual(originalDetails, newDetails)) {
+    if (persona &&
+        FOLKS_IS_FAVOURITE_DETAILS(persona) &&
+        !isEqual(QContactDetail::TypeFavorite, index,
+                 originalDetails, newDetails)) {
         qDebug() << "Favorite diff:"
                  << "\n\t" << originalDetails.size() << (originalDetails.size() > 0 ? originalDetails[0] : QContactDetail()) << "\n"
                  << "\n\t" << newDetails.size() << (newDetails.size() > 0 ? newDetails[0] : QContactDetail());
@@ -756,42 +842,84 @@ void UpdateContactRequest::updateFavorite()
             QContactFavorite favorite = static_cast<QContactFavorite>(newDetails[0]);
             isFavorite = favorite.isFavorite();
         }
-        folks_favourite_details_change_is_favourite(FOLKS_FAVOURITE_DETAILS(m_currentPersona),
+        folks_favourite_details_change_is_favourite(FOLKS_FAVOURITE_DETAILS(persona),
                                                     isFavorite,
                                                     (GAsyncReadyCallback) updateDetailsDone,
-                                                    this);
-    } else {
-        updateDetailsDone(0, 0, this);
+                                                    detailChangeData(QContactDetail::TypeFavorite, index));
+        return true;
     }
+    return false;
 }
 
-void UpdateContactRequest::updateExtendedDetails()
+void UpdateContactRequest::updateExtendedDetails(FolksPersona *persona, int index)
 {
-    QList<QContactDetail> originalDetails = originalDetailsFromPersona(QContactDetail::TypeExtendedDetail, m_currentPersonaIndex, 0);
-    QList<QContactDetail> newDetails = detailsFromPersona(QContactDetail::TypeExtendedDetail, m_currentPersonaIndex, 0);
-    if (m_currentPersona &&
-        !isEqual(originalDetails, newDetails)) {
+    QList<QContactDetail> originalDetails = originalDetailsFromPersona(QContactDetail::TypeExtendedDetail, index, 0);
+    QList<QContactDetail> newDetails = detailsFromPersona(QContactDetail::TypeExtendedDetail, index, 0);
+    if (persona &&
+        !isEqual(QContactDetail::TypeExtendedDetail, index,
+                 originalDetails, newDetails)) {
         qDebug() << "Extended details diff";
-        QIndividual::setExtendedDetails(m_currentPersona, newDetails);
+        QIndividual::setExtendedDetails(persona, newDetails);
+        m_writtenGroups++;
     }
-    updateDetailsDone(0, 0, this);
 }
 
-void UpdateContactRequest::updatePersona()
-{
-    if (m_personas.size() <= m_currentPersonaIndex) {
-        m_currentPersona = 0;
+/*
+ * Start the change of all details that differ from the original contact, the calls
+ * are not chained, all of them run at the same time and 'updateDetailsDone' joins
+ * the results.
+ */
+void UpdateContactRequest::updatePersona(FolksPersona *persona, int index)
+{
+    updateAddress(persona, index);
+    updateAvatar(persona, index);
+    updateBirthday(persona, index);
+    updateFullName(persona, index, QIndividual::displayName(m_newContact));
+    //WORKAROUND: Folks automatically add online accounts based on e-mail address
+    // for example user@gmail.com will create a jabber account, and this causes some
+    // confusions on the service during the update, because of that we first update
+    // the online account and only update the e-mails after it finishes
+    if (!updateOnlineAccount(persona, index)) {
+        updateEmail(persona, index);
+    }
+    updateFavorite(persona, index);
+    updateName(persona, index);
+    updateNickname(persona, index);
+    updateNote(persona, index);
+    updateOrganization(persona, index);
+    updatePhone(persona, index);
+    updateUrl(persona, index);
+}
+
+gpointer UpdateContactRequest::detailChangeData(QContactDetail::DetailType detailType, int index)
+{
+    DetailChangeData *data = new DetailChangeData;
+    data->m_request = this;
+    data->m_detailType = detailType;
+    data->m_personaIndex = index;
+    m_pendingChanges++;
+    m_writtenGroups++;
+    return data;
+}
+
+void UpdateContactRequest::finish()
+{
+    if (m_errorMessage.isEmpty()) {
+        // extended details are saved synchronously and can not run together with the folks changes
+        for(int i = 0; i < m_personas.size(); i++) {
+            updateExtendedDetails(m_personas[i], i + 1);
+        }
         if (m_parent) {
             m_parent->flush();
         }
-        invokeSlot();
-    } else {
-        m_currentPersona = m_personas[m_currentPersonaIndex];
-        g_object_ref(m_currentPersona);
-        m_currentDetailType = QContactDetail::TypeUndefined;
-        m_currentPersonaIndex++;
-        updateDetailsDone(0, 0, this);
     }
+
+    Q_FOREACH(FolksPersona *persona, m_personas) {
+        g_object_unref(persona);
+    }
+    m_personas.clear();
+
+    invokeSlot(m_errorMessage);
 }
 
 QString UpdateContactRequest::callDetailChangeFinish(QtContacts::QContactDetail::DetailType detailType,
@@ -855,97 +983,33 @@ QString UpdateContactRequest::callDetailChangeFinish(QtContacts::QContactDetail:
 
 void UpdateContactRequest::updateDetailsDone(GObject *detail, GAsyncResult *result, gpointer userdata)
 {
-    UpdateContactRequest *self = static_cast<UpdateContactRequest*>(userdata);
+    DetailChangeData *data = static_cast<DetailChangeData*>(userdata);
+    UpdateContactRequest *self = data->m_request;
 
     QString errorMessage;
-    if (detail && result) {
-        if (FOLKS_IS_PERSONA(detail)) {
-            // This is a normal field update
-            errorMessage = self->callDetailChangeFinish(static_cast<QContactDetail::DetailType>(self->m_currentDetailType),
-                                                        FOLKS_PERSONA(detail),
-                                                        result);
-        }
+    if (detail && result && FOLKS_IS_PERSONA(detail)) {
+        errorMessage = self->callDetailChangeFinish(data->m_detailType,
+                                                    FOLKS_PERSONA(detail),
+                                                    result);
+    }
 
-        if (!errorMessage.isEmpty()) {
-            qWarning() << "Fail to update contact" << errorMessage;
-            self->invokeSlot(errorMessage);
-            return;
+    if (!errorMessage.isEmpty()) {
+        qWarning() << "Fail to update contact" << errorMessage;
+        // keep the first error, the other changes still need to finish
+        if (self->m_errorMessage.isEmpty()) {
+            self->m_errorMessage = errorMessage;
         }
+    } else if ((data->m_detailType == QContactDetail::TypeOnlineAccount) &&
+               self->m_errorMessage.isEmpty()) {
+        //WORKAROUND: see 'updatePersona'
+        self->updateEmail(self->m_personas[data->m_personaIndex - 1],
+                          data->m_personaIndex);
     }
 
-    self->m_currentDetailType += 1;
-    switch(static_cast<QContactDetail::DetailType>(self->m_currentDetailType)) {
-    case QContactDetail::TypeAddress:
-        self->updateAddress();
-        break;
-    case QContactDetail::TypeAvatar:
-        self->updateAvatar();
-        break;
-    case QContactDetail::TypeBirthday:
-        self->updateBirthday();
-        break;
-    case QContactDetail::TypeDisplayLabel:
-        self->updateFullName(QIndividual::displayName(self->m_newContact));
-        break;
-    case QContactDetail::TypeEmailAddress:
-        //WORKAROUND: Folks automatically add online accounts based on e-mail address
-        // for example user@gmail.com will create a jabber account, and this causes some
-        // confusions on the service during the update, because of that we first update
-        // the online account and this will avoid problems with the automatic update ]
-        // from folks
-        self->updateOnlineAccount();
-        break;
-    case QContactDetail::TypeExtendedDetail:
-        self->updateExtendedDetails();
-        break;
-    case QContactDetail::TypeFavorite:
-        self->updateFavorite();
-        break;
-    case QContactDetail::TypeName:
-        self->updateName();
-        break;
-    case QContactDetail::TypeNickname:
-        self->updateNickname();
-        break;
-    case QContactDetail::TypeNote:
-        self->updateNote();
-        break;
-    case QContactDetail::TypeOnlineAccount:
-        //WORKAROUND: see TypeEmailAddress update clause
-        self->updateEmail();
-        break;
-    case QContactDetail::TypeOrganization:
-        self->updateOrganization();
-        break;
-    case QContactDetail::TypePhoneNumber:
-        self->updatePhone();
-        break;
-    case QContactDetail::TypeUrl:
-        self->updateUrl();
-        break;
-    case QContactDetail::TypeAnniversary:
-    case QContactDetail::TypeFamily:
-    case QContactDetail::TypeGender:
-    case QContactDetail::TypeGeoLocation:
-    case QContactDetail::TypeGlobalPresence:
-    case QContactDetail::TypeHobby: //Not supported by folks
-    case QContactDetail::TypeRingtone:
-    case QContactDetail::TypeTag:
-    case QContactDetail::TypeTimestamp:
-        //TODO
-    case QContactDetail::TypeGuid:
-    case QContactDetail::TypeType:
-        updateDetailsDone(0, 0, self);
-        break;
-    case QContactDetail::TypeVersion:
-        g_object_unref(self->m_currentPersona);
-        self->m_currentPersona = 0;
-        self->updatePersona();
-        break;
-    default:
-        qWarning() << "Update not implemented for" << self->m_currentDetailType;
-        updateDetailsDone(0, 0, self);
-        break;
+    delete data;
+    self->m_pendingChanges--;
+    if (self->m_pendingChanges == 0) {
+        self->finish();
     }
 }
 
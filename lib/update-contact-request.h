@@ -30,6 +30,8 @@
 
 #include <folks/folks.h>
 
+#include "contact-fingerprint.h"
+
 namespace galera {
 
 class QIndividual;
@@ -45,12 +47,18 @@ class UpdateContactRequest : public QObject
     Q_OBJECT
 
 public:
-    UpdateContactRequest(QtContacts::QContact newContact, QIndividual *parent, QObject *listener, const char *slot);
+    UpdateContactRequest(QtContacts::QContact newContact,
+                         const ContactFingerprint &newFingerprint,
+                         QIndividual *parent,
+                         QObject *listener,
+                         const char *slot,
+                         const QString &token = QString());
     ~UpdateContactRequest();
     void start();
     void wait();
     void deatach();
     void notifyError(const QString &errorMessage);
+    int writtenGroups() const;
 
 Q_SIGNALS:
     void done(const QString &errorMessage);
@@ -58,15 +66,19 @@ Q_SIGNALS:
 private:
     QIndividual *m_parent;
     QObject *m_object;
-    FolksPersona *m_currentPersona;
+    // first argument of the slot, the listener is called even if the individual is destroyed
+    QString m_token;
     QEventLoop *m_eventLoop;
 
     QList<FolksPersona*> m_personas;
     QtContacts::QContact m_originalContact;
     QtContacts::QContact m_newContact;
-    int m_currentDetailType;
+    ContactFingerprint m_originalFingerprint;
+    ContactFingerprint m_newFingerprint;
     QMetaMethod m_slot;
-    int m_currentPersonaIndex;
+    int m_pendingChanges;
+    int m_writtenGroups;
+    QString m_errorMessage;
 
     void invokeSlot(const QString &errorMessage = QString());
     static bool isEqual(QList<QtContacts::QContactDetail> listA,
@@ -77,6 +89,16 @@ private:
                         QList<QtContacts::QContactDetail> listB);
     static bool isEqual(const QtContacts::QContactDetail &detailA,
                         const QtContacts::QContactDetail &detailB);
+    bool isEqual(QtContacts::QContactDetail::DetailType type,
+                 int persona,
+                 const QList<QtContacts::QContactDetail> &listA,
+                 const QList<QtContacts::QContactDetail> &listB) const;
+    bool isEqual(QtContacts::QContactDetail::DetailType type,
+                 int persona,
+                 const QList<QtContacts::QContactDetail> &listA,
+                 const QtContacts::QContactDetail &prefA,
+                 const QList<QtContacts::QContactDetail> &listB,
+                 const QtContacts::QContactDetail &prefB) const;
     static bool checkPersona(QtContacts::QContactDetail &det, int persona);
     static QList<QtContacts::QContactDetail> detailsFromPersona(const QtContacts::QContact &contact,
                                                                 QtContacts::QContactDetail::DetailType type,
@@ -91,21 +113,23 @@ private:
                                                          QtContacts::QContactDetail *pref) const;
 
 
-    void updatePersona();
-    void updateAddress();
-    void updateAvatar();
-    void updateBirthday();
-    void updateFullName(const QString &fullName);
-    void updateEmail();
-    void updateName();
-    void updateNickname();
-    void updateNote();
-    void updateOnlineAccount();
-    void updateOrganization();
-    void updatePhone();
-    void updateUrl();
-    void updateFavorite();
-    void updateExtendedDetails();
+    void updatePersona(FolksPersona *persona, int index);
+    bool updateAddress(FolksPersona *persona, int index);
+    bool updateAvatar(FolksPersona *persona, int index);
+    bool updateBirthday(FolksPersona *persona, int index);
+    bool updateFullName(FolksPersona *persona, int index, const QString &fullName);
+    bool updateEmail(FolksPersona *persona, int index);
+    bool updateName(FolksPersona *persona, int index);
+    bool updateNickname(FolksPersona *persona, int index);
+    bool updateNote(FolksPersona *persona, int index);
+    bool updateOnlineAccount(FolksPersona *persona, int index);
+    bool updateOrganization(FolksPersona *persona, int index);
+    bool updatePhone(FolksPersona *persona, int index);
+    bool updateUrl(FolksPersona *persona, int index);
+    bool updateFavorite(FolksPersona *persona, int index);
+    void updateExtendedDetails(FolksPersona *persona, int index);
+    gpointer detailChangeData(QtContacts::QContactDetail::DetailType detailType, int index);
+    void finish();
 
     QString callDetailChangeFinish(QtContacts::QContactDetail::DetailType detailType,
                                    FolksPersona *persona,
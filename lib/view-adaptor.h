@@ -67,6 +67,7 @@ class ViewAdaptor: public QDBusAbstractAdaptor
 "    <method name=\"close\"/>\n"
 "  </interface>\n"
         "")
+    // reading 'count' while the filter runs blocks the view thread until it finishes
     Q_PROPERTY(int count READ count NOTIFY countChanged)
 public:
     ViewAdaptor(const QDBusConnection &connection, View *parent);
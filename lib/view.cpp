@@ -21,7 +21,9 @@
 #include "contacts-map.h"
 #include "contact-less-than.h"
 #include "qindividual.h"
+#include "metrics.h"
 
+#include "common/trace.h"
 #include "common/vcard-parser.h"
 #include "common/filter.h"
 #include "common/fetch-hint.h"
@@ -32,8 +34,14 @@
 #include <QtVersit/QVersitDocument>
 
 #include <QtCore/QReadWriteLock>
+#include <QtCore/QAtomicInt>
+#include <QtCore/QWaitCondition>
 #include <QtCore/QCoreApplication>
 
+// use the bitmap result directly when it is smaller than 1/BITMAP_SORT_RATIO of all contacts,
+// otherwise walk the sorted contacts to avoid sorting the result
+#define BITMAP_SORT_RATIO 4
+
 using namespace QtContacts;
 using namespace QtVersit;
 
@@ -43,18 +51,29 @@ namespace galera
 class FilterThread: public QRunnable
 {
 public:
-    FilterThread(QString filter, QString sort, int maxCount, bool showInvisible, ContactsMap *allContacts, QObject *parent)
+    FilterThread(QString filter, QString sort, int maxCount, bool showInvisible, const QStringList &sources,
+                 const ContactsSnapshot &allContacts, View::ResultMode mode, QObject *parent)
         : m_parent(parent),
           m_filter(filter),
           m_sortClause(sort),
-          m_maxCount(maxCount),
+          m_sources(sources),
           m_allContacts(allContacts),
+          m_mode(mode),
+          m_count(0),
+          m_maxCount(maxCount),
           m_showInvisible(showInvisible),
           m_canceled(false),
           m_running(false),
-          m_done(false)
+          m_done(0),
+          m_queuedAt(Metrics::now()),
+          m_runStartedAt(0),
+          m_traceQueuedAt(Trace::now()),
+          m_traceStartedAt(0)
     {
         setAutoDelete(false);
+        if (Trace::isEnabled()) {
+            m_traceId = static_cast<View*>(parent)->dynamicObjectPath();
+        }
     }
 
     QList<QContact> result() const
@@ -66,6 +85,45 @@ public:
         }
     }
 
+    QStringList ids() const
+    {
+        if (isRunning()) {
+            return QStringList();
+        }
+
+        QStringList ids(m_ids);
+        Q_FOREACH(const QContact &contact, m_contacts) {
+            ids << QString::fromUtf8(contact.id().localId());
+        }
+        return ids;
+    }
+
+    int count() const
+    {
+        if (isRunning()) {
+            return 0;
+        }
+        return resultSize();
+    }
+
+    QueryExecutor::Priority priority() const
+    {
+        return QueryExecutor::classify(m_filter, m_maxCount);
+    }
+
+    bool matchSources(ContactEntry *entry) const
+    {
+        if (m_sources.isEmpty()) {
+            return true;
+        }
+        Q_FOREACH(const QString &sourceId, entry->individual()->sourceIds()) {
+            if (m_sources.contains(sourceId)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
     bool appendContact(const QContact &contact, const QDateTime &deteletedAt)
     {
         if (checkContact(contact, deteletedAt)) {
@@ -108,94 +166,185 @@ public:
         m_canceledLock.unlock();
     }
 
+    // cancel the filter and let it delete itself when it finishes, returns false if it is
+    // already done and can be deleted by the caller
+    bool detach()
+    {
+        QWriteLocker locker(&m_canceledLock);
+        if (m_done.load()) {
+            return false;
+        }
+        m_canceled = true;
+        m_parent = 0;
+        return true;
+    }
+
     bool isRunning() const
     {
         return m_running;
     }
 
+    // called from the view thread, the acquire pairs with the release done by the
+    // pool thread so the result is complete when this returns true
     bool done() const
     {
-        return m_done;
+        return m_done.loadAcquire() != 0;
+    }
+
+    // block the calling thread until the filter finishes
+    void waitForDone()
+    {
+        m_canceledLock.lockForRead();
+        while (!done()) {
+            m_finished.wait(&m_canceledLock);
+        }
+        m_canceledLock.unlock();
     }
 
 protected:
-    void notifyFinished()
+    // returns true if the view was closed while the filter was running
+    bool notifyFinished()
     {
+        Metrics *metrics = Metrics::instance();
+        metrics->record(Metrics::FilterRunTime, (Metrics::now() - m_runStartedAt) / 1000);
+        metrics->add(Metrics::FiltersRunning, -1);
+        Trace::complete("filterScan", m_traceId, m_traceStartedAt);
+
+        QWriteLocker locker(&m_canceledLock);
         m_running = false;
-        m_done = true;
-        QMetaObject::invokeMethod(m_parent, "onFilterDone", Qt::QueuedConnection);
+        m_done.storeRelease(1);
+        m_finished.wakeAll();
+        if (m_parent) {
+            QMetaObject::invokeMethod(m_parent, "onFilterDone", Qt::QueuedConnection);
+            return false;
+        }
+        return true;
     }
 
     void run()
     {
-        if (m_canceled || !m_allContacts) {
-            notifyFinished();
+        Metrics *metrics = Metrics::instance();
+        m_runStartedAt = Metrics::now();
+        metrics->record(Metrics::FilterQueueTime, (m_runStartedAt - m_queuedAt) / 1000);
+        metrics->add(Metrics::FiltersPending, -1);
+        metrics->add(Metrics::FiltersRunning);
+        m_traceStartedAt = Trace::now();
+        Trace::complete("filterQueue", m_traceId, m_traceQueuedAt, m_traceStartedAt);
+
+        filter();
+        // let the map change its data in place again
+        m_allContacts = ContactsSnapshot();
+        if (notifyFinished()) {
+            // nobody is waiting for the result anymore
+            delete this;
+        }
+    }
+
+    void filter()
+    {
+        m_canceledLock.lockForRead();
+        bool canceled = m_canceled;
+        m_canceledLock.unlock();
+        if (canceled || m_allContacts.isNull()) {
             return;
         }
 
-        m_allContacts->lockForRead();
-        // only sort contacts if the contacts was stored in a different order into the contacts map
-        bool needSort = (!m_sortClause.isEmpty() &&
-                         (m_sortClause.toContactSortOrder() != m_allContacts->sort().toContactSortOrder()));
+        // only sort contacts if the contacts was stored in a different order into the contacts map,
+        // a count does not care about the order
+        bool needSort = ((m_mode != View::CountResult) &&
+                         !m_sortClause.isEmpty() &&
+                         (m_sortClause.toContactSortOrder() != m_allContacts.sort().toContactSortOrder()));
         // filter contacts if necessary
-        if (m_filter.isValid() && m_filter.isEmpty()) {
-            Q_FOREACH(ContactEntry *entry, m_allContacts->values()) {
-                if ((m_showInvisible || entry->individual()->isVisible()) &&
-                    !entry->individual()->deletedAt().isValid()) {
-
-                    QContact contact = entry->individual()->contact();
-
-                    if (needSort) {
-                        addSorted(&m_contacts, contact, m_sortClause);
-                    } else {
-                        m_contacts.append(contact);
-                    }
-
-                    if ((m_maxCount > 0) && (m_maxCount >= m_contacts.size())) {
-                        break;
-                    }
+        if (m_filter.isValid()) {
+            // the predicates supported by the attribute bitmaps are resolved by the query plan,
+            // any other predicate is tested for each contact left
+            bool exact = true;
+            FilterPlan plan;
+            QContactFilter residualFilter;
+            if (!m_filter.isEmpty()) {
+                plan = m_filter.plan(&residualFilter, &exact);
+            }
+            Filter residual(residualFilter);
+
+            bool useBitmap = exact || !plan.isAll() || !m_sources.isEmpty();
+            ContactBitmap candidates;
+            if (useBitmap) {
+                candidates = m_allContacts.evaluate(plan);
+                if (!m_sources.isEmpty()) {
+                    candidates &= m_allContacts.sourcesBitmap(m_sources);
+                }
+                if (!m_filter.includeRemoved()) {
+                    candidates -= m_allContacts.deletedBitmap();
+                }
+                if (!m_showInvisible) {
+                    candidates &= m_allContacts.visibleBitmap();
                 }
             }
-        } else if (m_filter.isValid()) {
+
             // optmization
-            QList<ContactEntry *> preFilter;
+            QList<const ContactRecord *> preFilter;
+            bool indexed = true;
 
             // check if is a query by id
             QStringList idsToFilter = m_filter.idsToFilter();
-            if (!idsToFilter.isEmpty()) {
-                preFilter = m_allContacts->values(idsToFilter);
-            } else {
+            QString phoneToFilter = m_filter.phoneNumberToFilter();
+            QDateTime since;
+            QContactChangeLogFilter::EventType eventType;
+            if (exact && (m_mode == View::CountResult)) {
+                // the bitmap is the result
+                m_count = candidates.count();
+                if (m_maxCount > 0) {
+                    m_count = qMin(m_count, m_maxCount);
+                }
+            } else if (!idsToFilter.isEmpty()) {
+                preFilter = m_allContacts.values(idsToFilter);
+            } else if (m_filter.removedSinceToFilter(&since)) {
+                // only deleted contacts can match, use the tombstone index
+                preFilter = m_allContacts.removedSince(since);
+            } else if (m_filter.changedSinceToFilter(&since, &eventType)) {
+                // only contacts created or modified after 'since' can match
+                preFilter = m_allContacts.changedSince(since, eventType);
+            } else if (!phoneToFilter.isEmpty()) {
                 // check if is a phone number query
-                QString phoneToFilter = m_filter.phoneNumberToFilter();
-                if (!phoneToFilter.isEmpty()) {
-                    preFilter = m_allContacts->valueByPhone(phoneToFilter);
+                preFilter = m_allContacts.valueByPhone(phoneToFilter);
+            } else if (useBitmap) {
+                // for a large result it is cheaper to walk the sorted contacts than to sort the result
+                if ((m_mode == View::CountResult) || needSort ||
+                    (candidates.count() * BITMAP_SORT_RATIO < m_allContacts.size())) {
+                    preFilter = m_allContacts.values(candidates);
                 } else {
-                    qDebug() << "Filter not optimized" << m_filter.toContactFilter();
-                    preFilter = m_allContacts->values();
+                    preFilter = m_allContacts.values();
+                    indexed = false;
                 }
+            } else {
+                qDebug() << "Filter not optimized" << m_filter.toContactFilter();
+                preFilter = m_allContacts.values();
+                indexed = false;
+            }
+
+            // the indexes do not keep the contacts map order
+            if (indexed && (m_mode != View::CountResult) && !needSort) {
+                m_allContacts.sortRecords(&preFilter);
             }
 
-            Q_FOREACH(ContactEntry *entry, preFilter) {
+            Q_FOREACH(const ContactRecord *record, preFilter) {
+                if (useBitmap && !candidates.contains(record->m_slot)) {
+                    continue;
+                }
+
                 m_canceledLock.lockForRead();
                 if (m_canceled) {
                     m_canceledLock.unlock();
-                    m_allContacts->unlock();
-                    notifyFinished();
                     return;
                 }
-
-                QContact contact = entry->individual()->contact();
-                QDateTime deletedAt = entry->individual()->deletedAt();
                 m_canceledLock.unlock();
 
-                if ((m_showInvisible || entry->individual()->isVisible()) &&
-                    checkContact(contact, deletedAt)) {
-                    if (needSort) {
-                        addSorted(&m_contacts, contact, m_sortClause);
-                    } else {
-                        m_contacts.append(contact);
-                    }
-                    if ((m_maxCount > 0) && (m_contacts.size() >= m_maxCount)) {
+                // visibility and deletion were already checked by the bitmaps
+                if (exact ||
+                    ((m_showInvisible || record->m_visible) &&
+                     residual.test(record->m_contact, record->m_deletedAt))) {
+                    addResult(record, needSort);
+                    if ((m_maxCount > 0) && (resultSize() >= m_maxCount)) {
                         break;
                     }
                 }
@@ -203,44 +352,96 @@ protected:
         } else {
             // invalid filter
             m_contacts.clear();
+            m_ids.clear();
+            m_count = 0;
         }
-
-        m_allContacts->unlock();
-        notifyFinished();
     }
 
 private:
     QObject *m_parent;
     Filter m_filter;
     SortClause m_sortClause;
-    ContactsMap *m_allContacts;
+    QStringList m_sources;
+    ContactsSnapshot m_allContacts;
     QList<QContact> m_contacts;
+    QStringList m_ids;
+    View::ResultMode m_mode;
+    int m_count;
 
     int m_maxCount;
     bool m_showInvisible;
     bool m_canceled;
     QReadWriteLock m_canceledLock;
+    QWaitCondition m_finished;
     bool m_running;
-    bool m_done;
+    QAtomicInt m_done;
+    qint64 m_queuedAt;
+    qint64 m_runStartedAt;
+    qint64 m_traceQueuedAt;
+    qint64 m_traceStartedAt;
+    QString m_traceId;
 
     bool checkContact(const QContact &contact, const QDateTime &deletedAt)
     {
         return m_filter.test(contact, deletedAt);
     }
+
+    int resultSize() const
+    {
+        switch (m_mode) {
+        case View::CountResult:
+            return m_count;
+        case View::IdsResult:
+            return m_ids.size() + m_contacts.size();
+        default:
+            return m_contacts.size();
+        }
+    }
+
+    // Id and count queries do not need the contact data unless the result must be sorted
+    void addResult(const ContactRecord *record, bool needSort)
+    {
+        if (m_mode == View::CountResult) {
+            m_count++;
+        } else if ((m_mode == View::IdsResult) && !needSort) {
+            m_ids << record->m_id;
+        } else if (needSort) {
+            addSorted(&m_contacts, record->m_contact, m_sortClause);
+        } else {
+            m_contacts.append(record->m_contact);
+        }
+    }
+};
+
+// contactsDetails call waiting for the filter
+class ContactsDetailsRequest
+{
+public:
+    QStringList m_fields;
+    int m_startIndex;
+    int m_pageSize;
+    QDBusMessage m_message;
+    qint64 m_started;
+    qint64 m_traceStarted;
 };
 
 View::View(const QString &clause, const QString &sort, int maxCount, bool showInvisible,
-           const QStringList &sources, ContactsMap *allContacts,
-           QObject *parent)
+           const QStringList &sources, const ContactsSnapshot &allContacts,
+           QObject *parent, ResultMode mode, QueryExecutor::Priority priority)
     : QObject(parent),
       m_sources(sources),
-      m_filterThread(new FilterThread(clause, sort, maxCount, showInvisible, allContacts, this)),
+      m_filterThread(new FilterThread(clause, sort, maxCount, showInvisible, sources, allContacts, mode, this)),
       m_adaptor(0),
-      m_waiting(0)
+      m_rowsHeld(0),
+      m_lastActivity(Metrics::now())
 {
-    if (allContacts) {
-        QThreadPool::globalInstance()->start(m_filterThread);
+    // without contacts the filter finishes at once with an empty result, so pending calls
+    // are answered
+    Metrics::instance()->add(Metrics::FiltersPending);
+    if (priority == QueryExecutor::Auto) {
+        priority = m_filterThread->priority();
     }
+    QueryExecutor::instance()->start(m_filterThread, priority);
 }
 
 View::~View()
@@ -250,22 +451,35 @@ View::~View()
 
 void View::close()
 {
+    setRowsHeld(0);
+    // the filter is released on the first call, a view that failed to register is
+    // still announced so its owner deletes it
+    bool wasOpen = (m_filterThread != 0);
     if (m_adaptor) {
+        Metrics::instance()->add(Metrics::OpenViews, -1);
         Q_EMIT m_adaptor->contactsRemoved(0, m_filterThread->result().count());
-        Q_EMIT closed();
 
         QDBusConnection conn = QDBusConnection::sessionBus();
         unregisterObject(conn);
         m_adaptor->destroy();
         m_adaptor = 0;
     }
+    if (wasOpen) {
+        Q_EMIT closed();
+    }
+
+    // the view is gone, pending calls get an empty page
+    Q_FOREACH(ContactsDetailsRequest *request, m_pendingDetails) {
+        QDBusConnection::sessionBus().send(request->m_message.createReply(QStringList()));
+        delete request;
+    }
+    m_pendingDetails.clear();
 
     if (m_filterThread) {
-        if (!m_filterThread->done()) {
-            m_filterThread->cancel();
-            waitFilter();
+        // a running filter deletes itself when it finishes
+        if (!m_filterThread->detach()) {
+            delete m_filterThread;
         }
-        delete m_filterThread;
         m_filterThread = 0;
     }
 }
@@ -275,6 +489,31 @@ bool View::isOpen() const
     return (m_adaptor != 0);
 }
 
+QString View::owner() const
+{
+    return m_owner;
+}
+
+void View::setOwner(const QString &owner)
+{
+    m_owner = owner;
+}
+
+qint64 View::idleTime() const
+{
+    return (Metrics::now() - m_lastActivity.load()) / 1000000;
+}
+
+int View::rowsHeld() const
+{
+    return m_rowsHeld.load();
+}
+
+void View::touch()
+{
+    m_lastActivity.store(Metrics::now());
+}
+
 QString View::contactDetails(const QStringList &fields, const QString &id)
 {
     Q_ASSERT(FALSE);
@@ -284,12 +523,35 @@ QString View::contactDetails(const QStringList &fields, const QString &id)
 QStringList View::contactsDetails(const QStringList &fields, int startIndex, int pageSize, const QDBusMessage &message)
 {
     if (!m_filterThread || !isOpen()) {
+        QDBusConnection::sessionBus().send(message.createReply(QStringList()));
         return QStringList();
     }
 
-    waitFilter();
+    touch();
+    ContactsDetailsRequest *request = new ContactsDetailsRequest;
+    request->m_fields = fields;
+    request->m_startIndex = startIndex;
+    request->m_pageSize = pageSize;
+    request->m_message = message;
+    request->m_started = Metrics::now();
+    request->m_traceStarted = Trace::now();
+
+    // the reply is sent when the filter finishes
+    if (m_filterThread->done()) {
+        replyContactsDetails(request);
+    } else {
+        m_pendingDetails << request;
+    }
+    return QStringList();
+}
+
+void View::replyContactsDetails(ContactsDetailsRequest *request)
+{
+    MetricsActivity activity("contactsDetails");
 
     const QList<QContact> &contacts = m_filterThread->result();
+    int startIndex = request->m_startIndex;
+    int pageSize = request->m_pageSize;
     if (startIndex < 0) {
         startIndex = 0;
     }
@@ -300,20 +562,34 @@ QStringList View::contactsDetails(const QStringList &fields, int startIndex, int
 
     QList<QContact> pageOfContacts;
     for(int i = startIndex, iMax = (startIndex + pageSize); i < iMax; i++) {
-        pageOfContacts << QIndividual::copy(contacts.at(i), FetchHint::parseFieldNames(fields));
+        pageOfContacts << QIndividual::copy(contacts.at(i), FetchHint::parseFieldNames(request->m_fields));
     }
 
     VCardParser *parser = new VCardParser(this);
-    parser->setProperty("DATA", QVariant::fromValue<QDBusMessage>(message));
+    parser->setProperty("DATA", QVariant::fromValue<QDBusMessage>(request->m_message));
+    parser->setProperty("STARTED", request->m_started);
+    if (Trace::isEnabled()) {
+        Trace::complete("contactsDetails.project", dynamicObjectPath(), request->m_traceStarted);
+        parser->setProperty("TRACE_STARTED", request->m_traceStarted);
+        parser->setProperty("TRACE_SERIALIZE", Trace::now());
+    }
+    delete request;
+
     connect(parser, &VCardParser::vcardParsed,
             this, &View::onVCardParsed);
     parser->contactToVcard(pageOfContacts);
-    return QStringList();
 }
 
 void View::onVCardParsed(const QStringList &vcards)
 {
     QObject *sender = QObject::sender();
+    Metrics::instance()->recordCall(Metrics::MethodContactsDetails,
+                                    (Metrics::now() - sender->property("STARTED").toLongLong()) / 1000);
+    if (Trace::isEnabled()) {
+        QString id = dynamicObjectPath();
+        Trace::complete("contactsDetails.serialize", id, sender->property("TRACE_SERIALIZE").toLongLong());
+        Trace::complete("contactsDetails", id, sender->property("TRACE_STARTED").toLongLong());
+    }
     QDBusMessage reply = sender->property("DATA").value<QDBusMessage>().createReply(vcards);
     QDBusConnection::sessionBus().send(reply);
     sender->deleteLater();
@@ -321,19 +597,34 @@ void View::onVCardParsed(const QStringList &vcards)
 
 void View::onFilterDone()
 {
-    if (m_waiting) {
-        m_waiting->quit();
-        m_waiting = 0;
+    if (isOpen()) {
+        setRowsHeld(resultCount());
+        Q_EMIT countChanged(m_filterThread->result().count());
+    }
+
+    // answer the calls received while the filter was running, in order
+    QList<ContactsDetailsRequest*> pending = m_pendingDetails;
+    m_pendingDetails.clear();
+    Q_FOREACH(ContactsDetailsRequest *request, pending) {
+        replyContactsDetails(request);
     }
+    Q_EMIT filterDone();
 }
 
-void View::waitFilter()
+QStringList View::ids() const
 {
-    if (m_filterThread && !m_filterThread->done()) {
-        QEventLoop loop;
-        m_waiting = &loop;
-        loop.exec();
+    if (!m_filterThread) {
+        return QStringList();
     }
+    return m_filterThread->ids();
+}
+
+int View::resultCount() const
+{
+    if (!m_filterThread) {
+        return 0;
+    }
+    return m_filterThread->count();
 }
 
 int View::count()
@@ -342,8 +633,10 @@ int View::count()
         return 0;
     }
 
-    waitFilter();
-
+    MetricsTimer timer(Metrics::MethodViewCount);
+    touch();
+    // a property read can not be answered later, only the view thread waits for the filter
+    m_filterThread->waitForDone();
     return m_filterThread->result().count();
 }
 
@@ -353,6 +646,7 @@ void View::sort(const QString &field)
         return;
     }
 
+    touch();
     m_filterThread->chageSort(SortClause(field));
 }
 
@@ -377,6 +671,10 @@ bool View::registerObject(QDBusConnection &connection)
             m_adaptor = 0;
         } else {
             connect(this, SIGNAL(countChanged(int)), m_adaptor, SIGNAL(countChanged(int)));
+            Metrics::instance()->add(Metrics::OpenViews);
+            if (m_filterThread && m_filterThread->done()) {
+                setRowsHeld(resultCount());
+            }
         }
     }
 
@@ -396,8 +694,10 @@ bool View::appendContact(ContactEntry *entry)
         return false;
     }
 
-    if (m_filterThread->appendContact(entry->individual()->contact(),
+    if (m_filterThread->matchSources(entry) &&
+        m_filterThread->appendContact(entry->individual()->contact(),
                                       entry->individual()->deletedAt())) {
+        setRowsHeld(m_filterThread->result().count());
         Q_EMIT countChanged(m_filterThread->result().count());
         return true;
     }
@@ -411,12 +711,19 @@ bool View::removeContact(ContactEntry *entry)
     }
 
     if (m_filterThread->removeContact(entry->individual()->contact())) {
+        setRowsHeld(m_filterThread->result().count());
         Q_EMIT countChanged(m_filterThread->result().count());
         return true;
     }
     return false;
 }
 
+void View::setRowsHeld(int rows)
+{
+    int old = m_rowsHeld.fetchAndStoreRelaxed(rows);
+    Metrics::instance()->add(Metrics::RowsHeld, rows - old);
+}
+
 QObject *View::adaptor() const
 {
     return m_adaptor;
@@ -22,6 +22,9 @@
 #include <common/sort-clause.h>
 #include <common/filter.h>
 
+#include "query-executor.h"
+
+#include <QtCore/QAtomicInteger>
 #include <QtCore/QString>
 #include <QtCore/QStringList>
 #include <QtDBus/QtDBus>
@@ -32,9 +35,10 @@ namespace galera
 {
 class ContactEntry;
 class ViewAdaptor;
-class ContactsMap;
+class ContactsSnapshot;
 class FilterThread;
 class SortContact;
+class ContactsDetailsRequest;
 
 class View : public QObject
 {
@@ -42,7 +46,14 @@ class View : public QObject
     Q_PROPERTY(int count READ count NOTIFY countChanged)
 
 public:
-    View(const QString &clause, const QString &sort, int maxCount, bool showInvisible, const QStringList &sources, ContactsMap *allContacts, QObject *parent);
+    enum ResultMode {
+        ContactsResult = 0,
+        IdsResult,
+        CountResult
+    };
+
+    View(const QString &clause, const QString &sort, int maxCount, bool showInvisible, const QStringList &sources, const ContactsSnapshot &allContacts, QObject *parent,
+         ResultMode mode = ContactsResult, QueryExecutor::Priority priority = QueryExecutor::Auto);
     ~View();
 
     static QString objectPath();
@@ -59,10 +70,21 @@ public:
     QString contactDetails(const QStringList &fields, const QString &id);
     int count();
     void sort(const QString &field);
-    void close();
+    Q_INVOKABLE void close();
 
     bool isOpen() const;
 
+    // unique bus name of the client that created the view
+    QString owner() const;
+    void setOwner(const QString &owner);
+    // time since the client last used the view, in ms
+    qint64 idleTime() const;
+    int rowsHeld() const;
+
+    // Query result without the contacts data, valid after 'filterDone'
+    QStringList ids() const;
+    int resultCount() const;
+
 public Q_SLOTS:
     QStringList contactsDetails(const QStringList &fields, int startIndex, int pageSize, const QDBusMessage &message);
     void onFilterDone();
@@ -72,15 +94,22 @@ private Q_SLOTS:
 
 Q_SIGNALS:
     void closed();
+    void filterDone();
     void countChanged(int count=0);
 
 private:
     QStringList m_sources;
     FilterThread *m_filterThread;
     ViewAdaptor *m_adaptor;
-    QEventLoop *m_waiting;
-
-    void waitFilter();
+    QList<ContactsDetailsRequest*> m_pendingDetails;
+    // rows accounted in the metrics, read by the address book to limit the rows held
+    QAtomicInt m_rowsHeld;
+    QString m_owner;
+    QAtomicInteger<qint64> m_lastActivity;
+
+    void replyContactsDetails(ContactsDetailsRequest *request);
+    void touch();
+    void setRowsHeld(int rows);
 };
 
 } //namespace
@@ -0,0 +1,102 @@
+/*
+ * Copyright 2013 Canonical Ltd.
+ *
+ * This file is part of contact-service-app.
+ *
+ * contact-service-app is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * contact-service-app is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "common/dbus-service-defs.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QCommandLineParser>
+#include <QtCore/QDebug>
+#include <QtCore/QFile>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QTextStream>
+
+#include <QtDBus/QDBusConnection>
+#include <QtDBus/QDBusMessage>
+#include <QtDBus/QDBusReply>
+
+// Dump the metrics of a running address book service as JSON
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("address-book-metrics");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Print the metrics collected by the address book service.");
+    parser.addHelpOption();
+    QCommandLineOption compactOption("compact", "Print the JSON in a single line.");
+    QCommandLineOption resetOption("reset", "Reset the counters after printing them.");
+    QCommandLineOption traceOption("trace", "Save the trace events of the service (Chrome trace format) to a file.", "file");
+    parser.addOption(compactOption);
+    parser.addOption(resetOption);
+    parser.addOption(traceOption);
+    parser.process(app);
+
+    QString serviceName = CPIM_SERVICE_NAME;
+    if (qEnvironmentVariableIsSet(ALTERNATIVE_CPIM_SERVICE_NAME)) {
+        serviceName = qgetenv(ALTERNATIVE_CPIM_SERVICE_NAME);
+    }
+
+    QDBusMessage call = QDBusMessage::createMethodCall(serviceName,
+                                                       CPIM_ADDRESSBOOK_OBJECT_PATH,
+                                                       CPIM_ADDRESSBOOK_METRICS_IFACE_NAME,
+                                                       "metrics");
+    QDBusReply<QString> reply = QDBusConnection::sessionBus().call(call);
+    if (!reply.isValid()) {
+        qWarning() << "Fail to read metrics from" << serviceName << ":" << reply.error().message();
+        return 1;
+    }
+
+    QJsonDocument doc = QJsonDocument::fromJson(reply.value().toUtf8());
+    QTextStream out(stdout);
+    out << doc.toJson(parser.isSet(compactOption) ? QJsonDocument::Compact : QJsonDocument::Indented);
+    out.flush();
+
+    if (parser.isSet(traceOption)) {
+        call = QDBusMessage::createMethodCall(serviceName,
+                                              CPIM_ADDRESSBOOK_OBJECT_PATH,
+                                              CPIM_ADDRESSBOOK_METRICS_IFACE_NAME,
+                                              "trace");
+        QDBusReply<QString> traceReply = QDBusConnection::sessionBus().call(call);
+        if (!traceReply.isValid()) {
+            qWarning() << "Fail to read trace:" << traceReply.error().message();
+            return 1;
+        } else if (traceReply.value().isEmpty()) {
+            qWarning() << "The service is not tracing, start it with ADDRESS_BOOK_TRACE set";
+        } else {
+            QFile traceFile(parser.value(traceOption));
+            if (!traceFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+                qWarning() << "Fail to open" << traceFile.fileName();
+                return 1;
+            }
+            traceFile.write(traceReply.value().toUtf8());
+        }
+    }
+
+    if (parser.isSet(resetOption)) {
+        call = QDBusMessage::createMethodCall(serviceName,
+                                              CPIM_ADDRESSBOOK_OBJECT_PATH,
+                                              CPIM_ADDRESSBOOK_METRICS_IFACE_NAME,
+                                              "reset");
+        QDBusMessage resetReply = QDBusConnection::sessionBus().call(call);
+        if (resetReply.type() == QDBusMessage::ErrorMessage) {
+            qWarning() << "Fail to reset metrics:" << resetReply.errorMessage();
+            return 1;
+        }
+    }
+    return 0;
+}
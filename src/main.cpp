@@ -21,7 +21,6 @@
 
 #include "config.h"
 #include "addressbook.h"
-#include "common/vcard-parser.h"
 
 #include <QtCore/QSettings>
 
@@ -41,11 +40,8 @@ void onServiceReady(galera::AddressBook *book)
         QFile demoFileData(qgetenv(ADDRESS_BOOK_SERVICE_DEMO_DATA));
         qDebug() << "Load demo data from:" << demoFileData.fileName();
         if (demoFileData.open(QFile::ReadOnly)) {
-            QByteArray demoData = demoFileData.readAll();
-            QStringList vcards = galera::VCardParser::splitVcards(demoData);
-            Q_FOREACH(const QString &vcard, vcards) {
-                book->createContact(vcard, "");
-            }
+            // the file descriptor is duplicated and read incrementally by the import
+            book->importVCards(QDBusUnixFileDescriptor(demoFileData.handle()), "");
         }
     }
 }
@@ -0,0 +1,691 @@
+/*
+ * Copyright 2015 Canonical Ltd.
+ *
+ * This file is part of contact-service-app.
+ *
+ * contact-service-app is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * contact-service-app is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Load generator for the address book service.
+ *
+ * Each client opens its own bus connection, like a separate application, and
+ * issues a mix of AddressBook/AddressBookView calls at fixed rates. Calls can
+ * be recorded to a trace file (one JSON object per line) and replayed later.
+ * Latencies are collected per method on log-linear histograms and printed as
+ * JSON when the run finishes.
+ */
+
+#include "common/dbus-service-defs.h"
+#include "common/filter.h"
+#include "common/vcard-parser.h"
+
+#include <QtCore>
+#include <QtDBus>
+#include <QtContacts/QContact>
+#include <QtContacts/QContactDetailFilter>
+#include <QtContacts/QContactPhoneNumber>
+#include <QtContacts/QContactDisplayLabel>
+#include <QtContacts/QContactNickname>
+#include <QtContacts/QContactGuid>
+
+#define DEFAULT_MIX             "query=5,contactsDetails=10,updateContacts=0.5,createContact=0.5,removeContacts=0.5"
+#define DEFAULT_DURATION        30
+#define DEFAULT_CLIENTS         4
+#define DEFAULT_IN_FLIGHT       1
+#define DEFAULT_PAGE_SIZE       20
+#define VCARD_POOL_SIZE         50
+#define DRAIN_TIMEOUT           10000
+#define HISTOGRAM_LINEAR        16
+#define HISTOGRAM_SUB_BUCKETS   8
+#define HISTOGRAM_BUCKETS       (HISTOGRAM_LINEAR + 40 * HISTOGRAM_SUB_BUCKETS)
+
+using namespace QtContacts;
+using namespace galera;
+
+// Latency histogram in microseconds, exact up to 16us and then with eight
+// sub buckets per power of two (about 12% relative error)
+class LatencyHistogram
+{
+public:
+    LatencyHistogram()
+        : m_buckets(HISTOGRAM_BUCKETS, 0),
+          m_count(0),
+          m_errors(0),
+          m_dropped(0),
+          m_total(0),
+          m_max(0)
+    {
+    }
+
+    void record(qint64 usecs, bool error)
+    {
+        usecs = qMax(qint64(0), usecs);
+        m_buckets[bucket(usecs)]++;
+        m_count++;
+        m_total += usecs;
+        m_max = qMax(m_max, usecs);
+        if (error) {
+            m_errors++;
+        }
+    }
+
+    void drop()
+    {
+        m_dropped++;
+    }
+
+    void merge(const LatencyHistogram &other)
+    {
+        for(int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+            m_buckets[i] += other.m_buckets[i];
+        }
+        m_count += other.m_count;
+        m_errors += other.m_errors;
+        m_dropped += other.m_dropped;
+        m_total += other.m_total;
+        m_max = qMax(m_max, other.m_max);
+    }
+
+    qint64 percentile(qreal p) const
+    {
+        quint64 rank = qCeil(m_count * p / 100.0);
+        quint64 seen = 0;
+        for(int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+            seen += m_buckets[i];
+            if ((seen >= rank) && (seen > 0)) {
+                return qMin(upperBound(i), m_max);
+            }
+        }
+        return m_max;
+    }
+
+    QJsonObject toJson() const
+    {
+        QJsonObject result;
+        result.insert("calls", qint64(m_count));
+        result.insert("errors", qint64(m_errors));
+        result.insert("dropped", qint64(m_dropped));
+        result.insert("meanUs", m_count ? qint64(m_total / m_count) : 0);
+        result.insert("p50Us", percentile(50));
+        result.insert("p90Us", percentile(90));
+        result.insert("p99Us", percentile(99));
+        result.insert("p999Us", percentile(99.9));
+        result.insert("maxUs", m_max);
+
+        QJsonArray buckets;
+        for(int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+            if (m_buckets[i] > 0) {
+                QJsonArray bucket;
+                bucket << upperBound(i) << qint64(m_buckets[i]);
+                buckets << bucket;
+            }
+        }
+        result.insert("histogram", buckets);
+        return result;
+    }
+
+private:
+    QVector<quint64> m_buckets;
+    quint64 m_count;
+    quint64 m_errors;
+    quint64 m_dropped;
+    quint64 m_total;
+    qint64 m_max;
+
+    static int bucket(qint64 value)
+    {
+        if (value < HISTOGRAM_LINEAR) {
+            return value;
+        }
+        int msb = 63 - __builtin_clzll(value);
+        int sub = (value >> (msb - 3)) & (HISTOGRAM_SUB_BUCKETS - 1);
+        return qMin(HISTOGRAM_LINEAR + (msb - 4) * HISTOGRAM_SUB_BUCKETS + sub,
+                    HISTOGRAM_BUCKETS - 1);
+    }
+
+    static qint64 upperBound(int bucket)
+    {
+        if (bucket < HISTOGRAM_LINEAR) {
+            return bucket;
+        }
+        int msb = 4 + (bucket - HISTOGRAM_LINEAR) / HISTOGRAM_SUB_BUCKETS;
+        int sub = (bucket - HISTOGRAM_LINEAR) % HISTOGRAM_SUB_BUCKETS;
+        return ((qint64(HISTOGRAM_SUB_BUCKETS + sub + 1)) << (msb - 3)) - 1;
+    }
+};
+
+struct LoadOptions
+{
+    QMap<QString, qreal> mix;
+    int duration;
+    int clients;
+    int maxInFlight;
+    int pageSize;
+    qreal speed;
+    QString serviceName;
+    QString recordFile;
+    QString replayFile;
+    QString outputFile;
+};
+
+class LoadClient : public QObject
+{
+    Q_OBJECT
+public:
+    LoadClient(int index, const LoadOptions &options, QIODevice *trace, QObject *parent = 0)
+        : QObject(parent),
+          m_connection(QDBusConnection::connectToBus(QDBusConnection::SessionBus,
+                                                     QString("address-book-load-%1").arg(index))),
+          m_options(options),
+          m_trace(trace),
+          m_index(index),
+          m_viewCount(0),
+          m_pageStart(0),
+          m_serial(0),
+          m_stopped(false)
+    {
+        m_elapsed.start();
+    }
+
+    ~LoadClient()
+    {
+        if (!m_viewPath.isEmpty()) {
+            call(m_viewPath, CPIM_ADDRESSBOOK_VIEW_IFACE_NAME, "close", QVariantList());
+        }
+        QDBusConnection::disconnectFromBus(m_connection.name());
+    }
+
+    bool prepare()
+    {
+        if (!m_connection.isConnected()) {
+            qWarning() << "Client" << m_index << "fail to connect to the session bus";
+            return false;
+        }
+
+        // the shared view emulates a contact list being scrolled
+        QDBusMessage reply = m_connection.call(addressBookCall("query", QVariantList()
+                                                               << QString() << QString() << -1
+                                                               << false << QStringList()));
+        if (reply.type() != QDBusMessage::ReplyMessage) {
+            qWarning() << "Client" << m_index << "fail to open a view" << reply.errorMessage();
+            return false;
+        }
+        m_viewPath = reply.arguments().first().value<QDBusObjectPath>().path();
+
+        QDBusInterface view(m_options.serviceName, m_viewPath,
+                            CPIM_ADDRESSBOOK_VIEW_IFACE_NAME, m_connection);
+        m_viewCount = view.property("count").toInt();
+
+        QDBusReply<QStringList> vcards = view.call("contactsDetails", QStringList(), 0, VCARD_POOL_SIZE);
+        m_vcards = vcards.value();
+        return true;
+    }
+
+    void start()
+    {
+        Q_FOREACH(const QString &method, m_options.mix.keys()) {
+            qreal rate = m_options.mix.value(method);
+            if (rate <= 0) {
+                continue;
+            }
+            QTimer *timer = new QTimer(this);
+            timer->setProperty("METHOD", method);
+            timer->setInterval(qMax(1, qRound(1000.0 / rate)));
+            connect(timer, SIGNAL(timeout()), SLOT(onTick()));
+            timer->start();
+        }
+    }
+
+    void stop()
+    {
+        m_stopped = true;
+        Q_FOREACH(QTimer *timer, findChildren<QTimer*>()) {
+            timer->stop();
+        }
+    }
+
+    int inFlight() const
+    {
+        int total = 0;
+        Q_FOREACH(int count, m_inFlight.values()) {
+            total += count;
+        }
+        return total;
+    }
+
+    const QMap<QString, LatencyHistogram> &histograms() const
+    {
+        return m_histograms;
+    }
+
+    void issue(const QString &method, const QVariantList &args)
+    {
+        if (m_stopped) {
+            return;
+        }
+        if (m_inFlight.value(method) >= m_options.maxInFlight) {
+            m_histograms[method].drop();
+            return;
+        }
+
+        QDBusMessage message;
+        if (method == "contactsDetails") {
+            message = QDBusMessage::createMethodCall(m_options.serviceName, m_viewPath,
+                                                     CPIM_ADDRESSBOOK_VIEW_IFACE_NAME, method);
+            message.setArguments(args);
+        } else {
+            message = addressBookCall(method, args);
+        }
+
+        if (m_trace) {
+            writeTrace(method, args);
+        }
+
+        m_inFlight[method]++;
+        QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(m_connection.asyncCall(message), this);
+        watcher->setProperty("METHOD", method);
+        watcher->setProperty("STARTED", m_elapsed.nsecsElapsed());
+        connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher*)),
+                SLOT(onCallFinished(QDBusPendingCallWatcher*)));
+    }
+
+private Q_SLOTS:
+    void onTick()
+    {
+        QString method = sender()->property("METHOD").toString();
+        QVariantList args = generateArgs(method);
+        if (!args.isEmpty()) {
+            issue(method, args);
+        }
+    }
+
+    void onCallFinished(QDBusPendingCallWatcher *watcher)
+    {
+        QString method = watcher->property("METHOD").toString();
+        qint64 usecs = (m_elapsed.nsecsElapsed() - watcher->property("STARTED").toLongLong()) / 1000;
+        QDBusMessage reply = watcher->reply();
+        bool error = (reply.type() != QDBusMessage::ReplyMessage);
+
+        m_inFlight[method]--;
+        m_histograms[method].record(usecs, error);
+
+        if (!error && (method == "query")) {
+            // lookups are short lived, close the view as the clients do
+            QString path = reply.arguments().first().value<QDBusObjectPath>().path();
+            m_connection.asyncCall(QDBusMessage::createMethodCall(m_options.serviceName, path,
+                                                                  CPIM_ADDRESSBOOK_VIEW_IFACE_NAME,
+                                                                  "close"));
+        } else if (!error && (method == "createContact")) {
+            QString vcard = reply.arguments().first().toString();
+            m_createdIds << VCardParser::vcardToContact(vcard).detail<QContactGuid>().guid();
+        }
+        watcher->deleteLater();
+    }
+
+private:
+    QDBusConnection m_connection;
+    LoadOptions m_options;
+    QIODevice *m_trace;
+    QElapsedTimer m_elapsed;
+    int m_index;
+    QString m_viewPath;
+    int m_viewCount;
+    int m_pageStart;
+    int m_serial;
+    bool m_stopped;
+    QStringList m_vcards;
+    QStringList m_createdIds;
+    QMap<QString, int> m_inFlight;
+    QMap<QString, LatencyHistogram> m_histograms;
+
+    QDBusMessage addressBookCall(const QString &method, const QVariantList &args) const
+    {
+        QDBusMessage message = QDBusMessage::createMethodCall(m_options.serviceName,
+                                                              CPIM_ADDRESSBOOK_OBJECT_PATH,
+                                                              CPIM_ADDRESSBOOK_IFACE_NAME,
+                                                              method);
+        message.setArguments(args);
+        return message;
+    }
+
+    void call(const QString &path, const QString &iface, const QString &method, const QVariantList &args)
+    {
+        QDBusMessage message = QDBusMessage::createMethodCall(m_options.serviceName, path, iface, method);
+        message.setArguments(args);
+        m_connection.call(message);
+    }
+
+    QVariantList generateArgs(const QString &method)
+    {
+        QVariantList args;
+        m_serial++;
+        if (method == "query") {
+            QString clause;
+            if (m_serial % 2) {
+                // dialer caller-ID lookup
+                QContactDetailFilter phone;
+                phone.setDetailType(QContactDetail::TypePhoneNumber, QContactPhoneNumber::FieldNumber);
+                phone.setValue(QString("+55%1").arg(qrand() % 100000000, 9, 10, QChar('0')));
+                phone.setMatchFlags(QContactFilter::MatchPhoneNumber);
+                clause = Filter(phone).toString();
+            } else {
+                // messaging name resolution
+                QContactDetailFilter label;
+                label.setDetailType(QContactDetail::TypeDisplayLabel, QContactDisplayLabel::FieldLabel);
+                label.setValue(QString(QChar('a' + (qrand() % 26))));
+                label.setMatchFlags(QContactFilter::MatchStartsWith);
+                clause = Filter(label).toString();
+            }
+            args << clause << QString() << -1 << false << QStringList();
+        } else if (method == "contactsDetails") {
+            if (m_pageStart >= m_viewCount) {
+                m_pageStart = 0;
+            }
+            args << QStringList() << m_pageStart << m_options.pageSize;
+            m_pageStart += m_options.pageSize;
+        } else if (method == "updateContacts") {
+            if (!m_vcards.isEmpty()) {
+                QContact contact = VCardParser::vcardToContact(m_vcards.at(m_serial % m_vcards.size()));
+                QContactNickname nickname = contact.detail<QContactNickname>();
+                nickname.setNickname(QString("load-%1-%2").arg(m_index).arg(m_serial));
+                contact.saveDetail(&nickname);
+                args << QStringList(VCardParser::contactToVcard(contact));
+            }
+        } else if (method == "createContact") {
+            QString vcard = QString("BEGIN:VCARD\r\n"
+                                    "VERSION:3.0\r\n"
+                                    "N:Load;Client_%1_%2;;;\r\n"
+                                    "TEL;TYPE=CELL:5555%1%2\r\n"
+                                    "END:VCARD\r\n").arg(m_index).arg(m_serial);
+            args << vcard << QString();
+        } else if (method == "removeContacts") {
+            // only remove what this client created
+            if (!m_createdIds.isEmpty()) {
+                args << QStringList(m_createdIds.takeFirst());
+            }
+        } else {
+            qWarning() << "Unknown method in the mix:" << method;
+        }
+        return args;
+    }
+
+    void writeTrace(const QString &method, const QVariantList &args)
+    {
+        QJsonObject entry;
+        entry.insert("at", m_elapsed.elapsed());
+        entry.insert("client", m_index);
+        entry.insert("method", method);
+        entry.insert("args", QJsonArray::fromVariantList(args));
+        m_trace->write(QJsonDocument(entry).toJson(QJsonDocument::Compact));
+        m_trace->write("\n");
+    }
+};
+
+class LoadRunner : public QObject
+{
+    Q_OBJECT
+public:
+    LoadRunner(const LoadOptions &options, QObject *parent = 0)
+        : QObject(parent),
+          m_options(options),
+          m_trace(0),
+          m_replayIndex(0)
+    {
+    }
+
+    ~LoadRunner()
+    {
+        qDeleteAll(m_clients);
+        delete m_trace;
+    }
+
+    bool start()
+    {
+        if (!m_options.recordFile.isEmpty()) {
+            m_trace = new QFile(m_options.recordFile);
+            if (!m_trace->open(QFile::WriteOnly | QFile::Truncate)) {
+                qWarning() << "Fail to open trace file" << m_options.recordFile;
+                return false;
+            }
+        }
+
+        if (!m_options.replayFile.isEmpty() && !loadReplay()) {
+            return false;
+        }
+
+        for(int i = 0; i < m_options.clients; i++) {
+            LoadClient *client = new LoadClient(i, m_options, m_trace);
+            if (!client->prepare()) {
+                delete client;
+                return false;
+            }
+            m_clients << client;
+        }
+
+        m_elapsed.start();
+        if (m_replay.isEmpty()) {
+            Q_FOREACH(LoadClient *client, m_clients) {
+                client->start();
+            }
+            QTimer::singleShot(m_options.duration * 1000, this, SLOT(finish()));
+        } else {
+            scheduleReplay();
+        }
+        return true;
+    }
+
+private Q_SLOTS:
+    void replayNext()
+    {
+        qint64 now = m_elapsed.elapsed();
+        while ((m_replayIndex < m_replay.size()) &&
+               (replayTime(m_replay.at(m_replayIndex)) <= now)) {
+            const QJsonObject &entry = m_replay.at(m_replayIndex++);
+            LoadClient *client = m_clients.at(entry.value("client").toInt() % m_clients.size());
+            client->issue(entry.value("method").toString(),
+                          toDBusArgs(entry.value("args").toArray()));
+        }
+        scheduleReplay();
+    }
+
+    void finish()
+    {
+        Q_FOREACH(LoadClient *client, m_clients) {
+            client->stop();
+        }
+        waitInFlight();
+
+        QMap<QString, LatencyHistogram> merged;
+        Q_FOREACH(LoadClient *client, m_clients) {
+            QMap<QString, LatencyHistogram>::const_iterator it = client->histograms().constBegin();
+            for(; it != client->histograms().constEnd(); it++) {
+                merged[it.key()].merge(it.value());
+            }
+        }
+
+        QJsonObject methods;
+        Q_FOREACH(const QString &method, merged.keys()) {
+            methods.insert(method, merged.value(method).toJson());
+        }
+
+        QJsonObject report;
+        report.insert("elapsedMs", m_elapsed.elapsed());
+        report.insert("clients", m_clients.size());
+        report.insert("maxInFlight", m_options.maxInFlight);
+        report.insert("replay", m_options.replayFile);
+        report.insert("methods", methods);
+
+        QByteArray json = QJsonDocument(report).toJson();
+        if (m_options.outputFile.isEmpty()) {
+            QTextStream(stdout) << json;
+        } else {
+            QFile output(m_options.outputFile);
+            if (output.open(QFile::WriteOnly | QFile::Truncate)) {
+                output.write(json);
+            } else {
+                qWarning() << "Fail to write report to" << m_options.outputFile;
+            }
+        }
+        QCoreApplication::quit();
+    }
+
+private:
+    LoadOptions m_options;
+    QFile *m_trace;
+    QList<LoadClient*> m_clients;
+    QList<QJsonObject> m_replay;
+    int m_replayIndex;
+    QElapsedTimer m_elapsed;
+
+    bool loadReplay()
+    {
+        QFile file(m_options.replayFile);
+        if (!file.open(QFile::ReadOnly)) {
+            qWarning() << "Fail to open trace file" << m_options.replayFile;
+            return false;
+        }
+        while (!file.atEnd()) {
+            QByteArray line = file.readLine().trimmed();
+            if (line.isEmpty()) {
+                continue;
+            }
+            QJsonParseError error;
+            QJsonDocument entry = QJsonDocument::fromJson(line, &error);
+            if (error.error != QJsonParseError::NoError) {
+                qWarning() << "Invalid trace entry" << line << error.errorString();
+                return false;
+            }
+            m_replay << entry.object();
+        }
+        return true;
+    }
+
+    qint64 replayTime(const QJsonObject &entry) const
+    {
+        return qRound64(entry.value("at").toDouble() / m_options.speed);
+    }
+
+    void scheduleReplay()
+    {
+        if (m_replayIndex >= m_replay.size()) {
+            QMetaObject::invokeMethod(this, "finish", Qt::QueuedConnection);
+            return;
+        }
+        qint64 wait = replayTime(m_replay.at(m_replayIndex)) - m_elapsed.elapsed();
+        QTimer::singleShot(qMax(qint64(0), wait), this, SLOT(replayNext()));
+    }
+
+    void waitInFlight()
+    {
+        QElapsedTimer timer;
+        timer.start();
+        forever {
+            int inFlight = 0;
+            Q_FOREACH(LoadClient *client, m_clients) {
+                inFlight += client->inFlight();
+            }
+            if ((inFlight == 0) || (timer.elapsed() > DRAIN_TIMEOUT)) {
+                break;
+            }
+            QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+        }
+    }
+
+    // JSON has no integer or string list types, map them back to the D-Bus ones
+    static QVariantList toDBusArgs(const QJsonArray &args)
+    {
+        QVariantList result;
+        Q_FOREACH(const QJsonValue &arg, args) {
+            if (arg.isArray()) {
+                QStringList values;
+                Q_FOREACH(const QJsonValue &value, arg.toArray()) {
+                    values << value.toString();
+                }
+                result << values;
+            } else if (arg.isDouble()) {
+                result << arg.toInt();
+            } else {
+                result << arg.toVariant();
+            }
+        }
+        return result;
+    }
+};
+
+static QMap<QString, qreal> parseMix(const QString &mix)
+{
+    QMap<QString, qreal> result;
+    Q_FOREACH(const QString &entry, mix.split(',', QString::SkipEmptyParts)) {
+        QStringList pair = entry.split('=');
+        if (pair.size() == 2) {
+            result.insert(pair[0].trimmed(), pair[1].toDouble());
+        } else {
+            qWarning() << "Invalid mix entry" << entry;
+        }
+    }
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("address-book-load");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Drive the address book service with a mix of client calls.");
+    parser.addHelpOption();
+    QCommandLineOption mixOption("mix", "Calls per second of each method, per client.", "method=rate,...", DEFAULT_MIX);
+    QCommandLineOption durationOption("duration", "Run time in seconds.", "seconds", QString::number(DEFAULT_DURATION));
+    QCommandLineOption clientsOption("clients", "Number of clients, each on its own bus connection.", "count", QString::number(DEFAULT_CLIENTS));
+    QCommandLineOption inFlightOption("max-in-flight", "Calls of one method a client keeps pending, extra calls are dropped.", "count", QString::number(DEFAULT_IN_FLIGHT));
+    QCommandLineOption pageOption("page-size", "Page size of contactsDetails calls.", "count", QString::number(DEFAULT_PAGE_SIZE));
+    QCommandLineOption recordOption("record", "Write the issued calls to a trace file.", "file");
+    QCommandLineOption replayOption("replay", "Replay the calls of a trace file instead of the mix.", "file");
+    QCommandLineOption speedOption("speed", "Replay speed factor.", "factor", "1");
+    QCommandLineOption outputOption("output", "Write the JSON report to a file instead of stdout.", "file");
+    parser.addOption(mixOption);
+    parser.addOption(durationOption);
+    parser.addOption(clientsOption);
+    parser.addOption(inFlightOption);
+    parser.addOption(pageOption);
+    parser.addOption(recordOption);
+    parser.addOption(replayOption);
+    parser.addOption(speedOption);
+    parser.addOption(outputOption);
+    parser.process(app);
+
+    LoadOptions options;
+    options.mix = parseMix(parser.value(mixOption));
+    options.duration = qMax(1, parser.value(durationOption).toInt());
+    options.clients = qMax(1, parser.value(clientsOption).toInt());
+    options.maxInFlight = qMax(1, parser.value(inFlightOption).toInt());
+    options.pageSize = qMax(1, parser.value(pageOption).toInt());
+    options.speed = parser.value(speedOption).toDouble() > 0 ? parser.value(speedOption).toDouble() : 1;
+    options.recordFile = parser.value(recordOption);
+    options.replayFile = parser.value(replayOption);
+    options.outputFile = parser.value(outputOption);
+    if (qEnvironmentVariableIsSet(ALTERNATIVE_CPIM_SERVICE_NAME)) {
+        options.serviceName = qgetenv(ALTERNATIVE_CPIM_SERVICE_NAME);
+    } else {
+        options.serviceName = CPIM_SERVICE_NAME;
+    }
+
+    LoadRunner runner(options);
+    if (!runner.start()) {
+        return 1;
+    }
+    return app.exec();
+}
+
+#include "address-book-load.moc"
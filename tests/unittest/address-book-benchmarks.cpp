@@ -0,0 +1,625 @@
+/*
+ * Copyright 2013 Canonical Ltd.
+ *
+ * This file is part of contact-service-app.
+ *
+ * contact-service-app is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * contact-service-app is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "base-client-test.h"
+#include "common/dbus-service-defs.h"
+#include "common/vcard-parser.h"
+#include "common/filter.h"
+
+#include <QObject>
+#include <QtDBus>
+#include <QtTest>
+#include <QDebug>
+
+#include <algorithm>
+
+#include <QtContacts/QContactDetailFilter>
+#include <QtContacts/QContactChangeLogFilter>
+#include <QtContacts/QContactUnionFilter>
+#include <QtContacts/QContactFavorite>
+#include <QtContacts/QContactPhoneNumber>
+#include <QtContacts/QContactEmailAddress>
+#include <QtContacts/QContactNickname>
+#include <QtContacts/QContactName>
+#include <QtContacts/QContactDisplayLabel>
+#include <QtContacts/QContactGuid>
+
+#define DEFAULT_BENCHMARK_SIZES     "1000,10000,100000"
+#define DEFAULT_BENCHMARK_OUTPUT    "address-book-benchmarks.json"
+#define BENCHMARK_QUERY_RUNS        5
+#define BENCHMARK_PAGE_SIZE         100
+#define BENCHMARK_WRITE_COUNT       1000
+#define BENCHMARK_WRITE_BATCH       100
+#define BENCHMARK_TIMEOUT           600000
+#define DEFAULT_PROFILE_CALLS       100
+#define BENCHMARK_STORM_BASE        1000
+#define BENCHMARK_STORM_SIZE        10000
+#define BENCHMARK_STORM_SEED        -1000
+
+using namespace QtContacts;
+
+/*
+ * Seed the dummy store with synthetic contacts and measure the service at
+ * each population size. The sizes can be changed with
+ * ADDRESS_BOOK_BENCHMARK_SIZES (comma separated) and the JSON results are
+ * written to ADDRESS_BOOK_BENCHMARK_OUTPUT.
+ *
+ * The write paths are also measured end to end under the dummy store latency
+ * profiles, ADDRESS_BOOK_BENCHMARK_PROFILE_CALLS sets the calls per method.
+ *
+ * The sync storm benchmark measures the read calls of an open view and a
+ * caller ID lookup while the service processes a large personas change.
+ */
+class AddressBookBenchmarks : public BaseClientTest
+{
+    Q_OBJECT
+
+private:
+    QList<int> m_sizes;
+    QString m_output;
+    QJsonArray m_results;
+    QJsonArray m_profileResults;
+    QJsonObject m_stormResult;
+    int m_profileCalls;
+
+    qint64 serverMemory(const QByteArray &field)
+    {
+        QDBusReply<uint> pid = QDBusConnection::sessionBus().interface()->servicePid(m_serverIface->service());
+        QFile status(QString("/proc/%1/status").arg(pid.value()));
+        if (status.open(QFile::ReadOnly)) {
+            Q_FOREACH(const QByteArray &line, status.readAll().split('\n')) {
+                if (line.startsWith(field + ":")) {
+                    return line.mid(field.size() + 1).trimmed().split(' ').first().toLongLong();
+                }
+            }
+        }
+        return -1;
+    }
+
+    static int spiedIds(const QSignalSpy &spy)
+    {
+        int total = 0;
+        for(int i = 0; i < spy.count(); i++) {
+            total += spy.at(i).first().toStringList().size();
+        }
+        return total;
+    }
+
+    static qreal median(QList<qreal> values)
+    {
+        std::sort(values.begin(), values.end());
+        return values.isEmpty() ? 0 : values.at(values.size() / 2);
+    }
+
+    static QJsonObject percentiles(QList<qreal> values, int failures)
+    {
+        std::sort(values.begin(), values.end());
+        QJsonObject result;
+        result.insert("calls", values.size());
+        result.insert("failures", failures);
+        if (!values.isEmpty()) {
+            result.insert("p50Ms", values.at(qCeil(values.size() * 0.50) - 1));
+            result.insert("p90Ms", values.at(qCeil(values.size() * 0.90) - 1));
+            result.insert("p99Ms", values.at(qCeil(values.size() * 0.99) - 1));
+            result.insert("maxMs", values.last());
+        }
+        return result;
+    }
+
+    static qreal elapsedMs(const QElapsedTimer &timer)
+    {
+        return timer.nsecsElapsed() / 1000000.0;
+    }
+
+    static qreal perSecond(int count, const QElapsedTimer &timer)
+    {
+        return count * 1000000000.0 / qMax(qint64(1), timer.nsecsElapsed());
+    }
+
+    int queryCount(const QString &clause)
+    {
+        QDBusReply<int> reply = m_serverIface->call("queryCount", clause, false, QStringList());
+        return reply.value();
+    }
+
+    QMap<QString, QString> filterClasses() const
+    {
+        QMap<QString, QString> classes;
+        classes.insert("all", QString());
+
+        QContactDetailFilter favorite;
+        favorite.setDetailType(QContactDetail::TypeFavorite, QContactFavorite::FieldFavorite);
+        favorite.setValue(true);
+        favorite.setMatchFlags(QContactFilter::MatchExactly);
+        classes.insert("favorite", galera::Filter(favorite).toString());
+
+        QContactDetailFilter hasPhone;
+        hasPhone.setDetailType(QContactDetail::TypePhoneNumber);
+        classes.insert("hasPhoneNumber", galera::Filter(hasPhone).toString());
+
+        QContactDetailFilter hasEmail;
+        hasEmail.setDetailType(QContactDetail::TypeEmailAddress);
+        classes.insert("hasEmailAddress", galera::Filter(hasEmail).toString());
+
+        QContactDetailFilter phone;
+        phone.setDetailType(QContactDetail::TypePhoneNumber, QContactPhoneNumber::FieldNumber);
+        phone.setValue("1234");
+        phone.setMatchFlags(QContactFilter::MatchContains);
+        classes.insert("phoneNumberContains", galera::Filter(phone).toString());
+
+        QContactDetailFilter name;
+        name.setDetailType(QContactDetail::TypeName, QContactName::FieldFirstName);
+        name.setValue("Maria");
+        name.setMatchFlags(QContactFilter::MatchExactly);
+        classes.insert("firstName", galera::Filter(name).toString());
+
+        QContactDetailFilter label;
+        label.setDetailType(QContactDetail::TypeDisplayLabel, QContactDisplayLabel::FieldLabel);
+        label.setValue("Jo");
+        label.setMatchFlags(QContactFilter::MatchStartsWith);
+        classes.insert("displayLabelStartsWith", galera::Filter(label).toString());
+
+        QContactChangeLogFilter changed(QContactChangeLogFilter::EventAdded);
+        changed.setSince(QDateTime::currentDateTime().addSecs(-3600));
+        classes.insert("changedSince", galera::Filter(changed).toString());
+
+        QContactUnionFilter anyAddress;
+        anyAddress << hasPhone << hasEmail;
+        classes.insert("union", galera::Filter(anyAddress).toString());
+        return classes;
+    }
+
+    QJsonObject benchmarkQueries()
+    {
+        QJsonObject queries;
+        QMap<QString, QString> classes = filterClasses();
+        Q_FOREACH(const QString &className, classes.keys()) {
+            const QString clause = classes.value(className);
+            QList<qreal> idsRuns;
+            QList<qreal> countRuns;
+            int matches = 0;
+            for(int i = 0; i < BENCHMARK_QUERY_RUNS; i++) {
+                QElapsedTimer timer;
+                timer.start();
+                QDBusReply<QStringList> ids = m_serverIface->call("queryIds", clause, "", -1, false, QStringList());
+                idsRuns << elapsedMs(timer);
+                matches = ids.value().size();
+
+                timer.start();
+                queryCount(clause);
+                countRuns << elapsedMs(timer);
+            }
+
+            QJsonObject result;
+            result.insert("matches", matches);
+            result.insert("queryIdsMs", median(idsRuns));
+            result.insert("queryCountMs", median(countRuns));
+            queries.insert(className, result);
+        }
+        return queries;
+    }
+
+    QJsonObject benchmarkPages(int size, QStringList *vcards)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        QDBusReply<QDBusObjectPath> viewPath = m_serverIface->call("query", "", "", -1, false, QStringList());
+        QDBusInterface view(m_serverIface->service(),
+                            viewPath.value().path(),
+                            CPIM_ADDRESSBOOK_VIEW_IFACE_NAME);
+        view.setTimeout(BENCHMARK_TIMEOUT);
+
+        QList<qreal> pageRuns;
+        int fetched = 0;
+        while (fetched < size) {
+            QElapsedTimer pageTimer;
+            pageTimer.start();
+            QDBusReply<QStringList> page = view.call("contactsDetails", QStringList(), fetched, BENCHMARK_PAGE_SIZE);
+            pageRuns << elapsedMs(pageTimer);
+            if (page.value().isEmpty()) {
+                break;
+            }
+            if (vcards->size() < BENCHMARK_WRITE_COUNT) {
+                *vcards << page.value();
+            }
+            fetched += page.value().size();
+        }
+        qreal contactsPerSecond = perSecond(fetched, timer);
+        view.call("close");
+
+        QJsonObject result;
+        result.insert("pageSize", BENCHMARK_PAGE_SIZE);
+        result.insert("fetched", fetched);
+        result.insert("pageMs", median(pageRuns));
+        result.insert("contactsPerSecond", contactsPerSecond);
+        return result;
+    }
+
+    QJsonObject benchmarkUpdates(const QStringList &vcards, QStringList *ids)
+    {
+        QList<QContact> contacts = galera::VCardParser::vcardToContactSync(vcards);
+        QStringList changed;
+        Q_FOREACH(QContact contact, contacts) {
+            QContactNickname nickname = contact.detail<QContactNickname>();
+            nickname.setNickname("benchmark");
+            contact.saveDetail(&nickname);
+            changed << galera::VCardParser::contactToVcard(contact);
+            *ids << contact.detail<QContactGuid>().guid();
+        }
+
+        QElapsedTimer timer;
+        timer.start();
+        int updated = 0;
+        for(int i = 0; i < changed.size(); i += BENCHMARK_WRITE_BATCH) {
+            QDBusReply<QStringList> reply = m_serverIface->call("updateContacts",
+                                                                changed.mid(i, BENCHMARK_WRITE_BATCH));
+            updated += reply.value().size();
+        }
+
+        QJsonObject result;
+        result.insert("batchSize", BENCHMARK_WRITE_BATCH);
+        result.insert("updated", updated);
+        result.insert("contactsPerSecond", perSecond(updated, timer));
+        return result;
+    }
+
+    QJsonObject benchmarkRemoves(const QStringList &ids)
+    {
+        QSignalSpy removedSpy(m_serverIface, SIGNAL(contactsRemoved(QStringList)));
+        QElapsedTimer timer;
+        timer.start();
+        for(int i = 0; i < ids.size(); i += BENCHMARK_WRITE_BATCH) {
+            m_serverIface->call("removeContacts", ids.mid(i, BENCHMARK_WRITE_BATCH));
+        }
+        while ((spiedIds(removedSpy) < ids.size()) && (timer.elapsed() < BENCHMARK_TIMEOUT)) {
+            QTest::qWait(10);
+        }
+
+        int removed = spiedIds(removedSpy);
+        QJsonObject result;
+        result.insert("batchSize", BENCHMARK_WRITE_BATCH);
+        result.insert("removed", removed);
+        result.insert("contactsPerSecond", perSecond(removed, timer));
+        return result;
+    }
+
+    void setLatencyProfile(int latency, int jitter, int failureRate)
+    {
+        QStringList operations;
+        operations << "add-persona" << "remove-persona" << "change-property";
+        Q_FOREACH(const QString &operation, operations) {
+            m_dummyIface->call("setLatencyProfile", operation, latency, jitter, failureRate);
+        }
+    }
+
+    QJsonObject profileUpdates(const QStringList &vcards, QStringList *ids)
+    {
+        QList<qreal> latencies;
+        int failures = 0;
+        QList<QContact> contacts = galera::VCardParser::vcardToContactSync(vcards);
+        Q_FOREACH(QContact contact, contacts) {
+            QContactNickname nickname = contact.detail<QContactNickname>();
+            nickname.setNickname("profile");
+            contact.saveDetail(&nickname);
+            *ids << contact.detail<QContactGuid>().guid();
+
+            QElapsedTimer timer;
+            timer.start();
+            QDBusMessage reply = m_serverIface->call("updateContacts",
+                                                     QStringList() << galera::VCardParser::contactToVcard(contact));
+            latencies << elapsedMs(timer);
+            if (reply.type() != QDBusMessage::ReplyMessage) {
+                failures++;
+            }
+        }
+        return percentiles(latencies, failures);
+    }
+
+    QJsonObject profileCreates(int calls, QStringList *ids)
+    {
+        QList<qreal> latencies;
+        int failures = 0;
+        for(int i = 0; i < calls; i++) {
+            QString vcard = QString("BEGIN:VCARD\r\n"
+                                    "VERSION:3.0\r\n"
+                                    "N:Profile;Fulano_%1;;;\r\n"
+                                    "TEL;TYPE=CELL:7777%1\r\n"
+                                    "END:VCARD\r\n").arg(i);
+            QElapsedTimer timer;
+            timer.start();
+            QDBusReply<QString> reply = m_serverIface->call("createContact", vcard, "dummy-store");
+            latencies << elapsedMs(timer);
+            if (!reply.isValid() || reply.value().isEmpty()) {
+                failures++;
+            } else {
+                *ids << galera::VCardParser::vcardToContact(reply.value()).detail<QContactGuid>().guid();
+            }
+        }
+        return percentiles(latencies, failures);
+    }
+
+    QJsonObject profileRemoves(const QStringList &ids)
+    {
+        QList<qreal> latencies;
+        int failures = 0;
+        Q_FOREACH(const QString &id, ids) {
+            QElapsedTimer timer;
+            timer.start();
+            QDBusReply<int> reply = m_serverIface->call("removeContacts", QStringList() << id);
+            latencies << elapsedMs(timer);
+            if (!reply.isValid() || (reply.value() != 1)) {
+                failures++;
+            }
+        }
+        return percentiles(latencies, failures);
+    }
+
+    // latencies and failures of the read calls, by method
+    typedef QMap<QString, QList<qreal> > Latencies;
+    typedef QMap<QString, int> Failures;
+
+    static void recordRead(const QString &method, const QDBusMessage &reply, const QElapsedTimer &timer,
+                           Latencies *latencies, Failures *failures)
+    {
+        (*latencies)[method] << elapsedMs(timer);
+        if (reply.type() != QDBusMessage::ReplyMessage) {
+            (*failures)[method]++;
+        }
+    }
+
+    // one round of the read calls issued by a dialer: a page of an open view, its count,
+    // a caller ID lookup, a caller ID view and the sources
+    void readRound(QDBusInterface *view, const QString &callerIdClause,
+                   Latencies *latencies, Failures *failures)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        QDBusMessage page = view->call("contactsDetails", QStringList(), 0, BENCHMARK_PAGE_SIZE);
+        recordRead("contactsDetails", page, timer, latencies, failures);
+
+        timer.start();
+        view->property("count");
+        (*latencies)["count"] << elapsedMs(timer);
+
+        timer.start();
+        QDBusMessage lookup = m_serverIface->call("queryIds", callerIdClause, "", 1, false, QStringList());
+        recordRead("queryIds", lookup, timer, latencies, failures);
+
+        timer.start();
+        QDBusMessage query = m_serverIface->call("query", callerIdClause, "", 1, false, QStringList());
+        recordRead("query", query, timer, latencies, failures);
+        QDBusReply<QDBusObjectPath> queryPath(query);
+        if (queryPath.isValid()) {
+            QDBusInterface callerId(m_serverIface->service(),
+                                    queryPath.value().path(),
+                                    CPIM_ADDRESSBOOK_VIEW_IFACE_NAME);
+            callerId.call("close");
+        }
+
+        timer.start();
+        QDBusMessage sources = m_serverIface->call("availableSources");
+        recordRead("availableSources", sources, timer, latencies, failures);
+    }
+
+    static QJsonObject readRounds(const Latencies &latencies, const Failures &failures)
+    {
+        QJsonObject result;
+        Latencies::const_iterator i = latencies.constBegin();
+        for(; i != latencies.constEnd(); i++) {
+            result.insert(i.key(), percentiles(i.value(), failures.value(i.key(), 0)));
+        }
+        return result;
+    }
+
+private Q_SLOTS:
+    void initTestCase()
+    {
+        BaseClientTest::initTestCase();
+        m_serverIface->setTimeout(BENCHMARK_TIMEOUT);
+        m_dummyIface->setTimeout(BENCHMARK_TIMEOUT);
+
+        QByteArray sizes = DEFAULT_BENCHMARK_SIZES;
+        if (qEnvironmentVariableIsSet("ADDRESS_BOOK_BENCHMARK_SIZES")) {
+            sizes = qgetenv("ADDRESS_BOOK_BENCHMARK_SIZES");
+        }
+        Q_FOREACH(const QByteArray &size, sizes.split(',')) {
+            if (size.trimmed().toInt() > 0) {
+                m_sizes << size.trimmed().toInt();
+            }
+        }
+
+        m_profileCalls = DEFAULT_PROFILE_CALLS;
+        if (qEnvironmentVariableIsSet("ADDRESS_BOOK_BENCHMARK_PROFILE_CALLS")) {
+            m_profileCalls = qBound(1, qgetenv("ADDRESS_BOOK_BENCHMARK_PROFILE_CALLS").toInt(),
+                                    BENCHMARK_WRITE_COUNT);
+        }
+
+        m_output = DEFAULT_BENCHMARK_OUTPUT;
+        if (qEnvironmentVariableIsSet("ADDRESS_BOOK_BENCHMARK_OUTPUT")) {
+            m_output = qgetenv("ADDRESS_BOOK_BENCHMARK_OUTPUT");
+        }
+    }
+
+    void cleanupTestCase()
+    {
+        QJsonObject report;
+        report.insert("benchmark", QString("address-book-benchmarks"));
+        report.insert("date", QDateTime::currentDateTimeUtc().toString(Qt::ISODate));
+        report.insert("results", m_results);
+        report.insert("latencyProfiles", m_profileResults);
+        report.insert("syncStorm", m_stormResult);
+
+        QFile output(m_output);
+        if (output.open(QFile::WriteOnly | QFile::Truncate)) {
+            output.write(QJsonDocument(report).toJson());
+            qDebug() << "Benchmark results written to" << QFileInfo(output).absoluteFilePath();
+        } else {
+            qWarning() << "Fail to write benchmark results to" << m_output;
+        }
+
+        BaseClientTest::cleanupTestCase();
+    }
+
+    void benchmarkService_data()
+    {
+        QTest::addColumn<int>("size");
+        Q_FOREACH(int size, m_sizes) {
+            QTest::newRow(QByteArray::number(size).constData()) << size;
+        }
+    }
+
+    void benchmarkService()
+    {
+        QFETCH(int, size);
+
+        // wait for the previous population to be gone
+        QTRY_COMPARE_WITH_TIMEOUT(queryCount(""), 0, BENCHMARK_TIMEOUT);
+
+        QJsonObject result;
+        result.insert("size", size);
+
+        QSignalSpy addedSpy(m_serverIface, SIGNAL(contactsAdded(QStringList)));
+        QElapsedTimer timer;
+        timer.start();
+        QDBusReply<int> seeded = m_dummyIface->call("seedContacts", size, size);
+        QCOMPARE(seeded.value(), size);
+        QTRY_COMPARE_WITH_TIMEOUT(spiedIds(addedSpy), size, BENCHMARK_TIMEOUT);
+        result.insert("timeToReadyMs", elapsedMs(timer));
+        result.insert("rssAfterSeedKb", serverMemory("VmRSS"));
+
+        result.insert("queries", benchmarkQueries());
+
+        QStringList vcards;
+        result.insert("contactsDetails", benchmarkPages(size, &vcards));
+
+        QStringList ids;
+        QJsonObject updates = benchmarkUpdates(vcards, &ids);
+        QCOMPARE(updates.value("updated").toInt(), ids.size());
+        result.insert("updates", updates);
+
+        QJsonObject removes = benchmarkRemoves(ids);
+        QCOMPARE(removes.value("removed").toInt(), ids.size());
+        result.insert("removes", removes);
+
+        result.insert("rssKb", serverMemory("VmRSS"));
+        result.insert("peakRssKb", serverMemory("VmHWM"));
+        m_results.append(result);
+
+        qDebug() << "Benchmark" << size << "contacts:"
+                 << QJsonDocument(result).toJson(QJsonDocument::Compact);
+    }
+
+    void benchmarkLatencyProfiles_data()
+    {
+        QTest::addColumn<int>("latency");
+        QTest::addColumn<int>("jitter");
+        QTest::addColumn<int>("failureRate");
+
+        QTest::newRow("baseline") << 0 << 0 << 0;
+        QTest::newRow("slow") << 50 << 50 << 0;
+        QTest::newRow("jittery") << 10 << 250 << 0;
+        QTest::newRow("failing") << 20 << 20 << 10;
+    }
+
+    void benchmarkLatencyProfiles()
+    {
+        QFETCH(int, latency);
+        QFETCH(int, jitter);
+        QFETCH(int, failureRate);
+
+        QTRY_COMPARE_WITH_TIMEOUT(queryCount(""), 0, BENCHMARK_TIMEOUT);
+
+        QSignalSpy addedSpy(m_serverIface, SIGNAL(contactsAdded(QStringList)));
+        QDBusReply<int> seeded = m_dummyIface->call("seedContacts", m_profileCalls,
+                                                   -(m_profileResults.size() + 1));
+        QCOMPARE(seeded.value(), m_profileCalls);
+        QTRY_COMPARE_WITH_TIMEOUT(spiedIds(addedSpy), m_profileCalls, BENCHMARK_TIMEOUT);
+
+        QStringList vcards;
+        benchmarkPages(m_profileCalls, &vcards);
+
+        setLatencyProfile(latency, jitter, failureRate);
+
+        QJsonObject result;
+        result.insert("profile", QString(QTest::currentDataTag()));
+        result.insert("latencyMs", latency);
+        result.insert("jitterMs", jitter);
+        result.insert("failureRate", failureRate);
+
+        QStringList ids;
+        result.insert("updateContacts", profileUpdates(vcards, &ids));
+        result.insert("createContact", profileCreates(m_profileCalls, &ids));
+        result.insert("removeContacts", profileRemoves(ids));
+        m_profileResults.append(result);
+
+        qDebug() << "Latency profile" << QTest::currentDataTag() << ":"
+                 << QJsonDocument(result).toJson(QJsonDocument::Compact);
+    }
+
+    void benchmarkSyncStorm()
+    {
+        QTRY_COMPARE_WITH_TIMEOUT(queryCount(""), 0, BENCHMARK_TIMEOUT);
+
+        QSignalSpy addedSpy(m_serverIface, SIGNAL(contactsAdded(QStringList)));
+        m_dummyIface->call("seedContacts", BENCHMARK_STORM_BASE, BENCHMARK_STORM_SEED);
+        QTRY_COMPARE_WITH_TIMEOUT(spiedIds(addedSpy), BENCHMARK_STORM_BASE, BENCHMARK_TIMEOUT);
+
+        QDBusReply<QDBusObjectPath> viewPath = m_serverIface->call("query", "", "", -1, false, QStringList());
+        QDBusInterface view(m_serverIface->service(),
+                            viewPath.value().path(),
+                            CPIM_ADDRESSBOOK_VIEW_IFACE_NAME);
+        view.setTimeout(BENCHMARK_TIMEOUT);
+
+        QContactDetailFilter phone;
+        phone.setDetailType(QContactDetail::TypePhoneNumber, QContactPhoneNumber::FieldNumber);
+        phone.setValue("1234");
+        phone.setMatchFlags(QContactFilter::MatchPhoneNumber);
+        QString callerIdClause = galera::Filter(phone).toString();
+
+        // idle service
+        Latencies latencies;
+        Failures failures;
+        for(int i = 0; i < m_profileCalls; i++) {
+            readRound(&view, callerIdClause, &latencies, &failures);
+        }
+        m_stormResult.insert("idle", readRounds(latencies, failures));
+
+        // the same calls while the service processes the new personas
+        latencies.clear();
+        failures.clear();
+        addedSpy.clear();
+        QElapsedTimer timer;
+        timer.start();
+        m_dummyIface->asyncCall("seedContacts", BENCHMARK_STORM_SIZE, BENCHMARK_STORM_SEED - 1);
+        do {
+            readRound(&view, callerIdClause, &latencies, &failures);
+        } while ((spiedIds(addedSpy) < BENCHMARK_STORM_SIZE) && (timer.elapsed() < BENCHMARK_TIMEOUT));
+
+        QJsonObject storm = readRounds(latencies, failures);
+        storm.insert("personas", BENCHMARK_STORM_SIZE);
+        storm.insert("durationMs", elapsedMs(timer));
+        m_stormResult.insert("storm", storm);
+        view.call("close");
+
+        qDebug() << "Sync storm:" << QJsonDocument(m_stormResult).toJson(QJsonDocument::Compact);
+    }
+};
+
+QTEST_MAIN(AddressBookBenchmarks)
+
+#include "address-book-benchmarks.moc"
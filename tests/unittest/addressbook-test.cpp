@@ -20,6 +20,7 @@
 #include "common/source.h"
 #include "common/dbus-service-defs.h"
 #include "common/vcard-parser.h"
+#include "common/filter.h"
 
 #include <QObject>
 #include <QtDBus>
@@ -240,6 +241,150 @@ private Q_SLOTS:
         QCOMPARE(addedContactSpy.count(), 0);
     }
 
+    void testCreateContacts()
+    {
+        // spy 'contactsAdded' signal
+        QSignalSpy addedContactSpy(m_serverIface, SIGNAL(contactsAdded(QStringList)));
+
+        // create two valid contacts and a invalid one in the same call
+        QStringList vcards;
+        vcards << m_basicVcard
+               << "INVALID VCARD"
+               << QString(m_basicVcard).replace("Fulano_", "Beltrano_");
+        QDBusMessage reply = m_serverIface->call("createContacts", vcards, "dummy-store");
+        QCOMPARE(reply.type(), QDBusMessage::ReplyMessage);
+        QCOMPARE(reply.arguments().size(), 2);
+
+        // check the result of each contact
+        QStringList result = reply.arguments()[0].toStringList();
+        QStringList errors = reply.arguments()[1].toStringList();
+        QCOMPARE(result.size(), 3);
+        QCOMPARE(errors.size(), 3);
+        QVERIFY(!result[0].isEmpty());
+        QVERIFY(errors[0].isEmpty());
+        QVERIFY(result[1].isEmpty());
+        QVERIFY(!errors[1].isEmpty());
+        QVERIFY(!result[2].isEmpty());
+        QVERIFY(errors[2].isEmpty());
+
+        // the result keeps the order of the request
+        QtContacts::QContact contactA = galera::VCardParser::vcardToContact(result[0]);
+        QtContacts::QContact contactB = galera::VCardParser::vcardToContact(result[2]);
+        QCOMPARE(contactA.detail<QtContacts::QContactName>().firstName(), QStringLiteral("Fulano_"));
+        QCOMPARE(contactB.detail<QtContacts::QContactName>().firstName(), QStringLiteral("Beltrano_"));
+
+        QDBusReply<QStringList> reply2 = m_dummyIface->call("listContacts");
+        QCOMPARE(reply2.value().count(), 2);
+
+        // check if the signal "contactAdded" was fired for both contacts
+        QTRY_VERIFY(!addedContactSpy.isEmpty());
+        QSet<QString> addedIds;
+        Q_FOREACH(const QList<QVariant> &args, addedContactSpy) {
+            addedIds += args[0].toStringList().toSet();
+        }
+        QCOMPARE(addedIds.size(), 2);
+    }
+
+    void testImportVCards()
+    {
+        QSignalSpy addedContactSpy(m_serverIface, SIGNAL(contactsAdded(QStringList)));
+        QSignalSpy finishedSpy(m_serverIface, SIGNAL(importFinished(QString,int,int)));
+
+        // write two valid vcards and a invalid one to a file
+        QTemporaryFile file;
+        QVERIFY(file.open());
+        file.write(m_basicVcard.toUtf8() + "\n");
+        file.write("BEGIN:VCARD\nINVALID VCARD\nEND:VCARD\n");
+        file.write(QString(m_basicVcard).replace("Fulano_", "Beltrano_").toUtf8() + "\n");
+        file.flush();
+        QVERIFY(file.seek(0));
+
+        QDBusReply<QString> reply = m_serverIface->call("importVCards",
+                                                        QVariant::fromValue(QDBusUnixFileDescriptor(file.handle())),
+                                                        "dummy-store");
+        QString importId = reply.value();
+        QVERIFY(!importId.isEmpty());
+
+        QTRY_COMPARE(finishedSpy.count(), 1);
+        QList<QVariant> args = finishedSpy.takeFirst();
+        QCOMPARE(args[0].toString(), importId);
+        QCOMPARE(args[1].toInt(), 2);
+        QCOMPARE(args[2].toInt(), 1);
+
+        QDBusReply<QStringList> reply2 = m_dummyIface->call("listContacts");
+        QCOMPARE(reply2.value().count(), 2);
+        QTRY_VERIFY(!addedContactSpy.isEmpty());
+    }
+
+    void testExportVCards()
+    {
+        QSignalSpy addedContactSpy(m_serverIface, SIGNAL(contactsAdded(QStringList)));
+        QStringList vcards;
+        vcards << m_basicVcard
+               << QString(m_basicVcard).replace("Fulano_", "Beltrano_");
+        QDBusMessage reply = m_serverIface->call("createContacts", vcards, "dummy-store");
+        QCOMPARE(reply.type(), QDBusMessage::ReplyMessage);
+        QTRY_VERIFY(!addedContactSpy.isEmpty());
+
+        // export all contacts
+        QTemporaryFile file;
+        QVERIFY(file.open());
+        QDBusReply<int> exportReply = m_serverIface->call("exportVCards",
+                                                          QVariant::fromValue(QDBusUnixFileDescriptor(file.handle())),
+                                                          QStringList(),
+                                                          QStringList());
+        QCOMPARE(exportReply.value(), 2);
+        QVERIFY(file.seek(0));
+        QList<QtContacts::QContact> contacts = galera::VCardParser::vcardToContactSync(galera::VCardParser::splitVcards(file.readAll()));
+        QCOMPARE(contacts.size(), 2);
+
+        // export contacts from a source that does not exist
+        QTemporaryFile emptyFile;
+        QVERIFY(emptyFile.open());
+        exportReply = m_serverIface->call("exportVCards",
+                                          QVariant::fromValue(QDBusUnixFileDescriptor(emptyFile.handle())),
+                                          QStringList(),
+                                          QStringList() << "invalid-source");
+        QCOMPARE(exportReply.value(), 0);
+        QCOMPARE(emptyFile.size(), qint64(0));
+    }
+
+    void testChangesSince()
+    {
+        // the first call returns the current token
+        QDBusMessage reply = m_serverIface->call("changesSince", QVariant::fromValue(quint64(0)));
+        QCOMPARE(reply.type(), QDBusMessage::ReplyMessage);
+        QCOMPARE(reply.arguments().size(), 5);
+        quint64 token = reply.arguments()[0].toULongLong();
+
+        QSignalSpy addedContactSpy(m_serverIface, SIGNAL(contactsAdded(QStringList)));
+        QDBusReply<QString> replyAdd = m_serverIface->call("createContact", m_basicVcard, "dummy-store");
+        QTRY_COMPARE(addedContactSpy.count(), 1);
+        QString contactId = galera::VCardParser::vcardToContact(replyAdd.value()).detail<QContactGuid>().guid();
+
+        reply = m_serverIface->call("changesSince", QVariant::fromValue(token));
+        QVERIFY(reply.arguments()[0].toULongLong() > token);
+        QCOMPARE(reply.arguments()[1].toBool(), true);
+        QCOMPARE(reply.arguments()[2].toStringList(), QStringList() << contactId);
+        QVERIFY(reply.arguments()[3].toStringList().isEmpty());
+        QVERIFY(reply.arguments()[4].toStringList().isEmpty());
+        token = reply.arguments()[0].toULongLong();
+
+        // nothing changed after the new token
+        reply = m_serverIface->call("changesSince", QVariant::fromValue(token));
+        QCOMPARE(reply.arguments()[0].toULongLong(), token);
+        QCOMPARE(reply.arguments()[1].toBool(), true);
+        QVERIFY(reply.arguments()[2].toStringList().isEmpty());
+
+        // remove the contact
+        QSignalSpy removedContactSpy(m_serverIface, SIGNAL(contactsRemoved(QStringList)));
+        QDBusReply<int> replyRemove = m_serverIface->call("removeContacts", QStringList() << contactId);
+        QCOMPARE(replyRemove.value(), 1);
+        QTRY_COMPARE(removedContactSpy.count(), 1);
+        reply = m_serverIface->call("changesSince", QVariant::fromValue(token));
+        QCOMPARE(reply.arguments()[4].toStringList(), QStringList() << contactId);
+    }
+
     void testRemoveContact()
     {
         // create a basic contact
@@ -314,6 +459,266 @@ private Q_SLOTS:
         contactUpdatedResult = contacts[0];
         compareContact(contactUpdatedResult, contactUpdated);
     }
+
+    void testUpdateContactWrittenGroups()
+    {
+        // create a basic contact
+        QSignalSpy addedContactSpy(m_serverIface, SIGNAL(contactsAdded(QStringList)));
+        QDBusReply<QString> replyAdd = m_serverIface->call("createContact", m_basicVcard, "dummy-store");
+        QTRY_COMPARE(addedContactSpy.count(), 1);
+
+        // update the contact phone number
+        QString vcard = QString(replyAdd.value()).replace("8888888", "0000000");
+        QDBusMessage reply = m_serverIface->call("updateContactsWithWrittenGroups", QStringList() << vcard);
+        QCOMPARE(reply.type(), QDBusMessage::ReplyMessage);
+        QCOMPARE(reply.arguments().size(), 2);
+
+        QStringList result = reply.arguments()[0].toStringList();
+        QList<int> writtenGroups = qdbus_cast<QList<int> >(reply.arguments()[1]);
+        QCOMPARE(result.size(), 1);
+        QCOMPARE(writtenGroups.size(), 1);
+        QVERIFY(writtenGroups[0] > 0);
+
+        // send the same contact again, nothing should be written
+        reply = m_serverIface->call("updateContactsWithWrittenGroups", result);
+        QCOMPARE(reply.type(), QDBusMessage::ReplyMessage);
+        writtenGroups = qdbus_cast<QList<int> >(reply.arguments()[1]);
+        QCOMPARE(writtenGroups, QList<int>() << 0);
+
+        // 'updateContacts' keeps a single reply argument
+        reply = m_serverIface->call("updateContacts", result);
+        QCOMPARE(reply.type(), QDBusMessage::ReplyMessage);
+        QCOMPARE(reply.arguments().size(), 1);
+    }
+
+    void testUpdateContactSwappedValues()
+    {
+        // create a contact with two phone numbers
+        QSignalSpy addedContactSpy(m_serverIface, SIGNAL(contactsAdded(QStringList)));
+        QString vcard = QString(m_basicVcard).replace("END:VCARD",
+                                                      "TEL;TYPE=HOME:7777777\nEND:VCARD");
+        QDBusReply<QString> replyAdd = m_serverIface->call("createContact", vcard, "dummy-store");
+        QTRY_COMPARE(addedContactSpy.count(), 1);
+
+        // move the values between the two details, the contact must be written
+        QString swapped = QString(replyAdd.value()).replace("8888888", "swap")
+                                                   .replace("7777777", "8888888")
+                                                   .replace("swap", "7777777");
+        QDBusMessage reply = m_serverIface->call("updateContactsWithWrittenGroups", QStringList() << swapped);
+        QCOMPARE(reply.type(), QDBusMessage::ReplyMessage);
+        QList<int> writtenGroups = qdbus_cast<QList<int> >(reply.arguments()[1]);
+        QCOMPARE(writtenGroups.size(), 1);
+        QVERIFY(writtenGroups[0] > 0);
+    }
+
+    void testConcurrentUpdateContacts()
+    {
+        // create two contacts
+        QSignalSpy addedContactSpy(m_serverIface, SIGNAL(contactsAdded(QStringList)));
+        QDBusReply<QString> replyAdd = m_serverIface->call("createContact", m_basicVcard, "dummy-store");
+        QString vcardA = replyAdd.value();
+        replyAdd = m_serverIface->call("createContact", QString(m_basicVcard).replace("Fulano_", "Beltrano_"), "dummy-store");
+        QString vcardB = replyAdd.value();
+        QTRY_COMPARE(addedContactSpy.count(), 2);
+
+        // update both contacts with independent calls, and the first one twice in the same call
+        QString vcardA1 = QString(vcardA).replace("8888888", "1111111");
+        QString vcardA2 = QString(vcardA).replace("8888888", "2222222");
+        QString vcardB1 = QString(vcardB).replace("8888888", "3333333");
+        QDBusPendingCall callA = m_serverIface->asyncCall("updateContacts", QStringList() << vcardA1 << vcardA2);
+        QDBusPendingCall callB = m_serverIface->asyncCall("updateContacts", QStringList() << vcardB1);
+
+        QDBusPendingReply<QStringList> replyA(callA);
+        QDBusPendingReply<QStringList> replyB(callB);
+        replyA.waitForFinished();
+        replyB.waitForFinished();
+        QVERIFY(!replyA.isError());
+        QVERIFY(!replyB.isError());
+        QCOMPARE(replyA.value().size(), 2);
+        QCOMPARE(replyB.value().size(), 1);
+
+        // the updates of the same contact must be applied in order
+        QList<QtContacts::QContact> contacts = galera::VCardParser::vcardToContactSync(replyA.value());
+        compareContact(contacts[1], galera::VCardParser::vcardToContact(vcardA2));
+        contacts = galera::VCardParser::vcardToContactSync(replyB.value());
+        compareContact(contacts[0], galera::VCardParser::vcardToContact(vcardB1));
+    }
+
+    void testQueryIdsAndCount()
+    {
+        // create a basic contact
+        QSignalSpy addedContactSpy(m_serverIface, SIGNAL(contactsAdded(QStringList)));
+        QDBusReply<QString> replyAdd = m_serverIface->call("createContact", m_basicVcard, "dummy-store");
+        // wait for added signal
+        QTRY_COMPARE(addedContactSpy.count(), 1);
+
+        QContact newContact = galera::VCardParser::vcardToContact(replyAdd.value());
+        QString newContactId = newContact.detail<QContactGuid>().guid();
+
+        // query all contacts ids
+        QDBusReply<QStringList> replyIds = m_serverIface->call("queryIds", "", "", -1, false, QStringList());
+        QCOMPARE(replyIds.value(), QStringList() << newContactId);
+
+        // query the number of contacts
+        QDBusReply<int> replyCount = m_serverIface->call("queryCount", "", false, QStringList());
+        QCOMPARE(replyCount.value(), 1);
+
+        // query using a filter that does not match
+        QtContacts::QContactDetailFilter filter;
+        filter.setDetailType(QtContacts::QContactDetail::TypeName, QtContacts::QContactName::FieldFirstName);
+        filter.setValue("NotFulano");
+        filter.setMatchFlags(QtContacts::QContactFilter::MatchExactly);
+        QString filterStr = galera::Filter(filter).toString();
+
+        replyIds = m_serverIface->call("queryIds", filterStr, "", -1, false, QStringList());
+        QCOMPARE(replyIds.value().size(), 0);
+
+        replyCount = m_serverIface->call("queryCount", filterStr, false, QStringList());
+        QCOMPARE(replyCount.value(), 0);
+    }
+
+    void testQueryBySources()
+    {
+        // create a basic contact
+        QSignalSpy addedContactSpy(m_serverIface, SIGNAL(contactsAdded(QStringList)));
+        QDBusReply<QString> replyAdd = m_serverIface->call("createContact", m_basicVcard, "dummy-store");
+        QTRY_COMPARE(addedContactSpy.count(), 1);
+
+        QContact newContact = galera::VCardParser::vcardToContact(replyAdd.value());
+        QString newContactId = newContact.detail<QContactGuid>().guid();
+
+        // query the contact source
+        QDBusReply<QStringList> replyIds = m_serverIface->call("queryIds", "", "", -1, false,
+                                                               QStringList() << "dummy-store");
+        QCOMPARE(replyIds.value(), QStringList() << newContactId);
+
+        QDBusReply<int> replyCount = m_serverIface->call("queryCount", "", false,
+                                                         QStringList() << "dummy-store");
+        QCOMPARE(replyCount.value(), 1);
+
+        // query a source without contacts
+        replyIds = m_serverIface->call("queryIds", "", "", -1, false, QStringList() << "unknown-store");
+        QCOMPARE(replyIds.value().size(), 0);
+
+        // the sources are applied together with the filter
+        QtContacts::QContactDetailFilter filter;
+        filter.setDetailType(QtContacts::QContactDetail::TypeName, QtContacts::QContactName::FieldFirstName);
+        filter.setValue("Fulano_");
+        filter.setMatchFlags(QtContacts::QContactFilter::MatchExactly);
+        QString filterStr = galera::Filter(filter).toString();
+
+        replyCount = m_serverIface->call("queryCount", filterStr, false, QStringList() << "dummy-store");
+        QCOMPARE(replyCount.value(), 1);
+
+        replyCount = m_serverIface->call("queryCount", filterStr, false, QStringList() << "unknown-store");
+        QCOMPARE(replyCount.value(), 0);
+    }
+
+    void testCreateContactOnNewSource()
+    {
+        // fill the persona stores table before the new source exists
+        QSignalSpy addedContactSpy(m_serverIface, SIGNAL(contactsAdded(QStringList)));
+        m_serverIface->call("createContact", m_basicVcard, "dummy-store");
+        QTRY_COMPARE(addedContactSpy.count(), 1);
+
+        QDBusReply<galera::Source> replySource = m_serverIface->call("createSource", "new-store", false);
+        QCOMPARE(replySource.value().id(), QStringLiteral("new-store"));
+
+        // the contact must be saved on the new source store
+        QDBusReply<QString> replyAdd = m_serverIface->call("createContact", m_basicVcard, "new-store");
+        QTRY_COMPARE(addedContactSpy.count(), 2);
+
+        QContact newContact = galera::VCardParser::vcardToContact(replyAdd.value());
+        QString newContactId = newContact.detail<QContactGuid>().guid();
+
+        QDBusReply<QStringList> replyIds = m_serverIface->call("queryIds", "", "", -1, false,
+                                                               QStringList() << "new-store");
+        QCOMPARE(replyIds.value(), QStringList() << newContactId);
+    }
+
+    void testPendingContactsDetails()
+    {
+        QSignalSpy addedContactSpy(m_serverIface, SIGNAL(contactsAdded(QStringList)));
+        m_serverIface->call("createContact", m_basicVcard, "dummy-store");
+        QTRY_COMPARE(addedContactSpy.count(), 1);
+
+        QDBusReply<QDBusObjectPath> replyQuery = m_serverIface->call("query", "", "", -1, false, QStringList());
+        QDBusInterface view(m_serverIface->service(),
+                            replyQuery.value().path(),
+                            CPIM_ADDRESSBOOK_VIEW_IFACE_NAME);
+
+        // calls issued before the filter finishes are queued and answered in order
+        QDBusPendingCall pageA = view.asyncCall("contactsDetails", QStringList(), 0, 10);
+        QDBusPendingCall pageB = view.asyncCall("contactsDetails", QStringList(), 1, 10);
+        QDBusPendingCall pageC = view.asyncCall("contactsDetails", QStringList(), 0, 10);
+        pageA.waitForFinished();
+        pageB.waitForFinished();
+        pageC.waitForFinished();
+
+        QDBusPendingReply<QStringList> replyA = pageA;
+        QDBusPendingReply<QStringList> replyB = pageB;
+        QDBusPendingReply<QStringList> replyC = pageC;
+        QVERIFY(!replyA.isError());
+        QCOMPARE(replyA.value().size(), 1);
+        QCOMPARE(replyB.value().size(), 0);
+        QCOMPARE(replyC.value(), replyA.value());
+        QCOMPARE(view.property("count").toInt(), 1);
+
+        // calls on a closed view do not block
+        view.call("close");
+        QDBusReply<QStringList> replyClosed = view.call("contactsDetails", QStringList(), 0, 10);
+        QVERIFY(replyClosed.value().isEmpty());
+    }
+
+    void testQueryPriority()
+    {
+        QSignalSpy addedContactSpy(m_serverIface, SIGNAL(contactsAdded(QStringList)));
+        m_serverIface->call("createContact", m_basicVcard, "dummy-store");
+        QTRY_COMPARE(addedContactSpy.count(), 1);
+
+        QDBusReply<bool> replyPriority = m_serverIface->call("setQueryPriority", "unknown");
+        QVERIFY(!replyPriority.value());
+
+        // the priority only changes where the queries run
+        replyPriority = m_serverIface->call("setQueryPriority", "bulk");
+        QVERIFY(replyPriority.value());
+        QDBusReply<int> replyCount = m_serverIface->call("queryCount", "", false, QStringList());
+        QCOMPARE(replyCount.value(), 1);
+
+        replyPriority = m_serverIface->call("setQueryPriority", "interactive");
+        QVERIFY(replyPriority.value());
+        QDBusReply<QStringList> replyIds = m_serverIface->call("queryIds", "", "", -1, false, QStringList());
+        QCOMPARE(replyIds.value().size(), 1);
+
+        replyPriority = m_serverIface->call("setQueryPriority", "auto");
+        QVERIFY(replyPriority.value());
+    }
+
+    void testViewClosedWhenClientLeaves()
+    {
+        QSignalSpy addedContactSpy(m_serverIface, SIGNAL(contactsAdded(QStringList)));
+        m_serverIface->call("createContact", m_basicVcard, "dummy-store");
+        QTRY_COMPARE(addedContactSpy.count(), 1);
+
+        // create the view from another bus connection and leave without closing it
+        QString viewPath;
+        {
+            QDBusConnection client = QDBusConnection::connectToBus(QDBusConnection::SessionBus, "view-owner");
+            QDBusInterface clientIface(m_serverIface->service(),
+                                       m_serverIface->path(),
+                                       m_serverIface->interface(),
+                                       client);
+            QDBusReply<QDBusObjectPath> replyQuery = clientIface.call("query", "", "", -1, false, QStringList());
+            viewPath = replyQuery.value().path();
+        }
+        QDBusInterface view(m_serverIface->service(), viewPath, CPIM_ADDRESSBOOK_VIEW_IFACE_NAME);
+        QDBusReply<QStringList> replyDetails = view.call("contactsDetails", QStringList(), 0, 10);
+        QCOMPARE(replyDetails.value().size(), 1);
+
+        QDBusConnection::disconnectFromBus("view-owner");
+        // the service closes the view and removes it from the bus
+        QTRY_COMPARE(view.call("contactsDetails", QStringList(), 0, 10).type(), QDBusMessage::ErrorMessage);
+    }
 };
 
 QTEST_MAIN(AddressBookTest)
@@ -0,0 +1,191 @@
+/*
+ * Copyright 2013 Canonical Ltd.
+ *
+ * This file is part of contact-service-app.
+ *
+ * contact-service-app is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * contact-service-app is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lib/change-journal.h"
+
+#include <QObject>
+#include <QtTest>
+#include <QDebug>
+
+using namespace galera;
+
+class ChangeJournalTest : public QObject
+{
+    Q_OBJECT
+
+private:
+    QSet<QString> ids(const QString &id)
+    {
+        return QSet<QString>() << id;
+    }
+
+private Q_SLOTS:
+    void testEmptyJournal()
+    {
+        ChangeJournal journal(10);
+        QStringList added, changed, removed;
+        QVERIFY(journal.changesSince(journal.currentToken(), &added, &changed, &removed));
+        QVERIFY(added.isEmpty());
+        QVERIFY(changed.isEmpty());
+        QVERIFY(removed.isEmpty());
+
+        // tokens of other runs are not valid
+        QVERIFY(!journal.changesSince(0, &added, &changed, &removed));
+        QVERIFY(!journal.changesSince(journal.currentToken() + 1, &added, &changed, &removed));
+    }
+
+    void testChangesSince()
+    {
+        ChangeJournal journal(10);
+        journal.append(ChangeJournal::ContactAdded, ids("a"));
+        quint64 token = journal.currentToken();
+        journal.append(ChangeJournal::ContactChanged, ids("a"));
+        journal.append(ChangeJournal::ContactAdded, ids("b"));
+        journal.append(ChangeJournal::ContactChanged, ids("b"));
+        journal.append(ChangeJournal::ContactAdded, ids("c"));
+        journal.append(ChangeJournal::ContactRemoved, ids("c"));
+        journal.append(ChangeJournal::ContactRemoved, ids("a"));
+        QCOMPARE(journal.currentToken(), token + 6);
+
+        QStringList added, changed, removed;
+        QVERIFY(journal.changesSince(token, &added, &changed, &removed));
+        // 'b' was added and changed, 'c' was added and removed, 'a' was changed and removed
+        QCOMPARE(added, QStringList() << "b");
+        QVERIFY(changed.isEmpty());
+        QCOMPARE(removed, QStringList() << "a");
+
+        // removed and added again is a change for the client
+        token = journal.currentToken();
+        journal.append(ChangeJournal::ContactAdded, ids("a"));
+        added.clear();
+        removed.clear();
+        QVERIFY(journal.changesSince(token - 1, &added, &changed, &removed));
+        QCOMPARE(changed, QStringList() << "a");
+    }
+
+    void testAddedRemovedAdded()
+    {
+        ChangeJournal journal(10);
+        quint64 token = journal.currentToken();
+        journal.append(ChangeJournal::ContactAdded, ids("a"));
+        journal.append(ChangeJournal::ContactRemoved, ids("a"));
+        journal.append(ChangeJournal::ContactAdded, ids("a"));
+        journal.append(ChangeJournal::ContactAdded, ids("b"));
+
+        // the contact is listed only once
+        QStringList added, changed, removed;
+        QVERIFY(journal.changesSince(token, &added, &changed, &removed));
+        QCOMPARE(added, QStringList() << "a" << "b");
+        QVERIFY(changed.isEmpty());
+        QVERIFY(removed.isEmpty());
+    }
+
+    void testRingBuffer()
+    {
+        ChangeJournal journal(3);
+        quint64 token = journal.currentToken();
+        for(int i = 0; i < 5; i++) {
+            journal.append(ChangeJournal::ContactChanged, ids(QString::number(i)));
+        }
+        QCOMPARE(journal.size(), 3);
+
+        // the oldest changes were overwritten
+        QStringList added, changed, removed;
+        QVERIFY(!journal.changesSince(token, &added, &changed, &removed));
+        QVERIFY(!journal.changesSince(token + 1, &added, &changed, &removed));
+        QVERIFY(journal.changesSince(token + 2, &added, &changed, &removed));
+        QCOMPARE(changed, QStringList() << "2" << "3" << "4");
+    }
+
+    void testReset()
+    {
+        ChangeJournal journal(10);
+        quint64 token = journal.currentToken();
+        journal.append(ChangeJournal::ContactAdded, ids("a"));
+        journal.reset();
+
+        QStringList added, changed, removed;
+        QVERIFY(!journal.changesSince(token, &added, &changed, &removed));
+        QVERIFY(journal.changesSince(journal.currentToken(), &added, &changed, &removed));
+    }
+
+    void testSaveAndLoad()
+    {
+        QTemporaryDir dir;
+        QString fileName = dir.path() + "/journal";
+
+        ChangeJournal journal(10);
+        quint64 token = journal.currentToken();
+        journal.append(ChangeJournal::ContactAdded, ids("a"));
+        journal.append(ChangeJournal::ContactChanged, ids("b"));
+
+        QHash<QString, qint64> contacts;
+        contacts.insert("a", 1);
+        contacts.insert("b", 1);
+        contacts.insert("c", 1);
+        journal.setSnapshot(contacts);
+        QVERIFY(journal.save(fileName));
+
+        ChangeJournal loaded(10);
+        QVERIFY(loaded.load(fileName));
+        QCOMPARE(loaded.currentToken(), journal.currentToken());
+
+        // the changes are unknown until the contacts are compared with the snapshot
+        QStringList added, changed, removed;
+        QVERIFY(loaded.needsReconcile());
+        QVERIFY(!loaded.changesSince(token, &added, &changed, &removed));
+
+        // 'a' did not change, 'b' was changed, 'c' removed and 'd' added while not running
+        contacts.insert("b", 2);
+        contacts.remove("c");
+        contacts.insert("d", 1);
+        loaded.reconcile(contacts);
+        QVERIFY(!loaded.needsReconcile());
+        QCOMPARE(loaded.currentToken(), journal.currentToken() + 3);
+
+        QVERIFY(loaded.changesSince(token, &added, &changed, &removed));
+        QCOMPARE(added, QStringList() << "a" << "d");
+        QCOMPARE(changed, QStringList() << "b");
+        QCOMPARE(removed, QStringList() << "c");
+    }
+
+    void testLoadWithoutSnapshot()
+    {
+        QTemporaryDir dir;
+        QString fileName = dir.path() + "/journal";
+
+        ChangeJournal journal(10);
+        quint64 token = journal.currentToken();
+        journal.append(ChangeJournal::ContactAdded, ids("a"));
+        QVERIFY(journal.save(fileName));
+
+        // the changes made while the service was not running are unknown, a full sync is needed
+        ChangeJournal loaded(10);
+        QVERIFY(loaded.load(fileName));
+        QVERIFY(!loaded.needsReconcile());
+        QCOMPARE(loaded.currentToken(), journal.currentToken());
+
+        QStringList added, changed, removed;
+        QVERIFY(!loaded.changesSince(token, &added, &changed, &removed));
+        QVERIFY(loaded.changesSince(loaded.currentToken(), &added, &changed, &removed));
+    }
+};
+
+QTEST_MAIN(ChangeJournalTest)
+
+#include "change-journal-test.moc"
@@ -304,6 +304,122 @@ private Q_SLOTS:
         QVERIFY(combination.includeRemoved());
     }
 
+    void testExtractRemovedSince()
+    {
+        QDateTime since = QDateTime::currentDateTime().addDays(-1);
+        QContactChangeLogFilter removedFilter;
+        removedFilter.setEventType(QContactChangeLogFilter::EventRemoved);
+        removedFilter.setSince(since);
+
+        QDateTime result;
+        QVERIFY(Filter(removedFilter).removedSinceToFilter(&result));
+        QCOMPARE(result, since);
+
+        QContactDetailFilter detFilter;
+        detFilter.setDetailType(QContactFavorite::Type, QContactFavorite::FieldFavorite);
+        detFilter.setValue(true);
+
+        result = QDateTime();
+        QVERIFY(Filter(detFilter & removedFilter).removedSinceToFilter(&result));
+        QCOMPARE(result, since);
+
+        // a union can match contacts not removed
+        QVERIFY(!Filter(detFilter | removedFilter).removedSinceToFilter(&result));
+        QVERIFY(!Filter(detFilter).removedSinceToFilter(&result));
+
+        QContactChangeLogFilter addedFilter;
+        addedFilter.setEventType(QContactChangeLogFilter::EventAdded);
+        addedFilter.setSince(since);
+        QVERIFY(!Filter(addedFilter).removedSinceToFilter(&result));
+    }
+
+    void testFilterPlan()
+    {
+        QContactDetailFilter favFilter;
+        favFilter.setDetailType(QContactFavorite::Type, QContactFavorite::FieldFavorite);
+        favFilter.setValue(true);
+
+        QContactDetailFilter phoneFilter;
+        phoneFilter.setDetailType(QContactPhoneNumber::Type);
+
+        QContactDetailFilter emailFilter;
+        emailFilter.setDetailType(QContactEmailAddress::Type);
+
+        QContactDetailFilter nameFilter;
+        nameFilter.setDetailType(QContactName::Type, QContactName::FieldFirstName);
+        nameFilter.setValue("Foo");
+
+        QContactFilter residual;
+        bool exact = false;
+
+        // a single supported predicate
+        FilterPlan plan = Filter(favFilter).plan(&residual, &exact);
+        QVERIFY(exact);
+        QCOMPARE(plan.type(), FilterPlan::Favorite);
+
+        // union and intersection of supported predicates
+        plan = Filter(favFilter & (phoneFilter | emailFilter)).plan(&residual, &exact);
+        QVERIFY(exact);
+        QCOMPARE(plan.type(), FilterPlan::And);
+        QCOMPARE(plan.children().size(), 2);
+        QCOMPARE(plan.children().at(1).type(), FilterPlan::Or);
+
+        // the unsupported predicate is left as residual
+        plan = Filter(favFilter & nameFilter).plan(&residual, &exact);
+        QVERIFY(!exact);
+        QCOMPARE(plan.type(), FilterPlan::And);
+        QCOMPARE(plan.children().size(), 1);
+        QCOMPARE(residual.type(), QContactFilter::IntersectionFilter);
+        QCOMPARE(QContactIntersectionFilter(residual).filters().size(), 1);
+
+        // a union with an unsupported predicate can not use the bitmaps
+        plan = Filter(favFilter | nameFilter).plan(&residual, &exact);
+        QVERIFY(!exact);
+        QVERIFY(plan.isAll());
+        QCOMPARE(residual.type(), QContactFilter::UnionFilter);
+
+        // only favorite = true is supported
+        favFilter.setValue(false);
+        plan = Filter(favFilter).plan(&residual, &exact);
+        QVERIFY(!exact);
+        QVERIFY(plan.isAll());
+    }
+
+    void testExtractChangedSince()
+    {
+        QDateTime since = QDateTime::currentDateTime().addDays(-1);
+        QContactChangeLogFilter changedFilter;
+        changedFilter.setEventType(QContactChangeLogFilter::EventChanged);
+        changedFilter.setSince(since);
+
+        QDateTime result;
+        QContactChangeLogFilter::EventType eventType = QContactChangeLogFilter::EventAdded;
+        QVERIFY(Filter(changedFilter).changedSinceToFilter(&result, &eventType));
+        QCOMPARE(result, since);
+        QCOMPARE(eventType, QContactChangeLogFilter::EventChanged);
+
+        QContactDetailFilter detFilter;
+        detFilter.setDetailType(QContactFavorite::Type, QContactFavorite::FieldFavorite);
+        detFilter.setValue(true);
+
+        QContactChangeLogFilter addedFilter;
+        addedFilter.setEventType(QContactChangeLogFilter::EventAdded);
+        addedFilter.setSince(since);
+        result = QDateTime();
+        QVERIFY(Filter(detFilter & addedFilter).changedSinceToFilter(&result, &eventType));
+        QCOMPARE(result, since);
+        QCOMPARE(eventType, QContactChangeLogFilter::EventAdded);
+
+        // a union can match contacts not changed
+        QVERIFY(!Filter(detFilter | addedFilter).changedSinceToFilter(&result, &eventType));
+
+        // removed contacts use the tombstone index
+        QContactChangeLogFilter removedFilter;
+        removedFilter.setEventType(QContactChangeLogFilter::EventRemoved);
+        removedFilter.setSince(since);
+        QVERIFY(!Filter(removedFilter).changedSinceToFilter(&result, &eventType));
+    }
+
     void testDeletedContact()
     {
         // create a contact with name
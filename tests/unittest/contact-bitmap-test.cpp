@@ -0,0 +1,125 @@
+/*
+ * Copyright 2013 Canonical Ltd.
+ *
+ * This file is part of contact-service-app.
+ *
+ * contact-service-app is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * contact-service-app is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lib/contact-bitmap.h"
+
+#include <QObject>
+#include <QtTest>
+#include <QDebug>
+
+using namespace galera;
+
+class ContactBitmapTest : public QObject
+{
+    Q_OBJECT
+
+private:
+    ContactBitmap fromList(const QList<int> &values)
+    {
+        ContactBitmap bitmap;
+        Q_FOREACH(int value, values) {
+            bitmap.insert(value);
+        }
+        return bitmap;
+    }
+
+private Q_SLOTS:
+    void testInsertAndRemove()
+    {
+        ContactBitmap bitmap;
+        QVERIFY(bitmap.isEmpty());
+
+        bitmap.insert(5);
+        bitmap.insert(70000);
+        bitmap.insert(5);
+        QCOMPARE(bitmap.count(), 2);
+        QVERIFY(bitmap.contains(5));
+        QVERIFY(bitmap.contains(70000));
+        QVERIFY(!bitmap.contains(6));
+        QCOMPARE(bitmap.toList(), QList<int>() << 5 << 70000);
+
+        bitmap.remove(5);
+        bitmap.remove(6);
+        QCOMPARE(bitmap.toList(), QList<int>() << 70000);
+
+        bitmap.setValue(70000, false);
+        QVERIFY(bitmap.isEmpty());
+    }
+
+    void testDenseContainer()
+    {
+        // more than 4096 values in the same chunk are stored as a bitset
+        ContactBitmap bitmap;
+        for(int i = 0; i < 10000; i += 2) {
+            bitmap.insert(i);
+        }
+        QCOMPARE(bitmap.count(), 5000);
+        QVERIFY(bitmap.contains(9998));
+        QVERIFY(!bitmap.contains(9999));
+
+        // and go back to a sorted array
+        for(int i = 0; i < 6000; i += 2) {
+            bitmap.remove(i);
+        }
+        QCOMPARE(bitmap.count(), 2000);
+        QCOMPARE(bitmap.toList().first(), 6000);
+        QCOMPARE(bitmap.toList().last(), 9998);
+    }
+
+    void testOperations()
+    {
+        ContactBitmap a = fromList(QList<int>() << 1 << 2 << 3 << 100000);
+        ContactBitmap b = fromList(QList<int>() << 2 << 3 << 4 << 200000);
+
+        QCOMPARE((a & b).toList(), QList<int>() << 2 << 3);
+        QCOMPARE((a | b).toList(), QList<int>() << 1 << 2 << 3 << 4 << 100000 << 200000);
+        QCOMPARE((a - b).toList(), QList<int>() << 1 << 100000);
+
+        a &= b;
+        QCOMPARE(a.toList(), QList<int>() << 2 << 3);
+    }
+
+    void testDenseOperations()
+    {
+        ContactBitmap all = ContactBitmap::range(70000);
+        QCOMPARE(all.count(), 70000);
+        QVERIFY(all.contains(69999));
+        QVERIFY(!all.contains(70000));
+
+        ContactBitmap even;
+        for(int i = 0; i < 70000; i += 2) {
+            even.insert(i);
+        }
+
+        ContactBitmap odd = all - even;
+        QCOMPARE(odd.count(), 35000);
+        QVERIFY(odd.contains(1));
+        QVERIFY(!odd.contains(2));
+        QVERIFY((odd & even).isEmpty());
+        QCOMPARE((odd | even).count(), 70000);
+
+        // dense & sparse
+        ContactBitmap sparse = fromList(QList<int>() << 1 << 2 << 65537);
+        QCOMPARE((odd & sparse).toList(), QList<int>() << 1 << 65537);
+        QCOMPARE((sparse - odd).toList(), QList<int>() << 2);
+    }
+};
+
+QTEST_MAIN(ContactBitmapTest)
+
+#include "contact-bitmap-test.moc"
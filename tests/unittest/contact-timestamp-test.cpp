@@ -165,6 +165,54 @@ private Q_SLOTS:
         // test
     }
 
+    void testRemoveMultipleContacts()
+    {
+        QDateTime currentDate = QDateTime::currentDateTime();
+        // wait one sec to cause a create date later
+        QTest::qWait(1000);
+
+        QList<QContact> contacts;
+        for(int i = 0; i < 10; i++) {
+            QContact contact = galera::VCardParser::vcardToContact(QString("BEGIN:VCARD\r\n"
+                                                                           "VERSION:3.0\r\n"
+                                                                           "N:;Fulano %1;;;\r\n"
+                                                                           "EMAIL:fulano_%1@gmail.com\r\n"
+                                                                           "TEL:12345%1\r\n"
+                                                                           "END:VCARD\r\n").arg(i));
+            contacts << contact;
+        }
+
+        QSignalSpy spyContactAdded(m_manager, SIGNAL(contactsAdded(QList<QContactId>)));
+        bool result = m_manager->saveContacts(&contacts);
+        QCOMPARE(result, true);
+        QTRY_VERIFY(spyContactAdded.count() > 0);
+
+        QList<QContactId> contactIds;
+        Q_FOREACH(const QContact &contact, contacts) {
+            contactIds << contact.id();
+        }
+
+        // wait one more sec to remove the contacts
+        QTest::qWait(1000);
+
+        // all contacts are marked as deleted with a single request
+        QSignalSpy spyContactRemoved(m_manager, SIGNAL(contactsRemoved(QList<QContactId>)));
+        result = m_manager->removeContacts(contactIds);
+        QVERIFY(result);
+        QTRY_VERIFY(spyContactRemoved.count() > 0);
+
+        QContactChangeLogFilter changeLogFilter;
+        changeLogFilter.setEventType(QContactChangeLogFilter::EventRemoved);
+        changeLogFilter.setSince(currentDate);
+
+        QList<QContactId> ids = m_manager->contactIds(changeLogFilter);
+        QCOMPARE(ids.toSet(), contactIds.toSet());
+
+        // removed contacts should not appear on the default query
+        ids = m_manager->contactIds(QContactFilter());
+        QCOMPARE(ids.size(), 0);
+    }
+
     void testPhoneNumberFilterWithDeleted()
     {
         QDateTime currentDate = QDateTime::currentDateTime();
@@ -181,6 +181,28 @@ private Q_SLOTS:
         m_map.insert(entry);
     }
 
+    void testSnapshot()
+    {
+        galera::ContactsSnapshot snapshot = m_map.snapshot();
+        QCOMPARE(snapshot.size(), m_map.size());
+
+        FolksIndividual *individual = randomIndividual();
+        QString id = QString::fromUtf8(folks_individual_get_id(individual));
+        galera::ContactEntry *entry = m_map.take(individual);
+        QVERIFY(entry);
+
+        // the snapshot keeps the contacts of the time it was taken
+        QVERIFY(!m_map.snapshot().value(id));
+        const galera::ContactRecord *record = snapshot.value(id);
+        QVERIFY(record);
+        QCOMPARE(record->m_id, id);
+        QCOMPARE(snapshot.size(), m_map.size() + 1);
+
+        //put it back
+        m_map.insert(entry);
+        QVERIFY(m_map.snapshot().value(id));
+    }
+
     void testLookupByVcard()
     {
         FolksIndividual *individual = randomIndividual();
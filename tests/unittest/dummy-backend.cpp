@@ -21,11 +21,21 @@
 #include "scoped-loop.h"
 
 #include "lib/qindividual.h"
+#include "lib/gee-utils.h"
 #include "common/vcard-parser.h"
 
 #include <QtCore/QDir>
 #include <QtCore/QDebug>
 
+// number of personas registered at once while seeding the store
+#define SEED_REGISTER_BATCH     1000
+
+// latency profile names of the persona store write paths, the
+// "change_*" calls can also be profiled by folks property name
+#define PROFILE_ADD_PERSONA     "add-persona"
+#define PROFILE_REMOVE_PERSONA  "remove-persona"
+#define PROFILE_CHANGE_PROPERTY "change-property"
+
 
 DummyBackendProxy::DummyBackendProxy()
     : m_adaptor(0),
@@ -125,6 +135,8 @@ void DummyBackendProxy::reset()
         m_contacts.clear();
     }
 
+    clearLatencyProfiles();
+
     // remove any extra collection/persona store
     GeeHashSet *extraStores = gee_hash_set_new(FOLKS_TYPE_PERSONA_STORE,
                                                  (GBoxedCopyFunc) g_object_ref, g_object_unref,
@@ -191,7 +203,16 @@ QString DummyBackendProxy::createContact(const QtContacts::QContact &qcontact)
 void DummyBackendProxy::contactUpdated(const QString &contactId,
                                        const QString &errorMsg)
 {
+    Q_UNUSED(contactId);
+    if (!errorMsg.isEmpty()) {
+        qWarning() << "Fail to update contact" << errorMsg;
+    }
+
     m_contactUpdated = true;
+    if (m_eventLoop) {
+        m_eventLoop->quit();
+        m_eventLoop = 0;
+    }
 }
 
 QString DummyBackendProxy::updateContact(const QString &contactId,
@@ -201,11 +222,212 @@ QString DummyBackendProxy::updateContact(const QString &contactId,
     Q_ASSERT(i);
     ScopedEventLoop loop(&m_eventLoop);
     m_contactUpdated = false;
-    i->update(qcontact, this, SLOT(contactUpdated(QString,QString)));
-    loop.exec();
+    if (i->update(qcontact, this, SLOT(contactUpdated(QString,QString)))) {
+        loop.exec();
+    }
     return i->id();
 }
 
+int DummyBackendProxy::seedContacts(int count, int seed)
+{
+    Q_ASSERT(m_primaryPersonaStore);
+    FolksDummyPersonaStore *store = FOLKS_DUMMY_PERSONA_STORE(m_primaryPersonaStore);
+
+    // keep the store frozen so the aggregator receives a single
+    // personas-changed notification for the whole seed
+    qsrand(seed);
+    folks_dummy_persona_store_freeze_personas_changed(store);
+    for(int i = 0; i < count; i += SEED_REGISTER_BATCH) {
+        GeeSet *personas = SET_PERSONA_NEW();
+        for(int p = i; p < qMin(count, i + SEED_REGISTER_BATCH); p++) {
+            QString contactId = QString("seed-%1-%2").arg(seed).arg(p);
+            FolksPersona *persona = syntheticPersona(m_primaryPersonaStore, contactId);
+            gee_collection_add(GEE_COLLECTION(personas), persona);
+            g_object_unref(persona);
+        }
+        folks_dummy_persona_store_register_personas(store, personas);
+        g_object_unref(personas);
+    }
+    folks_dummy_persona_store_thaw_personas_changed(store);
+    return count;
+}
+
+FolksPersona *DummyBackendProxy::syntheticPersona(FolksPersonaStore *store,
+                                                  const QString &contactId)
+{
+    static const char *firstNames[] = {"Maria", "Jose", "Ana", "Joao", "Antonio", "Francisca",
+                                       "Carlos", "Paulo", "Adriana", "Juliana", "Marcos", "Luiz"};
+    static const char *lastNames[] = {"Silva", "Santos", "Oliveira", "Souza", "Rodrigues",
+                                      "Ferreira", "Alves", "Pereira", "Lima", "Gomes"};
+    static const char *phoneTypes[] = {"cell", "home", "work"};
+    static const int firstNamesSize = sizeof(firstNames) / sizeof(firstNames[0]);
+    static const int lastNamesSize = sizeof(lastNames) / sizeof(lastNames[0]);
+
+    FolksDummyFullPersona *persona = folks_dummy_full_persona_new(FOLKS_DUMMY_PERSONA_STORE(store),
+                                                                  contactId.toUtf8().constData(),
+                                                                  FALSE, NULL, 0);
+    QByteArray firstName = firstNames[qrand() % firstNamesSize];
+    QByteArray lastName = lastNames[qrand() % lastNamesSize];
+
+    FolksStructuredName *sn = folks_structured_name_new(lastName.constData(),
+                                                        firstName.constData(),
+                                                        NULL, NULL, NULL);
+    folks_dummy_full_persona_update_structured_name(persona, sn);
+    folks_dummy_full_persona_update_full_name(persona, QByteArray(firstName + " " + lastName).constData());
+    g_object_unref(sn);
+
+    // most contacts have one phone number, a few have none or several
+    int roll = qrand() % 100;
+    int phones = roll < 10 ? 0 : (roll < 70 ? 1 : (roll < 95 ? 2 : 3));
+    if (phones > 0) {
+        GeeSet *phoneSet = SET_AFD_NEW();
+        for(int i = 0; i < phones; i++) {
+            QByteArray number = QString("+55%1").arg(qrand() % 100000000, 9, 10, QChar('0')).toUtf8();
+            FolksPhoneFieldDetails *field = folks_phone_field_details_new(number.constData(), NULL);
+            folks_abstract_field_details_add_parameter(FOLKS_ABSTRACT_FIELD_DETAILS(field),
+                                                       "type", phoneTypes[i]);
+            gee_collection_add(GEE_COLLECTION(phoneSet), field);
+            g_object_unref(field);
+        }
+        folks_dummy_full_persona_update_phone_numbers(persona, phoneSet);
+        g_object_unref(phoneSet);
+    }
+
+    // about half of the contacts have an e-mail address
+    roll = qrand() % 100;
+    int emails = roll < 50 ? 0 : (roll < 90 ? 1 : 2);
+    if (emails > 0) {
+        GeeSet *emailSet = SET_AFD_NEW();
+        for(int i = 0; i < emails; i++) {
+            QByteArray email = QString("%1.%2%3@example.com")
+                    .arg(QString(firstName).toLower())
+                    .arg(QString(lastName).toLower())
+                    .arg(qrand() % 10000).toUtf8();
+            FolksEmailFieldDetails *field = folks_email_field_details_new(email.constData(), NULL);
+            gee_collection_add(GEE_COLLECTION(emailSet), field);
+            g_object_unref(field);
+        }
+        folks_dummy_full_persona_update_email_addresses(persona, emailSet);
+        g_object_unref(emailSet);
+    }
+
+    if ((qrand() % 100) < 20) {
+        QByteArray nickname = QByteArray(firstName).left(3).toLower();
+        folks_dummy_full_persona_update_nickname(persona, nickname.constData());
+    }
+
+    if ((qrand() % 100) < 5) {
+        folks_dummy_full_persona_update_is_favourite(persona, TRUE);
+    }
+
+    return FOLKS_PERSONA(persona);
+}
+
+void DummyBackendProxy::setLatencyProfile(const QString &operation,
+                                          int latency,
+                                          int jitter,
+                                          int failureRate)
+{
+    LatencyProfile profile;
+    profile.latency = qMax(0, latency);
+    profile.jitter = qMax(0, jitter);
+    profile.failureRate = qBound(0, failureRate, 100);
+
+    m_latencyProfiles.insert(operation, profile);
+    installMocks(true);
+}
+
+void DummyBackendProxy::clearLatencyProfiles()
+{
+    m_latencyProfiles.clear();
+    installMocks(false);
+}
+
+void DummyBackendProxy::installMocks(bool install)
+{
+    if (!m_primaryPersonaStore) {
+        return;
+    }
+
+    FolksDummyPersonaStore *store = FOLKS_DUMMY_PERSONA_STORE(m_primaryPersonaStore);
+    folks_dummy_persona_store_set_add_persona_from_details_mock(store,
+        install ? (FolksDummyPersonaStoreAddPersonaFromDetailsMock) DummyBackendProxy::addPersonaMock : NULL,
+        install ? this : NULL);
+    folks_dummy_persona_store_set_remove_persona_mock(store,
+        install ? (FolksDummyPersonaStoreRemovePersonaMock) DummyBackendProxy::removePersonaMock : NULL,
+        install ? this : NULL);
+    folks_dummy_persona_store_set_change_property_mock(store,
+        install ? (FolksDummyPersonaStoreChangePropertyMock) DummyBackendProxy::changePropertyMock : NULL,
+        install ? this : NULL);
+}
+
+int DummyBackendProxy::mockDelay(const QString &operation, bool *fail) const
+{
+    *fail = false;
+    QHash<QString, LatencyProfile>::const_iterator it = m_latencyProfiles.find(operation);
+    if (it == m_latencyProfiles.end()) {
+        // operations without a profile keep the store default behaviour
+        return -1;
+    }
+
+    const LatencyProfile &profile = it.value();
+    *fail = (profile.failureRate > 0) && ((qrand() % 100) < profile.failureRate);
+    int delay = profile.latency;
+    if (profile.jitter > 0) {
+        delay += qrand() % (profile.jitter + 1);
+    }
+    return delay;
+}
+
+gint DummyBackendProxy::addPersonaMock(FolksDummyPersona *persona,
+                                       DummyBackendProxy *self,
+                                       GError **error)
+{
+    Q_UNUSED(persona);
+    bool fail;
+    int delay = self->mockDelay(PROFILE_ADD_PERSONA, &fail);
+    if (fail) {
+        g_set_error(error, FOLKS_PERSONA_STORE_ERROR, FOLKS_PERSONA_STORE_ERROR_CREATE_FAILED,
+                    "Injected failure");
+    }
+    return delay;
+}
+
+gint DummyBackendProxy::removePersonaMock(FolksDummyPersona *persona,
+                                          DummyBackendProxy *self,
+                                          GError **error)
+{
+    Q_UNUSED(persona);
+    bool fail;
+    int delay = self->mockDelay(PROFILE_REMOVE_PERSONA, &fail);
+    if (fail) {
+        g_set_error(error, FOLKS_PERSONA_STORE_ERROR, FOLKS_PERSONA_STORE_ERROR_REMOVE_FAILED,
+                    "Injected failure");
+    }
+    return delay;
+}
+
+gint DummyBackendProxy::changePropertyMock(FolksDummyPersona *persona,
+                                           const gchar *propertyName,
+                                           DummyBackendProxy *self,
+                                           GError **error)
+{
+    Q_UNUSED(persona);
+    QString operation = QString::fromUtf8(propertyName);
+    if (!self->m_latencyProfiles.contains(operation)) {
+        operation = PROFILE_CHANGE_PROPERTY;
+    }
+
+    bool fail;
+    int delay = self->mockDelay(operation, &fail);
+    if (fail) {
+        g_set_error(error, FOLKS_PROPERTY_ERROR, FOLKS_PROPERTY_ERROR_UNKNOWN_ERROR,
+                    "Injected failure changing %s", propertyName);
+    }
+    // keep the persona default (idle) delay for unprofiled properties
+    return (delay < 0) ? 0 : delay;
+}
+
 void DummyBackendProxy::checkError(GError *error)
 {
     if (error) {
@@ -420,6 +642,21 @@ QString DummyBackendAdaptor::updateContact(const QString &contactId, const QStri
     return m_proxy->updateContact(contactId, contact);
 }
 
+int DummyBackendAdaptor::seedContacts(int count, int seed)
+{
+    return m_proxy->seedContacts(count, seed);
+}
+
+void DummyBackendAdaptor::setLatencyProfile(const QString &operation, int latency, int jitter, int failureRate)
+{
+    m_proxy->setLatencyProfile(operation, latency, jitter, failureRate);
+}
+
+void DummyBackendAdaptor::clearLatencyProfiles()
+{
+    m_proxy->clearLatencyProfiles();
+}
+
 void DummyBackendAdaptor::enableAutoLink(bool flag)
 {
     galera::QIndividual::enableAutoLink(flag);
@@ -35,6 +35,14 @@
 
 class DummyBackendAdaptor;
 
+// simulated backing store behaviour for one write path
+struct LatencyProfile
+{
+    int latency;        // base delay in milliseconds
+    int jitter;         // random extra delay in milliseconds
+    int failureRate;    // percentage of calls that fail
+};
+
 class DummyBackendProxy: public QObject
 {
     Q_OBJECT
@@ -47,6 +55,9 @@ public:
 
     QString createContact(const QtContacts::QContact &qcontact);
     QString updateContact(const QString &contactId, const QtContacts::QContact &qcontact);
+    int seedContacts(int count, int seed);
+    void setLatencyProfile(const QString &operation, int latency, int jitter, int failureRate);
+    void clearLatencyProfiles();
     QList<QtContacts::QContact> contacts() const;
     QList<galera::QIndividual*> individuals() const;
 
@@ -75,6 +86,7 @@ private:
     QHash<QString, galera::QIndividual*> m_contacts;
     bool m_contactUpdated;
     bool m_useDBus;
+    QHash<QString, LatencyProfile> m_latencyProfiles;
 
     bool registerObject();
     void initFolks();
@@ -82,6 +94,19 @@ private:
     void prepareAggregator();
     void mkpath(const QString &path) const;
     static void checkError(GError *error);
+    static FolksPersona *syntheticPersona(FolksPersonaStore *store, const QString &contactId);
+    void installMocks(bool install);
+    int mockDelay(const QString &operation, bool *fail) const;
+    static gint addPersonaMock(FolksDummyPersona *persona,
+                               DummyBackendProxy *self,
+                               GError **error);
+    static gint removePersonaMock(FolksDummyPersona *persona,
+                                  DummyBackendProxy *self,
+                                  GError **error);
+    static gint changePropertyMock(FolksDummyPersona *persona,
+                                   const gchar *propertyName,
+                                   DummyBackendProxy *self,
+                                   GError **error);
     static void individualAggregatorPrepared(FolksIndividualAggregator *fia,
                                              GAsyncResult *res,
                                              DummyBackendProxy *self);
@@ -117,6 +142,18 @@ class DummyBackendAdaptor: public QDBusAbstractAdaptor
 "      <arg direction=\"in\" type=\"s\"/>\n"
 "      <arg direction=\"out\" type=\"s\"/>\n"
 "    </method>\n"
+"    <method name=\"seedContacts\">\n"
+"      <arg direction=\"in\" type=\"i\"/>\n"
+"      <arg direction=\"in\" type=\"i\"/>\n"
+"      <arg direction=\"out\" type=\"i\"/>\n"
+"    </method>\n"
+"    <method name=\"setLatencyProfile\">\n"
+"      <arg direction=\"in\" type=\"s\"/>\n"
+"      <arg direction=\"in\" type=\"i\"/>\n"
+"      <arg direction=\"in\" type=\"i\"/>\n"
+"      <arg direction=\"in\" type=\"i\"/>\n"
+"    </method>\n"
+"    <method name=\"clearLatencyProfiles\"/>\n"
 "    <method name=\"listContacts\">\n"
 "      <arg direction=\"out\" type=\"as\"/>\n"
 "    </method>\n"
@@ -136,6 +173,9 @@ public Q_SLOTS:
     QStringList listContacts();
     QString createContact(const QString &vcard);
     QString updateContact(const QString &contactId, const QString &vcard);
+    int seedContacts(int count, int seed);
+    void setLatencyProfile(const QString &operation, int latency, int jitter, int failureRate);
+    void clearLatencyProfiles();
     void enableAutoLink(bool flag);
 
 Q_SIGNALS:
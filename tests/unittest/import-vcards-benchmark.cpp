@@ -0,0 +1,104 @@
+/*
+ * Copyright 2013 Canonical Ltd.
+ *
+ * This file is part of contact-service-app.
+ *
+ * contact-service-app is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * contact-service-app is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "base-client-test.h"
+#include "common/dbus-service-defs.h"
+
+#include <QObject>
+#include <QtDBus>
+#include <QtTest>
+#include <QDebug>
+
+#define DEFAULT_IMPORT_CARDS    50000
+
+/*
+ * Measure the throughput of a vcard import, the number of vcards can be changed
+ * with IMPORT_BENCHMARK_CARDS, the server peak memory is printed at the end.
+ */
+class ImportVCardsBenchmark : public BaseClientTest
+{
+    Q_OBJECT
+
+private:
+    int m_cards;
+
+    qint64 serverPeakMemory()
+    {
+        QDBusReply<uint> pid = QDBusConnection::sessionBus().interface()->servicePid(m_serverIface->service());
+        QFile status(QString("/proc/%1/status").arg(pid.value()));
+        if (status.open(QFile::ReadOnly)) {
+            Q_FOREACH(const QByteArray &line, status.readAll().split('\n')) {
+                if (line.startsWith("VmHWM:")) {
+                    return line.mid(6).trimmed().split(' ').first().toLongLong();
+                }
+            }
+        }
+        return -1;
+    }
+
+private Q_SLOTS:
+    void initTestCase()
+    {
+        BaseClientTest::initTestCase();
+        m_cards = DEFAULT_IMPORT_CARDS;
+        if (qEnvironmentVariableIsSet("IMPORT_BENCHMARK_CARDS")) {
+            m_cards = qMax(1, qgetenv("IMPORT_BENCHMARK_CARDS").toInt());
+        }
+    }
+
+    void benchmarkImport()
+    {
+        QTemporaryFile file;
+        QVERIFY(file.open());
+        for(int i = 0; i < m_cards; i++) {
+            file.write(QString("BEGIN:VCARD\r\n"
+                               "VERSION:3.0\r\n"
+                               "N:Tal;Fulano_%1;de;;\r\n"
+                               "EMAIL:fulano_%1@ubuntu.com\r\n"
+                               "TEL;TYPE=CELL:8888%1\r\n"
+                               "END:VCARD\r\n").arg(i).toUtf8());
+        }
+        file.flush();
+        QVERIFY(file.seek(0));
+
+        QSignalSpy finishedSpy(m_serverIface, SIGNAL(importFinished(QString,int,int)));
+        QElapsedTimer timer;
+        timer.start();
+
+        QBENCHMARK_ONCE {
+            QDBusReply<QString> reply = m_serverIface->call("importVCards",
+                                                            QVariant::fromValue(QDBusUnixFileDescriptor(file.handle())),
+                                                            "dummy-store");
+            QVERIFY(!reply.value().isEmpty());
+            QTRY_COMPARE_WITH_TIMEOUT(finishedSpy.count(), 1, 600000);
+        }
+
+        qint64 elapsed = qMax(qint64(1), timer.elapsed());
+        QList<QVariant> args = finishedSpy.takeFirst();
+        QCOMPARE(args[1].toInt(), m_cards);
+        QCOMPARE(args[2].toInt(), 0);
+
+        qDebug() << "Imported" << m_cards << "vcards in" << elapsed << "ms,"
+                 << (m_cards * 1000 / elapsed) << "vcards/s, server peak memory"
+                 << serverPeakMemory() << "kB";
+    }
+};
+
+QTEST_MAIN(ImportVCardsBenchmark)
+
+#include "import-vcards-benchmark.moc"
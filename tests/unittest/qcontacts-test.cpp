@@ -168,6 +168,54 @@ private Q_SLOTS:
         QCOMPARE(updatedName.lastName(), name.lastName());
     }
 
+    /*
+     * Test query only the contact ids
+     */
+    void testContactIds()
+    {
+        QContact contact = testContact();
+        QSignalSpy spyContactAdded(m_manager, SIGNAL(contactsAdded(QList<QContactId>)));
+        bool result = m_manager->saveContact(&contact);
+        QCOMPARE(result, true);
+        QTRY_COMPARE(spyContactAdded.count(), 1);
+
+        QList<QContactId> ids = m_manager->contactIds(QContactFilter());
+        QCOMPARE(ids.size(), 1);
+        QCOMPARE(ids[0], contact.id());
+    }
+
+    /*
+     * Test query contacts with collection filters
+     */
+    void testQueryCollections()
+    {
+        QContact contact = testContact();
+        QSignalSpy spyContactAdded(m_manager, SIGNAL(contactsAdded(QList<QContactId>)));
+        bool result = m_manager->saveContact(&contact);
+        QCOMPARE(result, true);
+        QTRY_COMPARE(spyContactAdded.count(), 1);
+
+        QContactCollectionFilter dummyStore;
+        dummyStore.setCollectionId(QContactCollectionId(m_manager->managerUri(), "dummy-store"));
+        QContactCollectionFilter otherStore;
+        otherStore.setCollectionId(QContactCollectionId(m_manager->managerUri(), "other-store"));
+
+        QList<QContactId> ids = m_manager->contactIds(dummyStore);
+        QCOMPARE(ids.size(), 1);
+        QCOMPARE(ids[0], contact.id());
+
+        // the same collection twice still matches
+        QContactIntersectionFilter sameStore;
+        sameStore << dummyStore << dummyStore;
+        QCOMPARE(m_manager->contactIds(sameStore).size(), 1);
+
+        // a contact can not be in two collections
+        QContactIntersectionFilter bothStores;
+        bothStores << dummyStore << otherStore;
+        QCOMPARE(m_manager->contactIds(bothStores).size(), 0);
+        QCOMPARE(m_manager->contacts(bothStores).size(), 0);
+    }
+
     /*
      * Test query a contact source using the contact group
      */
@@ -0,0 +1,191 @@
+/*
+ * Copyright 2013 Canonical Ltd.
+ *
+ * This file is part of contact-service-app.
+ *
+ * contact-service-app is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * contact-service-app is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lib/query-executor.h"
+#include "common/filter.h"
+
+#include <QObject>
+#include <QtTest>
+#include <QDebug>
+#include <QSemaphore>
+
+#include <QtContacts/QContactDetailFilter>
+#include <QtContacts/QContactIdFilter>
+#include <QtContacts/QContactChangeLogFilter>
+#include <QtContacts/QContactIntersectionFilter>
+#include <QtContacts/QContactGuid>
+#include <QtContacts/QContactName>
+#include <QtContacts/QContactPhoneNumber>
+
+using namespace QtContacts;
+using namespace galera;
+
+// Block a thread of the pool until it is released
+class BlockingJob : public QRunnable
+{
+public:
+    BlockingJob(QSemaphore *started, QSemaphore *release)
+        : m_started(started),
+          m_release(release)
+    {
+    }
+
+    void run()
+    {
+        m_started->release();
+        m_release->acquire();
+    }
+
+private:
+    QSemaphore *m_started;
+    QSemaphore *m_release;
+};
+
+class FlagJob : public QRunnable
+{
+public:
+    FlagJob(QAtomicInt *flag)
+        : m_flag(flag)
+    {
+    }
+
+    void run()
+    {
+        m_flag->storeRelease(1);
+    }
+
+private:
+    QAtomicInt *m_flag;
+};
+
+class QueryExecutorTest : public QObject
+{
+    Q_OBJECT
+
+private:
+    QContactFilter nameFilter()
+    {
+        QContactDetailFilter filter;
+        filter.setDetailType(QContactDetail::TypeName, QContactName::FieldFirstName);
+        filter.setValue("Fulano");
+        filter.setMatchFlags(QContactFilter::MatchContains);
+        return filter;
+    }
+
+private Q_SLOTS:
+    void testClassifyIds()
+    {
+        QContactDetailFilter guidFilter;
+        guidFilter.setDetailType(QContactDetail::TypeGuid, QContactGuid::FieldGuid);
+        guidFilter.setValue("contact-id");
+        guidFilter.setMatchFlags(QContactFilter::MatchExactly);
+        QCOMPARE(QueryExecutor::classify(Filter(guidFilter), -1), QueryExecutor::Interactive);
+
+        QContactIdFilter idFilter;
+        idFilter.setIds(QList<QContactId>() << QContactId::fromString("qtcontacts:memory::1"));
+        QCOMPARE(QueryExecutor::classify(Filter(idFilter), -1), QueryExecutor::Interactive);
+    }
+
+    void testClassifyPhone()
+    {
+        QContactDetailFilter filter;
+        filter.setDetailType(QContactDetail::TypePhoneNumber, QContactPhoneNumber::FieldNumber);
+        filter.setValue("33331410");
+        filter.setMatchFlags(QContactFilter::MatchPhoneNumber);
+        QCOMPARE(QueryExecutor::classify(Filter(filter), -1), QueryExecutor::Interactive);
+    }
+
+    void testClassifyMaxCount()
+    {
+        // a small page of a full listing is interactive
+        QCOMPARE(QueryExecutor::classify(Filter(QContactFilter()), 50), QueryExecutor::Interactive);
+        QCOMPARE(QueryExecutor::classify(Filter(QContactFilter()), 51), QueryExecutor::Bulk);
+        QCOMPARE(QueryExecutor::classify(Filter(QContactFilter()), 0), QueryExecutor::Bulk);
+    }
+
+    void testClassifyEmptyFilter()
+    {
+        QCOMPARE(QueryExecutor::classify(Filter(QContactFilter()), -1), QueryExecutor::Bulk);
+    }
+
+    void testClassifyChangedSince()
+    {
+        QContactChangeLogFilter changed(QContactChangeLogFilter::EventChanged);
+        changed.setSince(QDateTime::currentDateTime().addDays(-1));
+        QCOMPARE(QueryExecutor::classify(Filter(changed), -1), QueryExecutor::Bulk);
+
+        QContactChangeLogFilter removed(QContactChangeLogFilter::EventRemoved);
+        removed.setSince(QDateTime::currentDateTime().addDays(-1));
+        QCOMPARE(QueryExecutor::classify(Filter(removed), -1), QueryExecutor::Bulk);
+
+        // the sync scan is bulk even with other terms
+        QContactIntersectionFilter filter;
+        filter << nameFilter() << changed;
+        QCOMPARE(QueryExecutor::classify(Filter(filter), -1), QueryExecutor::Bulk);
+    }
+
+    void testClassifyOtherFilter()
+    {
+        QCOMPARE(QueryExecutor::classify(Filter(nameFilter()), -1), QueryExecutor::Interactive);
+    }
+
+    void testPriorityNames()
+    {
+        bool ok = false;
+        QCOMPARE(QueryExecutor::fromString("interactive", &ok), QueryExecutor::Interactive);
+        QVERIFY(ok);
+        QCOMPARE(QueryExecutor::fromString("bulk", &ok), QueryExecutor::Bulk);
+        QVERIFY(ok);
+        QCOMPARE(QueryExecutor::fromString("auto", &ok), QueryExecutor::Auto);
+        QVERIFY(ok);
+        QCOMPARE(QueryExecutor::fromString("unknown", &ok), QueryExecutor::Auto);
+        QVERIFY(!ok);
+        QCOMPARE(QueryExecutor::toString(QueryExecutor::Bulk), QStringLiteral("bulk"));
+    }
+
+    void testInteractiveDoesNotWaitForBulk()
+    {
+        QueryExecutor *executor = QueryExecutor::instance();
+        int bulkThreads = executor->toJson().value("bulk").toObject().value("maxThreads").toInt();
+        QVERIFY(bulkThreads > 0);
+
+        // fill every bulk thread and queue one more bulk job behind them
+        QSemaphore started;
+        QSemaphore release;
+        for(int i = 0; i <= bulkThreads; i++) {
+            executor->start(new BlockingJob(&started, &release), QueryExecutor::Bulk);
+        }
+        QVERIFY(started.tryAcquire(bulkThreads, 5000));
+
+        QAtomicInt bulkDone;
+        executor->start(new FlagJob(&bulkDone), QueryExecutor::Bulk);
+        QAtomicInt interactiveDone;
+        executor->start(new FlagJob(&interactiveDone), QueryExecutor::Interactive);
+
+        QTRY_VERIFY(interactiveDone.loadAcquire());
+        QVERIFY(!bulkDone.loadAcquire());
+
+        release.release(bulkThreads + 1);
+        QTRY_VERIFY(bulkDone.loadAcquire());
+        QVERIFY(started.tryAcquire(1, 5000));
+    }
+};
+
+QTEST_MAIN(QueryExecutorTest)
+
+#include "query-executor-test.moc"
@@ -0,0 +1,161 @@
+/*
+ * Copyright 2013 Canonical Ltd.
+ *
+ * This file is part of contact-service-app.
+ *
+ * contact-service-app is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * contact-service-app is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include "dummy-backend.h"
+
+#include "lib/qindividual.h"
+
+#include <QObject>
+#include <QtTest>
+#include <QDebug>
+
+#include <QtContacts>
+
+using namespace QtContacts;
+
+/*
+ * Measure the latency of a contact update on the dummy backend, the number of
+ * detail groups changed in each update is the benchmark data.
+ */
+class UpdateContactBenchmark : public QObject
+{
+    Q_OBJECT
+
+private:
+    DummyBackendProxy *m_dummy;
+    QString m_contactId;
+    int m_round;
+
+    QContact currentContact() const
+    {
+        Q_FOREACH(galera::QIndividual *i, m_dummy->individuals()) {
+            if (i->id() == m_contactId) {
+                return i->contact();
+            }
+        }
+        return QContact();
+    }
+
+    QContact changeContact(QContact contact, int detailGroups)
+    {
+        QString suffix = QString::number(m_round++);
+
+        QContactPhoneNumber phone = contact.detail<QContactPhoneNumber>();
+        phone.setNumber(QString("33331410%1").arg(suffix));
+        contact.saveDetail(&phone);
+
+        if (detailGroups > 1) {
+            QContactEmailAddress email = contact.detail<QContactEmailAddress>();
+            email.setEmailAddress(QString("fulano_%1@ubuntu.com").arg(suffix));
+            contact.saveDetail(&email);
+        }
+
+        if (detailGroups > 2) {
+            QContactNote note = contact.detail<QContactNote>();
+            note.setNote(QString("note %1").arg(suffix));
+            contact.saveDetail(&note);
+        }
+
+        if (detailGroups > 3) {
+            QContactUrl url = contact.detail<QContactUrl>();
+            url.setUrl(QString("http://www.ubuntu.com/%1").arg(suffix));
+            contact.saveDetail(&url);
+        }
+
+        if (detailGroups > 4) {
+            QContactOrganization org = contact.detail<QContactOrganization>();
+            org.setName(QString("Canonical %1").arg(suffix));
+            contact.saveDetail(&org);
+        }
+
+        return contact;
+    }
+
+private Q_SLOTS:
+    void initTestCase()
+    {
+        m_round = 0;
+        m_dummy = new DummyBackendProxy();
+        m_dummy->start();
+        QTRY_VERIFY(m_dummy->isReady());
+
+        QContact contact;
+        QContactName name;
+        name.setFirstName("Fulano");
+        name.setLastName("Tal");
+        contact.saveDetail(&name);
+
+        QContactPhoneNumber phone;
+        phone.setNumber("33331410");
+        contact.saveDetail(&phone);
+
+        QContactEmailAddress email;
+        email.setEmailAddress("fulano@ubuntu.com");
+        contact.saveDetail(&email);
+
+        QContactNote note;
+        note.setNote("note");
+        contact.saveDetail(&note);
+
+        QContactUrl url;
+        url.setUrl("http://www.ubuntu.com");
+        contact.saveDetail(&url);
+
+        QContactOrganization org;
+        org.setName("Canonical");
+        contact.saveDetail(&org);
+
+        m_dummy->createContact(contact);
+        QTRY_COMPARE(m_dummy->individuals().size(), 1);
+        m_contactId = m_dummy->individuals().first()->id();
+    }
+
+    void cleanupTestCase()
+    {
+        m_dummy->shutdown();
+        delete m_dummy;
+    }
+
+    void benchmarkUpdate_data()
+    {
+        QTest::addColumn<int>("detailGroups");
+
+        QTest::newRow("one detail group") << 1;
+        QTest::newRow("three detail groups") << 3;
+        QTest::newRow("five detail groups") << 5;
+    }
+
+    void benchmarkUpdate()
+    {
+        QFETCH(int, detailGroups);
+
+        QBENCHMARK {
+            QContact contact = changeContact(currentContact(), detailGroups);
+            m_dummy->updateContact(m_contactId, contact);
+        }
+
+        QContact updated = currentContact();
+        QCOMPARE(updated.detail<QContactPhoneNumber>().number(),
+                 QString("33331410%1").arg(m_round - 1));
+    }
+};
+
+QTEST_MAIN(UpdateContactBenchmark)
+
+#include "update-contact-benchmark.moc"
@@ -415,6 +415,27 @@ private Q_SLOTS:
         QCOMPARE(xDetails.size(), 2);
     }
 
+    void testTakeVCardsFromStream()
+    {
+        QByteArray data = m_vcards.join("").toUtf8();
+
+        // feed the data in small chunks, a vcard is complete only when the next one begins
+        QByteArray buffer;
+        QStringList vcards;
+        for(int i = 0; i < data.size(); i += 7) {
+            buffer.append(data.mid(i, 7));
+            vcards += VCardParser::takeVcards(buffer, false);
+        }
+        QCOMPARE(vcards.size(), 1);
+        QCOMPARE(vcards[0], m_vcards[0]);
+
+        // the last vcard is returned at the end of the stream
+        vcards += VCardParser::takeVcards(buffer, true);
+        QCOMPARE(vcards, m_vcards);
+        QVERIFY(buffer.isEmpty());
+        QCOMPARE(vcards, VCardParser::splitVcards(data));
+    }
+
      void testContactIdToUid()
      {
          // Create manager to allow us to creact contact id